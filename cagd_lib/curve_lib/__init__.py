@@ -0,0 +1,6 @@
+from ._curve_lib import CurveKinds, CurveScene, load_dat, parse_dat, save_dat, load_scene, save_scene, Mesh, \
+    load_itd, parse_itd, dat_to_scene, scene_to_dat, SCENE_SUFFIX, evaluate_scene, evaluate_curve, \
+    evaluate_derivatives, flatten_scene, intersect_curves, intersect_scene, ArcLengthTable, ARCLEN_NODES, \
+    set_threads, PickIndex, closest_point, closest_curve, offset_samples, evolute_samples, \
+    rotation_minimizing_frames, JobQueue, JobCancelled, job_cancelled, \
+    VertexStream, STREAM_STRIDE
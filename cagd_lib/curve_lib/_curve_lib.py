@@ -0,0 +1,1079 @@
+import ctypes
+import itertools
+import pathlib
+import threading
+from enum import IntEnum
+from typing import Any, Callable, NamedTuple
+
+import numpy as np
+
+__all__ = [
+    "CurveKinds", "CurveScene", "load_dat", "parse_dat", "save_dat", "load_scene", "save_scene", "Mesh", "load_itd",
+    "parse_itd", "dat_to_scene", "scene_to_dat", "SCENE_SUFFIX", "evaluate_scene", "evaluate_curve",
+    "evaluate_derivatives", "flatten_scene", "intersect_curves", "intersect_scene", "ArcLengthTable", "ARCLEN_NODES",
+    "set_threads", "offset_samples", "evolute_samples", "rotation_minimizing_frames", "PickIndex", "closest_point",
+    "closest_curve", "JobQueue", "JobCancelled", "job_cancelled", "VertexStream", "STREAM_STRIDE",
+]
+
+SCENE_SUFFIX = ".crvs"
+
+
+class CurveKinds(IntEnum):
+    BEZIER = 0
+    BSPLINE = 1
+
+
+class IOErrors(IntEnum):
+    OPEN = 1
+    ALLOC = 2
+    ORDER_EXPECT = 3
+    KNOTS = 4
+    POINT = 5
+    NUMBER = 6
+    EOF = 7
+    FORMAT = 8
+    VERSION = 9
+    WRITE = 10
+    ITD = 11
+
+
+IO_ERROR_MESSAGES = {
+    IOErrors.OPEN: "could not open file",
+    IOErrors.ALLOC: "out of memory",
+    IOErrors.ORDER_EXPECT: "expected curve order",
+    IOErrors.KNOTS: "bad knot vector",
+    IOErrors.POINT: "control point must have 2 or 3 coordinates",
+    IOErrors.NUMBER: "bad number",
+    IOErrors.EOF: "unexpected end of file",
+    IOErrors.FORMAT: "not a curve scene file",
+    IOErrors.VERSION: "curve scene file is of a newer version",
+    IOErrors.WRITE: "could not write file",
+    IOErrors.ITD: "expected an [OBJECT, a polygon or a vertex",
+}
+
+
+class _CrvScene(ctypes.Structure):
+    _fields_ = [
+        ("n_curves", ctypes.c_int),
+        ("n_knots", ctypes.c_int),
+        ("n_points", ctypes.c_int),
+        ("kind", ctypes.POINTER(ctypes.c_int)),
+        ("order", ctypes.POINTER(ctypes.c_int)),
+        ("knots_offset", ctypes.POINTER(ctypes.c_int)),
+        ("points_offset", ctypes.POINTER(ctypes.c_int)),
+        ("knots", ctypes.POINTER(ctypes.c_double)),
+        ("wx", ctypes.POINTER(ctypes.c_double)),
+        ("wy", ctypes.POINTER(ctypes.c_double)),
+        ("w", ctypes.POINTER(ctypes.c_double)),
+        ("curves_capacity", ctypes.c_int),
+        ("knots_capacity", ctypes.c_int),
+        ("points_capacity", ctypes.c_int),
+        ("mapping", ctypes.c_void_p),
+        ("mapping_len", ctypes.c_size_t),
+    ]
+
+
+class _CrvPolyline(ctypes.Structure):
+    _fields_ = [
+        ("n_curves", ctypes.c_int),
+        ("n_vertices", ctypes.c_int),
+        ("vertices_offset", ctypes.POINTER(ctypes.c_int)),
+        ("x", ctypes.POINTER(ctypes.c_float)),
+        ("y", ctypes.POINTER(ctypes.c_float)),
+        ("t", ctypes.POINTER(ctypes.c_double)),
+    ]
+
+
+class _CrvIntersections(ctypes.Structure):
+    _fields_ = [
+        ("n_intersections", ctypes.c_int),
+        ("curve1", ctypes.POINTER(ctypes.c_int)),
+        ("curve2", ctypes.POINTER(ctypes.c_int)),
+        ("t1", ctypes.POINTER(ctypes.c_double)),
+        ("t2", ctypes.POINTER(ctypes.c_double)),
+        ("x", ctypes.POINTER(ctypes.c_double)),
+        ("y", ctypes.POINTER(ctypes.c_double)),
+    ]
+
+
+class _CrvArclen(ctypes.Structure):
+    _fields_ = [
+        ("n_intervals", ctypes.c_int),
+        ("t", ctypes.POINTER(ctypes.c_double)),
+        ("s", ctypes.POINTER(ctypes.c_double)),
+        ("coef", ctypes.POINTER(ctypes.c_double)),
+    ]
+
+
+class _CrvStream(ctypes.Structure):
+    _fields_ = [
+        ("n_vertices", ctypes.c_int),
+        ("n_indices", ctypes.c_int),
+        ("vertices", ctypes.POINTER(ctypes.c_float)),
+        ("indices", ctypes.POINTER(ctypes.c_uint)),
+        ("vertices_capacity", ctypes.c_int),
+        ("indices_capacity", ctypes.c_int),
+    ]
+
+
+class _CrvMesh(ctypes.Structure):
+    _fields_ = [
+        ("n_vertices", ctypes.c_int),
+        ("n_faces", ctypes.c_int),
+        ("n_indices", ctypes.c_int),
+        ("n_triangles", ctypes.c_int),
+        ("vertices", ctypes.POINTER(ctypes.c_float)),
+        ("normals", ctypes.POINTER(ctypes.c_float)),
+        ("faces_offset", ctypes.POINTER(ctypes.c_int)),
+        ("indices", ctypes.POINTER(ctypes.c_int)),
+        ("triangles", ctypes.POINTER(ctypes.c_int)),
+    ]
+
+
+ARCLEN_NODES = 5
+"""speed samples per interval of an arc length table (CRV_ARCLEN_NODES)"""
+
+clib = ctypes.CDLL("./curvelib.so")
+clib.crv_alloc_scene.restype = ctypes.POINTER(_CrvScene)
+
+clib.crv_copy_scene.argtypes = [ctypes.POINTER(_CrvScene)]
+clib.crv_copy_scene.restype = ctypes.POINTER(_CrvScene)
+
+clib.crv_free_scene.argtypes = [ctypes.POINTER(_CrvScene)]
+
+clib.crv_parse_dat.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+clib.crv_parse_dat.restype = ctypes.POINTER(_CrvScene)
+
+clib.crv_load_dat.argtypes = [ctypes.c_char_p]
+clib.crv_load_dat.restype = ctypes.POINTER(_CrvScene)
+
+clib.crv_save_dat.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_char_p]
+clib.crv_save_dat.restype = ctypes.c_int
+
+clib.crv_load_scene.argtypes = [ctypes.c_char_p]
+clib.crv_load_scene.restype = ctypes.POINTER(_CrvScene)
+
+clib.crv_save_scene.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_char_p]
+clib.crv_save_scene.restype = ctypes.c_int
+
+clib.crv_ioerror.restype = ctypes.c_int
+clib.crv_ioerror_line.restype = ctypes.c_int
+
+clib.crv_parse_itd.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+clib.crv_parse_itd.restype = ctypes.POINTER(_CrvMesh)
+
+clib.crv_load_itd.argtypes = [ctypes.c_char_p]
+clib.crv_load_itd.restype = ctypes.POINTER(_CrvMesh)
+
+clib.crv_free_mesh.argtypes = [ctypes.POINTER(_CrvMesh)]
+
+clib.crv_set_threads.argtypes = [ctypes.c_int]
+clib.crv_get_threads.restype = ctypes.c_int
+
+_JOB_FUNCTION = ctypes.CFUNCTYPE(None, ctypes.c_void_p)
+
+clib.crv_alloc_jobs.restype = ctypes.c_void_p
+clib.crv_free_jobs.argtypes = [ctypes.c_void_p]
+
+clib.crv_submit_job.argtypes = [ctypes.c_void_p, ctypes.c_int, _JOB_FUNCTION, ctypes.c_void_p]
+clib.crv_submit_job.restype = ctypes.c_int
+
+clib.crv_cancel_jobs.argtypes = [ctypes.c_void_p, ctypes.c_int]
+clib.crv_wait_jobs.argtypes = [ctypes.c_void_p]
+clib.crv_job_cancelled.restype = ctypes.c_int
+
+clib.crv_scene_samples.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+clib.crv_scene_samples.restype = ctypes.c_int
+
+clib.crv_eval_scene.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.POINTER(ctypes.c_int),
+                                ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_float)]
+
+clib.crv_eval_curve.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_eval_derivs.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                 ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+                                 ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_flatten_scene.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_double]
+clib.crv_flatten_scene.restype = ctypes.POINTER(_CrvPolyline)
+
+clib.crv_free_polyline.argtypes = [ctypes.POINTER(_CrvPolyline)]
+
+clib.crv_intersect_curves.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.c_int, ctypes.c_double]
+clib.crv_intersect_curves.restype = ctypes.POINTER(_CrvIntersections)
+
+clib.crv_intersect_scene.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_double]
+clib.crv_intersect_scene.restype = ctypes.POINTER(_CrvIntersections)
+
+clib.crv_free_intersections.argtypes = [ctypes.POINTER(_CrvIntersections)]
+
+clib.crv_curve_is_valid.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int]
+clib.crv_curve_is_valid.restype = ctypes.c_int
+
+clib.crv_arclen_nodes.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_arclen_from_speeds.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                        ctypes.POINTER(ctypes.c_double)]
+clib.crv_arclen_from_speeds.restype = ctypes.POINTER(_CrvArclen)
+
+clib.crv_curve_arclen.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.c_int]
+clib.crv_curve_arclen.restype = ctypes.POINTER(_CrvArclen)
+
+clib.crv_free_arclen.argtypes = [ctypes.POINTER(_CrvArclen)]
+
+clib.crv_arclen_length.argtypes = [ctypes.POINTER(_CrvArclen)]
+clib.crv_arclen_length.restype = ctypes.c_double
+
+clib.crv_arclen_lengths.argtypes = [ctypes.POINTER(_CrvArclen), ctypes.POINTER(ctypes.c_double), ctypes.c_int,
+                                    ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_arclen_params.argtypes = [ctypes.POINTER(_CrvArclen), ctypes.POINTER(ctypes.c_double), ctypes.c_int,
+                                   ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_offset_samples.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                    ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_ubyte), ctypes.c_int,
+                                    ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_evolute_samples.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                     ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+                                     ctypes.POINTER(ctypes.c_ubyte), ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_rotation_minimizing_frames.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                                                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+                                                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+                                                ctypes.POINTER(ctypes.c_double)]
+
+clib.crv_closest_point.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_int, ctypes.c_double, ctypes.c_double,
+                                   ctypes.c_double, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+                                   ctypes.POINTER(ctypes.c_double)]
+clib.crv_closest_point.restype = ctypes.c_double
+
+clib.crv_closest_curve.argtypes = [ctypes.POINTER(_CrvScene), ctypes.c_double, ctypes.c_double, ctypes.c_double,
+                                   ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+clib.crv_closest_curve.restype = ctypes.c_int
+
+clib.crv_alloc_stream.restype = ctypes.POINTER(_CrvStream)
+clib.crv_free_stream.argtypes = [ctypes.POINTER(_CrvStream)]
+clib.crv_clear_stream.argtypes = [ctypes.POINTER(_CrvStream)]
+
+clib.crv_stream_strip.argtypes = [ctypes.POINTER(_CrvStream), ctypes.c_int, ctypes.c_int,
+                                  ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_float),
+                                  ctypes.POINTER(ctypes.c_float)]
+clib.crv_stream_strip.restype = ctypes.c_int
+
+clib.crv_stream_circle.argtypes = [ctypes.POINTER(_CrvStream), ctypes.POINTER(ctypes.c_double), ctypes.c_double,
+                                   ctypes.POINTER(ctypes.c_double), ctypes.c_int, ctypes.POINTER(ctypes.c_float)]
+clib.crv_stream_circle.restype = ctypes.c_int
+
+clib.crv_alloc_pick_index.restype = ctypes.c_void_p
+clib.crv_free_pick_index.argtypes = [ctypes.c_void_p]
+
+clib.crv_pick_insert_curve.argtypes = [ctypes.c_void_p, ctypes.c_int]
+clib.crv_pick_insert_curve.restype = ctypes.c_int
+
+clib.crv_pick_delete_curve.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+clib.crv_pick_set_curve.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                    ctypes.c_int, ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_float),
+                                    ctypes.c_int, ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_float)]
+clib.crv_pick_set_curve.restype = ctypes.c_int
+
+clib.crv_pick_nearest_curve.argtypes = [ctypes.c_void_p, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+                                        ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_double)]
+clib.crv_pick_nearest_curve.restype = ctypes.c_int
+
+for _pick_nearest in (clib.crv_pick_nearest_point, clib.crv_pick_nearest_sample):
+    _pick_nearest.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+                              ctypes.POINTER(ctypes.c_double)]
+    _pick_nearest.restype = ctypes.c_int
+
+
+def _raise_io_error(source):
+    error = clib.crv_ioerror()
+    line = clib.crv_ioerror_line()
+    message = IO_ERROR_MESSAGES.get(error, f"error {error}")
+    if line:
+        raise ValueError(f"{source}:{line}: {message}")
+    raise ValueError(f"{source}: {message}")
+
+
+class CurveScene:
+    """
+    Curves stored as struct of arrays, owned by the native library.
+
+    Curve i owns ``knots[knots_offset[i]:knots_offset[i + 1]]`` and the control points
+    ``points_offset[i]:points_offset[i + 1]`` of ``wx``, ``wy`` and ``w`` (homogeneous, as in the .dat files).
+    The arrays are views on the native buffers and keep the scene alive.
+    """
+
+    def __init__(self, scene_pointer):
+        if not bool(scene_pointer):
+            raise ValueError(scene_pointer)
+        self._scene_pointer = scene_pointer
+
+    @classmethod
+    def from_arrays(cls, kind, order, knots_offset, points_offset, knots, wx, wy, w) -> 'CurveScene':
+        """
+        Copy curves given as struct of arrays (see class doc) into a new native scene.
+        """
+        int_arrays = [np.ascontiguousarray(a, dtype=np.intc) for a in (kind, order, knots_offset, points_offset)]
+        double_arrays = [np.ascontiguousarray(a, dtype=np.float64) for a in (knots, wx, wy, w)]
+        int_pointers = [a.ctypes.data_as(ctypes.POINTER(ctypes.c_int)) for a in int_arrays]
+        double_pointers = [a.ctypes.data_as(ctypes.POINTER(ctypes.c_double)) for a in double_arrays]
+
+        borrowed_scene = _CrvScene(len(int_arrays[0]), len(double_arrays[0]), len(double_arrays[1]),
+                                   *int_pointers, *double_pointers)
+        scene_pointer = clib.crv_copy_scene(ctypes.byref(borrowed_scene))
+        if not bool(scene_pointer):
+            raise MemoryError()
+        return cls(scene_pointer)
+
+    def __del__(self):
+        clib.crv_free_scene(self._scene_pointer)
+
+    def __len__(self):
+        return self._scene_pointer.contents.n_curves
+
+    def _view(self, field: str, size: int, c_type):
+        if size == 0:
+            return np.empty(0, dtype=c_type)
+        address = ctypes.addressof(getattr(self._scene_pointer.contents, field).contents)
+        buffer = (c_type * size).from_address(address)
+        buffer._owner = self
+        view = np.frombuffer(buffer, dtype=c_type)
+        if self._scene_pointer.contents.mapping:
+            view.flags.writeable = False
+        return view
+
+    @property
+    def kind(self) -> np.ndarray:
+        return self._view("kind", len(self), ctypes.c_int)
+
+    @property
+    def order(self) -> np.ndarray:
+        return self._view("order", len(self), ctypes.c_int)
+
+    @property
+    def knots_offset(self) -> np.ndarray:
+        return self._view("knots_offset", len(self) + 1, ctypes.c_int)
+
+    @property
+    def points_offset(self) -> np.ndarray:
+        return self._view("points_offset", len(self) + 1, ctypes.c_int)
+
+    @property
+    def knots(self) -> np.ndarray:
+        return self._view("knots", self._scene_pointer.contents.n_knots, ctypes.c_double)
+
+    @property
+    def wx(self) -> np.ndarray:
+        return self._view("wx", self._scene_pointer.contents.n_points, ctypes.c_double)
+
+    @property
+    def wy(self) -> np.ndarray:
+        return self._view("wy", self._scene_pointer.contents.n_points, ctypes.c_double)
+
+    @property
+    def w(self) -> np.ndarray:
+        return self._view("w", self._scene_pointer.contents.n_points, ctypes.c_double)
+
+
+def load_dat(path: pathlib.Path) -> CurveScene:
+    scene_pointer = clib.crv_load_dat(str(path.resolve()).encode())
+    if not bool(scene_pointer):
+        _raise_io_error(path)
+    return CurveScene(scene_pointer)
+
+
+def parse_dat(text: bytes) -> CurveScene:
+    scene_pointer = clib.crv_parse_dat(text, len(text))
+    if not bool(scene_pointer):
+        _raise_io_error("<bytes>")
+    return CurveScene(scene_pointer)
+
+
+def save_dat(path: pathlib.Path, scene: CurveScene):
+    if not clib.crv_save_dat(scene._scene_pointer, str(path.resolve()).encode()):
+        _raise_io_error(path)
+
+
+def load_scene(path: pathlib.Path) -> CurveScene:
+    """
+    Map a binary scene file. The returned scene arrays are read only views on the file.
+    """
+    scene_pointer = clib.crv_load_scene(str(path.resolve()).encode())
+    if not bool(scene_pointer):
+        _raise_io_error(path)
+    return CurveScene(scene_pointer)
+
+
+def save_scene(path: pathlib.Path, scene: CurveScene):
+    if not clib.crv_save_scene(scene._scene_pointer, str(path.resolve()).encode()):
+        _raise_io_error(path)
+
+
+def dat_to_scene(dat_path: pathlib.Path, scene_path: pathlib.Path):
+    save_scene(scene_path, load_dat(dat_path))
+
+
+def scene_to_dat(scene_path: pathlib.Path, dat_path: pathlib.Path):
+    save_dat(dat_path, load_scene(scene_path))
+
+
+class Mesh(NamedTuple):
+    """
+    An indexed polygonal mesh. Vertices are unique (position, normal) pairs, face i is the vertices
+    ``indices[faces_offset[i]:faces_offset[i + 1]]``, and triangles is every face fanned to triangles.
+    """
+    vertices: np.ndarray  # (N x 3) float32
+    normals: np.ndarray  # (N x 3) float32
+    faces_offset: np.ndarray  # n_faces + 1 ints
+    indices: np.ndarray
+    triangles: np.ndarray  # (T x 3) ints
+
+
+def _mesh_arrays(mesh_pointer) -> Mesh:
+    try:
+        mesh = mesh_pointer.contents
+
+        def copy(field, size, shape):
+            if size == 0:
+                return np.empty(shape, dtype=np.float32 if field in ("vertices", "normals") else np.intc)
+            return np.ctypeslib.as_array(getattr(mesh, field), shape=shape).copy()
+
+        return Mesh(copy("vertices", mesh.n_vertices, (mesh.n_vertices, 3)),
+                    copy("normals", mesh.n_vertices, (mesh.n_vertices, 3)),
+                    copy("faces_offset", mesh.n_faces + 1, (mesh.n_faces + 1,)),
+                    copy("indices", mesh.n_indices, (mesh.n_indices,)),
+                    copy("triangles", mesh.n_triangles, (mesh.n_triangles, 3)))
+    finally:
+        clib.crv_free_mesh(mesh_pointer)
+
+
+def load_itd(path: pathlib.Path) -> Mesh:
+    """
+    Load the polygons of an IRIT .itd file (see crv_itd.c for the subset read).
+    """
+    mesh_pointer = clib.crv_load_itd(str(path.resolve()).encode())
+    if not bool(mesh_pointer):
+        _raise_io_error(path)
+    return _mesh_arrays(mesh_pointer)
+
+
+def parse_itd(text: bytes) -> Mesh:
+    mesh_pointer = clib.crv_parse_itd(text, len(text))
+    if not bool(mesh_pointer):
+        _raise_io_error("<bytes>")
+    return _mesh_arrays(mesh_pointer)
+
+
+def set_threads(n_threads: int = 0):
+    """
+    Number of threads the native evaluators use, 0 for one per processor.
+    """
+    clib.crv_set_threads(n_threads)
+
+
+def evaluate_scene(scene: CurveScene, n_samples: int) -> tuple[np.ndarray, np.ndarray]:
+    """
+    Evaluate every curve of the scene at n_samples + 1 uniform parameters over its domain, in parallel.
+
+    :return: (samples_offset, samples) where samples is a (3, total) float32 buffer (x, y and z = 0 rows) and
+        curve i samples are the columns samples_offset[i]:samples_offset[i + 1]. Curves that can not be evaluated
+        (too few control points, bad knot vector) get no samples.
+    """
+    samples_offset = np.empty(len(scene) + 1, dtype=np.intc)
+    offset_pointer = samples_offset.ctypes.data_as(ctypes.POINTER(ctypes.c_int))
+    total = clib.crv_scene_samples(scene._scene_pointer, n_samples, offset_pointer)
+
+    samples = np.zeros((3, total), dtype=np.float32)
+    if total > 0:
+        clib.crv_eval_scene(scene._scene_pointer, n_samples, offset_pointer,
+                            samples[0].ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+                            samples[1].ctypes.data_as(ctypes.POINTER(ctypes.c_float)))
+    return samples_offset, samples
+
+
+def evaluate_curve(scene: CurveScene, curve: int, t: np.ndarray) -> np.ndarray:
+    """
+    Evaluate curve number curve of the scene at the parameters t (clamped to its domain).
+
+    :return: (T x 2) points, NaN if the curve can not be evaluated.
+    """
+    if not 0 <= curve < len(scene):
+        raise IndexError(curve)
+    t = np.ascontiguousarray(t, dtype=np.float64).reshape(-1)
+    x, y = np.empty_like(t), np.empty_like(t)
+    clib.crv_eval_curve(scene._scene_pointer, curve, t.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), t.size,
+                        x.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                        y.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    return np.stack((x, y), axis=1)
+
+
+def evaluate_derivatives(scene: CurveScene, curve: int, t: np.ndarray) \
+        -> tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Evaluate curve number curve of the scene and its first and second derivatives at the parameters t (clamped to
+    its domain), exactly - from the hodograph of the curve piece, with the quotient rule for the weights. Sorted
+    parameters are cheapest, a B-spline span is extracted once for all the parameters in it in a row.
+
+    :return: (points, first, second, curvature) - three (T x 2) arrays and the (T,) signed curvature
+        (x' y'' - y' x'') / |C'|^3, NaN if the curve can not be evaluated.
+    """
+    if not 0 <= curve < len(scene):
+        raise IndexError(curve)
+    t = np.ascontiguousarray(t, dtype=np.float64).reshape(-1)
+    points, first, second = np.empty((t.size, 2)), np.empty((t.size, 2)), np.empty((t.size, 2))
+    curvature = np.empty_like(t)
+    clib.crv_eval_derivs(scene._scene_pointer, curve, t.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), t.size,
+                         points.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                         first.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                         second.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                         curvature.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+    return points, first, second, curvature
+
+
+def flatten_scene(scene: CurveScene, tolerance: float) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Flatten every curve of the scene to the polyline, adaptively subdivided, that is within tolerance of it.
+    Raises JobCancelled when run by a JobQueue job that was cancelled meanwhile.
+
+    :return: (vertices_offset, vertices, parameters) where vertices is a (3, total) float32 buffer (x, y and z = 0
+        rows), parameters the curve parameter of every vertex, and curve i vertices are the columns
+        vertices_offset[i]:vertices_offset[i + 1]. Curves that can not be evaluated get no vertices.
+    """
+    if not tolerance > 0:
+        raise ValueError(f"tolerance must be positive: {tolerance}")
+
+    polyline_pointer = clib.crv_flatten_scene(scene._scene_pointer, tolerance)
+    if not bool(polyline_pointer):
+        raise JobCancelled() if job_cancelled() else MemoryError()
+    try:
+        polyline = polyline_pointer.contents
+        total = polyline.n_vertices
+        vertices_offset = np.ctypeslib.as_array(polyline.vertices_offset, shape=(len(scene) + 1,)).copy()
+        vertices = np.zeros((3, total), dtype=np.float32)
+        parameters = np.empty(total, dtype=np.float64)
+        if total > 0:
+            vertices[0] = np.ctypeslib.as_array(polyline.x, shape=(total,))
+            vertices[1] = np.ctypeslib.as_array(polyline.y, shape=(total,))
+            parameters[:] = np.ctypeslib.as_array(polyline.t, shape=(total,))
+    finally:
+        clib.crv_free_polyline(polyline_pointer)
+    return vertices_offset, vertices, parameters
+
+
+def _intersections_arrays(intersections_pointer) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+    if not bool(intersections_pointer):
+        raise MemoryError()
+    try:
+        intersections = intersections_pointer.contents
+        total = intersections.n_intersections
+        curves, parameters, points = \
+            np.empty((total, 2), dtype=np.intc), np.empty((total, 2)), np.empty((total, 2))
+        if total > 0:
+            curves[:, 0] = np.ctypeslib.as_array(intersections.curve1, shape=(total,))
+            curves[:, 1] = np.ctypeslib.as_array(intersections.curve2, shape=(total,))
+            parameters[:, 0] = np.ctypeslib.as_array(intersections.t1, shape=(total,))
+            parameters[:, 1] = np.ctypeslib.as_array(intersections.t2, shape=(total,))
+            points[:, 0] = np.ctypeslib.as_array(intersections.x, shape=(total,))
+            points[:, 1] = np.ctypeslib.as_array(intersections.y, shape=(total,))
+    finally:
+        clib.crv_free_intersections(intersections_pointer)
+    return curves, parameters, points
+
+
+def intersect_curves(scene: CurveScene, curve_1: int, curve_2: int, tolerance: float) \
+        -> tuple[np.ndarray, np.ndarray]:
+    """
+    Intersect curves number curve_1 and curve_2 of the scene (positive weights assumed). Intersections closer than
+    tolerance to each other are reported once, and curves within tolerance of each other (touching) intersect.
+
+    :return: (parameters, points) - (N x 2) arrays of the (curve_1, curve_2) parameters and the (x, y) locations.
+    """
+    if not tolerance > 0:
+        raise ValueError(f"tolerance must be positive: {tolerance}")
+
+    _, parameters, points = _intersections_arrays(
+        clib.crv_intersect_curves(scene._scene_pointer, curve_1, curve_2, tolerance))
+    return parameters, points
+
+
+def intersect_scene(scene: CurveScene, tolerance: float) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Intersect all the pairs of curves of the scene, as intersect_curves, in parallel. Pairs whose bounding boxes
+    are apart are culled by a sweep first.
+
+    :return: (curves, parameters, points) - (N x 2) arrays of the intersecting curves (curves[i, 0] < curves[i, 1]),
+        their parameters and the (x, y) locations.
+    """
+    if not tolerance > 0:
+        raise ValueError(f"tolerance must be positive: {tolerance}")
+
+    return _intersections_arrays(clib.crv_intersect_scene(scene._scene_pointer, tolerance))
+
+
+def closest_point(scene: CurveScene, curve: int, x: float, y: float, max_distance: float = np.inf) \
+        -> tuple[float, float, tuple[float, float]] | None:
+    """
+    Exact point inversion: the point of the curve closest to (x, y).
+
+    :return: (parameter, distance, (x, y) of the point), or None if the curve is farther than max_distance or can not
+        be evaluated.
+    """
+    if not 0 <= curve < len(scene):
+        raise IndexError(curve)
+    t, cx, cy = ctypes.c_double(), ctypes.c_double(), ctypes.c_double()
+    distance = clib.crv_closest_point(scene._scene_pointer, curve, x, y, max_distance,
+                                      ctypes.byref(t), ctypes.byref(cx), ctypes.byref(cy))
+    if distance == np.inf:
+        return None
+    return t.value, distance, (cx.value, cy.value)
+
+
+def closest_curve(scene: CurveScene, x: float, y: float, max_distance: float = np.inf) \
+        -> tuple[int, float, float] | None:
+    """
+    :return: (curve, parameter, distance) of the scene curve point closest to (x, y), or None if all the curves are
+        farther than max_distance.
+    """
+    t, distance = ctypes.c_double(), ctypes.c_double()
+    curve = clib.crv_closest_curve(scene._scene_pointer, x, y, max_distance, ctypes.byref(t), ctypes.byref(distance))
+    if curve < 0:
+        return None
+    return curve, t.value, distance.value
+
+
+def _float_pointer(array: np.ndarray):
+    return array.ctypes.data_as(ctypes.POINTER(ctypes.c_float))
+
+
+def _float_xy(points) -> tuple[np.ndarray, np.ndarray]:
+    points = np.asarray(points, dtype=np.float32)
+    if points.size == 0:
+        points = np.empty((0, 2), dtype=np.float32)
+    return np.ascontiguousarray(points[:, 0]), np.ascontiguousarray(points[:, 1])
+
+
+def _double_pointer(array: np.ndarray):
+    return array.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+
+
+def _samples_arrays(points: np.ndarray, normals: np.ndarray, defined: np.ndarray | None):
+    points = np.ascontiguousarray(points, dtype=np.float64)
+    normals = np.ascontiguousarray(normals, dtype=np.float64)
+    if points.ndim != 2 or normals.shape != points.shape:
+        raise ValueError(f"points and normals must be (N x D) arrays: {points.shape}, {normals.shape}")
+    if defined is not None:
+        defined = np.ascontiguousarray(defined, dtype=np.uint8).reshape(-1)
+        if defined.size != len(points):
+            raise ValueError(f"defined must have {len(points)} entries: {defined.size}")
+    defined_pointer = None if defined is None else defined.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte))
+    return points, normals, defined, defined_pointer
+
+
+def offset_samples(points: np.ndarray, normals: np.ndarray, offsets, defined: np.ndarray | None = None) -> np.ndarray:
+    """
+    Offset curves of cached curve samples at many offset distances at once: points + offset * normals.
+
+    :param points: (N x D) curve samples.
+    :param normals: (N x D) unit normals at the samples.
+    :param defined: N flags, False where the normal is undefined (those samples give NaN). None - all defined.
+    :return: (len(offsets) x N x D) offset curves samples.
+    """
+    points, normals, defined, defined_pointer = _samples_arrays(points, normals, defined)
+    offsets = np.ascontiguousarray(offsets, dtype=np.float64).reshape(-1)
+    out = np.empty((offsets.size, *points.shape))
+    clib.crv_offset_samples(len(points), points.shape[1], _double_pointer(points), _double_pointer(normals),
+                            defined_pointer, offsets.size, _double_pointer(offsets), _double_pointer(out))
+    return out
+
+
+def evolute_samples(points: np.ndarray, normals: np.ndarray, radii: np.ndarray,
+                    defined: np.ndarray | None = None) -> np.ndarray:
+    """
+    Evolute (centers of curvature) of cached curve samples: points + radii * normals.
+
+    :param radii: N curvature radii at the samples.
+    :param defined: N flags, False where the normal or the radius is undefined (those samples give NaN).
+    :return: (N x D) evolute samples.
+    """
+    points, normals, defined, defined_pointer = _samples_arrays(points, normals, defined)
+    radii = np.ascontiguousarray(radii, dtype=np.float64).reshape(-1)
+    if radii.size != len(points):
+        raise ValueError(f"radii must have {len(points)} entries: {radii.size}")
+    out = np.empty(points.shape)
+    clib.crv_evolute_samples(len(points), points.shape[1], _double_pointer(points), _double_pointer(normals),
+                             _double_pointer(radii), defined_pointer, _double_pointer(out))
+    return out
+
+
+def rotation_minimizing_frames(points: np.ndarray, tangents: np.ndarray,
+                               normal: np.ndarray | None = None) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Rotation minimizing frames (double reflection method) of curve samples - a frame that, unlike the Frenet
+    frame, needs no second and third derivatives and is continuous through inflections and straight parts.
+
+    :param points: (N x 3) curve samples.
+    :param tangents: (N x 3) tangents at the samples, need not be unit. Zero tangents keep the previous frame.
+    :param normal: the first frame normal is its projection onto the first normal plane. None - any normal.
+    :return: (T, N, B) unit tangents, normals and bi normals, (N x 3) each. All NaN if no tangent is nonzero.
+    """
+    points = np.ascontiguousarray(points, dtype=np.float64)
+    tangents = np.ascontiguousarray(tangents, dtype=np.float64)
+    if points.ndim != 2 or points.shape[1] != 3 or tangents.shape != points.shape:
+        raise ValueError(f"points and tangents must be (N x 3) arrays: {points.shape}, {tangents.shape}")
+    normal_pointer = None
+    if normal is not None:
+        normal = np.ascontiguousarray(normal, dtype=np.float64).reshape(3)
+        normal_pointer = _double_pointer(normal)
+
+    t, n, b = (np.empty(points.shape) for _ in range(3))
+    clib.crv_rotation_minimizing_frames(len(points), _double_pointer(points), _double_pointer(tangents),
+                                        normal_pointer, _double_pointer(t), _double_pointer(n), _double_pointer(b))
+    return t, n, b
+
+
+STREAM_STRIDE = 6
+"""floats per VertexStream vertex: x, y, z, r, g, b"""
+
+
+class VertexStream:
+    """
+    Line drawings (curve samples, control polygons, frame vectors, circles) packed natively into one interleaved
+    float32 vertex buffer (STREAM_STRIDE floats per vertex: position and color) and the segments as pairs of vertex
+    indices - the whole stream is drawn by a single glDrawElements(GL_LINES) call, no vertex sent twice.
+    Clear and refill it every frame, its native buffers are reused.
+    """
+
+    def __init__(self):
+        self._stream_pointer = clib.crv_alloc_stream()
+        if not bool(self._stream_pointer):
+            raise MemoryError()
+
+    def __del__(self):
+        clib.crv_free_stream(self._stream_pointer)
+
+    def clear(self):
+        clib.crv_clear_stream(self._stream_pointer)
+
+    def add_strip(self, points, color=(1, 1, 1), colors: np.ndarray | None = None):
+        """
+        Append the polyline through the points, (N x 2 or 3), of color or of per point colors (N x 3). Points that
+        are not finite are dropped and break the polyline.
+        """
+        points = np.ascontiguousarray(points, dtype=np.float64)
+        if points.size == 0:
+            return
+        points = points.reshape(len(points), -1)
+        if points.shape[1] not in (2, 3):
+            raise ValueError(f"points must have 2 or 3 coordinates, got shape {points.shape}")
+        color = np.ascontiguousarray(color, dtype=np.float32).reshape(3)
+        if colors is not None:
+            colors = np.ascontiguousarray(colors, dtype=np.float32).reshape(len(points), 3)
+        if not clib.crv_stream_strip(self._stream_pointer, len(points), points.shape[1], _double_pointer(points),
+                                     _float_pointer(color), None if colors is None else _float_pointer(colors)):
+            raise MemoryError()
+
+    def add_circle(self, center, radius: float, normal=(0, 0, 1), color=(1, 1, 1), n_segments: int = 100):
+        """
+        Append the circle of radius about center (2 or 3 coordinates), in the plane normal to normal.
+        """
+        center_3d, normal = np.zeros(3), np.ascontiguousarray(normal, dtype=np.float64).reshape(3)
+        center_3d[:np.size(center)] = np.ravel(center)
+        color = np.ascontiguousarray(color, dtype=np.float32).reshape(3)
+        if not clib.crv_stream_circle(self._stream_pointer, _double_pointer(center_3d), radius,
+                                      _double_pointer(normal), n_segments, _float_pointer(color)):
+            raise MemoryError()
+
+    @property
+    def vertices(self) -> np.ndarray:
+        """
+        (N x STREAM_STRIDE) float32 copy of the vertices.
+        """
+        stream = self._stream_pointer.contents
+        if stream.n_vertices == 0:
+            return np.empty((0, STREAM_STRIDE), dtype=np.float32)
+        return np.ctypeslib.as_array(stream.vertices, shape=(stream.n_vertices, STREAM_STRIDE)).copy()
+
+    @property
+    def indices(self) -> np.ndarray:
+        """
+        uint32 copy of the segments vertex indices, two per segment.
+        """
+        stream = self._stream_pointer.contents
+        if stream.n_indices == 0:
+            return np.empty(0, dtype=np.uint32)
+        return np.ctypeslib.as_array(stream.indices, shape=(stream.n_indices,)).copy()
+
+
+class ArcLengthTable:
+    """
+    Arc length of a curve as a function of its parameter and back. The speed ||dC|| is sampled at ARCLEN_NODES
+    Gauss-Legendre nodes per interval; every query is then a binary search (plus Newton iterations from arc length to
+    parameter) with no curve evaluations.
+    """
+
+    def __init__(self, table_pointer):
+        if not bool(table_pointer):
+            raise MemoryError()
+        self._table_pointer = table_pointer
+
+    def __del__(self):
+        clib.crv_free_arclen(self._table_pointer)
+
+    @classmethod
+    def from_speed(cls, speed, domain: tuple[float, float], n_intervals: int) -> 'ArcLengthTable':
+        """
+        Table of any curve, expression curves too, over n_intervals uniform intervals of its domain.
+
+        :param speed: speed(t) - ||dC(t)|| at an array of parameters (np.vectorize a scalar one).
+        """
+        if n_intervals < 1:
+            raise ValueError(f"n_intervals must be positive: {n_intervals}")
+        t = np.linspace(*domain, n_intervals + 1)
+        nodes = np.empty(n_intervals * ARCLEN_NODES)
+        clib.crv_arclen_nodes(n_intervals, _double_pointer(t), _double_pointer(nodes))
+        speeds = np.ascontiguousarray(speed(nodes), dtype=np.float64).reshape(nodes.shape)
+        if not np.isfinite(speeds).all():
+            raise ValueError("speed is not finite over the domain")
+        return cls(clib.crv_arclen_from_speeds(n_intervals, _double_pointer(t), _double_pointer(speeds)))
+
+    @classmethod
+    def from_curve(cls, scene: CurveScene, curve: int, intervals_per_piece: int = 8) -> 'ArcLengthTable':
+        """
+        Table of curve number curve of the scene, every polynomial piece (B-spline knot span) split to
+        intervals_per_piece intervals.
+        """
+        if not 0 <= curve < len(scene):
+            raise IndexError(curve)
+        if not clib.crv_curve_is_valid(scene._scene_pointer, curve):
+            raise ValueError(f"curve {curve} can not be evaluated")
+        if intervals_per_piece < 1:
+            raise ValueError(f"intervals_per_piece must be positive: {intervals_per_piece}")
+        return cls(clib.crv_curve_arclen(scene._scene_pointer, curve, intervals_per_piece))
+
+    @property
+    def length(self) -> float:
+        return clib.crv_arclen_length(self._table_pointer)
+
+    def lengths(self, t: np.ndarray) -> np.ndarray:
+        """
+        :return: the arc lengths at the parameters t (clamped to the domain).
+        """
+        t = np.ascontiguousarray(t, dtype=np.float64).reshape(-1)
+        s = np.empty_like(t)
+        clib.crv_arclen_lengths(self._table_pointer, _double_pointer(t), t.size, _double_pointer(s))
+        return s
+
+    def parameters(self, s: np.ndarray) -> np.ndarray:
+        """
+        :return: the parameters at the arc lengths s (clamped to [0, length]).
+        """
+        s = np.ascontiguousarray(s, dtype=np.float64).reshape(-1)
+        t = np.empty_like(s)
+        clib.crv_arclen_params(self._table_pointer, _double_pointer(s), s.size, _double_pointer(t))
+        return t
+
+    def uniform_parameters(self, n_samples: int) -> np.ndarray:
+        """
+        :return: the n_samples + 1 parameters of equally spaced (in arc length) points, both ends included.
+        """
+        return self.parameters(np.linspace(0, self.length, n_samples + 1))
+
+
+class PickIndex:
+    """
+    Spatial index (bounding volume hierarchies) over the samples and control points of a list of curves, to find
+    the curve, control point or sample nearest to a location. Curves are numbered as in the mirrored list, kept in
+    sync with insert_curve / set_curve / delete_curve; only the changed curve is rebuilt.
+    """
+
+    def __init__(self):
+        self._index_pointer = clib.crv_alloc_pick_index()
+        if not self._index_pointer:
+            raise MemoryError()
+        self._n_curves = 0
+
+    def __del__(self):
+        clib.crv_free_pick_index(self._index_pointer)
+
+    def __len__(self):
+        return self._n_curves
+
+    def insert_curve(self, curve: int, samples: np.ndarray, control_points):
+        if not clib.crv_pick_insert_curve(self._index_pointer, curve):
+            raise MemoryError() if 0 <= curve <= len(self) else IndexError(curve)
+        self._n_curves += 1
+        self.set_curve(curve, samples, control_points)
+
+    def set_curve(self, curve: int, samples: np.ndarray, control_points):
+        """
+        :param samples: (N x 2 or more) polyline vertices.
+        :param control_points: (M x 2 or more) control points.
+        """
+        if not 0 <= curve < len(self):
+            raise IndexError(curve)
+        (x, y), (px, py) = _float_xy(samples), _float_xy(control_points)
+        if not clib.crv_pick_set_curve(self._index_pointer, curve, x.size, _float_pointer(x), _float_pointer(y),
+                                       px.size, _float_pointer(px), _float_pointer(py)):
+            raise MemoryError()
+
+    def delete_curve(self, curve: int):
+        if not 0 <= curve < len(self):
+            raise IndexError(curve)
+        clib.crv_pick_delete_curve(self._index_pointer, curve)
+        self._n_curves -= 1
+
+    def nearest_curve(self, x: float, y: float, radius: float, skip_curve: int | None = None) \
+            -> tuple[int, int, float] | None:
+        """
+        :return: (curve, segment, distance) of the curve polyline nearest to (x, y) within radius, or None.
+        """
+        segment, distance = ctypes.c_int(), ctypes.c_double()
+        curve = clib.crv_pick_nearest_curve(self._index_pointer, x, y, radius,
+                                            -1 if skip_curve is None else skip_curve,
+                                            ctypes.byref(segment), ctypes.byref(distance))
+        return None if curve < 0 else (curve, segment.value, distance.value)
+
+    def nearest_point(self, curve: int, x: float, y: float, radius: float) -> int | None:
+        """
+        :return: the control point of the curve nearest to (x, y) within radius, or None.
+        """
+        distance = ctypes.c_double()
+        point = clib.crv_pick_nearest_point(self._index_pointer, curve, x, y, radius, ctypes.byref(distance))
+        return None if point < 0 else point
+
+    def nearest_sample(self, curve: int, x: float, y: float, radius: float) -> int | None:
+        """
+        :return: the sample (polyline vertex) of the curve nearest to (x, y) within radius, or None.
+        """
+        distance = ctypes.c_double()
+        sample = clib.crv_pick_nearest_sample(self._index_pointer, curve, x, y, radius, ctypes.byref(distance))
+        return None if sample < 0 else sample
+
+
+class JobCancelled(Exception):
+    """
+    Raised by the native routines a JobQueue job calls (flatten_scene), when a newer job of the same key cancelled it.
+    """
+
+
+def job_cancelled() -> bool:
+    """
+    :return: whether the JobQueue job running on this thread was cancelled - to give up long Python jobs early.
+    """
+    return bool(clib.crv_job_cancelled())
+
+
+_submitted_jobs: dict[int, tuple['JobQueue', Any, Callable[[], Any]]] = {}
+"""the jobs not run yet, by the job number given to the native queue as ctx"""
+_jobs_numbers = itertools.count(1)
+
+
+@_JOB_FUNCTION
+def _run_job(job_number):
+    queue, key, job = _submitted_jobs.pop(job_number)
+    queue._run(key, job_number, job)
+
+
+class JobQueue:
+    """
+    Jobs (callables, typically resampling a curve) run in order by a native worker thread, off the calling (UI)
+    thread. Every job has a key, such as the curve it resamples: submitting a job cancels the jobs of that key which
+    did not finish, as only the newest one is of use - queued ones are skipped, and a running one sees job_cancelled()
+    and the native routines it calls give up (JobCancelled). The result of the newest job of every key is kept until
+    take_results, which the UI thread calls to publish all the finished results at once.
+    """
+
+    def __init__(self, on_result: Callable[[], Any] | None = None):
+        """
+        :param on_result: called by the worker thread whenever a result is kept, to wake the UI thread up for
+            take_results (such as wx.WakeUpIdle) - it must be callable from any thread
+        """
+        self._on_result = on_result
+        self._jobs_pointer = clib.crv_alloc_jobs()
+        if not self._jobs_pointer:
+            raise MemoryError()
+        self._lock = threading.Lock()
+        self._keys: dict[Any, list[int]] = {}
+        """[native key, newest job number, jobs not run yet] of every key with jobs"""
+        self._native_keys = itertools.count()
+        self._results: dict[Any, tuple[bool, Any]] = {}
+        """(failed, result or exception) of the newest job of every key, until taken"""
+
+    def __del__(self):
+        clib.crv_free_jobs(self._jobs_pointer)
+
+    def submit(self, key, job: Callable[[], Any]):
+        """
+        Queue job() under key (any hashable), cancelling the unfinished jobs of key.
+        """
+        with self._lock:
+            job_number = next(_jobs_numbers)
+            key_jobs = self._keys.setdefault(key, [next(self._native_keys) & 0x7fffffff, 0, 0])
+            key_jobs[1] = job_number
+            key_jobs[2] += 1
+            self._results.pop(key, None)
+            _submitted_jobs[job_number] = self, key, job
+            if not clib.crv_submit_job(self._jobs_pointer, key_jobs[0], _run_job, job_number):
+                del _submitted_jobs[job_number]
+                self._job_done(key)
+                raise MemoryError()
+
+    def cancel(self, key=None):
+        """
+        Cancel the unfinished jobs of key, of all the keys if None, and drop their results not taken yet.
+        """
+        with self._lock:
+            if key is None:
+                clib.crv_cancel_jobs(self._jobs_pointer, -1)
+                for key_jobs in self._keys.values():
+                    key_jobs[1] = 0
+                self._results.clear()
+            elif key in self._keys:
+                clib.crv_cancel_jobs(self._jobs_pointer, self._keys[key][0])
+                self._keys[key][1] = 0
+                self._results.pop(key, None)
+            else:
+                self._results.pop(key, None)
+
+    def wait(self):
+        """
+        Wait until all the submitted jobs ran (or were skipped). Not from within a job.
+        """
+        clib.crv_wait_jobs(self._jobs_pointer)
+
+    def take_results(self) -> tuple[dict, dict]:
+        """
+        :return: the result of the newest job of every key that finished since the last call, and the exception of
+            the newest job of every key that failed since, by key
+        """
+        with self._lock:
+            results, self._results = self._results, {}
+        return ({key: result for key, (failed, result) in results.items() if not failed},
+                {key: result for key, (failed, result) in results.items() if failed})
+
+    def _run(self, key, job_number, job):
+        result = None
+        if not job_cancelled():
+            try:
+                result = False, job()
+            except JobCancelled:
+                pass
+            except Exception as e:
+                result = True, e
+        with self._lock:
+            kept = result is not None and self._keys[key][1] == job_number
+            if kept:
+                self._results[key] = result
+            self._job_done(key)
+        if kept and self._on_result is not None:
+            self._on_result()
+
+    def _job_done(self, key):
+        key_jobs = self._keys[key]
+        key_jobs[2] -= 1
+        if key_jobs[2] == 0:
+            del self._keys[key]
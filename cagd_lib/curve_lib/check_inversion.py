@@ -0,0 +1,99 @@
+"""
+Brute force check of the exact point inversion (closest_point) against dense sampling of the curves.
+
+Every curve of the curves files is inverted from random points about it and near it, and the distance closest_point
+returns is compared with the nearest of BRUTE_FORCE_SAMPLES uniform samples of the curve: a farther point is a miss
+(the samples are a bit farther than the exact point, never nearer). REGRESSIONS, points that were missed once, are
+checked too. Exits with status 1 on any miss.
+"""
+import argparse
+import pathlib
+import sys
+
+import numpy as np
+
+from cagd_lib.curve_lib import load_dat, closest_point, evaluate_curve
+
+BRUTE_FORCE_SAMPLES = 200001
+
+TOLERANCE = 1e-9
+"""distance closest_point may exceed the samples by, relative to the curve size"""
+
+ROOT = pathlib.Path(__file__).resolve().parents[2]
+
+REGRESSIONS = [
+    # a cubic nearly straight polygon turning at its end: the ends did not bracket the interior minimum
+    ("Bsplines/CoolDude.dat", 11, (-1.137, -1.105)),
+]
+"""(curves file from the repository root, curve, point) of points that were missed"""
+
+
+def curve_samples(scene, curve: int) -> np.ndarray:
+    knots = scene.knots[scene.knots_offset[curve]:scene.knots_offset[curve + 1]]
+    domain = (knots[0], knots[-1]) if len(knots) else (0.0, 1.0)  # clamped to the actual domain
+    return evaluate_curve(scene, curve, np.linspace(*domain, BRUTE_FORCE_SAMPLES))
+
+
+def check_point(scene, curve: int, samples: np.ndarray, point) -> str | None:
+    """
+    :return: the miss, or None if closest_point is as near as the samples
+    """
+    nearest = np.hypot(*(samples - point).T).min()
+    found = closest_point(scene, curve, *point)
+    size = np.ptp(samples, axis=0).max()
+    if found is None or found[1] > nearest + TOLERANCE * size:
+        return f"curve {curve} from {tuple(map(float, point))}: closest_point {found}, samples {nearest}"
+    return None
+
+
+def check_file(path: pathlib.Path, points: int, rng: np.random.Generator) -> list[str]:
+    scene = load_dat(path)
+    misses = []
+    for curve in range(len(scene)):
+        samples = curve_samples(scene, curve)
+        if not np.isfinite(samples).all():
+            continue  # can not be evaluated
+        low, high = samples.min(axis=0), samples.max(axis=0)
+        margin = 0.3 * (high - low).max()
+        # about the curve, and near it where the minima are closer together
+        about = rng.uniform(low - margin, high + margin, (points, 2))
+        near = samples[rng.integers(len(samples), size=points)] + rng.normal(0.0, 0.05 * margin, (points, 2))
+        for point in np.vstack([about, near]):
+            miss = check_point(scene, curve, samples, point)
+            if miss is not None:
+                misses.append(f"{path}: {miss}")
+    return misses
+
+
+def check_regressions() -> list[str]:
+    misses = []
+    for file, curve, point in REGRESSIONS:
+        scene = load_dat(ROOT / file)
+        miss = check_point(scene, curve, curve_samples(scene, curve), np.array(point))
+        if miss is not None:
+            misses.append(f"{file}: {miss}")
+    return misses
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("curves", type=pathlib.Path, nargs="*", help="curves files to check, e.g. Bsplines/*.dat")
+    parser.add_argument("--points", type=int, default=20, help="points about every curve, and as many near it")
+    parser.add_argument("--seed", type=int, default=0, help="seed of the points")
+    arguments = parser.parse_args(argv)
+
+    rng = np.random.default_rng(arguments.seed)
+    misses = check_regressions()
+    for path in arguments.curves:
+        try:
+            misses += check_file(path, arguments.points, rng)
+        except (OSError, ValueError) as e:
+            print(f"{path}: skipped, {e}")
+    for miss in misses:
+        print(miss)
+    print(f"{len(misses)} misses, {len(REGRESSIONS)} regressions and {len(arguments.curves)} curves files checked")
+    sys.exit(1 if misses else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,471 @@
+/*****************************************************************************
+*   Module of arc length tables - arc length to parameter and back.          *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. arclen_nodes(n_intervals, t, nodes) - the parameters to sample the      *
+*                  speed |C'| at, for arclen_from_speeds.                    *
+*    crv_arclen *arclen_from_speeds(n_intervals, t, speeds) - a table of     *
+*                  any curve (expression curves too) from its speeds.        *
+*    crv_arclen *curve_arclen(scene, curve, intervals_per_piece) - the table *
+*                  of a scene curve, with adaptive intervals.                *
+* 2. double arclen_length(table) - the curve length.                         *
+*    arclen_lengths(table, t, n_t, s) - arc lengths at parameters.           *
+*    arclen_params(table, s, n_s, t) - parameters at arc lengths.            *
+* 3. free_arclen(table) - release memory allocated for a table.              *
+*                                                                            *
+*   The domain is split into intervals, and the speed is sampled at the      *
+* CRV_ARCLEN_NODES Gauss-Legendre nodes of every interval. The speed         *
+* polynomial interpolating these samples is kept per interval: its integral  *
+* over the interval is the Gauss-Legendre quadrature, and its integral up to *
+* any parameter gives the arc length there in closed form. Queries binary    *
+* search the interval, arc length to parameter then runs Newton iterations   *
+* (safeguarded by bisection) on the interval polynomial - no curve           *
+* evaluations, O(log n) per query.                                           *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_ITERATIONS     32
+#define  ITERATIONS_EPSILON 1e-15
+#define  MAX_DEPTH          24   /* Bisections of an initial curve interval */
+#define  ADAPT_TOLERANCE    1e-10     /* Relative, of an interval quadrature */
+#define  INITIAL_CAPACITY   64
+
+#if CRV_ARCLEN_NODES != 5
+#error "Gauss-Legendre nodes below are of 5 points"
+#endif
+
+static const double
+    GAUSS_NODES[CRV_ARCLEN_NODES] = {        /* Over [0, 1], increasing */
+        0.046910077030668004, 0.23076534494715845, 0.5,
+        0.76923465505284155, 0.95308992296933200
+    },
+    GAUSS_WEIGHTS[CRV_ARCLEN_NODES] = {
+        0.11846344252809454, 0.23931433524968324, 0.28444444444444444,
+        0.23931433524968324, 0.11846344252809454
+    };
+
+typedef struct arclen_builder {             /* Intervals of a scene curve */
+     const crv_scene *scene;
+     int curve;
+     int n, capacity;                               /* Break points number */
+     double *t;
+     double *speeds;         /* CRV_ARCLEN_NODES per interval, n - 1 of them */
+     int failed;                           /* An allocation failed, if set */
+} arclen_builder;
+
+static void adapt_interval(arclen_builder *builder, double a, double b,
+                           const double *speeds, int depth);
+static void node_speeds(arclen_builder *builder, double a, double b,
+                        double *speeds);
+static int push_interval(arclen_builder *builder, double b,
+                         const double *speeds);
+static double quadrature(double a, double b, const double *speeds);
+static int find_interval(const double *a, int n, double v);
+static int nodes_inverse(double *inverse);
+static double interval_length(const double *coef, double u);
+static double interval_speed(const double *coef, double u);
+
+/*****************************************************************************
+*   Routine to compute the parameters to sample the speed at for a table     *
+* over the n_intervals intervals of the n_intervals + 1 increasing break     *
+* points t: CRV_ARCLEN_NODES nodes per interval, into nodes.                 *
+*****************************************************************************/
+void crv_arclen_nodes(int n_intervals, const double *t, double *nodes)
+{
+    int i, k;
+
+    for (i = 0; i < n_intervals; i++)
+        for (k = 0; k < CRV_ARCLEN_NODES; k++)
+            nodes[i * CRV_ARCLEN_NODES + k] =
+                t[i] + GAUSS_NODES[k] * (t[i + 1] - t[i]);
+}
+
+/*****************************************************************************
+*   Routine to build an arc length table of a curve, given the break points  *
+* t of its n_intervals intervals and its speeds at the crv_arclen_nodes      *
+* nodes. The speed should be smooth inside every interval. Returns NULL if   *
+* out of memory.                                                             *
+*****************************************************************************/
+crv_arclen *crv_arclen_from_speeds(int n_intervals, const double *t,
+                                   const double *speeds)
+{
+    int i, j, k;
+    double inverse[CRV_ARCLEN_NODES * CRV_ARCLEN_NODES], *coef;
+    crv_arclen *table;
+
+    table = (crv_arclen *) calloc(1, sizeof(crv_arclen));
+    if (table == NULL) return NULL;
+    table -> n_intervals = n_intervals;
+    table -> t = (double *) malloc((n_intervals + 1) * sizeof(double));
+    table -> s = (double *) malloc((n_intervals + 1) * sizeof(double));
+    table -> coef = (double *) malloc((n_intervals * CRV_ARCLEN_NODES + 1) *
+                                      sizeof(double));
+    if (table -> t == NULL || table -> s == NULL || table -> coef == NULL ||
+        !nodes_inverse(inverse)) {
+        crv_free_arclen(table);
+        return NULL;
+    }
+
+    table -> t[0] = t[0];
+    table -> s[0] = 0.0;
+    for (i = 0; i < n_intervals; i++) {
+        /* Speed monomial coefficients in u = (t - t[i]) / (t[i+1] - t[i]): */
+        coef = &table -> coef[i * CRV_ARCLEN_NODES];
+        for (j = 0; j < CRV_ARCLEN_NODES; j++) {
+            coef[j] = 0.0;
+            for (k = 0; k < CRV_ARCLEN_NODES; k++)
+                coef[j] += inverse[j * CRV_ARCLEN_NODES + k] *
+                           speeds[i * CRV_ARCLEN_NODES + k];
+        }
+
+        table -> t[i + 1] = t[i + 1];
+        table -> s[i + 1] = table -> s[i] +
+                            (t[i + 1] - t[i]) * interval_length(coef, 1.0);
+    }
+
+    return table;
+}
+
+/*****************************************************************************
+*   Routine to build the arc length table of curve number curve of a scene.  *
+* Every Bezier piece of it (see crv_curve_piece) is split to                 *
+* intervals_per_piece intervals, and each is bisected further while the      *
+* quadrature of its halves differs from its own (see adapt_interval).        *
+* Returns NULL if the curve is invalid or if out of memory.                  *
+*****************************************************************************/
+crv_arclen *crv_curve_arclen(const crv_scene *scene, int curve,
+                             int intervals_per_piece)
+{
+    int i, j, n_pieces;
+    double speeds[CRV_ARCLEN_NODES], t_start, t_end, t0, t1, a, b;
+    const double *knots = scene -> knots + scene -> knots_offset[curve];
+    arclen_builder builder;
+    crv_arclen *table = NULL;
+
+    if (!crv_curve_is_valid(scene, curve) || intervals_per_piece < 1)
+        return NULL;
+    crv_curve_domain(scene, curve, &t_start, &t_end);
+
+    builder.scene = scene;
+    builder.curve = curve;
+    builder.n = builder.capacity = 0;
+    builder.t = builder.speeds = NULL;
+    builder.failed = !push_interval(&builder, t_start, NULL);
+
+    /* Intervals inside the (non empty) knot spans: */
+    n_pieces = crv_curve_pieces(scene, curve);
+    for (i = 0; i < n_pieces && !builder.failed; i++) {
+        if (scene -> kind[curve] == CRV_BEZIER) {
+            t0 = t_start;
+            t1 = t_end;
+        }
+        else {
+            t0 = knots[scene -> order[curve] - 1 + i];
+            t1 = knots[scene -> order[curve] + i];
+            if (t0 == t1) continue;
+        }
+        for (j = 0; j < intervals_per_piece; j++) {
+            a = t0 + (t1 - t0) * j / intervals_per_piece;
+            b = j == intervals_per_piece - 1 ?
+                    t1 : t0 + (t1 - t0) * (j + 1) / intervals_per_piece;
+            node_speeds(&builder, a, b, speeds);
+            adapt_interval(&builder, a, b, speeds, 0);
+        }
+    }
+
+    if (!builder.failed)
+        table = crv_arclen_from_speeds(builder.n - 1, builder.t,
+                                       builder.speeds);
+    free(builder.t);
+    free(builder.speeds);
+    return table;
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for an arc length table.             *
+*****************************************************************************/
+void crv_free_arclen(crv_arclen *table)
+{
+    if (table == NULL) return;
+
+    free(table -> t);
+    free(table -> s);
+    free(table -> coef);
+    free(table);
+}
+
+/*****************************************************************************
+*   Routine to return the length of the curve of a table.                    *
+*****************************************************************************/
+double crv_arclen_length(const crv_arclen *table)
+{
+    return table -> s[table -> n_intervals];
+}
+
+/*****************************************************************************
+*   Routine to compute the arc lengths s at the n_t parameters t (clamped to *
+* the table domain).                                                         *
+*****************************************************************************/
+void crv_arclen_lengths(const crv_arclen *table, const double *t, int n_t,
+                        double *s)
+{
+    int i, j,
+        n = table -> n_intervals;
+    double h;
+
+    for (i = 0; i < n_t; i++) {
+        if (n == 0 || !(t[i] > table -> t[0])) {
+            s[i] = 0.0;
+            continue;
+        }
+        if (t[i] >= table -> t[n]) {
+            s[i] = table -> s[n];
+            continue;
+        }
+
+        j = find_interval(table -> t, n, t[i]);
+        h = table -> t[j + 1] - table -> t[j];
+        s[i] = table -> s[j] +
+               h * interval_length(&table -> coef[j * CRV_ARCLEN_NODES],
+                                   (t[i] - table -> t[j]) / h);
+    }
+}
+
+/*****************************************************************************
+*   Routine to compute the parameters t at the n_s arc lengths s (clamped to *
+* [0, length]): the interval by binary search, then Newton iterations on its *
+* arc length polynomial from the linear interpolation, safeguarded by        *
+* bisection.                                                                 *
+*****************************************************************************/
+void crv_arclen_params(const crv_arclen *table, const double *s, int n_s,
+                       double *t)
+{
+    int i, j, k,
+        n = table -> n_intervals;
+    double h, target, u, u_next, a, b, f, df;
+    const double *coef;
+
+    for (i = 0; i < n_s; i++) {
+        if (n == 0 || !(s[i] > 0.0)) {
+            t[i] = table -> t[0];
+            continue;
+        }
+        if (s[i] >= table -> s[n]) {
+            t[i] = table -> t[n];
+            continue;
+        }
+
+        j = find_interval(table -> s, n, s[i]);
+        h = table -> t[j + 1] - table -> t[j];
+        coef = &table -> coef[j * CRV_ARCLEN_NODES];
+        target = s[i] - table -> s[j];
+        a = 0.0;
+        b = 1.0;
+        u = target / (table -> s[j + 1] - table -> s[j]);
+
+        for (k = 0; k < MAX_ITERATIONS; k++) {
+            f = h * interval_length(coef, u) - target;
+            df = h * interval_speed(coef, u);
+            if (f == 0.0) break;
+            if (f < 0.0)
+                a = u;
+            else
+                b = u;
+
+            u_next = df > 0.0 ? u - f / df : a - 1.0;
+            if (!(u_next > a && u_next < b))
+                u_next = 0.5 * (a + b);
+            if (fabs(u_next - u) < ITERATIONS_EPSILON) break;
+            u = u_next;
+        }
+        t[i] = table -> t[j] + u * h;
+    }
+}
+
+/*****************************************************************************
+*   Routine to add the interval [a, b] of the curve, given its node speeds,  *
+* bisecting it while the quadratures of its halves add up to more than       *
+* ADAPT_TOLERANCE away from its own - where the speed is far from a          *
+* polynomial, as about cusps or with uneven weights.                         *
+*****************************************************************************/
+static void adapt_interval(arclen_builder *builder, double a, double b,
+                           const double *speeds, int depth)
+{
+    double left[CRV_ARCLEN_NODES], right[CRV_ARCLEN_NODES], length,
+           middle = 0.5 * (a + b);
+
+    if (builder -> failed) return;
+
+    node_speeds(builder, a, middle, left);
+    node_speeds(builder, middle, b, right);
+    length = quadrature(a, middle, left) + quadrature(middle, b, right);
+    if (depth >= MAX_DEPTH ||
+        fabs(length - quadrature(a, b, speeds)) <= ADAPT_TOLERANCE * length) {
+        if (!push_interval(builder, middle, left) ||
+            !push_interval(builder, b, right))
+            builder -> failed = TRUE;
+        return;
+    }
+
+    adapt_interval(builder, a, middle, left, depth + 1);
+    adapt_interval(builder, middle, b, right, depth + 1);
+}
+
+/*****************************************************************************
+*   Routine to evaluate the curve speed at the nodes of the interval [a, b]. *
+*****************************************************************************/
+static void node_speeds(arclen_builder *builder, double a, double b,
+                        double *speeds)
+{
+    int k;
+    double t[2], nodes[CRV_ARCLEN_NODES], c[2 * CRV_ARCLEN_NODES],
+           d1[2 * CRV_ARCLEN_NODES], d2[2 * CRV_ARCLEN_NODES],
+           curvature[CRV_ARCLEN_NODES];
+
+    t[0] = a;
+    t[1] = b;
+    crv_arclen_nodes(1, t, nodes);
+    crv_eval_derivs(builder -> scene, builder -> curve, nodes,
+                    CRV_ARCLEN_NODES, c, d1, d2, curvature);
+    for (k = 0; k < CRV_ARCLEN_NODES; k++)
+        speeds[k] = hypot(d1[2 * k], d1[2 * k + 1]);
+}
+
+/*****************************************************************************
+*   Routine to append the next break point b, ending an interval of the      *
+* given node speeds (none for the first break point). FALSE if out of memory.*
+*****************************************************************************/
+static int push_interval(arclen_builder *builder, double b,
+                         const double *speeds)
+{
+    int k, capacity;
+    double *new_t, *new_speeds;
+
+    if (builder -> n == builder -> capacity) {
+        capacity = builder -> capacity == 0 ? INITIAL_CAPACITY :
+                                              2 * builder -> capacity;
+        new_t = (double *) realloc(builder -> t, capacity * sizeof(double));
+        if (new_t != NULL) builder -> t = new_t;
+        new_speeds = (double *) realloc(builder -> speeds,
+                                        capacity * CRV_ARCLEN_NODES *
+                                            sizeof(double));
+        if (new_speeds != NULL) builder -> speeds = new_speeds;
+        if (new_t == NULL || new_speeds == NULL) return FALSE;
+        builder -> capacity = capacity;
+    }
+
+    if (speeds != NULL)
+        for (k = 0; k < CRV_ARCLEN_NODES; k++)
+            builder -> speeds[(builder -> n - 1) * CRV_ARCLEN_NODES + k] =
+                speeds[k];
+    builder -> t[builder -> n++] = b;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to return the Gauss-Legendre quadrature of the speed over [a, b].*
+*****************************************************************************/
+static double quadrature(double a, double b, const double *speeds)
+{
+    int k;
+    double length = 0.0;
+
+    for (k = 0; k < CRV_ARCLEN_NODES; k++)
+        length += GAUSS_WEIGHTS[k] * speeds[k];
+    return (b - a) * length;
+}
+
+/*****************************************************************************
+*   Routine to find the interval i, 0 <= i < n, with a[i] <= v < a[i + 1],   *
+* of the n + 1 non decreasing a, for a[0] < v < a[n].                        *
+*****************************************************************************/
+static int find_interval(const double *a, int n, double v)
+{
+    int low = 0,
+        high = n - 1,
+        middle;
+
+    while (low < high) {                                 /* Binary search */
+        middle = (low + high + 1) / 2;
+        if (a[middle] <= v)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+/*****************************************************************************
+*   Routine to compute the inverse of the Vandermonde matrix of the Gauss    *
+* nodes (row j gives monomial coefficient j from the node values), by        *
+* Gauss-Jordan elimination with partial pivoting. FALSE if singular.         *
+*****************************************************************************/
+static int nodes_inverse(double *inverse)
+{
+    int i, j, k, pivot,
+        n = CRV_ARCLEN_NODES;
+    double m[CRV_ARCLEN_NODES * CRV_ARCLEN_NODES], factor, swap;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            m[i * n + j] = j == 0 ? 1.0 : m[i * n + j - 1] * GAUSS_NODES[i];
+            inverse[i * n + j] = i == j ? 1.0 : 0.0;
+        }
+
+    for (j = 0; j < n; j++) {
+        for (pivot = j, i = j + 1; i < n; i++)
+            if (fabs(m[i * n + j]) > fabs(m[pivot * n + j])) pivot = i;
+        if (m[pivot * n + j] == 0.0) return FALSE;
+        for (k = 0; k < n; k++) {
+            swap = m[j * n + k];
+            m[j * n + k] = m[pivot * n + k];
+            m[pivot * n + k] = swap;
+            swap = inverse[j * n + k];
+            inverse[j * n + k] = inverse[pivot * n + k];
+            inverse[pivot * n + k] = swap;
+        }
+        for (i = 0; i < n; i++) {
+            if (i == j) continue;
+            factor = m[i * n + j] / m[j * n + j];
+            for (k = 0; k < n; k++) {
+                m[i * n + k] -= factor * m[j * n + k];
+                inverse[i * n + k] -= factor * inverse[j * n + k];
+            }
+        }
+    }
+    for (i = 0; i < n; i++)
+        for (k = 0; k < n; k++)
+            inverse[i * n + k] /= m[i * n + i];
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routines to evaluate the integral over [0, u] and the value at u of the  *
+* speed polynomial of an interval, by Horner's rule.                         *
+*****************************************************************************/
+static double interval_length(const double *coef, double u)
+{
+    int j;
+    double length = 0.0;
+
+    for (j = CRV_ARCLEN_NODES - 1; j >= 0; j--)
+        length = length * u + coef[j] / (j + 1);
+    return length * u;
+}
+
+static double interval_speed(const double *coef, double u)
+{
+    int j;
+    double speed = 0.0;
+
+    for (j = CRV_ARCLEN_NODES - 1; j >= 0; j--)
+        speed = speed * u + coef[j];
+    return speed;
+}
@@ -0,0 +1,504 @@
+/*****************************************************************************
+*   Module to evaluate the (rational) Bezier and B-spline curves of a scene. *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. int curve_is_valid(scene, curve) - TRUE if the curve can be evaluated.  *
+*    curve_domain(scene, curve, t_start, t_end) - the parameter domain.      *
+* 2. int scene_samples(scene, n_samples, samples_offset) - set per curve     *
+*                  sample offsets, return total number of samples.           *
+*    eval_scene(scene, n_samples, samples_offset, x, y) - evaluate all the   *
+*                  curves at n_samples + 1 uniform parameters, in parallel.  *
+* 3. eval_curve(scene, curve, t, n_t, x, y) - evaluate one curve at the      *
+*                  given parameters.                                         *
+* 4. int curve_pieces(scene, curve) - number of polynomial pieces (spans).   *
+*    int curve_piece(scene, curve, piece, wx, wy, w, t0, t1) - the piece as  *
+*                  a Bezier curve over [t0, t1], returns its points number.  *
+* 5. eval_derivs(scene, curve, t, n_t, c, d1, d2, curvature) - evaluate one  *
+*                  curve and its first two derivatives at given parameters.  *
+*    eval_piece(points, n, s, tmp, c, d1, d2) - the same for a Bezier piece. *
+*                                                                            *
+*   Evaluation is done in homogeneous coordinates, de Casteljau for Bezier   *
+* curves and de Boor for B-spline curves, and then projected (x = wx / w).   *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_LOCAL_POINTS 32       /* Larger curves allocate their scratch */
+
+typedef struct eval_scene_ctx {
+     const crv_scene *scene;
+     int n_samples;
+     const int *samples_offset;
+     float *x, *y;
+} eval_scene_ctx;
+
+static int scratch_size(const crv_scene *scene, int curve);
+static double *get_scratch(int size, double *local);
+static void eval_point(const crv_scene *scene, int curve, double t,
+                       double *scratch, double *x, double *y);
+static int find_span(const double *knots, int order, int n_points, double t);
+static void blossom(const crv_scene *scene, int curve, int span,
+                    const double *args, double *scratch,
+                    double *wx, double *wy, double *w);
+static void eval_scene_task(void *ctx, int begin, int end);
+
+/*****************************************************************************
+*   Routine to test a curve can be evaluated: it must be in the scene, a     *
+* Bezier curve needs at least two control points, and a B-spline curve order *
+* control points, exactly n_points + order knots and a non empty domain.     *
+*****************************************************************************/
+int crv_curve_is_valid(const crv_scene *scene, int curve)
+{
+    int order, n_points, n_knots;
+    const double *knots;
+
+    if (curve < 0 || curve >= scene -> n_curves) return FALSE;
+
+    order = scene -> order[curve];
+    n_points = scene -> points_offset[curve + 1] -
+               scene -> points_offset[curve];
+    n_knots = scene -> knots_offset[curve + 1] - scene -> knots_offset[curve];
+    knots = scene -> knots + scene -> knots_offset[curve];
+
+    if (scene -> kind[curve] == CRV_BEZIER) return n_points >= 2;
+
+    return order >= 1 && n_points >= order && n_knots == n_points + order &&
+           knots[order - 1] < knots[n_points];
+}
+
+/*****************************************************************************
+*   Routine to return the parameter domain of a (valid) curve.               *
+*****************************************************************************/
+void crv_curve_domain(const crv_scene *scene, int curve,
+                      double *t_start, double *t_end)
+{
+    const double *knots = scene -> knots + scene -> knots_offset[curve];
+    int n_points = scene -> points_offset[curve + 1] -
+                   scene -> points_offset[curve];
+
+    if (scene -> kind[curve] == CRV_BEZIER) {
+        *t_start = 0.0;
+        *t_end = 1.0;
+    }
+    else {
+        *t_start = knots[scene -> order[curve] - 1];
+        *t_end = knots[n_points];
+    }
+}
+
+/*****************************************************************************
+*   Routine to compute the offset of every curve samples in a scene samples  *
+* buffer: every valid curve gets n_samples + 1 samples, others none.         *
+* samples_offset has n_curves + 1 entries. Returns the total samples number. *
+*****************************************************************************/
+int crv_scene_samples(const crv_scene *scene, int n_samples,
+                      int *samples_offset)
+{
+    int i;
+
+    samples_offset[0] = 0;
+    for (i = 0; i < scene -> n_curves; i++)
+        samples_offset[i + 1] = samples_offset[i] +
+                     (crv_curve_is_valid(scene, i) ? n_samples + 1 : 0);
+    return samples_offset[scene -> n_curves];
+}
+
+/*****************************************************************************
+*   Routine to evaluate all the scene curves, in parallel over the curves.   *
+* Curve i samples are written to x, y [samples_offset[i], samples_offset[i+1]*
+* ) - as computed by crv_scene_samples - at n_samples + 1 uniform params.    *
+*****************************************************************************/
+void crv_eval_scene(const crv_scene *scene, int n_samples,
+                    const int *samples_offset, float *x, float *y)
+{
+    eval_scene_ctx ctx;
+
+    ctx.scene = scene;
+    ctx.n_samples = n_samples;
+    ctx.samples_offset = samples_offset;
+    ctx.x = x;
+    ctx.y = y;
+    crv_parallel_for(scene -> n_curves, 1, eval_scene_task, &ctx);
+}
+
+/*****************************************************************************
+*   Routine to evaluate one curve at the n_t parameters t. Parameters out of *
+* the domain are clamped to it. An invalid curve (or out of memory)          *
+* evaluates to NaN.                                                          *
+*****************************************************************************/
+void crv_eval_curve(const crv_scene *scene, int curve, const double *t,
+                    int n_t, double *x, double *y)
+{
+    double local[3 * MAX_LOCAL_POINTS], *scratch, t_start, t_end, t_i;
+    int i;
+
+    scratch = crv_curve_is_valid(scene, curve) ?
+              get_scratch(scratch_size(scene, curve), local) : NULL;
+    if (scratch == NULL) {
+        for (i = 0; i < n_t; i++) x[i] = y[i] = NAN;
+        return;
+    }
+    crv_curve_domain(scene, curve, &t_start, &t_end);
+
+    for (i = 0; i < n_t; i++) {
+        t_i = t[i] < t_start ? t_start : t[i] > t_end ? t_end : t[i];
+        eval_point(scene, curve, t_i, scratch, &x[i], &y[i]);
+    }
+
+    if (scratch != local) free(scratch);
+}
+
+/*****************************************************************************
+*   The crv_eval_scene task: evaluate the curves [begin, end).               *
+*****************************************************************************/
+static void eval_scene_task(void *ctx, int begin, int end)
+{
+    eval_scene_ctx *eval_ctx = (eval_scene_ctx *) ctx;
+    const crv_scene *scene = eval_ctx -> scene;
+    double local[3 * MAX_LOCAL_POINTS], *scratch, t_start, t_end, x, y;
+    int i, j, offset, n = eval_ctx -> n_samples;
+
+    for (i = begin; i < end; i++) {
+        offset = eval_ctx -> samples_offset[i];
+        if (eval_ctx -> samples_offset[i + 1] == offset) continue;
+
+        crv_curve_domain(scene, i, &t_start, &t_end);
+        scratch = get_scratch(scratch_size(scene, i), local);
+        if (scratch == NULL) {                           /* Out of memory */
+            for (j = 0; j <= n; j++)
+                eval_ctx -> x[offset + j] = eval_ctx -> y[offset + j] = NAN;
+            continue;
+        }
+        for (j = 0; j <= n; j++) {
+            eval_point(scene, i,
+                       j == n ? t_end : t_start + (t_end - t_start) * j / n,
+                       scratch, &x, &y);
+            eval_ctx -> x[offset + j] = (float) x;
+            eval_ctx -> y[offset + j] = (float) y;
+        }
+        if (scratch != local) free(scratch);
+    }
+}
+
+/*****************************************************************************
+*   Routines to get a scratch area for eval_point: the local (stack) one if  *
+* the curve is small enough, else allocate it - NULL if out of memory.       *
+*****************************************************************************/
+static int scratch_size(const crv_scene *scene, int curve)
+{
+    if (scene -> kind[curve] == CRV_BEZIER)
+        return 3 * (scene -> points_offset[curve + 1] -
+                    scene -> points_offset[curve]);
+    else
+        return 3 * scene -> order[curve];
+}
+
+static double *get_scratch(int size, double *local)
+{
+    if (size <= 3 * MAX_LOCAL_POINTS) return local;
+    return (double *) malloc(size * sizeof(double));
+}
+
+/*****************************************************************************
+*   Routine to evaluate one point of a valid curve, at t inside its domain.  *
+* scratch must hold scratch_size(scene, curve) doubles.                      *
+*****************************************************************************/
+static void eval_point(const crv_scene *scene, int curve, double t,
+                       double *scratch, double *x, double *y)
+{
+    int i, r, k, p, n,
+        first = scene -> points_offset[curve];
+    const double *knots = scene -> knots + scene -> knots_offset[curve];
+    double *dx, *dy, *dw, alpha;
+
+    if (scene -> kind[curve] == CRV_BEZIER) {
+        n = scene -> points_offset[curve + 1] - first;
+        dx = scratch;
+        dy = scratch + n;
+        dw = scratch + 2 * n;
+        for (i = 0; i < n; i++) {
+            dx[i] = scene -> wx[first + i];
+            dy[i] = scene -> wy[first + i];
+            dw[i] = scene -> w[first + i];
+        }
+        for (r = 1; r < n; r++) {                        /* de Casteljau */
+            for (i = 0; i < n - r; i++) {
+                dx[i] += t * (dx[i + 1] - dx[i]);
+                dy[i] += t * (dy[i + 1] - dy[i]);
+                dw[i] += t * (dw[i + 1] - dw[i]);
+            }
+        }
+    }
+    else {
+        p = scene -> order[curve] - 1;                         /* Degree */
+        n = scene -> points_offset[curve + 1] - first;
+        k = find_span(knots, p + 1, n, t);
+        dx = scratch;
+        dy = scratch + p + 1;
+        dw = scratch + 2 * (p + 1);
+        for (i = 0; i <= p; i++) {
+            dx[i] = scene -> wx[first + k - p + i];
+            dy[i] = scene -> wy[first + k - p + i];
+            dw[i] = scene -> w[first + k - p + i];
+        }
+        for (r = 1; r <= p; r++) {                              /* de Boor */
+            for (i = p; i >= r; i--) {
+                alpha = (t - knots[k - p + i]) /
+                        (knots[k + 1 + i - r] - knots[k - p + i]);
+                dx[i] = dx[i - 1] + alpha * (dx[i] - dx[i - 1]);
+                dy[i] = dy[i - 1] + alpha * (dy[i] - dy[i - 1]);
+                dw[i] = dw[i - 1] + alpha * (dw[i] - dw[i - 1]);
+            }
+        }
+        dx += p;
+        dy += p;
+        dw += p;
+    }
+
+    *x = dx[0] / dw[0];
+    *y = dy[0] / dw[0];
+}
+
+/*****************************************************************************
+*   Routine to find the knot span k, order - 1 <= k < n_points, such that    *
+* knots[k] <= t < knots[k + 1]. The domain end is in the last non empty span.*
+*****************************************************************************/
+static int find_span(const double *knots, int order, int n_points, double t)
+{
+    int low = order - 1,
+        high = n_points - 1,
+        middle;
+
+    if (t >= knots[n_points]) {
+        while (high > low && knots[high] == knots[high + 1]) high--;
+        return high;
+    }
+    while (low < high) {                                 /* Binary search */
+        middle = (low + high + 1) / 2;
+        if (knots[middle] <= t)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+/*****************************************************************************
+*   Routine to return the number of pieces of a (valid) curve: 1 for Bezier  *
+* curves, and the number of spans of the domain for B-spline curves (empty   *
+* spans included - crv_curve_piece returns 0 for them).                      *
+*****************************************************************************/
+int crv_curve_pieces(const crv_scene *scene, int curve)
+{
+    if (scene -> kind[curve] == CRV_BEZIER) return 1;
+
+    return scene -> points_offset[curve + 1] - scene -> points_offset[curve] -
+           scene -> order[curve] + 1;
+}
+
+/*****************************************************************************
+*   Routine to extract a piece of a (valid) curve as a Bezier curve of the   *
+* same degree, in homogeneous coordinates, over the parameters [t0, t1].     *
+* wx, wy and w must hold scratch_size / 3 doubles (the Bezier points number, *
+* or the B-spline order). Returns the number of points, 0 for empty spans    *
+* (and out of memory).                                                       *
+*****************************************************************************/
+int crv_curve_piece(const crv_scene *scene, int curve, int piece,
+                    double *wx, double *wy, double *w, double *t0, double *t1)
+{
+    double local[4 * MAX_LOCAL_POINTS], *scratch, *args;
+    const double *knots = scene -> knots + scene -> knots_offset[curve];
+    int i, j,
+        first = scene -> points_offset[curve],
+        order = scene -> order[curve],
+        span = order - 1 + piece;
+
+    if (scene -> kind[curve] == CRV_BEZIER) {
+        for (i = first; i < scene -> points_offset[curve + 1]; i++) {
+            wx[i - first] = scene -> wx[i];
+            wy[i - first] = scene -> wy[i];
+            w[i - first] = scene -> w[i];
+        }
+        *t0 = 0.0;
+        *t1 = 1.0;
+        return i - first;
+    }
+
+    if (knots[span] == knots[span + 1]) return 0;
+
+    if ((scratch = get_scratch(4 * order, local)) == NULL) return 0;
+    args = scratch + 3 * order;
+    for (j = 0; j < order; j++) {
+        /* Bezier point j is the blossom at (t0^(degree - j), t1^j): */
+        for (i = 0; i < order - 1; i++)
+            args[i] = i < j ? knots[span + 1] : knots[span];
+        blossom(scene, curve, span, args, scratch, &wx[j], &wy[j], &w[j]);
+    }
+    if (scratch != local) free(scratch);
+
+    *t0 = knots[span];
+    *t1 = knots[span + 1];
+    return order;
+}
+
+/*****************************************************************************
+*   Routine to evaluate the blossom of span span of a B-spline curve at the  *
+* degree arguments args: de Boor's algorithm with level r using args[r - 1]. *
+* scratch must hold 3 * order doubles.                                       *
+*****************************************************************************/
+static void blossom(const crv_scene *scene, int curve, int span,
+                    const double *args, double *scratch,
+                    double *wx, double *wy, double *w)
+{
+    int i, r,
+        p = scene -> order[curve] - 1,
+        first = scene -> points_offset[curve] + span - p;
+    const double *knots = scene -> knots + scene -> knots_offset[curve];
+    double *dx = scratch,
+           *dy = scratch + p + 1,
+           *dw = scratch + 2 * (p + 1),
+           alpha;
+
+    for (i = 0; i <= p; i++) {
+        dx[i] = scene -> wx[first + i];
+        dy[i] = scene -> wy[first + i];
+        dw[i] = scene -> w[first + i];
+    }
+    for (r = 1; r <= p; r++) {
+        for (i = p; i >= r; i--) {
+            alpha = (args[r - 1] - knots[span - p + i]) /
+                    (knots[span + 1 + i - r] - knots[span - p + i]);
+            dx[i] = dx[i - 1] + alpha * (dx[i] - dx[i - 1]);
+            dy[i] = dy[i - 1] + alpha * (dy[i] - dy[i - 1]);
+            dw[i] = dw[i - 1] + alpha * (dw[i] - dw[i - 1]);
+        }
+    }
+
+    *wx = dx[p];
+    *wy = dy[p];
+    *w = dw[p];
+}
+
+/*****************************************************************************
+*   Routine to evaluate one curve and its first and second derivatives at    *
+* the n_t parameters t (clamped to the domain), and its signed curvature     *
+* (x' y'' - y' x'') / |C'|^3. c, d1 and d2 get n_t (x, y) pairs. A B-spline  *
+* span is extracted as a Bezier piece once for all the parameters in it in   *
+* a row, so sorted parameters cost one extraction per span. One sided (left) *
+* derivatives are given at the domain end, right ones at inner knots. An     *
+* invalid curve (or out of memory) evaluates to NaN.                         *
+*****************************************************************************/
+void crv_eval_derivs(const crv_scene *scene, int curve, const double *t,
+                     int n_t, double *c, double *d1, double *d2,
+                     double *curvature)
+{
+    double local[6 * MAX_LOCAL_POINTS], *points = NULL, t_start, t_end, t_i,
+           t0, t1, scale, speed;
+    const double *knots;
+    int i, size, span, n, n_points,
+        piece_span = -1;
+
+    /* The piece points, then the crv_eval_piece scratch: */
+    if (crv_curve_is_valid(scene, curve))
+        points = get_scratch(2 * scratch_size(scene, curve), local);
+    if (points == NULL) {
+        for (i = 0; i < 2 * n_t; i++) c[i] = d1[i] = d2[i] = NAN;
+        for (i = 0; i < n_t; i++) curvature[i] = NAN;
+        return;
+    }
+    knots = scene -> knots + scene -> knots_offset[curve];
+    n_points = scene -> points_offset[curve + 1] -
+               scene -> points_offset[curve];
+    crv_curve_domain(scene, curve, &t_start, &t_end);
+    size = scratch_size(scene, curve) / 3;
+
+    n = size;
+    t0 = 0.0;
+    t1 = 1.0;
+    if (scene -> kind[curve] == CRV_BEZIER)
+        crv_curve_piece(scene, curve, 0, points, points + size,
+                        points + 2 * size, &t0, &t1);
+
+    for (i = 0; i < n_t; i++) {
+        t_i = t[i] < t_start ? t_start : t[i] > t_end ? t_end : t[i];
+        if (scene -> kind[curve] == CRV_BSPLINE) {
+            span = find_span(knots, size, n_points, t_i);
+            if (span != piece_span) {
+                n = crv_curve_piece(scene, curve, span - size + 1, points,
+                                    points + size, points + 2 * size,
+                                    &t0, &t1);
+                piece_span = span;
+            }
+        }
+
+        crv_eval_piece(points, n, (t_i - t0) / (t1 - t0), points + 3 * size,
+                       &c[2 * i], &d1[2 * i], &d2[2 * i]);
+
+        /* d/dt = d/ds / (t1 - t0): */
+        scale = 1.0 / (t1 - t0);
+        d1[2 * i] *= scale;
+        d1[2 * i + 1] *= scale;
+        d2[2 * i] *= scale * scale;
+        d2[2 * i + 1] *= scale * scale;
+
+        speed = hypot(d1[2 * i], d1[2 * i + 1]);
+        curvature[i] = (d1[2 * i] * d2[2 * i + 1] -
+                        d1[2 * i + 1] * d2[2 * i]) / (speed * speed * speed);
+    }
+
+    if (points != local) free(points);
+}
+
+/*****************************************************************************
+*   Routine to evaluate a rational Bezier piece of n homogeneous points      *
+* (wx[n], wy[n], w[n] in points) and its first and second derivatives at s,  *
+* by de Casteljau's algorithm down to a quadratic and the quotient rule.     *
+* c, d1 and d2 get (x, y) pairs. tmp must hold 3 * n doubles.                *
+*****************************************************************************/
+void crv_eval_piece(const double *points, int n, double s, double *tmp,
+                    double *c, double *d1, double *d2)
+{
+    int i, r, k,
+        degree = n - 1;
+    double a[3], a1[3], a2[3], *q;
+
+    for (k = 0; k < 3; k++) {
+        q = tmp + k * n;
+        for (i = 0; i < n; i++)
+            q[i] = points[k * n + i];
+
+        /* Down to 3 points, then a quadratic in q[0..2]: */
+        for (r = 1; r < degree - 1; r++)
+            for (i = 0; i < n - r; i++)
+                q[i] += s * (q[i + 1] - q[i]);
+
+        if (degree >= 2) {
+            a[k] = (1 - s) * (1 - s) * q[0] + 2 * s * (1 - s) * q[1] +
+                   s * s * q[2];
+            a1[k] = degree * ((1 - s) * (q[1] - q[0]) + s * (q[2] - q[1]));
+            a2[k] = degree * (degree - 1) * (q[2] - 2 * q[1] + q[0]);
+        }
+        else if (degree == 1) {
+            a[k] = q[0] + s * (q[1] - q[0]);
+            a1[k] = q[1] - q[0];
+            a2[k] = 0.0;
+        }
+        else {
+            a[k] = q[0];
+            a1[k] = a2[k] = 0.0;
+        }
+    }
+
+    /* C = A / w, C' = (A' - w' C) / w, C'' = (A'' - 2 w' C' - w'' C) / w: */
+    for (k = 0; k < 2; k++) {
+        c[k] = a[k] / a[2];
+        d1[k] = (a1[k] - a1[2] * c[k]) / a[2];
+        d2[k] = (a2[k] - 2 * a1[2] * d1[k] - a2[2] * c[k]) / a[2];
+    }
+}
@@ -0,0 +1,276 @@
+/*****************************************************************************
+*   Module to flatten the curves of a scene into polylines, adaptively.      *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_polyline *flatten_scene(scene, tolerance) - flatten all the curves, *
+*                  in parallel over the curves.                              *
+* 2. free_polyline(polyline)    - release memory allocated for a polyline.   *
+*                                                                            *
+*   Every piece of a curve (the Bezier curve, or every span of a B-spline    *
+* curve extracted as a Bezier curve) is recursively subdivided at its        *
+* middle parameter until its control polygon is within tolerance of its      *
+* chord. The polyline vertices are then the end points of the pieces - all   *
+* exactly on the curve - together with their parameters.                     *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_DEPTH        20             /* At most 2^20 segments per piece */
+#define  INITIAL_CAPACITY 64
+
+typedef struct flat_curve {                   /* One curve polyline output */
+     int n_vertices, capacity;
+     float *x, *y;
+     double *t;
+} flat_curve;
+
+typedef struct flatten_ctx {
+     const crv_scene *scene;
+     double tolerance;
+     flat_curve *curves;
+     int failed;            /* An allocation failed (or cancelled), if set */
+} flatten_ctx;
+
+static void flatten_task(void *ctx, int begin, int end);
+static int flatten_piece(flat_curve *curve, const double *points, int n,
+                         double *scratch, double t0, double t1,
+                         double tolerance, int depth);
+static int is_flat(const double *points, int n, double tolerance);
+static int push_vertex(flat_curve *curve, double x, double y, double t);
+
+/*****************************************************************************
+*   Routine to flatten all the scene curves to polylines that are within     *
+* tolerance of the curves. Curves that can not be evaluated get no vertices. *
+* Returns NULL if out of memory, or if the job running it was cancelled      *
+* (see crv_job_cancelled).                                                   *
+*****************************************************************************/
+crv_polyline *crv_flatten_scene(const crv_scene *scene, double tolerance)
+{
+    int i, j, n;
+    flatten_ctx ctx;
+    crv_polyline *polyline;
+
+    ctx.scene = scene;
+    ctx.tolerance = tolerance;
+    ctx.failed = FALSE;
+    ctx.curves = (flat_curve *) calloc(scene -> n_curves + 1,
+                                       sizeof(flat_curve));
+    if (ctx.curves == NULL) return NULL;
+
+    crv_parallel_for(scene -> n_curves, 1, flatten_task, &ctx);
+
+    polyline = (crv_polyline *) calloc(1, sizeof(crv_polyline));
+    if (polyline != NULL && !ctx.failed) {
+        polyline -> n_curves = scene -> n_curves;
+        polyline -> vertices_offset = (int *) malloc((scene -> n_curves + 1) *
+                                                     sizeof(int));
+        if (polyline -> vertices_offset != NULL) {
+            polyline -> vertices_offset[0] = 0;
+            for (i = 0; i < scene -> n_curves; i++)
+                polyline -> vertices_offset[i + 1] =
+                    polyline -> vertices_offset[i] + ctx.curves[i].n_vertices;
+            n = polyline -> n_vertices =
+                polyline -> vertices_offset[scene -> n_curves];
+            polyline -> x = (float *) malloc((n + 1) * sizeof(float));
+            polyline -> y = (float *) malloc((n + 1) * sizeof(float));
+            polyline -> t = (double *) malloc((n + 1) * sizeof(double));
+        }
+    }
+
+    if (polyline == NULL || ctx.failed || polyline -> vertices_offset == NULL ||
+        polyline -> x == NULL || polyline -> y == NULL || polyline -> t == NULL) {
+        crv_free_polyline(polyline);
+        polyline = NULL;
+    }
+    else {
+        for (i = 0; i < scene -> n_curves; i++) {
+            n = polyline -> vertices_offset[i];
+            for (j = 0; j < ctx.curves[i].n_vertices; j++) {
+                polyline -> x[n + j] = ctx.curves[i].x[j];
+                polyline -> y[n + j] = ctx.curves[i].y[j];
+                polyline -> t[n + j] = ctx.curves[i].t[j];
+            }
+        }
+    }
+
+    for (i = 0; i < scene -> n_curves; i++) {
+        free(ctx.curves[i].x);
+        free(ctx.curves[i].y);
+        free(ctx.curves[i].t);
+    }
+    free(ctx.curves);
+    return polyline;
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for a polyline.                      *
+*****************************************************************************/
+void crv_free_polyline(crv_polyline *polyline)
+{
+    if (polyline == NULL) return;
+
+    free(polyline -> vertices_offset);
+    free(polyline -> x);
+    free(polyline -> y);
+    free(polyline -> t);
+    free(polyline);
+}
+
+/*****************************************************************************
+*   The crv_flatten_scene task: flatten the curves [begin, end), each to its *
+* own flat_curve.                                                            *
+*****************************************************************************/
+static void flatten_task(void *ctx, int begin, int end)
+{
+    flatten_ctx *flat_ctx = (flatten_ctx *) ctx;
+    const crv_scene *scene = flat_ctx -> scene;
+    int i, j, n, size, first;
+    double *points, t0, t1;
+    flat_curve *curve;
+
+    for (i = begin; i < end && !flat_ctx -> failed; i++) {
+        if (!crv_curve_is_valid(scene, i)) continue;
+
+        curve = &flat_ctx -> curves[i];
+        size = scene -> kind[i] == CRV_BEZIER ?
+                   scene -> points_offset[i + 1] - scene -> points_offset[i] :
+                   scene -> order[i];
+
+        /* The piece points, then 2 (left, right) of them per depth level: */
+        points = (double *) malloc(3 * size * (2 * MAX_DEPTH + 1) *
+                                   sizeof(double));
+        if (points == NULL) {
+            flat_ctx -> failed = TRUE;
+            return;
+        }
+
+        first = TRUE;
+        for (j = 0; j < crv_curve_pieces(scene, i); j++) {
+            n = crv_curve_piece(scene, i, j, points, points + size,
+                                points + 2 * size, &t0, &t1);
+            if (n == 0) continue;
+
+            if (first) {
+                first = FALSE;
+                if (!push_vertex(curve, points[0] / points[2 * size],
+                                 points[size] / points[2 * size], t0)) {
+                    flat_ctx -> failed = TRUE;
+                    break;
+                }
+            }
+            if (!flatten_piece(curve, points, size, points + 3 * size, t0, t1,
+                               flat_ctx -> tolerance, 0)) {
+                flat_ctx -> failed = TRUE;
+                break;
+            }
+        }
+
+        free(points);
+    }
+}
+
+/*****************************************************************************
+*   Routine to flatten one Bezier piece of n homogeneous points (wx[n],      *
+* wy[n], w[n] in points) over [t0, t1], pushing all its vertices but the     *
+* first. Depth level d keeps its two halves at scratch + 6 * n * d, so       *
+* scratch must hold 6 * n * MAX_DEPTH doubles. FALSE if out of memory, or if *
+* the job running it was cancelled.                                          *
+*****************************************************************************/
+static int flatten_piece(flat_curve *curve, const double *points, int n,
+                         double *scratch, double t0, double t1,
+                         double tolerance, int depth)
+{
+    int i, r, c;
+    double *left = scratch + 6 * n * depth,
+           *right = left + 3 * n;
+
+    if (crv_job_cancelled()) return FALSE;
+
+    if (depth >= MAX_DEPTH || is_flat(points, n, tolerance))
+        return push_vertex(curve, points[n - 1] / points[3 * n - 1],
+                           points[2 * n - 1] / points[3 * n - 1], t1);
+
+    /* Subdivide at the middle, de Casteljau - right is the last diagonal: */
+    for (c = 0; c < 3; c++) {
+        for (i = 0; i < n; i++)
+            right[c * n + i] = points[c * n + i];
+        left[c * n] = right[c * n];
+        for (r = 1; r < n; r++) {
+            for (i = 0; i < n - r; i++)
+                right[c * n + i] = 0.5 * (right[c * n + i] +
+                                          right[c * n + i + 1]);
+            left[c * n + r] = right[c * n];
+        }
+    }
+
+    return flatten_piece(curve, left, n, scratch, t0, 0.5 * (t0 + t1),
+                         tolerance, depth + 1) &&
+           flatten_piece(curve, right, n, scratch, 0.5 * (t0 + t1), t1,
+                         tolerance, depth + 1);
+}
+
+/*****************************************************************************
+*   Routine to test if a Bezier piece (as in flatten_piece) is flat: all its *
+* projected control points are within tolerance of its chord segment. With   *
+* positive weights the piece is in the control polygon convex hull, so the   *
+* chord error is below tolerance as well.                                    *
+*****************************************************************************/
+static int is_flat(const double *points, int n, double tolerance)
+{
+    int i;
+    const double *wx = points,
+                 *wy = points + n,
+                 *w = points + 2 * n;
+    double x0 = wx[0] / w[0],
+           y0 = wy[0] / w[0],
+           dx = wx[n - 1] / w[n - 1] - x0,
+           dy = wy[n - 1] / w[n - 1] - y0,
+           length2 = dx * dx + dy * dy,
+           px, py, s;
+
+    for (i = 1; i < n - 1; i++) {
+        px = wx[i] / w[i] - x0;
+        py = wy[i] / w[i] - y0;
+        s = length2 > 0.0 ? (px * dx + py * dy) / length2 : 0.0;
+        s = s < 0.0 ? 0.0 : s > 1.0 ? 1.0 : s;
+        px -= s * dx;
+        py -= s * dy;
+        if (!(px * px + py * py <= tolerance * tolerance))   /* NaN - FALSE */
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to append a vertex to a curve polyline. FALSE if out of memory.  *
+*****************************************************************************/
+static int push_vertex(flat_curve *curve, double x, double y, double t)
+{
+    int capacity;
+    float *new_x, *new_y;
+    double *new_t;
+
+    if (curve -> n_vertices == curve -> capacity) {
+        capacity = curve -> capacity == 0 ? INITIAL_CAPACITY :
+                                            2 * curve -> capacity;
+        new_x = (float *) realloc(curve -> x, capacity * sizeof(float));
+        if (new_x != NULL) curve -> x = new_x;
+        new_y = (float *) realloc(curve -> y, capacity * sizeof(float));
+        if (new_y != NULL) curve -> y = new_y;
+        new_t = (double *) realloc(curve -> t, capacity * sizeof(double));
+        if (new_t != NULL) curve -> t = new_t;
+        if (new_x == NULL || new_y == NULL || new_t == NULL) return FALSE;
+        curve -> capacity = capacity;
+    }
+
+    curve -> x[curve -> n_vertices] = (float) x;
+    curve -> y[curve -> n_vertices] = (float) y;
+    curve -> t[curve -> n_vertices++] = t;
+    return TRUE;
+}
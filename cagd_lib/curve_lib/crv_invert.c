@@ -0,0 +1,310 @@
+/*****************************************************************************
+*   Module of point inversion - the closest point on a curve to a location.  *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. double closest_point(scene, curve, x, y, max_dist, t, cx, cy) - the     *
+*                  closest point of one curve, its parameter and distance.   *
+* 2. int closest_curve(scene, x, y, max_dist, t, dist) - the closest curve   *
+*                  of the scene, and its closest point parameter.            *
+*                                                                            *
+*   Every Bezier piece of the curve (as in crv_flat.c) is subdivided while   *
+* the bounding box of its control polygon may hold points nearer than the    *
+* nearest point found yet, until its hodograph is in a narrow cone about its *
+* chord. The leaf is then sampled for sign changes of (C(t) - P) . C'(t),    *
+* and Newton iterations, safeguarded by bisection, refine every minimum so   *
+* bracketed - from the projection of P on the chord where it is inside.      *
+* Positive weights are assumed - the pruning relies on the convex hull.      *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_DEPTH        16
+#define  STRAIGHT_RATIO   0.05   /* Leaf weights apart by less */
+#define  CONE_RATIO       0.2    /* Leaf hodograph off its chord by less */
+#define  LEAF_SAMPLES        2   /* Intervals a leaf brackets minima in */
+#define  MAX_ITERATIONS     64
+#define  ITERATIONS_EPSILON 1e-14
+
+typedef struct invert_ctx {
+     double x, y;                                       /* The location P */
+     int n;                                  /* Points of the Bezier piece */
+     double *scratch;               /* Halves of every depth, see search */
+     double *tmp;                             /* 3 * n, for crv_eval_piece */
+     double best;                        /* Distance to nearest point yet */
+     double best_s;          /* Its parameter in the searched piece [0, 1] */
+     double best_x, best_y;
+} invert_ctx;
+
+static void search_piece(invert_ctx *ctx, const double *points, double s0,
+                         double s1, int depth);
+static int is_straight(const double *points, int n);
+static double box_dist(const double *points, int n, double x, double y);
+static void refine_leaf(invert_ctx *ctx, const double *points, double s0,
+                        double s1);
+static void leaf_point(invert_ctx *ctx, const double *points, double s,
+                       double s0, double s1, double *f, double *df);
+
+/*****************************************************************************
+*   Routine to find the point of curve number curve closest to (x, y). Sets  *
+* its parameter t and location cx, cy and returns its distance. Returns      *
+* INFINITY (t etc. unset) if the curve is invalid or is farther than         *
+* max_dist (INFINITY for no limit), or if out of memory.                     *
+*****************************************************************************/
+double crv_closest_point(const crv_scene *scene, int curve, double x,
+                         double y, double max_dist, double *t, double *cx,
+                         double *cy)
+{
+    int j, size,
+        found = FALSE;
+    double *points, t0, t1;
+    invert_ctx ctx;
+
+    if (!crv_curve_is_valid(scene, curve)) return INFINITY;
+
+    size = scene -> kind[curve] == CRV_BEZIER ?
+               scene -> points_offset[curve + 1] -
+                   scene -> points_offset[curve] :
+               scene -> order[curve];
+
+    /* Piece points, 2 halves per depth level, then crv_eval_piece scratch: */
+    points = (double *) malloc(3 * size * (2 * MAX_DEPTH + 2) *
+                               sizeof(double));
+    if (points == NULL) return INFINITY;
+
+    ctx.x = x;
+    ctx.y = y;
+    ctx.n = size;
+    ctx.scratch = points + 3 * size;
+    ctx.tmp = ctx.scratch + 6 * size * MAX_DEPTH;
+    ctx.best = max_dist;
+
+    for (j = 0; j < crv_curve_pieces(scene, curve); j++) {
+        if (crv_curve_piece(scene, curve, j, points, points + size,
+                            points + 2 * size, &t0, &t1) == 0)
+            continue;
+
+        ctx.best_s = -1.0;
+        search_piece(&ctx, points, 0.0, 1.0, 0);
+        if (ctx.best_s >= 0.0) {               /* Found a nearer point here */
+            found = TRUE;
+            *t = t0 + ctx.best_s * (t1 - t0);
+            *cx = ctx.best_x;
+            *cy = ctx.best_y;
+        }
+    }
+
+    free(points);
+    return found ? ctx.best : INFINITY;
+}
+
+/*****************************************************************************
+*   Routine to find the curve of the scene closest to (x, y), within         *
+* max_dist. Returns the curve number, or -1 if none, and sets t to its       *
+* closest point parameter and dist to the distance.                          *
+*****************************************************************************/
+int crv_closest_curve(const crv_scene *scene, double x, double y,
+                      double max_dist, double *t, double *dist)
+{
+    int i,
+        nearest = -1;
+    double d, t_i, cx, cy;
+
+    for (i = 0; i < scene -> n_curves; i++) {
+        /* Nearer curves only, so farther ones are pruned at the top: */
+        d = crv_closest_point(scene, i, x, y, max_dist, &t_i, &cx, &cy);
+        if (d != INFINITY) {
+            max_dist = d;
+            nearest = i;
+            *t = t_i;
+            *dist = d;
+        }
+    }
+    return nearest;
+}
+
+/*****************************************************************************
+*   Routine to search the part [s0, s1] of the piece, given as its own       *
+* Bezier points (as in crv_flat.c), for points nearer than ctx -> best.      *
+* Depth level d keeps its two halves at ctx -> scratch + 6 * n * d.          *
+*****************************************************************************/
+static void search_piece(invert_ctx *ctx, const double *points, double s0,
+                         double s1, int depth)
+{
+    int i, r, c,
+        n = ctx -> n;
+    double *left = ctx -> scratch + 6 * n * depth,
+           *right = left + 3 * n;
+
+    if (box_dist(points, n, ctx -> x, ctx -> y) >= ctx -> best) return;
+
+    if (depth >= MAX_DEPTH || is_straight(points, n)) {
+        refine_leaf(ctx, points, s0, s1);
+        return;
+    }
+
+    for (c = 0; c < 3; c++) {                /* Subdivide at the middle */
+        for (i = 0; i < n; i++)
+            right[c * n + i] = points[c * n + i];
+        left[c * n] = right[c * n];
+        for (r = 1; r < n; r++) {
+            for (i = 0; i < n - r; i++)
+                right[c * n + i] = 0.5 * (right[c * n + i] +
+                                          right[c * n + i + 1]);
+            left[c * n + r] = right[c * n];
+        }
+    }
+
+    /* Nearer half first, so the farther one is more likely pruned: */
+    if (box_dist(left, n, ctx -> x, ctx -> y) <=
+        box_dist(right, n, ctx -> x, ctx -> y)) {
+        search_piece(ctx, left, s0, 0.5 * (s0 + s1), depth + 1);
+        search_piece(ctx, right, 0.5 * (s0 + s1), s1, depth + 1);
+    }
+    else {
+        search_piece(ctx, right, 0.5 * (s0 + s1), s1, depth + 1);
+        search_piece(ctx, left, s0, 0.5 * (s0 + s1), depth + 1);
+    }
+}
+
+/*****************************************************************************
+*   Routine to find the point of a leaf closest to P, in the leaf own [0, 1] *
+* parameter: f(s) = (C(s) - P) . C'(s) is sampled at LEAF_SAMPLES + 1 points *
+* (candidates themselves), and every root of f it brackets from below - a    *
+* minimum, even where the end points do not bracket one - is found by        *
+* Newton iterations, falling back to bisection (safeguarded).                *
+*****************************************************************************/
+static void refine_leaf(invert_ctx *ctx, const double *points, double s0,
+                        double s1)
+{
+    int i, k,
+        n = ctx -> n;
+    double f, df, f_a, f_b, dx, dy, length2, s_next, a, b, s,
+           x0 = points[0] / points[2 * n],
+           y0 = points[n] / points[2 * n],
+           s_chord = 0.5;
+
+    dx = points[n - 1] / points[3 * n - 1] - x0;
+    dy = points[2 * n - 1] / points[3 * n - 1] - y0;
+    length2 = dx * dx + dy * dy;
+    if (length2 > 0.0)     /* Projection of P on the chord, a Newton start */
+        s_chord = ((ctx -> x - x0) * dx + (ctx -> y - y0) * dy) / length2;
+
+    leaf_point(ctx, points, 0.0, s0, s1, &f_b, &df);
+    for (k = 1; k <= LEAF_SAMPLES; k++) {
+        f_a = f_b;
+        a = (double) (k - 1) / LEAF_SAMPLES;
+        b = (double) k / LEAF_SAMPLES;
+        leaf_point(ctx, points, b, s0, s1, &f_b, &df);
+        if (!(f_a <= 0.0 && f_b >= 0.0) || (f_a == 0.0 && f_b == 0.0))
+            continue;                         /* No minimum inside [a, b] */
+
+        s = s_chord > a && s_chord < b ? s_chord : 0.5 * (a + b);
+        for (i = 0; i < MAX_ITERATIONS; i++) {
+            leaf_point(ctx, points, s, s0, s1, &f, &df);
+            if (f == 0.0) break;
+            if (f < 0.0)
+                a = s;
+            else
+                b = s;
+
+            s_next = df > 0.0 ? s - f / df : a - 1.0;
+            if (!(s_next > a && s_next < b))
+                s_next = 0.5 * (a + b);
+            if (fabs(s_next - s) < ITERATIONS_EPSILON) break;
+            s = s_next;
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to evaluate a leaf at s: makes it the nearest point if it is,    *
+* and sets f (see refine_leaf) and its derivative df.                        *
+*****************************************************************************/
+static void leaf_point(invert_ctx *ctx, const double *points, double s,
+                       double s0, double s1, double *f, double *df)
+{
+    double c[2], d1[2], d2[2], d;
+
+    crv_eval_piece(points, ctx -> n, s, ctx -> tmp, c, d1, d2);
+    *f = (c[0] - ctx -> x) * d1[0] + (c[1] - ctx -> y) * d1[1];
+    *df = (c[0] - ctx -> x) * d2[0] + (c[1] - ctx -> y) * d2[1] +
+          d1[0] * d1[0] + d1[1] * d1[1];
+
+    d = hypot(c[0] - ctx -> x, c[1] - ctx -> y);
+    if (d <= ctx -> best) {
+        ctx -> best = d;
+        ctx -> best_s = s0 + s * (s1 - s0);
+        ctx -> best_x = c[0];
+        ctx -> best_y = c[1];
+    }
+}
+
+/*****************************************************************************
+*   Routine to test if a piece is a leaf: the differences of its projected   *
+* control points (its hodograph, up to the degree, with the weights within   *
+* STRAIGHT_RATIO of each other) point along the chord, off it by less than   *
+* CONE_RATIO. The curve then runs forward along the chord, so f of           *
+* refine_leaf does not turn back - a polygon merely close to the chord may   *
+* still turn at its ends, where a nonuniform parametrization crawls.         *
+*****************************************************************************/
+static int is_straight(const double *points, int n)
+{
+    int i;
+    const double *wx = points,
+                 *wy = points + n,
+                 *w = points + 2 * n;
+    double dx = wx[n - 1] / w[n - 1] - wx[0] / w[0],
+           dy = wy[n - 1] / w[n - 1] - wy[0] / w[0],
+           w_min = w[0],
+           w_max = w[0],
+           ex, ey, along, across;
+
+    if (!(dx * dx + dy * dy > 0.0)) return FALSE;
+
+    for (i = 1; i < n; i++) {
+        w_min = w[i] < w_min ? w[i] : w_min;
+        w_max = w[i] > w_max ? w[i] : w_max;
+    }
+    if (!(w_max <= w_min * (1.0 + STRAIGHT_RATIO))) return FALSE;
+
+    for (i = 1; i < n; i++) {        /* Every hodograph point in the cone */
+        ex = wx[i] / w[i] - wx[i - 1] / w[i - 1];
+        ey = wy[i] / w[i] - wy[i - 1] / w[i - 1];
+        along = ex * dx + ey * dy;
+        across = ex * dy - ey * dx;
+        if (!(along >= 0.0 && fabs(across) <= CONE_RATIO * along))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to return the distance from (x, y) to the bounding box of the    *
+* projected control points of a piece - a lower bound of its distance.       *
+*****************************************************************************/
+static double box_dist(const double *points, int n, double x, double y)
+{
+    int i;
+    double px, py, dx, dy,
+           x_min = INFINITY, y_min = INFINITY,
+           x_max = -INFINITY, y_max = -INFINITY;
+
+    for (i = 0; i < n; i++) {
+        px = points[i] / points[2 * n + i];
+        py = points[n + i] / points[2 * n + i];
+        x_min = px < x_min ? px : x_min;
+        x_max = px > x_max ? px : x_max;
+        y_min = py < y_min ? py : y_min;
+        y_max = py > y_max ? py : y_max;
+    }
+
+    dx = x < x_min ? x_min - x : x > x_max ? x - x_max : 0.0;
+    dy = y < y_min ? y_min - y : y > y_max ? y - y_max : 0.0;
+    return hypot(dx, dy);
+}
@@ -0,0 +1,883 @@
+/*****************************************************************************
+*   Module to load curve scenes (Bezier and B-spline curves) from files.     *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_scene *load_dat(path)  - map the .dat file and parse it.            *
+*    crv_scene *parse_dat(buf, len) - parse a .dat file already in memory.   *
+*    int ioerror()              - return error number (curvelib.h), 0 o.k.   *
+*    int ioerror_line()         - line number the last error was found at.   *
+*    set_ioerror(error, line)   - set them (for loaders of other modules).   *
+*    int save_dat(scene, path)  - write the scene as a .dat file.            *
+* 2. crv_scene *load_scene(path) - map a binary .crvs scene, no parsing.     *
+*    int save_scene(scene, path) - write the scene as a binary .crvs file.   *
+* 3. crv_scene *alloc_scene()   - returns a new empty scene.                 *
+*    crv_scene *copy_scene(scene) - returns a new (owned) copy of a scene.   *
+*    free_scene(scene)          - release memory allocated for the scene.    *
+* 4. map_file(path, len) / unmap_file(buf, len) - read only file mapping.    *
+*                                                                            *
+*   The .dat grammar (blank lines and lines starting with # are ignored):    *
+* FILE    ::= CURVE*                                                         *
+* CURVE   ::= ORDER POINT^ORDER                              (Bezier curve)  *
+*          |  ORDER KNOTS POINT*                           (B-spline curve)  *
+* KNOTS   ::= knots[N] = NUMBER*   (N numbers, may span over several lines)  *
+* POINT   ::= NUMBER NUMBER | NUMBER NUMBER NUMBER         (x y | wx wy w)   *
+*                                                                            *
+*   The file is scanned in place - no lines are copied, only the numbers     *
+* themselves are converted, directly into the scene arrays.                  *
+*                                                                            *
+*   The binary .crvs file is the crv_scene arrays, each in its own section   *
+* aligned to CRV_SCENE_ALIGN bytes, after a crv_scene_header. Loading it     *
+* only validates the header and offsets - the arrays are used in place.      *
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_NUMBER_LEN   63
+#define  INITIAL_CAPACITY 16
+
+#define  IS_SPACE(c)  ((c) == ' ' || (c) == '\t' || (c) == '\r' || \
+                       (c) == '\v' || (c) == '\f')
+
+#define  N_SCENE_SECTIONS 8
+
+typedef struct crv_scene_header {
+     char magic[8];                                      /* CRV_SCENE_MAGIC */
+     uint32_t byte_order;                           /* CRV_SCENE_BYTE_ORDER */
+     uint32_t version;
+     uint32_t header_size;
+     uint32_t n_curves;
+     uint32_t n_knots;
+     uint32_t n_points;
+     uint64_t sections[N_SCENE_SECTIONS];    /* File offset of every array */
+} crv_scene_header;
+
+enum {                                      /* Order of the scene sections */
+     SECTION_KIND,
+     SECTION_ORDER,
+     SECTION_KNOTS_OFFSET,
+     SECTION_POINTS_OFFSET,
+     SECTION_KNOTS,
+     SECTION_WX,
+     SECTION_WY,
+     SECTION_W
+};
+
+typedef struct dat_reader {
+     const char *next, *end;        /* Not yet scanned part of the buffer */
+     const char *line, *line_end;               /* Current line (no EOL) */
+     int line_number;
+} dat_reader;
+
+static int glbl_io_error;                  /* Globals used by the loaders */
+static int glbl_io_error_line;
+
+static int next_line(dat_reader *reader);
+static const char *next_token(const char **s, const char *end);
+static int count_tokens(const char *s, const char *end);
+static int parse_double(const char *s, const char *end, double *data);
+static int parse_int(const char *s, const char *end, int *data);
+static int reserve_curves(crv_scene *scene, int n_curves);
+static int reserve_knots(crv_scene *scene, int n_knots);
+static int reserve_points(crv_scene *scene, int n_points);
+static int begin_curve(crv_scene *scene, int kind, int order);
+static void end_curve(crv_scene *scene);
+static int push_knots(crv_scene *scene, const char *s, const char *end,
+                      int n_knots);
+static int push_point(crv_scene *scene, const char *s, const char *end);
+static crv_scene *parse_error(crv_scene *scene, dat_reader *reader, int error);
+static void scene_sections(const crv_scene *scene, void *arrays[],
+                           size_t sizes[]);
+static int check_scene_offsets(const crv_scene *scene);
+static int write_padding(FILE *f, long position);
+
+/*****************************************************************************
+*   Routine to map a whole file to memory, read only. Returns NULL if the    *
+* file could not be opened. An empty file is mapped to an empty string.      *
+*****************************************************************************/
+const char *crv_map_file(const char *path, size_t *len)
+{
+#ifdef _WIN32
+    HANDLE file, mapping;
+    LARGE_INTEGER size;
+    const char *buf;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return NULL;
+    }
+    *len = (size_t) size.QuadPart;
+    if (*len == 0) {
+        CloseHandle(file);
+        return "";
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    buf = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);            /* The view keeps the mapping alive */
+    return buf;
+#else
+    int fd;
+    struct stat st;
+    void *buf;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    *len = (size_t) st.st_size;
+    if (*len == 0) {
+        close(fd);
+        return "";
+    }
+    buf = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);                          /* The mapping keeps the file open */
+    if (buf == MAP_FAILED) return NULL;
+#ifdef MADV_SEQUENTIAL
+    (void) madvise(buf, *len, MADV_SEQUENTIAL);
+#endif
+    return (const char *) buf;
+#endif
+}
+
+/*****************************************************************************
+*   Routine to release a mapping returned by crv_map_file.                   *
+*****************************************************************************/
+void crv_unmap_file(const char *buf, size_t len)
+{
+    if (buf == NULL || len == 0) return;
+#ifdef _WIN32
+    UnmapViewOfFile(buf);
+#else
+    munmap((void *) buf, len);
+#endif
+}
+
+/*****************************************************************************
+*   Routine to allocate a new empty scene. Returns NULL if out of memory.    *
+*****************************************************************************/
+crv_scene *crv_alloc_scene(void)
+{
+    crv_scene *scene = (crv_scene *) calloc(1, sizeof(crv_scene));
+
+    if (scene == NULL) return NULL;
+    if (!reserve_curves(scene, INITIAL_CAPACITY) ||
+        !reserve_knots(scene, INITIAL_CAPACITY) ||
+        !reserve_points(scene, INITIAL_CAPACITY)) {
+        crv_free_scene(scene);
+        return NULL;
+    }
+    scene -> knots_offset[0] = scene -> points_offset[0] = 0;
+    return scene;
+}
+
+/*****************************************************************************
+*   Routine to free a scene - release all memory allocated by it.            *
+*****************************************************************************/
+void crv_free_scene(crv_scene *scene)
+{
+    if (!scene) return;
+    if (scene -> mapping != NULL) {        /* Arrays are in the mapping */
+        crv_unmap_file(scene -> mapping, scene -> mapping_len);
+        free(scene);
+        return;
+    }
+    free(scene -> kind);
+    free(scene -> order);
+    free(scene -> knots_offset);
+    free(scene -> points_offset);
+    free(scene -> knots);
+    free(scene -> wx);
+    free(scene -> wy);
+    free(scene -> w);
+    free(scene);
+}
+
+/*****************************************************************************
+*   Routine to create a new copy of a given scene, owning its arrays.        *
+* Returns NULL if out of memory.                                             *
+*****************************************************************************/
+crv_scene *crv_copy_scene(const crv_scene *scene)
+{
+    crv_scene *copy;
+    void *arrays[N_SCENE_SECTIONS], *copy_arrays[N_SCENE_SECTIONS];
+    size_t sizes[N_SCENE_SECTIONS];
+    int i;
+
+    if ((copy = crv_alloc_scene()) == NULL) return NULL;
+    if (!reserve_curves(copy, scene -> n_curves) ||
+        !reserve_knots(copy, scene -> n_knots) ||
+        !reserve_points(copy, scene -> n_points)) {
+        crv_free_scene(copy);
+        return NULL;
+    }
+    copy -> n_curves = scene -> n_curves;
+    copy -> n_knots = scene -> n_knots;
+    copy -> n_points = scene -> n_points;
+
+    scene_sections(scene, arrays, sizes);
+    scene_sections(copy, copy_arrays, NULL);
+    for (i = 0; i < N_SCENE_SECTIONS; i++)
+        if (sizes[i] > 0) memcpy(copy_arrays[i], arrays[i], sizes[i]);
+    return copy;
+}
+
+/*****************************************************************************
+*   Routine to load a .dat file into a new scene. The file is mapped to      *
+* memory and parsed in place.                                                *
+* Returns NULL if an error was found, and error is in crv_ioerror()          *
+*****************************************************************************/
+crv_scene *crv_load_dat(const char *path)
+{
+    const char *buf;
+    size_t len = 0;
+    crv_scene *scene;
+
+    if ((buf = crv_map_file(path, &len)) == NULL) {
+        glbl_io_error = CRV_OPEN_ERROR;
+        glbl_io_error_line = 0;
+        return NULL;
+    }
+    scene = crv_parse_dat(buf, len);
+    crv_unmap_file(buf, len);
+    return scene;
+}
+
+/*****************************************************************************
+*   Routine to parse a .dat file held in buf (need not be NULL terminated).  *
+* See the grammar above. Returns NULL if an error was found, and error is    *
+* in crv_ioerror(), the line it was found at in crv_ioerror_line().          *
+*****************************************************************************/
+crv_scene *crv_parse_dat(const char *buf, size_t len)
+{
+    int order, n_knots;
+    const char *s, *token, *open_bracket, *close_bracket, *equal;
+    dat_reader reader;
+    crv_scene *scene;
+
+    glbl_io_error = glbl_io_error_line = 0;
+    reader.next = buf;
+    reader.end = buf + len;
+    reader.line_number = 0;
+
+    if ((scene = crv_alloc_scene()) == NULL)
+        return parse_error(scene, &reader, CRV_ALLOC_ERROR);
+    if (!next_line(&reader)) return scene;       /* An empty file is fine */
+
+    while (TRUE) {
+        /* Every curve starts with its order, alone on its line: */
+        s = reader.line;
+        if (count_tokens(reader.line, reader.line_end) != 1 ||
+            (token = next_token(&s, reader.line_end)) == NULL ||
+            !parse_int(token, s, &order) || order < 1)
+            return parse_error(scene, &reader, CRV_ORDER_EXPECT_ERROR);
+
+        if (!next_line(&reader))
+            return parse_error(scene, &reader, CRV_EOF_ERROR);
+
+        s = reader.line;
+        while (s < reader.line_end && IS_SPACE(*s)) s++;
+        if (reader.line_end - s >= 5 && strncmp(s, "knots", 5) == 0) {
+            /* B-spline curve: knots[N] = k0 k1 ... over one or more lines */
+            if (!begin_curve(scene, CRV_BSPLINE, order))
+                return parse_error(scene, &reader, CRV_ALLOC_ERROR);
+
+            open_bracket = memchr(s, '[', reader.line_end - s);
+            close_bracket = open_bracket == NULL ? NULL :
+                       memchr(open_bracket, ']', reader.line_end - open_bracket);
+            equal = close_bracket == NULL ? NULL :
+                       memchr(close_bracket, '=', reader.line_end - close_bracket);
+            if (equal == NULL ||
+                !parse_int(open_bracket + 1, close_bracket, &n_knots) ||
+                n_knots < 0)
+                return parse_error(scene, &reader, CRV_KNOTS_ERROR);
+
+            if (!push_knots(scene, equal + 1, reader.line_end, n_knots))
+                return parse_error(scene, &reader, glbl_io_error);
+            while (scene -> n_knots -
+                   scene -> knots_offset[scene -> n_curves] < n_knots) {
+                if (!next_line(&reader))
+                    return parse_error(scene, &reader, CRV_EOF_ERROR);
+                if (!push_knots(scene, reader.line, reader.line_end, n_knots))
+                    return parse_error(scene, &reader, glbl_io_error);
+            }
+
+            /* Control points up to the order line of the next curve: */
+            if (!next_line(&reader))
+                return parse_error(scene, &reader, CRV_EOF_ERROR);
+            while (count_tokens(reader.line, reader.line_end) > 1) {
+                if (!push_point(scene, reader.line, reader.line_end))
+                    return parse_error(scene, &reader, glbl_io_error);
+                if (!next_line(&reader)) {
+                    end_curve(scene);
+                    return scene;
+                }
+            }
+            end_curve(scene);
+        }
+        else {
+            /* Bezier curve: exactly order control points */
+            if (!begin_curve(scene, CRV_BEZIER, order))
+                return parse_error(scene, &reader, CRV_ALLOC_ERROR);
+            if (!push_point(scene, reader.line, reader.line_end))
+                return parse_error(scene, &reader, glbl_io_error);
+            while (scene -> n_points -
+                   scene -> points_offset[scene -> n_curves] < order) {
+                if (!next_line(&reader))
+                    return parse_error(scene, &reader, CRV_EOF_ERROR);
+                if (!push_point(scene, reader.line, reader.line_end))
+                    return parse_error(scene, &reader, glbl_io_error);
+            }
+            end_curve(scene);
+
+            if (!next_line(&reader)) return scene;
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to return loading error if happen one, zero elsewhere            *
+*****************************************************************************/
+int crv_ioerror(void)
+{
+    int temp;
+
+    temp = glbl_io_error;
+    glbl_io_error = 0;
+    return temp;
+}
+
+/*****************************************************************************
+*   Routine to return the line (1 based) of the last loading error.          *
+*****************************************************************************/
+int crv_ioerror_line(void)
+{
+    return glbl_io_error_line;
+}
+
+/*****************************************************************************
+*   Routine to set the loading error (and its line), for the loaders of      *
+* other modules, such as crv_itd.c.                                          *
+*****************************************************************************/
+void crv_set_ioerror(int error, int line)
+{
+    glbl_io_error = error;
+    glbl_io_error_line = line;
+}
+
+/*****************************************************************************
+*   Routine to record a parsing error, release the partial scene and return  *
+* NULL, so the parser can simply return its result.                          *
+*****************************************************************************/
+static crv_scene *parse_error(crv_scene *scene, dat_reader *reader, int error)
+{
+    glbl_io_error = error;
+    glbl_io_error_line = reader -> line_number;
+    crv_free_scene(scene);
+    return NULL;
+}
+
+/*****************************************************************************
+*   Routine to advance the reader to the next line which is neither blank    *
+* nor a comment. Returns FALSE if the end of the buffer was reached.         *
+*****************************************************************************/
+static int next_line(dat_reader *reader)
+{
+    const char *s, *eol;
+
+    while (reader -> next < reader -> end) {
+        s = reader -> next;
+        eol = memchr(s, '\n', reader -> end - s);
+        if (eol == NULL) eol = reader -> end;
+        reader -> next = eol < reader -> end ? eol + 1 : eol;
+        reader -> line_number++;
+
+        while (s < eol && IS_SPACE(*s)) s++;
+        if (s == eol || *s == '#') continue;    /* Blank line or comment */
+
+        reader -> line = s;
+        reader -> line_end = eol;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*****************************************************************************
+*   Routine to get the next white space separated token in [*s, end).        *
+* Returns the token start (NULL if none), and sets *s to one after its end.  *
+*****************************************************************************/
+static const char *next_token(const char **s, const char *end)
+{
+    const char *token;
+
+    while (*s < end && IS_SPACE(**s)) (*s)++;
+    if (*s == end) return NULL;
+    token = *s;
+    while (*s < end && !IS_SPACE(**s)) (*s)++;
+    return token;
+}
+
+/*****************************************************************************
+*   Routine to count the white space separated tokens in [s, end).           *
+*****************************************************************************/
+static int count_tokens(const char *s, const char *end)
+{
+    int n = 0;
+
+    while (next_token(&s, end) != NULL) n++;
+    return n;
+}
+
+/*****************************************************************************
+*   Routine to convert the token [s, end) to a double. The token is copied   *
+* to a small local buffer as the mapped file is not NULL terminated.         *
+*****************************************************************************/
+static int parse_double(const char *s, const char *end, double *data)
+{
+    char number[MAX_NUMBER_LEN + 1], *number_end;
+    size_t len = end - s;
+
+    if (len == 0 || len > MAX_NUMBER_LEN) return FALSE;
+    memcpy(number, s, len);
+    number[len] = 0;
+    *data = strtod(number, &number_end);
+    return number_end == number + len;
+}
+
+/*****************************************************************************
+*   Routine to convert the token [s, end) to an int, allowing white spaces.  *
+*****************************************************************************/
+static int parse_int(const char *s, const char *end, int *data)
+{
+    char number[MAX_NUMBER_LEN + 1], *number_end;
+    size_t len;
+    long value;
+
+    while (s < end && IS_SPACE(*s)) s++;
+    while (end > s && IS_SPACE(end[-1])) end--;
+    len = end - s;
+    if (len == 0 || len > MAX_NUMBER_LEN) return FALSE;
+    memcpy(number, s, len);
+    number[len] = 0;
+    value = strtol(number, &number_end, 10);
+    *data = (int) value;
+    return number_end == number + len && value == *data;
+}
+
+/*****************************************************************************
+*   Routines to make sure the scene arrays can hold the given sizes.         *
+* Returns FALSE if out of memory (the scene is left unchanged).              *
+*****************************************************************************/
+static int reserve_curves(crv_scene *scene, int n_curves)
+{
+    int capacity = scene -> curves_capacity > 0 ? scene -> curves_capacity
+                                                : INITIAL_CAPACITY;
+    int *kind, *order, *knots_offset, *points_offset;
+
+    if (n_curves <= scene -> curves_capacity) return TRUE;
+    while (capacity < n_curves) capacity *= 2;
+
+    if ((kind = realloc(scene -> kind, capacity * sizeof(int))) == NULL)
+        return FALSE;
+    scene -> kind = kind;
+    if ((order = realloc(scene -> order, capacity * sizeof(int))) == NULL)
+        return FALSE;
+    scene -> order = order;
+    if ((knots_offset = realloc(scene -> knots_offset,
+                                (capacity + 1) * sizeof(int))) == NULL)
+        return FALSE;
+    scene -> knots_offset = knots_offset;
+    if ((points_offset = realloc(scene -> points_offset,
+                                 (capacity + 1) * sizeof(int))) == NULL)
+        return FALSE;
+    scene -> points_offset = points_offset;
+
+    scene -> curves_capacity = capacity;
+    return TRUE;
+}
+
+static int reserve_knots(crv_scene *scene, int n_knots)
+{
+    int capacity = scene -> knots_capacity > 0 ? scene -> knots_capacity
+                                               : INITIAL_CAPACITY;
+    double *knots;
+
+    if (n_knots <= scene -> knots_capacity) return TRUE;
+    while (capacity < n_knots) capacity *= 2;
+
+    if ((knots = realloc(scene -> knots, capacity * sizeof(double))) == NULL)
+        return FALSE;
+    scene -> knots = knots;
+    scene -> knots_capacity = capacity;
+    return TRUE;
+}
+
+static int reserve_points(crv_scene *scene, int n_points)
+{
+    int capacity = scene -> points_capacity > 0 ? scene -> points_capacity
+                                                : INITIAL_CAPACITY;
+    double *wx, *wy, *w;
+
+    if (n_points <= scene -> points_capacity) return TRUE;
+    while (capacity < n_points) capacity *= 2;
+
+    if ((wx = realloc(scene -> wx, capacity * sizeof(double))) == NULL)
+        return FALSE;
+    scene -> wx = wx;
+    if ((wy = realloc(scene -> wy, capacity * sizeof(double))) == NULL)
+        return FALSE;
+    scene -> wy = wy;
+    if ((w = realloc(scene -> w, capacity * sizeof(double))) == NULL)
+        return FALSE;
+    scene -> w = w;
+
+    scene -> points_capacity = capacity;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to open a new curve at the end of the scene. Its knots and       *
+* control points are the ones pushed until end_curve is called.              *
+*****************************************************************************/
+static int begin_curve(crv_scene *scene, int kind, int order)
+{
+    int i = scene -> n_curves;
+
+    if (!reserve_curves(scene, i + 1)) return FALSE;
+    scene -> kind[i] = kind;
+    scene -> order[i] = order;
+    scene -> knots_offset[i] = scene -> n_knots;
+    scene -> points_offset[i] = scene -> n_points;
+    return TRUE;
+}
+
+static void end_curve(crv_scene *scene)
+{
+    int i = scene -> n_curves++;
+
+    scene -> knots_offset[i + 1] = scene -> n_knots;
+    scene -> points_offset[i + 1] = scene -> n_points;
+}
+
+/*****************************************************************************
+*   Routine to push the knots found in [s, end) to the current curve, which  *
+* must not hold more than n_knots knots. Sets glbl_io_error if fails.        *
+*****************************************************************************/
+static int push_knots(crv_scene *scene, const char *s, const char *end,
+                      int n_knots)
+{
+    const char *token;
+    int last = scene -> knots_offset[scene -> n_curves] + n_knots;
+
+    while ((token = next_token(&s, end)) != NULL) {
+        if (scene -> n_knots >= last) {
+            glbl_io_error = CRV_KNOTS_ERROR;
+            return FALSE;
+        }
+        if (!reserve_knots(scene, scene -> n_knots + 1)) {
+            glbl_io_error = CRV_ALLOC_ERROR;
+            return FALSE;
+        }
+        if (!parse_double(token, s, &scene -> knots[scene -> n_knots])) {
+            glbl_io_error = CRV_NUMBER_ERROR;
+            return FALSE;
+        }
+        scene -> n_knots++;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to push the control point in [s, end) to the current curve. A    *
+* point is either "x y" (weight of 1) or "wx wy w". Sets glbl_io_error if    *
+* fails.                                                                     *
+*****************************************************************************/
+static int push_point(crv_scene *scene, const char *s, const char *end)
+{
+    const char *token;
+    double coords[3];
+    int n = 0, i = scene -> n_points;
+
+    while ((token = next_token(&s, end)) != NULL) {
+        if (n == 3) {
+            glbl_io_error = CRV_POINT_ERROR;
+            return FALSE;
+        }
+        if (!parse_double(token, s, &coords[n++])) {
+            glbl_io_error = CRV_NUMBER_ERROR;
+            return FALSE;
+        }
+    }
+    if (n < 2) {
+        glbl_io_error = CRV_POINT_ERROR;
+        return FALSE;
+    }
+    if (n == 2) coords[2] = 1.0;
+
+    if (!reserve_points(scene, i + 1)) {
+        glbl_io_error = CRV_ALLOC_ERROR;
+        return FALSE;
+    }
+    scene -> wx[i] = coords[0];
+    scene -> wy[i] = coords[1];
+    scene -> w[i] = coords[2];
+    scene -> n_points++;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to write a scene as a .dat file. Numbers are written with enough *
+* digits to read back exactly the same doubles.                              *
+* Returns FALSE if failed, and error is in crv_ioerror()                     *
+*****************************************************************************/
+int crv_save_dat(const crv_scene *scene, const char *path)
+{
+    FILE *f;
+    int i, j;
+
+    glbl_io_error = glbl_io_error_line = 0;
+    if ((f = fopen(path, "w")) == NULL) {
+        glbl_io_error = CRV_OPEN_ERROR;
+        return FALSE;
+    }
+
+    for (i = 0; i < scene -> n_curves; i++) {
+        fprintf(f, "%d\n", scene -> order[i]);
+        if (scene -> kind[i] == CRV_BSPLINE) {
+            fprintf(f, "knots[%d] = \n",
+                    scene -> knots_offset[i + 1] - scene -> knots_offset[i]);
+            for (j = scene -> knots_offset[i];
+                 j < scene -> knots_offset[i + 1];
+                 j++)
+                fprintf(f, "%.17g\n", scene -> knots[j]);
+        }
+        for (j = scene -> points_offset[i];
+             j < scene -> points_offset[i + 1];
+             j++)
+            fprintf(f, "%.17g %.17g %.17g\n",
+                    scene -> wx[j], scene -> wy[j], scene -> w[j]);
+    }
+
+    if (ferror(f) | (fclose(f) != 0)) {
+        glbl_io_error = CRV_WRITE_ERROR;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to load a binary .crvs scene. The file is mapped and the scene   *
+* arrays point into the mapping, so nothing is parsed nor copied. Such a     *
+* scene is read only - use crv_copy_scene to get a modifiable one.           *
+* Returns NULL if an error was found, and error is in crv_ioerror()          *
+*****************************************************************************/
+crv_scene *crv_load_scene(const char *path)
+{
+    const char *buf;
+    size_t len = 0, sizes[N_SCENE_SECTIONS];
+    crv_scene_header header;
+    crv_scene *scene;
+    void *arrays[N_SCENE_SECTIONS];
+    int i;
+
+    glbl_io_error = glbl_io_error_line = 0;
+    if ((buf = crv_map_file(path, &len)) == NULL) {
+        glbl_io_error = CRV_OPEN_ERROR;
+        return NULL;
+    }
+
+    if (len < sizeof(crv_scene_header)) {
+        crv_unmap_file(buf, len);
+        glbl_io_error = CRV_FORMAT_ERROR;
+        return NULL;
+    }
+    memcpy(&header, buf, sizeof(crv_scene_header));
+    if (memcmp(header.magic, CRV_SCENE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byte_order != CRV_SCENE_BYTE_ORDER ||
+        header.header_size < sizeof(crv_scene_header) ||
+        header.n_curves > INT32_MAX ||
+        header.n_knots > INT32_MAX ||
+        header.n_points > INT32_MAX) {
+        crv_unmap_file(buf, len);
+        glbl_io_error = CRV_FORMAT_ERROR;
+        return NULL;
+    }
+    if (header.version > CRV_SCENE_VERSION) {
+        crv_unmap_file(buf, len);
+        glbl_io_error = CRV_VERSION_ERROR;
+        return NULL;
+    }
+
+    if ((scene = (crv_scene *) calloc(1, sizeof(crv_scene))) == NULL) {
+        crv_unmap_file(buf, len);
+        glbl_io_error = CRV_ALLOC_ERROR;
+        return NULL;
+    }
+    scene -> mapping = buf;
+    scene -> mapping_len = len;
+    scene -> n_curves = (int) header.n_curves;
+    scene -> n_knots = (int) header.n_knots;
+    scene -> n_points = (int) header.n_points;
+
+    scene_sections(scene, arrays, sizes);
+    for (i = 0; i < N_SCENE_SECTIONS; i++) {
+        if (header.sections[i] % CRV_SCENE_ALIGN != 0 ||
+            header.sections[i] > len ||
+            sizes[i] > len - header.sections[i]) {
+            crv_free_scene(scene);
+            glbl_io_error = CRV_FORMAT_ERROR;
+            return NULL;
+        }
+    }
+    scene -> kind = (int *) (buf + header.sections[SECTION_KIND]);
+    scene -> order = (int *) (buf + header.sections[SECTION_ORDER]);
+    scene -> knots_offset =
+                     (int *) (buf + header.sections[SECTION_KNOTS_OFFSET]);
+    scene -> points_offset =
+                     (int *) (buf + header.sections[SECTION_POINTS_OFFSET]);
+    scene -> knots = (double *) (buf + header.sections[SECTION_KNOTS]);
+    scene -> wx = (double *) (buf + header.sections[SECTION_WX]);
+    scene -> wy = (double *) (buf + header.sections[SECTION_WY]);
+    scene -> w = (double *) (buf + header.sections[SECTION_W]);
+
+    if (!check_scene_offsets(scene)) {
+        crv_free_scene(scene);
+        glbl_io_error = CRV_FORMAT_ERROR;
+        return NULL;
+    }
+    return scene;
+}
+
+/*****************************************************************************
+*   Routine to write a scene as a binary .crvs file.                         *
+* Returns FALSE if failed, and error is in crv_ioerror()                     *
+*****************************************************************************/
+int crv_save_scene(const crv_scene *scene, const char *path)
+{
+    FILE *f;
+    crv_scene_header header;
+    void *arrays[N_SCENE_SECTIONS];
+    size_t sizes[N_SCENE_SECTIONS];
+    uint64_t position;
+    int i;
+
+    glbl_io_error = glbl_io_error_line = 0;
+    if (!check_scene_offsets(scene)) {
+        glbl_io_error = CRV_FORMAT_ERROR;
+        return FALSE;
+    }
+
+    memset(&header, 0, sizeof(crv_scene_header));
+    memcpy(header.magic, CRV_SCENE_MAGIC, sizeof(header.magic));
+    header.byte_order = CRV_SCENE_BYTE_ORDER;
+    header.version = CRV_SCENE_VERSION;
+    header.header_size = sizeof(crv_scene_header);
+    header.n_curves = scene -> n_curves;
+    header.n_knots = scene -> n_knots;
+    header.n_points = scene -> n_points;
+
+    scene_sections(scene, arrays, sizes);
+    position = sizeof(crv_scene_header);
+    for (i = 0; i < N_SCENE_SECTIONS; i++) {
+        position = (position + CRV_SCENE_ALIGN - 1) /
+                                             CRV_SCENE_ALIGN * CRV_SCENE_ALIGN;
+        header.sections[i] = position;
+        position += sizes[i];
+    }
+
+    if ((f = fopen(path, "wb")) == NULL) {
+        glbl_io_error = CRV_OPEN_ERROR;
+        return FALSE;
+    }
+    fwrite(&header, sizeof(crv_scene_header), 1, f);
+    for (i = 0; i < N_SCENE_SECTIONS; i++) {
+        write_padding(f, (long) header.sections[i]);
+        if (sizes[i] > 0) fwrite(arrays[i], 1, sizes[i], f);
+    }
+
+    if (ferror(f) | (fclose(f) != 0)) {
+        glbl_io_error = CRV_WRITE_ERROR;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to list the scene arrays and their sizes in bytes, in the order  *
+* of the sections of the binary file. sizes might be NULL.                   *
+*****************************************************************************/
+static void scene_sections(const crv_scene *scene, void *arrays[],
+                           size_t sizes[])
+{
+    arrays[SECTION_KIND] = scene -> kind;
+    arrays[SECTION_ORDER] = scene -> order;
+    arrays[SECTION_KNOTS_OFFSET] = scene -> knots_offset;
+    arrays[SECTION_POINTS_OFFSET] = scene -> points_offset;
+    arrays[SECTION_KNOTS] = scene -> knots;
+    arrays[SECTION_WX] = scene -> wx;
+    arrays[SECTION_WY] = scene -> wy;
+    arrays[SECTION_W] = scene -> w;
+    if (sizes == NULL) return;
+
+    sizes[SECTION_KIND] = sizes[SECTION_ORDER] =
+                                    (size_t) scene -> n_curves * sizeof(int);
+    sizes[SECTION_KNOTS_OFFSET] = sizes[SECTION_POINTS_OFFSET] =
+                              ((size_t) scene -> n_curves + 1) * sizeof(int);
+    sizes[SECTION_KNOTS] = (size_t) scene -> n_knots * sizeof(double);
+    sizes[SECTION_WX] = sizes[SECTION_WY] = sizes[SECTION_W] =
+                                 (size_t) scene -> n_points * sizeof(double);
+}
+
+/*****************************************************************************
+*   Routine to verify the per curve offsets are monotone and cover exactly   *
+* the knots and points arrays, so no curve reaches outside them.             *
+*****************************************************************************/
+static int check_scene_offsets(const crv_scene *scene)
+{
+    int i;
+
+    if (scene -> n_curves < 0 ||
+        scene -> knots_offset[0] != 0 || scene -> points_offset[0] != 0)
+        return FALSE;
+    for (i = 0; i < scene -> n_curves; i++) {
+        if (scene -> knots_offset[i + 1] < scene -> knots_offset[i] ||
+            scene -> points_offset[i + 1] < scene -> points_offset[i])
+            return FALSE;
+    }
+    return scene -> knots_offset[scene -> n_curves] == scene -> n_knots &&
+           scene -> points_offset[scene -> n_curves] == scene -> n_points;
+}
+
+/*****************************************************************************
+*   Routine to pad the file with zeros up to the given position.             *
+*****************************************************************************/
+static int write_padding(FILE *f, long position)
+{
+    static const char zeros[CRV_SCENE_ALIGN] = { 0 };
+    long current = ftell(f);
+
+    if (current < 0 || current > position) return FALSE;
+    return fwrite(zeros, 1, position - current, f) ==
+                                               (size_t) (position - current);
+}
@@ -0,0 +1,692 @@
+/*****************************************************************************
+*   Module to intersect the curves of a scene with each other.               *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_intersections *intersect_curves(scene, curve1, curve2, tolerance) - *
+*                  the intersections of two curves.                          *
+* 2. crv_intersections *intersect_scene(scene, tolerance) - the              *
+*                  intersections of all the pairs of curves, in parallel.    *
+* 3. free_intersections(intersections) - release memory allocated for them.  *
+*                                                                            *
+*   Every pair of Bezier pieces (as in crv_flat.c) whose bounding boxes and  *
+* fat lines are within tolerance is recursively subdivided, the larger piece *
+* first, until both are flat within tolerance. The chords intersection then  *
+* starts Newton iterations on C1(s) - C2(u) = 0 over the pieces, and points  *
+* within tolerance of both curves are kept - once, intersections closer than *
+* tolerance to each other are merged. Touching (tangent) curves report their *
+* contact point. A curve is not intersected with itself.                     *
+*   The scene pairs are culled by a sweep over the curves bounding boxes in  *
+* x. Positive weights are assumed - the culling relies on the convex hull.   *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_DEPTH         48     /* Subdivisions of both pieces together */
+#define  NEWTON_ITERATIONS 16
+#define  NEWTON_EPSILON    1e-15
+#define  INITIAL_CAPACITY  16
+
+typedef struct hit_list {                /* Intersections found, growing */
+     int n, capacity;
+     int *curve1, *curve2;
+     double *t1, *t2, *x, *y;
+} hit_list;
+
+typedef struct pair_ctx {            /* Intersecting two pieces of curves */
+     int n1, n2;                                /* Points of the pieces */
+     const double *piece1, *piece2;
+     double piece1_t0, piece1_t1, piece2_t0, piece2_t1;
+     double *scratch;            /* Halves of every depth, see intersect */
+     double *tmp;                            /* For crv_eval_piece */
+     double tolerance;
+     int curve1, curve2;
+     hit_list *hits;
+     int failed;                           /* An allocation failed, if set */
+} pair_ctx;
+
+typedef struct curve_box {
+     double x_min, y_min, x_max, y_max;
+     int curve;
+} curve_box;
+
+typedef struct scene_ctx {
+     const crv_scene *scene;
+     double tolerance;
+     const int *pairs;                          /* curve1, curve2 per pair */
+     hit_list *hits;                                      /* One per pair */
+     int failed;
+} scene_ctx;
+
+static void intersect_task(void *ctx, int begin, int end);
+static int intersect_pair(const crv_scene *scene, int curve1, int curve2,
+                          double tolerance, hit_list *hits);
+static void intersect(pair_ctx *ctx, const double *p1, double s0, double s1,
+                      const double *p2, double u0, double u1, int depth);
+static void intersect_leaf(pair_ctx *ctx, const double *p1, double s0,
+                           double s1, const double *p2, double u0, double u1);
+static double newton(pair_ctx *ctx, double *s, double *u, double *x,
+                     double *y, int iterations);
+static void subdivide(const double *points, int n, double *left,
+                      double *right);
+static void piece_box(const double *points, int n, double *box);
+static int fat_line_apart(const double *points1, int n1,
+                          const double *points2, int n2, double tolerance);
+static int is_flat(const double *points, int n, double tolerance);
+static int piece_size(const crv_scene *scene, int curve);
+static int push_hit(hit_list *hits, int curve1, int curve2, double t1,
+                    double t2, double x, double y);
+static crv_intersections *hits_to_intersections(hit_list *hits, int n_lists);
+static void free_hits(hit_list *hits);
+static int box_compare(const void *a, const void *b);
+static int pair_compare(const void *a, const void *b);
+
+/*****************************************************************************
+*   Routine to intersect two curves of a scene. Returns the intersections    *
+* (none if a curve is invalid or both are the same), or NULL if out of       *
+* memory.                                                                    *
+*****************************************************************************/
+crv_intersections *crv_intersect_curves(const crv_scene *scene, int curve1,
+                                        int curve2, double tolerance)
+{
+    hit_list hits = { 0 };
+
+    if (curve1 != curve2 && crv_curve_is_valid(scene, curve1) &&
+        crv_curve_is_valid(scene, curve2) &&
+        !intersect_pair(scene, curve1, curve2, tolerance, &hits)) {
+        free_hits(&hits);
+        return NULL;
+    }
+    return hits_to_intersections(&hits, 1);
+}
+
+/*****************************************************************************
+*   Routine to intersect all the pairs of curves of a scene, with curve1 <   *
+* curve2 in every intersection, ordered by the pairs. Returns NULL if out of *
+* memory.                                                                    *
+*****************************************************************************/
+crv_intersections *crv_intersect_scene(const crv_scene *scene,
+                                       double tolerance)
+{
+    int i, j, k, n_boxes, n_pairs, capacity, *pairs, *new_pairs;
+    double box[4];
+    curve_box *boxes;
+    scene_ctx ctx;
+    crv_intersections *intersections;
+
+    boxes = (curve_box *) malloc((scene -> n_curves + 1) * sizeof(curve_box));
+    capacity = INITIAL_CAPACITY;
+    pairs = (int *) malloc(2 * capacity * sizeof(int));
+    if (boxes == NULL || pairs == NULL) {
+        free(boxes);
+        free(pairs);
+        return NULL;
+    }
+
+    /* Boxes of the control points, each projected by its weight: */
+    for (i = n_boxes = 0; i < scene -> n_curves; i++) {
+        if (!crv_curve_is_valid(scene, i)) continue;
+        box[0] = box[1] = INFINITY;
+        box[2] = box[3] = -INFINITY;
+        for (j = scene -> points_offset[i];
+             j < scene -> points_offset[i + 1];
+             j++) {
+            box[0] = fmin(box[0], scene -> wx[j] / scene -> w[j]);
+            box[1] = fmin(box[1], scene -> wy[j] / scene -> w[j]);
+            box[2] = fmax(box[2], scene -> wx[j] / scene -> w[j]);
+            box[3] = fmax(box[3], scene -> wy[j] / scene -> w[j]);
+        }
+        boxes[n_boxes].x_min = box[0];
+        boxes[n_boxes].y_min = box[1];
+        boxes[n_boxes].x_max = box[2];
+        boxes[n_boxes].y_max = box[3];
+        boxes[n_boxes++].curve = i;
+    }
+
+    /* Sweep in x: only boxes starting before this one ends may overlap it: */
+    qsort(boxes, n_boxes, sizeof(curve_box), box_compare);
+    for (i = n_pairs = 0; i < n_boxes; i++) {
+        for (j = i + 1;
+             j < n_boxes && boxes[j].x_min <= boxes[i].x_max + tolerance;
+             j++) {
+            if (boxes[j].y_min > boxes[i].y_max + tolerance ||
+                boxes[i].y_min > boxes[j].y_max + tolerance)
+                continue;
+
+            if (n_pairs == capacity) {
+                new_pairs = (int *) realloc(pairs,
+                                            4 * capacity * sizeof(int));
+                if (new_pairs == NULL) {
+                    free(boxes);
+                    free(pairs);
+                    return NULL;
+                }
+                pairs = new_pairs;
+                capacity *= 2;
+            }
+            k = boxes[i].curve < boxes[j].curve;
+            pairs[2 * n_pairs] = k ? boxes[i].curve : boxes[j].curve;
+            pairs[2 * n_pairs++ + 1] = k ? boxes[j].curve : boxes[i].curve;
+        }
+    }
+    free(boxes);
+    qsort(pairs, n_pairs, 2 * sizeof(int), pair_compare);
+
+    ctx.scene = scene;
+    ctx.tolerance = tolerance;
+    ctx.pairs = pairs;
+    ctx.failed = FALSE;
+    ctx.hits = (hit_list *) calloc(n_pairs + 1, sizeof(hit_list));
+    if (ctx.hits == NULL) {
+        free(pairs);
+        return NULL;
+    }
+
+    crv_parallel_for(n_pairs, 1, intersect_task, &ctx);
+    free(pairs);
+
+    if (ctx.failed) {
+        for (i = 0; i < n_pairs; i++) free_hits(&ctx.hits[i]);
+        intersections = NULL;
+    }
+    else
+        intersections = hits_to_intersections(ctx.hits, n_pairs);
+    free(ctx.hits);
+    return intersections;
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for intersections.                   *
+*****************************************************************************/
+void crv_free_intersections(crv_intersections *intersections)
+{
+    if (intersections == NULL) return;
+
+    free(intersections -> curve1);
+    free(intersections -> curve2);
+    free(intersections -> t1);
+    free(intersections -> t2);
+    free(intersections -> x);
+    free(intersections -> y);
+    free(intersections);
+}
+
+/*****************************************************************************
+*   The crv_intersect_scene task: intersect the pairs [begin, end), each to  *
+* its own hit list.                                                          *
+*****************************************************************************/
+static void intersect_task(void *ctx, int begin, int end)
+{
+    scene_ctx *isect_ctx = (scene_ctx *) ctx;
+    int i;
+
+    for (i = begin; i < end && !isect_ctx -> failed; i++) {
+        if (!intersect_pair(isect_ctx -> scene, isect_ctx -> pairs[2 * i],
+                            isect_ctx -> pairs[2 * i + 1],
+                            isect_ctx -> tolerance, &isect_ctx -> hits[i]))
+            isect_ctx -> failed = TRUE;
+    }
+}
+
+/*****************************************************************************
+*   Routine to intersect two (valid, different) curves, appending the        *
+* intersections to hits. FALSE if out of memory.                             *
+*****************************************************************************/
+static int intersect_pair(const crv_scene *scene, int curve1, int curve2,
+                          double tolerance, hit_list *hits)
+{
+    int i, j, k, first,
+        size1 = piece_size(scene, curve1),
+        size2 = piece_size(scene, curve2),
+        size = size1 > size2 ? size1 : size2,
+        pieces2 = crv_curve_pieces(scene, curve2);
+    double *points1, *points2, *domains2, t0, t1;
+    pair_ctx ctx;
+
+    /* Piece of curve1, all pieces of curve2 and their domains, 2 halves    */
+    /* per depth level, then crv_eval_piece scratch:                        */
+    points1 = (double *) malloc((3 * size1 + (3 * size2 + 2) * pieces2 +
+                                 6 * size * MAX_DEPTH + 3 * size) *
+                                sizeof(double));
+    if (points1 == NULL) return FALSE;
+    points2 = points1 + 3 * size1;
+    domains2 = points2 + 3 * size2 * pieces2;
+
+    ctx.n1 = size1;
+    ctx.n2 = size2;
+    ctx.scratch = domains2 + 2 * pieces2;
+    ctx.tmp = ctx.scratch + 6 * size * MAX_DEPTH;
+    ctx.tolerance = tolerance;
+    ctx.curve1 = curve1;
+    ctx.curve2 = curve2;
+    ctx.hits = hits;
+    ctx.failed = FALSE;
+
+    for (k = 0; k < pieces2; k++) {
+        domains2[2 * k] = domains2[2 * k + 1] = 0.0;         /* Empty span */
+        crv_curve_piece(scene, curve2, k, &points2[3 * size2 * k],
+                        &points2[3 * size2 * k + size2],
+                        &points2[3 * size2 * k + 2 * size2],
+                        &domains2[2 * k], &domains2[2 * k + 1]);
+    }
+
+    first = hits -> n;
+    for (j = 0; j < crv_curve_pieces(scene, curve1) && !ctx.failed; j++) {
+        if (crv_curve_piece(scene, curve1, j, points1, points1 + size1,
+                            points1 + 2 * size1, &t0, &t1) == 0)
+            continue;
+
+        for (k = 0; k < pieces2 && !ctx.failed; k++) {
+            if (domains2[2 * k] == domains2[2 * k + 1]) continue;
+
+            ctx.piece1 = points1;
+            ctx.piece2 = &points2[3 * size2 * k];
+            ctx.piece1_t0 = t0;
+            ctx.piece1_t1 = t1;
+            ctx.piece2_t0 = domains2[2 * k];
+            ctx.piece2_t1 = domains2[2 * k + 1];
+            intersect(&ctx, ctx.piece1, 0.0, 1.0, ctx.piece2, 0.0, 1.0, 0);
+        }
+    }
+    free(points1);
+
+    /* Merge intersections within tolerance, found by neighbour leaves or   */
+    /* pieces (at a knot):                                                  */
+    for (i = k = first; i < hits -> n; i++) {
+        for (j = first; j < k; j++)
+            if (hypot(hits -> x[i] - hits -> x[j],
+                      hits -> y[i] - hits -> y[j]) <= tolerance)
+                break;
+        if (j < k) continue;
+        hits -> t1[k] = hits -> t1[i];
+        hits -> t2[k] = hits -> t2[i];
+        hits -> x[k] = hits -> x[i];
+        hits -> y[k++] = hits -> y[i];
+    }
+    hits -> n = k;
+
+    return !ctx.failed;
+}
+
+/*****************************************************************************
+*   Routine to intersect the parts [s0, s1] of the current piece of curve1   *
+* and [u0, u1] of that of curve2, given as their own Bezier points (as in    *
+* crv_flat.c). Depth level d keeps its two halves at                         *
+* ctx -> scratch + 6 * max(n1, n2) * d.                                      *
+*****************************************************************************/
+static void intersect(pair_ctx *ctx, const double *p1, double s0, double s1,
+                      const double *p2, double u0, double u1, int depth)
+{
+    int flat1, flat2, split1,
+        n = ctx -> n1 > ctx -> n2 ? ctx -> n1 : ctx -> n2;
+    double box1[4], box2[4],
+           *left = ctx -> scratch + 6 * n * depth,
+           *right = left + 3 * n,
+           tolerance = ctx -> tolerance;
+
+    if (ctx -> failed) return;
+
+    piece_box(p1, ctx -> n1, box1);
+    piece_box(p2, ctx -> n2, box2);
+    if (box1[0] > box2[2] + tolerance || box2[0] > box1[2] + tolerance ||
+        box1[1] > box2[3] + tolerance || box2[1] > box1[3] + tolerance ||
+        fat_line_apart(p1, ctx -> n1, p2, ctx -> n2, tolerance) ||
+        fat_line_apart(p2, ctx -> n2, p1, ctx -> n1, tolerance))
+        return;
+
+    flat1 = is_flat(p1, ctx -> n1, tolerance);
+    flat2 = is_flat(p2, ctx -> n2, tolerance);
+    if (depth >= MAX_DEPTH || (flat1 && flat2)) {
+        intersect_leaf(ctx, p1, s0, s1, p2, u0, u1);
+        return;
+    }
+
+    /* Split the larger part, unless it is flat already: */
+    split1 = !flat1 && (flat2 || hypot(box1[2] - box1[0], box1[3] - box1[1]) >=
+                                 hypot(box2[2] - box2[0], box2[3] - box2[1]));
+    if (split1) {
+        subdivide(p1, ctx -> n1, left, right);
+        intersect(ctx, left, s0, 0.5 * (s0 + s1), p2, u0, u1, depth + 1);
+        intersect(ctx, right, 0.5 * (s0 + s1), s1, p2, u0, u1, depth + 1);
+    }
+    else {
+        subdivide(p2, ctx -> n2, left, right);
+        intersect(ctx, p1, s0, s1, left, u0, 0.5 * (u0 + u1), depth + 1);
+        intersect(ctx, p1, s0, s1, right, 0.5 * (u0 + u1), u1, depth + 1);
+    }
+}
+
+/*****************************************************************************
+*   Routine to intersect two flat parts (as in intersect): Newton iterations *
+* from the chords intersection, clamped to the chords. The point reached, or *
+* the start if nearer, is an intersection if within tolerance.               *
+*****************************************************************************/
+static void intersect_leaf(pair_ctx *ctx, const double *p1, double s0,
+                           double s1, const double *p2, double u0, double u1)
+{
+    int n1 = ctx -> n1,
+        n2 = ctx -> n2;
+    double ax = p1[0] / p1[2 * n1],
+           ay = p1[n1] / p1[2 * n1],
+           adx = p1[n1 - 1] / p1[3 * n1 - 1] - ax,
+           ady = p1[2 * n1 - 1] / p1[3 * n1 - 1] - ay,
+           bx = p2[0] / p2[2 * n2],
+           by = p2[n2] / p2[2 * n2],
+           bdx = p2[n2 - 1] / p2[3 * n2 - 1] - bx,
+           bdy = p2[2 * n2 - 1] / p2[3 * n2 - 1] - by,
+           cross = adx * bdy - ady * bdx,
+           a = 0.5,
+           b = 0.5,
+           s, u, x, y, d, s_start, u_start, x_start, y_start, d_start;
+
+    if (cross != 0.0) {
+        a = ((bx - ax) * bdy - (by - ay) * bdx) / cross;
+        b = ((bx - ax) * ady - (by - ay) * adx) / cross;
+        a = a < 0.0 ? 0.0 : a > 1.0 ? 1.0 : a;
+        b = b < 0.0 ? 0.0 : b > 1.0 ? 1.0 : b;
+    }
+
+    s = s_start = s0 + a * (s1 - s0);
+    u = u_start = u0 + b * (u1 - u0);
+    d_start = newton(ctx, &s_start, &u_start, &x_start, &y_start, 0);
+    d = newton(ctx, &s, &u, &x, &y, NEWTON_ITERATIONS);
+    if (d_start < d) {
+        s = s_start;
+        u = u_start;
+        x = x_start;
+        y = y_start;
+        d = d_start;
+    }
+    if (!(d <= ctx -> tolerance)) return;
+
+    if (!push_hit(ctx -> hits, ctx -> curve1, ctx -> curve2,
+                  ctx -> piece1_t0 + s * (ctx -> piece1_t1 - ctx -> piece1_t0),
+                  ctx -> piece2_t0 + u * (ctx -> piece2_t1 - ctx -> piece2_t0),
+                  x, y))
+        ctx -> failed = TRUE;
+}
+
+/*****************************************************************************
+*   Routine to run (at most) iterations Newton iterations on                 *
+* C1(s) - C2(u) = 0 over the current pieces, from (s, u) and staying in      *
+* [0, 1]^2. Sets (s, u), the middle (x, y) of the two points and returns     *
+* their distance.                                                            *
+*****************************************************************************/
+static double newton(pair_ctx *ctx, double *s, double *u, double *x,
+                     double *y, int iterations)
+{
+    int i;
+    double c1[2], c2[2], d1[2], d2[2], dd[2], fx, fy, det, ds, du;
+
+    for (i = 0; ; i++) {
+        crv_eval_piece(ctx -> piece1, ctx -> n1, *s, ctx -> tmp, c1, d1, dd);
+        crv_eval_piece(ctx -> piece2, ctx -> n2, *u, ctx -> tmp, c2, d2, dd);
+        fx = c1[0] - c2[0];
+        fy = c1[1] - c2[1];
+        if (i == iterations) break;
+
+        /* [C1'  -C2'] (ds, du) = -(C1 - C2): */
+        det = d2[0] * d1[1] - d1[0] * d2[1];
+        if (det == 0.0 || !isfinite(det)) break;
+        ds = (fx * d2[1] - d2[0] * fy) / det;
+        du = (fx * d1[1] - d1[0] * fy) / det;
+        ds = *s + ds < 0.0 ? -*s : *s + ds > 1.0 ? 1.0 - *s : ds;
+        du = *u + du < 0.0 ? -*u : *u + du > 1.0 ? 1.0 - *u : du;
+        *s += ds;
+        *u += du;
+        if (fabs(ds) + fabs(du) < NEWTON_EPSILON) {
+            crv_eval_piece(ctx -> piece1, ctx -> n1, *s, ctx -> tmp, c1, d1,
+                           dd);
+            crv_eval_piece(ctx -> piece2, ctx -> n2, *u, ctx -> tmp, c2, d2,
+                           dd);
+            fx = c1[0] - c2[0];
+            fy = c1[1] - c2[1];
+            break;
+        }
+    }
+
+    *x = 0.5 * (c1[0] + c2[0]);
+    *y = 0.5 * (c1[1] + c2[1]);
+    return hypot(fx, fy);
+}
+
+/*****************************************************************************
+*   Routine to subdivide a Bezier piece (as in crv_flat.c) at its middle by  *
+* de Casteljau's algorithm - right is the last diagonal.                     *
+*****************************************************************************/
+static void subdivide(const double *points, int n, double *left,
+                      double *right)
+{
+    int i, r, c;
+
+    for (c = 0; c < 3; c++) {
+        for (i = 0; i < n; i++)
+            right[c * n + i] = points[c * n + i];
+        left[c * n] = right[c * n];
+        for (r = 1; r < n; r++) {
+            for (i = 0; i < n - r; i++)
+                right[c * n + i] = 0.5 * (right[c * n + i] +
+                                          right[c * n + i + 1]);
+            left[c * n + r] = right[c * n];
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to compute the bounding box (x_min, y_min, x_max, y_max) of the  *
+* projected control points of a piece.                                       *
+*****************************************************************************/
+static void piece_box(const double *points, int n, double *box)
+{
+    int i;
+    double px, py;
+
+    box[0] = box[1] = INFINITY;
+    box[2] = box[3] = -INFINITY;
+    for (i = 0; i < n; i++) {
+        px = points[i] / points[2 * n + i];
+        py = points[n + i] / points[2 * n + i];
+        box[0] = px < box[0] ? px : box[0];
+        box[1] = py < box[1] ? py : box[1];
+        box[2] = px > box[2] ? px : box[2];
+        box[3] = py > box[3] ? py : box[3];
+    }
+}
+
+/*****************************************************************************
+*   Routine to test if the fat line of piece 1 - the band along its chord    *
+* holding its projected control points - and the projected control points    *
+* of piece 2 are more than tolerance apart, so are the pieces (as in Bezier  *
+* clipping). Boxes alone let long slanted pieces overlap about everything.   *
+*****************************************************************************/
+static int fat_line_apart(const double *points1, int n1,
+                          const double *points2, int n2, double tolerance)
+{
+    int i;
+    double x0 = points1[0] / points1[2 * n1],
+           y0 = points1[n1] / points1[2 * n1],
+           nx = y0 - points1[2 * n1 - 1] / points1[3 * n1 - 1],
+           ny = points1[n1 - 1] / points1[3 * n1 - 1] - x0,
+           length = hypot(nx, ny),
+           d, d_min = 0.0, d_max = 0.0, d2_min = INFINITY, d2_max = -INFINITY;
+
+    if (!(length > 0.0)) return FALSE;
+    nx /= length;
+    ny /= length;
+
+    for (i = 1; i < n1 - 1; i++) {
+        d = (points1[i] / points1[2 * n1 + i] - x0) * nx +
+            (points1[n1 + i] / points1[2 * n1 + i] - y0) * ny;
+        d_min = d < d_min ? d : d_min;
+        d_max = d > d_max ? d : d_max;
+    }
+    for (i = 0; i < n2; i++) {
+        d = (points2[i] / points2[2 * n2 + i] - x0) * nx +
+            (points2[n2 + i] / points2[2 * n2 + i] - y0) * ny;
+        d2_min = d < d2_min ? d : d2_min;
+        d2_max = d > d2_max ? d : d2_max;
+    }
+    return d2_min > d_max + tolerance || d2_max < d_min - tolerance;
+}
+
+/*****************************************************************************
+*   Routine to test if a Bezier piece is flat: all its projected control     *
+* points are within tolerance of its chord segment (as in crv_flat.c).       *
+*****************************************************************************/
+static int is_flat(const double *points, int n, double tolerance)
+{
+    int i;
+    const double *wx = points,
+                 *wy = points + n,
+                 *w = points + 2 * n;
+    double x0 = wx[0] / w[0],
+           y0 = wy[0] / w[0],
+           dx = wx[n - 1] / w[n - 1] - x0,
+           dy = wy[n - 1] / w[n - 1] - y0,
+           length2 = dx * dx + dy * dy,
+           px, py, s;
+
+    for (i = 1; i < n - 1; i++) {
+        px = wx[i] / w[i] - x0;
+        py = wy[i] / w[i] - y0;
+        s = length2 > 0.0 ? (px * dx + py * dy) / length2 : 0.0;
+        s = s < 0.0 ? 0.0 : s > 1.0 ? 1.0 : s;
+        px -= s * dx;
+        py -= s * dy;
+        if (!(px * px + py * py <= tolerance * tolerance))   /* NaN - FALSE */
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to return the number of points of every piece of a curve.        *
+*****************************************************************************/
+static int piece_size(const crv_scene *scene, int curve)
+{
+    return scene -> kind[curve] == CRV_BEZIER ?
+               scene -> points_offset[curve + 1] -
+                   scene -> points_offset[curve] :
+               scene -> order[curve];
+}
+
+/*****************************************************************************
+*   Routine to append an intersection to a hit list. FALSE if out of memory. *
+*****************************************************************************/
+static int push_hit(hit_list *hits, int curve1, int curve2, double t1,
+                    double t2, double x, double y)
+{
+    int capacity, *new_curve1, *new_curve2;
+    double *new_t1, *new_t2, *new_x, *new_y;
+
+    if (hits -> n == hits -> capacity) {
+        capacity = hits -> capacity == 0 ? INITIAL_CAPACITY :
+                                           2 * hits -> capacity;
+        new_curve1 = (int *) realloc(hits -> curve1, capacity * sizeof(int));
+        if (new_curve1 != NULL) hits -> curve1 = new_curve1;
+        new_curve2 = (int *) realloc(hits -> curve2, capacity * sizeof(int));
+        if (new_curve2 != NULL) hits -> curve2 = new_curve2;
+        new_t1 = (double *) realloc(hits -> t1, capacity * sizeof(double));
+        if (new_t1 != NULL) hits -> t1 = new_t1;
+        new_t2 = (double *) realloc(hits -> t2, capacity * sizeof(double));
+        if (new_t2 != NULL) hits -> t2 = new_t2;
+        new_x = (double *) realloc(hits -> x, capacity * sizeof(double));
+        if (new_x != NULL) hits -> x = new_x;
+        new_y = (double *) realloc(hits -> y, capacity * sizeof(double));
+        if (new_y != NULL) hits -> y = new_y;
+        if (new_curve1 == NULL || new_curve2 == NULL || new_t1 == NULL ||
+            new_t2 == NULL || new_x == NULL || new_y == NULL)
+            return FALSE;
+        hits -> capacity = capacity;
+    }
+
+    hits -> curve1[hits -> n] = curve1;
+    hits -> curve2[hits -> n] = curve2;
+    hits -> t1[hits -> n] = t1;
+    hits -> t2[hits -> n] = t2;
+    hits -> x[hits -> n] = x;
+    hits -> y[hits -> n++] = y;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to concatenate n_lists hit lists into (allocated) intersections, *
+* releasing the lists. Returns NULL if out of memory.                        *
+*****************************************************************************/
+static crv_intersections *hits_to_intersections(hit_list *hits, int n_lists)
+{
+    int i, j,
+        n = 0;
+    crv_intersections *intersections;
+
+    for (i = 0; i < n_lists; i++) n += hits[i].n;
+
+    intersections = (crv_intersections *) calloc(1, sizeof(crv_intersections));
+    if (intersections != NULL) {
+        intersections -> n_intersections = n;
+        intersections -> curve1 = (int *) malloc((n + 1) * sizeof(int));
+        intersections -> curve2 = (int *) malloc((n + 1) * sizeof(int));
+        intersections -> t1 = (double *) malloc((n + 1) * sizeof(double));
+        intersections -> t2 = (double *) malloc((n + 1) * sizeof(double));
+        intersections -> x = (double *) malloc((n + 1) * sizeof(double));
+        intersections -> y = (double *) malloc((n + 1) * sizeof(double));
+        if (intersections -> curve1 == NULL ||
+            intersections -> curve2 == NULL || intersections -> t1 == NULL ||
+            intersections -> t2 == NULL || intersections -> x == NULL ||
+            intersections -> y == NULL) {
+            crv_free_intersections(intersections);
+            intersections = NULL;
+        }
+    }
+
+    for (i = n = 0; i < n_lists; i++) {
+        for (j = 0; j < hits[i].n && intersections != NULL; j++, n++) {
+            intersections -> curve1[n] = hits[i].curve1[j];
+            intersections -> curve2[n] = hits[i].curve2[j];
+            intersections -> t1[n] = hits[i].t1[j];
+            intersections -> t2[n] = hits[i].t2[j];
+            intersections -> x[n] = hits[i].x[j];
+            intersections -> y[n] = hits[i].y[j];
+        }
+        free_hits(&hits[i]);
+    }
+    return intersections;
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for a hit list.                      *
+*****************************************************************************/
+static void free_hits(hit_list *hits)
+{
+    free(hits -> curve1);
+    free(hits -> curve2);
+    free(hits -> t1);
+    free(hits -> t2);
+    free(hits -> x);
+    free(hits -> y);
+}
+
+/*****************************************************************************
+*   qsort comparison of curve boxes, by x_min, and of pairs of curves.       *
+*****************************************************************************/
+static int box_compare(const void *a, const void *b)
+{
+    double x_a = ((const curve_box *) a) -> x_min,
+           x_b = ((const curve_box *) b) -> x_min;
+
+    return x_a < x_b ? -1 : x_a > x_b ? 1 : 0;
+}
+
+static int pair_compare(const void *a, const void *b)
+{
+    const int *pair_a = (const int *) a,
+              *pair_b = (const int *) b;
+
+    return pair_a[0] != pair_b[0] ? pair_a[0] - pair_b[0] :
+                                    pair_a[1] - pair_b[1];
+}
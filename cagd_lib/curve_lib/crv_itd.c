@@ -0,0 +1,599 @@
+/*****************************************************************************
+*   Module to load IRIT .itd polygonal data into indexed mesh buffers.       *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_mesh *load_itd(path)   - map the .itd file and parse it.            *
+*    crv_mesh *parse_itd(buf, len) - parse an .itd file already in memory.   *
+*    Errors are reported by crv_ioerror() / crv_ioerror_line() (crv_io.c).   *
+* 2. free_mesh(mesh)            - release memory allocated for the mesh.     *
+*                                                                            *
+*   The .itd subset read (anything after # up to the line end is ignored):   *
+* FILE    ::= OBJECT*                                                        *
+* OBJECT  ::= [OBJECT ATTR* NAME? (OBJECT | POLYGON | ATTR)* ]               *
+* POLYGON ::= [POLYGON ATTR* COUNT? VERTEX* ]                                *
+* VERTEX  ::= [ATTR* NUMBER NUMBER NUMBER]                                   *
+* ATTR    ::= [WORD ...]           (any bracketed list, brackets balanced)   *
+*   The [PLANE a b c d] attribute of a polygon and the [NORMAL x y z]        *
+* attribute of a vertex are used, other attributes (and other objects, such  *
+* as polylines) are skipped. A vertex without a normal takes its polygon     *
+* plane normal, or the polygon Newell normal if it has no plane either.      *
+*                                                                            *
+*   The file is scanned once, in place. Vertices are deduplicated by their   *
+* (position, normal) through a hash table as they are read, so shared        *
+* vertices are stored once, and every polygon is also fanned to triangles.   *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_NUMBER_LEN   63
+#define  INITIAL_CAPACITY 64
+
+#define  IS_SPACE(c)  ((c) == ' ' || (c) == '\t' || (c) == '\r' || \
+                       (c) == '\n' || (c) == '\v' || (c) == '\f')
+
+enum {                                  /* Kinds of itd_reader tokens */
+     TOKEN_END,
+     TOKEN_OPEN,
+     TOKEN_CLOSE,
+     TOKEN_WORD
+};
+
+typedef struct itd_reader {
+     const char *next, *end;        /* Not yet scanned part of the buffer */
+     const char *token, *token_end;            /* Last TOKEN_WORD scanned */
+     int line_number;
+} itd_reader;
+
+typedef struct itd_vertex {
+     float position[3], normal[3];
+     int has_normal;
+} itd_vertex;
+
+typedef struct itd_builder {
+     crv_mesh *mesh;
+     int *table;          /* Hash table of vertex indices, -1 marks empty */
+     int table_size;                                    /* A power of two */
+     itd_vertex *polygon;              /* Vertices of the current polygon */
+     int polygon_capacity;
+     int vertices_capacity, normals_capacity;        /* Of the mesh arrays */
+     int faces_capacity, indices_capacity;
+} itd_builder;
+
+static int next_token(itd_reader *reader);
+static int match_word(const itd_reader *reader, const char *word);
+static int parse_double(const char *s, const char *end, double *data);
+static int skip_list(itd_reader *reader);
+static int parse_object(itd_reader *reader, itd_builder *builder);
+static int parse_polygon(itd_reader *reader, itd_builder *builder);
+static int parse_vertex(itd_reader *reader, int token, itd_vertex *vertex);
+static int parse_numbers(itd_reader *reader, double *numbers, int n);
+static int end_polygon(itd_builder *builder, int n, const double *plane);
+static int insert_vertex(itd_builder *builder, const itd_vertex *vertex);
+static uint32_t hash_vertex(const float *key);
+static int grow_table(itd_builder *builder);
+static int reserve(void **array, int *capacity, int n, size_t item_size);
+static crv_mesh *itd_error(crv_mesh *mesh, itd_builder *builder,
+                           const itd_reader *reader, int error);
+
+/*****************************************************************************
+*   Routine to load an .itd file into a new mesh. The file is mapped to      *
+* memory and parsed in place.                                                *
+* Returns NULL if an error was found, and error is in crv_ioerror()          *
+*****************************************************************************/
+crv_mesh *crv_load_itd(const char *path)
+{
+    const char *buf;
+    size_t len = 0;
+    crv_mesh *mesh;
+
+    if ((buf = crv_map_file(path, &len)) == NULL) {
+        crv_set_ioerror(CRV_OPEN_ERROR, 0);
+        return NULL;
+    }
+    mesh = crv_parse_itd(buf, len);
+    crv_unmap_file(buf, len);
+    return mesh;
+}
+
+/*****************************************************************************
+*   Routine to parse an .itd file held in buf (need not be NULL terminated). *
+* See the grammar above. Returns NULL if an error was found, and error is    *
+* in crv_ioerror(), the line it was found at in crv_ioerror_line().          *
+*****************************************************************************/
+crv_mesh *crv_parse_itd(const char *buf, size_t len)
+{
+    int token, i, j, k;
+    itd_reader reader;
+    itd_builder builder;
+    crv_mesh *mesh;
+
+    crv_set_ioerror(0, 0);
+    reader.next = buf;
+    reader.end = buf + len;
+    reader.line_number = 1;
+    memset(&builder, 0, sizeof(builder));
+
+    if ((mesh = (crv_mesh *) calloc(1, sizeof(crv_mesh))) == NULL)
+        return itd_error(mesh, &builder, &reader, CRV_ALLOC_ERROR);
+    builder.mesh = mesh;
+    if (!reserve((void **) &mesh -> faces_offset, &builder.faces_capacity, 1,
+                 sizeof(int)) ||
+        !grow_table(&builder))
+        return itd_error(mesh, &builder, &reader, CRV_ALLOC_ERROR);
+    mesh -> faces_offset[0] = 0;
+
+    while ((token = next_token(&reader)) != TOKEN_END) {
+        if (token != TOKEN_OPEN || next_token(&reader) != TOKEN_WORD ||
+            !match_word(&reader, "OBJECT"))
+            return itd_error(mesh, &builder, &reader, CRV_ITD_ERROR);
+        if (!parse_object(&reader, &builder))
+            return itd_error(mesh, &builder, &reader, crv_ioerror());
+    }
+
+    /* Fan every polygon to triangles: */
+    mesh -> n_triangles = 0;
+    for (i = 0; i < mesh -> n_faces; i++) {
+        k = mesh -> faces_offset[i + 1] - mesh -> faces_offset[i];
+        if (k >= 3) mesh -> n_triangles += k - 2;
+    }
+    if (mesh -> n_triangles > 0 &&
+        (mesh -> triangles = (int *) malloc(3 * sizeof(int) *
+                                            mesh -> n_triangles)) == NULL)
+        return itd_error(mesh, &builder, &reader, CRV_ALLOC_ERROR);
+    for (i = k = 0; i < mesh -> n_faces; i++) {
+        const int *face = &mesh -> indices[mesh -> faces_offset[i]];
+
+        for (j = 2; j < mesh -> faces_offset[i + 1] -
+                        mesh -> faces_offset[i]; j++) {
+            mesh -> triangles[k++] = face[0];
+            mesh -> triangles[k++] = face[j - 1];
+            mesh -> triangles[k++] = face[j];
+        }
+    }
+
+    free(builder.table);
+    free(builder.polygon);
+    return mesh;
+}
+
+/*****************************************************************************
+*   Routine to free a mesh - release all memory allocated by it.             *
+*****************************************************************************/
+void crv_free_mesh(crv_mesh *mesh)
+{
+    if (!mesh) return;
+    free(mesh -> vertices);
+    free(mesh -> normals);
+    free(mesh -> faces_offset);
+    free(mesh -> indices);
+    free(mesh -> triangles);
+    free(mesh);
+}
+
+/*****************************************************************************
+*   Routine to record a parsing error, release the partial mesh and return   *
+* NULL, so the parser can simply return its result.                          *
+*****************************************************************************/
+static crv_mesh *itd_error(crv_mesh *mesh, itd_builder *builder,
+                           const itd_reader *reader, int error)
+{
+    crv_set_ioerror(error, reader -> line_number);
+    crv_free_mesh(mesh);
+    free(builder -> table);
+    free(builder -> polygon);
+    return NULL;
+}
+
+/*****************************************************************************
+*   Routine to scan the next token: a bracket or a word (any run of other    *
+* characters). Comments and white spaces are skipped, counting lines.        *
+*****************************************************************************/
+static int next_token(itd_reader *reader)
+{
+    const char *s = reader -> next,
+        *end = reader -> end;
+
+    while (s < end) {
+        if (*s == '\n') reader -> line_number++;
+        if (*s == '#') {
+            while (s < end && *s != '\n') s++;
+            continue;
+        }
+        if (!IS_SPACE(*s)) break;
+        s++;
+    }
+    if (s == end) {
+        reader -> next = s;
+        return TOKEN_END;
+    }
+    if (*s == '[' || *s == ']') {
+        reader -> next = s + 1;
+        return *s == '[' ? TOKEN_OPEN : TOKEN_CLOSE;
+    }
+    reader -> token = s;
+    while (s < end && !IS_SPACE(*s) && *s != '[' && *s != ']' && *s != '#')
+        s++;
+    reader -> token_end = reader -> next = s;
+    return TOKEN_WORD;
+}
+
+/*****************************************************************************
+*   Routine to test if the last word scanned is word (case insensitive, as   *
+* IRIT writes keywords).                                                     *
+*****************************************************************************/
+static int match_word(const itd_reader *reader, const char *word)
+{
+    size_t len = strlen(word), i;
+
+    if ((size_t) (reader -> token_end - reader -> token) != len) return FALSE;
+    for (i = 0; i < len; i++) {
+        char c = reader -> token[i];
+
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != word[i]) return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to convert the token [s, end) to a double. The token is copied   *
+* to a small local buffer as the mapped file is not NULL terminated.         *
+*****************************************************************************/
+static int parse_double(const char *s, const char *end, double *data)
+{
+    char number[MAX_NUMBER_LEN + 1], *number_end;
+    size_t len = end - s;
+
+    if (len == 0 || len > MAX_NUMBER_LEN) return FALSE;
+    memcpy(number, s, len);
+    number[len] = 0;
+    *data = strtod(number, &number_end);
+    return number_end == number + len;
+}
+
+/*****************************************************************************
+*   Routine to skip the rest of a list whose [ was just scanned, up to its   *
+* matching ]. Returns FALSE if the file ends first.                          *
+*****************************************************************************/
+static int skip_list(itd_reader *reader)
+{
+    int depth = 1;
+
+    while (depth > 0) {
+        switch (next_token(reader)) {
+            case TOKEN_END:
+                crv_set_ioerror(CRV_EOF_ERROR, reader -> line_number);
+                return FALSE;
+            case TOKEN_OPEN:
+                depth++;
+                break;
+            case TOKEN_CLOSE:
+                depth--;
+                break;
+        }
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to parse an object whose "[OBJECT" was just scanned, up to its   *
+* ]. Polygons (of nested objects too) are added to the mesh.                 *
+*****************************************************************************/
+static int parse_object(itd_reader *reader, itd_builder *builder)
+{
+    while (TRUE) {
+        switch (next_token(reader)) {
+            case TOKEN_END:
+                crv_set_ioerror(CRV_EOF_ERROR, reader -> line_number);
+                return FALSE;
+            case TOKEN_CLOSE:
+                return TRUE;
+            case TOKEN_WORD:                         /* The object name */
+                break;
+            case TOKEN_OPEN:
+                if (next_token(reader) != TOKEN_WORD) {
+                    crv_set_ioerror(CRV_ITD_ERROR, reader -> line_number);
+                    return FALSE;
+                }
+                if (match_word(reader, "OBJECT")) {
+                    if (!parse_object(reader, builder)) return FALSE;
+                }
+                else if (match_word(reader, "POLYGON")) {
+                    if (!parse_polygon(reader, builder)) return FALSE;
+                }
+                else if (!skip_list(reader))
+                    return FALSE;
+                break;
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to parse a polygon whose "[POLYGON" was just scanned, up to its  *
+* ], and add it to the mesh.                                                 *
+*****************************************************************************/
+static int parse_polygon(itd_reader *reader, itd_builder *builder)
+{
+    int token,
+        n = 0,
+        has_plane = FALSE;
+    double plane[4], count;
+
+    while (TRUE) {
+        switch (next_token(reader)) {
+            case TOKEN_END:
+                crv_set_ioerror(CRV_EOF_ERROR, reader -> line_number);
+                return FALSE;
+            case TOKEN_CLOSE:
+                if (!end_polygon(builder, n, has_plane ? plane : NULL)) {
+                    crv_set_ioerror(CRV_ALLOC_ERROR, reader -> line_number);
+                    return FALSE;
+                }
+                return TRUE;
+            case TOKEN_WORD:      /* The number of vertices, not relied on */
+                if (!parse_double(reader -> token, reader -> token_end,
+                                  &count)) {
+                    crv_set_ioerror(CRV_NUMBER_ERROR, reader -> line_number);
+                    return FALSE;
+                }
+                break;
+            case TOKEN_OPEN:
+                token = next_token(reader);
+                if (token == TOKEN_WORD && match_word(reader, "PLANE")) {
+                    if (!parse_numbers(reader, plane, 4)) return FALSE;
+                    has_plane = TRUE;
+                }
+                else if (token == TOKEN_OPEN ||
+                         (token == TOKEN_WORD &&
+                          parse_double(reader -> token, reader -> token_end,
+                                       &count))) {
+                    if (!reserve((void **) &builder -> polygon,
+                                 &builder -> polygon_capacity, n + 1,
+                                 sizeof(itd_vertex))) {
+                        crv_set_ioerror(CRV_ALLOC_ERROR,
+                                        reader -> line_number);
+                        return FALSE;
+                    }
+                    if (!parse_vertex(reader, token, &builder -> polygon[n]))
+                        return FALSE;
+                    n++;
+                }
+                else if (token == TOKEN_WORD) {  /* Any other attribute */
+                    if (!skip_list(reader)) return FALSE;
+                }
+                else {
+                    crv_set_ioerror(CRV_ITD_ERROR, reader -> line_number);
+                    return FALSE;
+                }
+                break;
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to parse a vertex whose [ and first token (given as token - an   *
+* attribute [ or the x coordinate word) were just scanned, up to its ].      *
+*****************************************************************************/
+static int parse_vertex(itd_reader *reader, int token, itd_vertex *vertex)
+{
+    int i;
+    double numbers[3];
+
+    vertex -> has_normal = FALSE;
+    while (token == TOKEN_OPEN) {
+        if (next_token(reader) != TOKEN_WORD) {
+            crv_set_ioerror(CRV_ITD_ERROR, reader -> line_number);
+            return FALSE;
+        }
+        if (match_word(reader, "NORMAL")) {
+            if (!parse_numbers(reader, numbers, 3)) return FALSE;
+            for (i = 0; i < 3; i++) vertex -> normal[i] = (float) numbers[i];
+            vertex -> has_normal = TRUE;
+        }
+        else if (!skip_list(reader))
+            return FALSE;
+        token = next_token(reader);
+    }
+
+    if (token != TOKEN_WORD ||
+        !parse_double(reader -> token, reader -> token_end, &numbers[0])) {
+        crv_set_ioerror(CRV_POINT_ERROR, reader -> line_number);
+        return FALSE;
+    }
+    if (!parse_numbers(reader, &numbers[1], 2)) return FALSE;
+    for (i = 0; i < 3; i++) vertex -> position[i] = (float) numbers[i];
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to parse exactly n numbers and the ] closing their list.         *
+*****************************************************************************/
+static int parse_numbers(itd_reader *reader, double *numbers, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (next_token(reader) != TOKEN_WORD) {
+            crv_set_ioerror(CRV_POINT_ERROR, reader -> line_number);
+            return FALSE;
+        }
+        if (!parse_double(reader -> token, reader -> token_end, &numbers[i])) {
+            crv_set_ioerror(CRV_NUMBER_ERROR, reader -> line_number);
+            return FALSE;
+        }
+    }
+    if (next_token(reader) != TOKEN_CLOSE) {
+        crv_set_ioerror(CRV_POINT_ERROR, reader -> line_number);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to add the n vertices of the polygon just parsed to the mesh, as *
+* a face. Vertices with no normal take the plane normal (a, b, c), or the    *
+* Newell normal of the polygon if plane is NULL. Returns FALSE if out of     *
+* memory.                                                                    *
+*****************************************************************************/
+static int end_polygon(itd_builder *builder, int n, const double *plane)
+{
+    int i, index;
+    double normal[3], length;
+    const float *p, *q;
+    crv_mesh *mesh = builder -> mesh;
+
+    if (n == 0) return TRUE;
+    if (plane != NULL) {
+        normal[0] = plane[0];
+        normal[1] = plane[1];
+        normal[2] = plane[2];
+    }
+    else {
+        normal[0] = normal[1] = normal[2] = 0.0;
+        for (i = 0; i < n; i++) {
+            p = builder -> polygon[i].position;
+            q = builder -> polygon[(i + 1) % n].position;
+            normal[0] += ((double) p[1] - q[1]) * ((double) p[2] + q[2]);
+            normal[1] += ((double) p[2] - q[2]) * ((double) p[0] + q[0]);
+            normal[2] += ((double) p[0] - q[0]) * ((double) p[1] + q[1]);
+        }
+    }
+    length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                  normal[2] * normal[2]);
+    if (length > 0.0)
+        for (i = 0; i < 3; i++) normal[i] /= length;
+
+    if (!reserve((void **) &mesh -> indices, &builder -> indices_capacity,
+                 mesh -> n_indices + n, sizeof(int)) ||
+        !reserve((void **) &mesh -> faces_offset, &builder -> faces_capacity,
+                 mesh -> n_faces + 2, sizeof(int)))
+        return FALSE;
+    for (i = 0; i < n; i++) {
+        itd_vertex *vertex = &builder -> polygon[i];
+
+        if (!vertex -> has_normal) {
+            vertex -> normal[0] = (float) normal[0];
+            vertex -> normal[1] = (float) normal[1];
+            vertex -> normal[2] = (float) normal[2];
+        }
+        if ((index = insert_vertex(builder, vertex)) < 0) return FALSE;
+        mesh -> indices[mesh -> n_indices++] = index;
+    }
+    mesh -> faces_offset[++mesh -> n_faces] = mesh -> n_indices;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to find the index of a vertex (position and normal) in the mesh, *
+* adding it if it is new. Returns -1 if out of memory.                       *
+*****************************************************************************/
+static int insert_vertex(itd_builder *builder, const itd_vertex *vertex)
+{
+    int i, index;
+    float key[6];
+    uint32_t slot;
+    crv_mesh *mesh = builder -> mesh;
+
+    for (i = 0; i < 3; i++) {
+        key[i] = vertex -> position[i] + 0.0f;         /* -0 hashes as +0 */
+        key[i + 3] = vertex -> normal[i] + 0.0f;
+    }
+
+    slot = hash_vertex(key) & (builder -> table_size - 1);
+    while ((index = builder -> table[slot]) >= 0) {
+        if (memcmp(&mesh -> vertices[3 * index], key,
+                   3 * sizeof(float)) == 0 &&
+            memcmp(&mesh -> normals[3 * index], &key[3],
+                   3 * sizeof(float)) == 0)
+            return index;
+        slot = (slot + 1) & (builder -> table_size - 1);
+    }
+
+    index = mesh -> n_vertices;
+    if (!reserve((void **) &mesh -> vertices, &builder -> vertices_capacity,
+                 3 * (index + 1), sizeof(float)) ||
+        !reserve((void **) &mesh -> normals, &builder -> normals_capacity,
+                 3 * (index + 1), sizeof(float)))
+        return -1;
+    memcpy(&mesh -> vertices[3 * index], key, 3 * sizeof(float));
+    memcpy(&mesh -> normals[3 * index], &key[3], 3 * sizeof(float));
+    mesh -> n_vertices++;
+    builder -> table[slot] = index;
+
+    /* Keep the table at most half full: */
+    if (2 * mesh -> n_vertices > builder -> table_size &&
+        !grow_table(builder))
+        return -1;
+    return index;
+}
+
+/*****************************************************************************
+*   Routine to hash the 6 floats of a vertex key (FNV-1a over their bits).   *
+*****************************************************************************/
+static uint32_t hash_vertex(const float *key)
+{
+    int i;
+    uint32_t bits,
+        hash = 2166136261u;
+
+    for (i = 0; i < 6; i++) {
+        memcpy(&bits, &key[i], sizeof(bits));
+        hash = (hash ^ bits) * 16777619u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+/*****************************************************************************
+*   Routine to double the vertices hash table (allocate it at first), and    *
+* rehash the mesh vertices into it. Returns FALSE if out of memory.          *
+*****************************************************************************/
+static int grow_table(itd_builder *builder)
+{
+    int i, size = builder -> table_size > 0 ? 2 * builder -> table_size
+                                            : 2 * INITIAL_CAPACITY;
+    int *table;
+    float key[6];
+    uint32_t slot;
+    crv_mesh *mesh = builder -> mesh;
+
+    if ((table = (int *) malloc(size * sizeof(int))) == NULL) return FALSE;
+    for (i = 0; i < size; i++) table[i] = -1;
+    for (i = 0; i < mesh -> n_vertices; i++) {
+        memcpy(key, &mesh -> vertices[3 * i], 3 * sizeof(float));
+        memcpy(&key[3], &mesh -> normals[3 * i], 3 * sizeof(float));
+        slot = hash_vertex(key) & (size - 1);
+        while (table[slot] >= 0) slot = (slot + 1) & (size - 1);
+        table[slot] = i;
+    }
+    free(builder -> table);
+    builder -> table = table;
+    builder -> table_size = size;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to make sure *array (of *capacity items) can hold n items,       *
+* doubling it as needed. Returns FALSE if out of memory (*array unchanged).  *
+*****************************************************************************/
+static int reserve(void **array, int *capacity, int n, size_t item_size)
+{
+    int new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY;
+    void *new_array;
+
+    if (n <= *capacity) return TRUE;
+    while (new_capacity < n) new_capacity *= 2;
+    if ((new_array = realloc(*array, new_capacity * item_size)) == NULL)
+        return FALSE;
+    *array = new_array;
+    *capacity = new_capacity;
+    return TRUE;
+}
@@ -0,0 +1,112 @@
+/*****************************************************************************
+*   Module to generate offset curves and evolutes from curve samples.        *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. offset_samples(n_samples, dim, points, normals, defined, n_offsets,     *
+*                  offsets, out) - the samples of offset curves at many      *
+*                  offset distances at once, in parallel.                    *
+* 2. evolute_samples(n_samples, dim, points, normals, radii, defined, out) - *
+*                  the samples of the evolute, in parallel.                  *
+*                                                                            *
+*   Both take cached samples (points and unit normals, dim coordinates       *
+* each), so nothing of the curve is evaluated again when only the offset     *
+* distance changes. Samples whose normal (or curvature radius) is undefined  *
+* are flagged by defined[i] == 0 and give NaN points.                        *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  GRAIN     4096             /* Samples per task of the thread pool */
+
+typedef struct offset_ctx {
+     int n_samples, dim;
+     const double *points, *normals;
+     const double *distances;           /* Per sample (evolute), or NULL */
+     const unsigned char *defined;                          /* Or NULL */
+     int n_offsets;
+     const double *offsets;
+     double *out;
+} offset_ctx;
+
+static void offset_task(void *ctx, int begin, int end);
+
+/*****************************************************************************
+*   Routine to compute the offset curves of the n_samples samples points,    *
+* with unit normals normals (n_samples * dim each), at the n_offsets offset  *
+* distances: out[k][i] = points[i] + offsets[k] * normals[i], out holding    *
+* n_offsets * n_samples * dim doubles. defined may be NULL (all defined).    *
+*****************************************************************************/
+void crv_offset_samples(int n_samples, int dim, const double *points,
+                        const double *normals, const unsigned char *defined,
+                        int n_offsets, const double *offsets, double *out)
+{
+    offset_ctx ctx;
+
+    ctx.n_samples = n_samples;
+    ctx.dim = dim;
+    ctx.points = points;
+    ctx.normals = normals;
+    ctx.distances = NULL;
+    ctx.defined = defined;
+    ctx.n_offsets = n_offsets;
+    ctx.offsets = offsets;
+    ctx.out = out;
+    crv_parallel_for(n_samples, GRAIN, offset_task, &ctx);
+}
+
+/*****************************************************************************
+*   Routine to compute the evolute - the centers of curvature - of the       *
+* n_samples samples points, with unit (principal) normals normals and        *
+* curvature radii radii: out[i] = points[i] + radii[i] * normals[i], out     *
+* holding n_samples * dim doubles. defined may be NULL (all defined).        *
+*****************************************************************************/
+void crv_evolute_samples(int n_samples, int dim, const double *points,
+                         const double *normals, const double *radii,
+                         const unsigned char *defined, double *out)
+{
+    offset_ctx ctx;
+
+    ctx.n_samples = n_samples;
+    ctx.dim = dim;
+    ctx.points = points;
+    ctx.normals = normals;
+    ctx.distances = radii;
+    ctx.defined = defined;
+    ctx.n_offsets = 1;
+    ctx.offsets = NULL;
+    ctx.out = out;
+    crv_parallel_for(n_samples, GRAIN, offset_task, &ctx);
+}
+
+/*****************************************************************************
+*   The crv_offset_samples / crv_evolute_samples task: the samples           *
+* [begin, end) of every offset.                                              *
+*****************************************************************************/
+static void offset_task(void *ctx, int begin, int end)
+{
+    offset_ctx *offset = (offset_ctx *) ctx;
+    int i, k, c,
+        dim = offset -> dim;
+    const double *p, *normal;
+    double d, *q;
+
+    for (k = 0; k < offset -> n_offsets; k++) {
+        for (i = begin; i < end; i++) {
+            p = &offset -> points[i * dim];
+            normal = &offset -> normals[i * dim];
+            q = &offset -> out[((size_t) k * offset -> n_samples + i) * dim];
+            d = offset -> distances != NULL ? offset -> distances[i] :
+                                              offset -> offsets[k];
+
+            if (offset -> defined != NULL && !offset -> defined[i]) {
+                for (c = 0; c < dim; c++) q[c] = NAN;
+                continue;
+            }
+            for (c = 0; c < dim; c++)
+                q[c] = p[c] + d * normal[c];
+        }
+    }
+}
@@ -0,0 +1,584 @@
+/*****************************************************************************
+*   Module of a spatial index over the curves samples (polylines) and        *
+* control points of a scene, to pick curves, points and samples near a       *
+* location.                                                                  *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_pick_index *alloc_pick_index() - returns a new empty index.         *
+*    free_pick_index(index)     - release memory allocated for the index.    *
+* 2. int pick_insert_curve(index, curve) - insert an empty curve at curve.   *
+*    pick_delete_curve(index, curve) - delete a curve, next curves shift.    *
+*    int pick_set_curve(index, curve, n_samples, x, y, n_points, px, py) -   *
+*                  set (replace) the samples and control points of a curve.  *
+* 3. int pick_nearest_curve(index, x, y, radius, skip_curve, segment, dist)  *
+*    int pick_nearest_point(index, curve, x, y, radius, dist)                *
+*    int pick_nearest_sample(index, curve, x, y, radius, dist) - the nearest *
+*                  curve / control point / sample within radius, or -1.      *
+*                                                                            *
+*   Every curve has a bounding volume hierarchy (BVH) of its polyline        *
+* segments and one of its control points, built when the curve is set. A     *
+* top BVH over the curves boxes is rebuilt lazily, on the first query after  *
+* a change, so replacing a curve costs only the rebuild of that curve.       *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  BVH_LEAF_SIZE    4
+#define  BVH_STACK_SIZE   128   /* Median split - depth is ~log2(n_items) */
+
+typedef struct bvh {
+     int n_items;
+     int n_nodes;
+     float *box;       /* 4 per node: x_min, y_min, x_max, y_max, as items */
+     int *first;    /* Leaf: items order[first, first + count), else child */
+     int *count;        /* 0 for inner nodes, children are first, first + 1 */
+     int *order;
+} bvh;
+
+typedef struct pick_curve {
+     int n_samples, n_points;
+     float *x, *y;                                       /* The polyline */
+     float *px, *py;                                 /* The control points */
+     bvh segments, points;
+} pick_curve;
+
+struct crv_pick_index {
+     int n_curves, capacity;
+     pick_curve *curves;
+     bvh top;                          /* Over the curves having segments */
+     int *top_curves;                   /* Top BVH item to curve number */
+     int dirty;                                  /* Top BVH is out of date */
+};
+
+/* Distance from (x, y) to an item, or more than best if not nearer: */
+typedef double (*item_dist_fn)(void *ctx, int item, double x, double y,
+                               double best);
+
+typedef struct top_ctx {
+     crv_pick_index *index;
+     int skip_curve;
+     int segment;              /* Nearest segment of the nearest curve yet */
+} top_ctx;
+
+static int bvh_build(bvh *b, const float *item_box, int n_items);
+static void bvh_split(bvh *b, const float *item_box, const float *centroid,
+                      int node, int first, int count);
+static void bvh_free(bvh *b);
+static int bvh_nearest(const bvh *b, double x, double y, double *best,
+                       item_dist_fn fn, void *ctx);
+static void select_nth(int *order, const float *key, int count, int n);
+static double box_dist2(const float *box, double x, double y);
+static int n_segments(const pick_curve *curve);
+static void segment_box(const pick_curve *curve, int segment, float *box);
+static double segment_dist(void *ctx, int item, double x, double y,
+                           double best);
+static double vertex_dist(void *ctx, int item, double x, double y,
+                          double best);
+static double point_dist(void *ctx, int item, double x, double y,
+                         double best);
+static double curve_dist(void *ctx, int item, double x, double y,
+                         double best);
+static void clear_curve(pick_curve *curve);
+static int update_top(crv_pick_index *index);
+
+/*****************************************************************************
+*   Routine to allocate a new empty pick index. NULL if out of memory.       *
+*****************************************************************************/
+crv_pick_index *crv_alloc_pick_index(void)
+{
+    return (crv_pick_index *) calloc(1, sizeof(crv_pick_index));
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for a pick index.                    *
+*****************************************************************************/
+void crv_free_pick_index(crv_pick_index *index)
+{
+    int i;
+
+    if (index == NULL) return;
+
+    for (i = 0; i < index -> n_curves; i++)
+        clear_curve(&index -> curves[i]);
+    free(index -> curves);
+    bvh_free(&index -> top);
+    free(index -> top_curves);
+    free(index);
+}
+
+/*****************************************************************************
+*   Routine to insert a new curve, with no samples or points, before curve   *
+* number curve (n_curves to append). Returns FALSE if out of memory.         *
+*****************************************************************************/
+int crv_pick_insert_curve(crv_pick_index *index, int curve)
+{
+    int capacity;
+    pick_curve *curves;
+
+    if (curve < 0 || curve > index -> n_curves) return FALSE;
+
+    if (index -> n_curves == index -> capacity) {
+        capacity = index -> capacity == 0 ? 16 : 2 * index -> capacity;
+        curves = (pick_curve *) realloc(index -> curves,
+                                        capacity * sizeof(pick_curve));
+        if (curves == NULL) return FALSE;
+        index -> curves = curves;
+        index -> capacity = capacity;
+    }
+
+    memmove(&index -> curves[curve + 1], &index -> curves[curve],
+            (index -> n_curves - curve) * sizeof(pick_curve));
+    memset(&index -> curves[curve], 0, sizeof(pick_curve));
+    index -> n_curves++;
+    index -> dirty = TRUE;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to delete curve number curve, the next curves numbers shift.     *
+*****************************************************************************/
+void crv_pick_delete_curve(crv_pick_index *index, int curve)
+{
+    if (curve < 0 || curve >= index -> n_curves) return;
+
+    clear_curve(&index -> curves[curve]);
+    memmove(&index -> curves[curve], &index -> curves[curve + 1],
+            (index -> n_curves - curve - 1) * sizeof(pick_curve));
+    index -> n_curves--;
+    index -> dirty = TRUE;
+}
+
+/*****************************************************************************
+*   Routine to set the polyline (n_samples vertices x, y) and the control    *
+* points (n_points px, py) of curve number curve, and build its BVHs.        *
+* Returns FALSE if out of memory, the curve is then left empty.              *
+*****************************************************************************/
+int crv_pick_set_curve(crv_pick_index *index, int curve, int n_samples,
+                       const float *x, const float *y, int n_points,
+                       const float *px, const float *py)
+{
+    int i, n;
+    float *item_box;
+    pick_curve *c;
+
+    if (curve < 0 || curve >= index -> n_curves) return FALSE;
+
+    c = &index -> curves[curve];
+    clear_curve(c);
+    index -> dirty = TRUE;
+
+    c -> x = (float *) malloc((n_samples + 1) * sizeof(float));
+    c -> y = (float *) malloc((n_samples + 1) * sizeof(float));
+    c -> px = (float *) malloc((n_points + 1) * sizeof(float));
+    c -> py = (float *) malloc((n_points + 1) * sizeof(float));
+    n = n_samples > n_points ? n_samples : n_points;
+    item_box = (float *) malloc(4 * (n + 1) * sizeof(float));
+    if (c -> x == NULL || c -> y == NULL || c -> px == NULL ||
+        c -> py == NULL || item_box == NULL) {
+        free(item_box);
+        clear_curve(c);
+        return FALSE;
+    }
+
+    c -> n_samples = n_samples;
+    c -> n_points = n_points;
+    memcpy(c -> x, x, n_samples * sizeof(float));
+    memcpy(c -> y, y, n_samples * sizeof(float));
+    memcpy(c -> px, px, n_points * sizeof(float));
+    memcpy(c -> py, py, n_points * sizeof(float));
+
+    for (i = 0; i < n_segments(c); i++)
+        segment_box(c, i, &item_box[4 * i]);
+    if (!bvh_build(&c -> segments, item_box, n_segments(c))) {
+        free(item_box);
+        clear_curve(c);
+        return FALSE;
+    }
+
+    for (i = 0; i < n_points; i++) {
+        item_box[4 * i] = item_box[4 * i + 2] = px[i];
+        item_box[4 * i + 1] = item_box[4 * i + 3] = py[i];
+    }
+    if (!bvh_build(&c -> points, item_box, n_points)) {
+        free(item_box);
+        clear_curve(c);
+        return FALSE;
+    }
+
+    free(item_box);
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to find the curve nearest to (x, y), within radius, but for      *
+* skip_curve (-1 for none). Returns the curve number, or -1 if none, and     *
+* sets segment to its nearest polyline segment and dist to the distance.     *
+*****************************************************************************/
+int crv_pick_nearest_curve(crv_pick_index *index, double x, double y,
+                           double radius, int skip_curve, int *segment,
+                           double *dist)
+{
+    int item;
+    double best = radius;
+    top_ctx ctx;
+
+    if (index -> dirty && !update_top(index)) return -1;
+
+    ctx.index = index;
+    ctx.skip_curve = skip_curve;
+    ctx.segment = -1;
+    item = bvh_nearest(&index -> top, x, y, &best, curve_dist, &ctx);
+    if (item < 0) return -1;
+
+    *segment = ctx.segment;
+    *dist = best;
+    return index -> top_curves[item];
+}
+
+/*****************************************************************************
+*   Routine to find the control point of curve number curve nearest to       *
+* (x, y), within radius. Returns the point number or -1, and sets dist.      *
+*****************************************************************************/
+int crv_pick_nearest_point(crv_pick_index *index, int curve, double x,
+                           double y, double radius, double *dist)
+{
+    int point;
+    double best = radius;
+
+    if (curve < 0 || curve >= index -> n_curves) return -1;
+
+    point = bvh_nearest(&index -> curves[curve].points, x, y, &best,
+                        point_dist, &index -> curves[curve]);
+    if (point >= 0) *dist = best;
+    return point;
+}
+
+/*****************************************************************************
+*   Routine to find the sample (polyline vertex) of curve number curve       *
+* nearest to (x, y), within radius. Returns the sample number or -1, and     *
+* sets dist.                                                                 *
+*****************************************************************************/
+int crv_pick_nearest_sample(crv_pick_index *index, int curve, double x,
+                            double y, double radius, double *dist)
+{
+    int segment;
+    double best = radius;
+    pick_curve *c;
+
+    if (curve < 0 || curve >= index -> n_curves) return -1;
+
+    c = &index -> curves[curve];
+    segment = bvh_nearest(&c -> segments, x, y, &best, vertex_dist, c);
+    if (segment < 0) return -1;
+
+    *dist = best;
+    if (segment + 1 < c -> n_samples &&
+        hypot(c -> x[segment + 1] - x, c -> y[segment + 1] - y) <
+        hypot(c -> x[segment] - x, c -> y[segment] - y))
+        return segment + 1;
+    return segment;
+}
+
+/*****************************************************************************
+*   Routine to rebuild the top BVH over the curves that have segments.       *
+*****************************************************************************/
+static int update_top(crv_pick_index *index)
+{
+    int i, n = 0;
+    float *item_box;
+
+    bvh_free(&index -> top);
+    free(index -> top_curves);
+    index -> top_curves = (int *) malloc((index -> n_curves + 1) * sizeof(int));
+    item_box = (float *) malloc(4 * (index -> n_curves + 1) * sizeof(float));
+    if (index -> top_curves == NULL || item_box == NULL) {
+        free(item_box);
+        return FALSE;
+    }
+
+    for (i = 0; i < index -> n_curves; i++) {
+        if (index -> curves[i].segments.n_nodes == 0) continue;
+        memcpy(&item_box[4 * n], index -> curves[i].segments.box,
+               4 * sizeof(float));
+        index -> top_curves[n++] = i;
+    }
+    if (!bvh_build(&index -> top, item_box, n)) {
+        free(item_box);
+        return FALSE;
+    }
+
+    free(item_box);
+    index -> dirty = FALSE;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routines of the items distances, for bvh_nearest.                        *
+*****************************************************************************/
+static double segment_dist(void *ctx, int item, double x, double y,
+                           double best)
+{
+    const pick_curve *c = (const pick_curve *) ctx;
+    int next = item + 1 < c -> n_samples ? item + 1 : item;
+    double x0 = c -> x[item],
+           y0 = c -> y[item],
+           dx = c -> x[next] - x0,
+           dy = c -> y[next] - y0,
+           length2 = dx * dx + dy * dy,
+           s = length2 > 0.0 ? ((x - x0) * dx + (y - y0) * dy) / length2 : 0.0;
+
+    (void) best;
+    s = s < 0.0 ? 0.0 : s > 1.0 ? 1.0 : s;
+    return hypot(x0 + s * dx - x, y0 + s * dy - y);
+}
+
+static double vertex_dist(void *ctx, int item, double x, double y,
+                          double best)
+{
+    const pick_curve *c = (const pick_curve *) ctx;
+    int next = item + 1 < c -> n_samples ? item + 1 : item;
+    double d0 = hypot(c -> x[item] - x, c -> y[item] - y),
+           d1 = hypot(c -> x[next] - x, c -> y[next] - y);
+
+    (void) best;
+    return d0 < d1 ? d0 : d1;
+}
+
+static double point_dist(void *ctx, int item, double x, double y,
+                         double best)
+{
+    const pick_curve *c = (const pick_curve *) ctx;
+
+    (void) best;
+    return hypot(c -> px[item] - x, c -> py[item] - y);
+}
+
+static double curve_dist(void *ctx, int item, double x, double y,
+                         double best)
+{
+    top_ctx *t_ctx = (top_ctx *) ctx;
+    int curve = t_ctx -> index -> top_curves[item],
+        segment;
+    pick_curve *c = &t_ctx -> index -> curves[curve];
+
+    if (curve == t_ctx -> skip_curve) return INFINITY;
+
+    segment = bvh_nearest(&c -> segments, x, y, &best, segment_dist, c);
+    if (segment < 0) return INFINITY;
+
+    t_ctx -> segment = segment;
+    return best;
+}
+
+/*****************************************************************************
+*   Routines of the curves polyline segments.                                *
+*****************************************************************************/
+static int n_segments(const pick_curve *curve)
+{
+    return curve -> n_samples > 1 ? curve -> n_samples - 1 : curve -> n_samples;
+}
+
+static void segment_box(const pick_curve *curve, int segment, float *box)
+{
+    int next = segment + 1 < curve -> n_samples ? segment + 1 : segment;
+
+    box[0] = fminf(curve -> x[segment], curve -> x[next]);
+    box[1] = fminf(curve -> y[segment], curve -> y[next]);
+    box[2] = fmaxf(curve -> x[segment], curve -> x[next]);
+    box[3] = fmaxf(curve -> y[segment], curve -> y[next]);
+}
+
+static void clear_curve(pick_curve *curve)
+{
+    free(curve -> x);
+    free(curve -> y);
+    free(curve -> px);
+    free(curve -> py);
+    bvh_free(&curve -> segments);
+    bvh_free(&curve -> points);
+    memset(curve, 0, sizeof(pick_curve));
+}
+
+/*****************************************************************************
+*   Routine to build a BVH over n_items boxes (4 floats each, see bvh), by   *
+* median splits on the longer axis of the boxes centers. Returns FALSE if    *
+* out of memory.                                                             *
+*****************************************************************************/
+static int bvh_build(bvh *b, const float *item_box, int n_items)
+{
+    int i,
+        max_nodes = 2 * n_items;
+    float *centroid;
+
+    memset(b, 0, sizeof(bvh));
+    if (n_items == 0) return TRUE;
+
+    b -> box = (float *) malloc(4 * max_nodes * sizeof(float));
+    b -> first = (int *) malloc(max_nodes * sizeof(int));
+    b -> count = (int *) malloc(max_nodes * sizeof(int));
+    b -> order = (int *) malloc(n_items * sizeof(int));
+    centroid = (float *) malloc(2 * n_items * sizeof(float));
+    if (b -> box == NULL || b -> first == NULL || b -> count == NULL ||
+        b -> order == NULL || centroid == NULL) {
+        free(centroid);
+        bvh_free(b);
+        return FALSE;
+    }
+
+    for (i = 0; i < n_items; i++) {
+        b -> order[i] = i;
+        centroid[i] = 0.5f * (item_box[4 * i] + item_box[4 * i + 2]);
+        centroid[n_items + i] = 0.5f * (item_box[4 * i + 1] +
+                                        item_box[4 * i + 3]);
+    }
+    b -> n_items = n_items;
+    b -> n_nodes = 1;
+    bvh_split(b, item_box, centroid, 0, 0, n_items);
+
+    free(centroid);
+    return TRUE;
+}
+
+static void bvh_split(bvh *b, const float *item_box, const float *centroid,
+                      int node, int first, int count)
+{
+    int i, item, axis, child;
+    float c_min[2], c_max[2],
+          *box = &b -> box[4 * node];
+
+    box[0] = box[1] = INFINITY;
+    box[2] = box[3] = -INFINITY;
+    c_min[0] = c_min[1] = INFINITY;
+    c_max[0] = c_max[1] = -INFINITY;
+    for (i = first; i < first + count; i++) {
+        item = b -> order[i];
+        box[0] = fminf(box[0], item_box[4 * item]);
+        box[1] = fminf(box[1], item_box[4 * item + 1]);
+        box[2] = fmaxf(box[2], item_box[4 * item + 2]);
+        box[3] = fmaxf(box[3], item_box[4 * item + 3]);
+        for (axis = 0; axis < 2; axis++) {
+            c_min[axis] = fminf(c_min[axis], centroid[axis * b -> n_items + item]);
+            c_max[axis] = fmaxf(c_max[axis], centroid[axis * b -> n_items + item]);
+        }
+    }
+
+    b -> first[node] = first;
+    b -> count[node] = count;
+    if (count <= BVH_LEAF_SIZE) return;
+
+    axis = c_max[1] - c_min[1] > c_max[0] - c_min[0];
+    select_nth(&b -> order[first], &centroid[axis * b -> n_items], count,
+               count / 2);
+
+    child = b -> n_nodes;
+    b -> n_nodes += 2;
+    b -> first[node] = child;
+    b -> count[node] = 0;
+    bvh_split(b, item_box, centroid, child, first, count / 2);
+    bvh_split(b, item_box, centroid, child + 1, first + count / 2,
+              count - count / 2);
+}
+
+static void bvh_free(bvh *b)
+{
+    free(b -> box);
+    free(b -> first);
+    free(b -> count);
+    free(b -> order);
+    memset(b, 0, sizeof(bvh));
+}
+
+/*****************************************************************************
+*   Routine to reorder order[0, count) so order[n] is the item of the n'th   *
+* smallest key, with smaller (larger) keys before (after) it - quickselect.  *
+*****************************************************************************/
+static void select_nth(int *order, const float *key, int count, int n)
+{
+    int low = 0,
+        high = count - 1,
+        i, j, tmp;
+    float pivot;
+
+    while (low < high) {
+        pivot = key[order[(low + high) / 2]];
+        i = low;
+        j = high;
+        while (i <= j) {
+            while (key[order[i]] < pivot) i++;
+            while (key[order[j]] > pivot) j--;
+            if (i <= j) {
+                tmp = order[i];
+                order[i++] = order[j];
+                order[j--] = tmp;
+            }
+        }
+        if (n <= j)
+            high = j;
+        else if (n >= i)
+            low = i;
+        else
+            return;
+    }
+}
+
+/*****************************************************************************
+*   Routine to find the item nearest to (x, y) at distance less than best,   *
+* nearer nodes first, skipping nodes farther than best. Returns the item or  *
+* -1 if none, best is updated to its distance.                               *
+*****************************************************************************/
+static int bvh_nearest(const bvh *b, double x, double y, double *best,
+                       item_dist_fn fn, void *ctx)
+{
+    int stack[BVH_STACK_SIZE],
+        top = 0,
+        nearest = -1,
+        node, i, item, near_child;
+    double d;
+
+    if (b -> n_nodes == 0) return -1;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        node = stack[--top];
+        if (box_dist2(&b -> box[4 * node], x, y) > *best * *best) continue;
+
+        if (b -> count[node] > 0) {
+            for (i = b -> first[node]; i < b -> first[node] + b -> count[node];
+                 i++) {
+                item = b -> order[i];
+                d = fn(ctx, item, x, y, *best);
+                if (d <= *best && d != INFINITY) {
+                    *best = d;
+                    nearest = item;
+                }
+            }
+        }
+        else if (top + 2 <= BVH_STACK_SIZE) {
+            /* Push the farther child first so the nearer one pops first: */
+            near_child = box_dist2(&b -> box[4 * b -> first[node]], x, y) <=
+                         box_dist2(&b -> box[4 * (b -> first[node] + 1)], x, y) ?
+                                 b -> first[node] : b -> first[node] + 1;
+            stack[top++] = 2 * b -> first[node] + 1 - near_child;
+            stack[top++] = near_child;
+        }
+    }
+    return nearest;
+}
+
+/*****************************************************************************
+*   Routine to return the squared distance from (x, y) to a box, 0 inside.   *
+*****************************************************************************/
+static double box_dist2(const float *box, double x, double y)
+{
+    double dx = x < box[0] ? box[0] - x : x > box[2] ? x - box[2] : 0.0,
+           dy = y < box[1] ? box[1] - y : y > box[3] ? y - box[3] : 0.0;
+
+    return dx * dx + dy * dy;
+}
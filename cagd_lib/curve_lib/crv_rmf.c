@@ -0,0 +1,170 @@
+/*****************************************************************************
+*   Module to compute rotation minimizing frames along sampled curves.       *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. rotation_minimizing_frames(n_samples, points, tangents, normal, t, n,   *
+*                  b) - the frame (T, N, B) at every sample, by the double   *
+*                  reflection method.                                        *
+*                                                                            *
+*   Only positions and tangents are needed, no higher derivatives, and the   *
+* frame is continuous through inflections and straight parts, where the      *
+* Frenet frame is undefined. Every frame is carried to the next sample by a  *
+* reflection in the bisector plane of the two points, then a reflection that *
+* maps the reflected tangent onto the next tangent (Wang, Juttler, Zheng and *
+* Liu, "Computation of rotation minimizing frames", 2008) - a fourth order   *
+* approximation of the exact rotation minimizing frame.                      *
+*****************************************************************************/
+
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+static int unit(const double *v, double *u);
+static void reflect(const double *v, const double *axis, double axis2,
+                    double *r);
+static void cross(const double *u, const double *v, double *w);
+static double dot(const double *u, const double *v);
+static void some_normal(const double *t, const double *normal, double *n);
+
+/*****************************************************************************
+*   Routine to compute the rotation minimizing frames of the n_samples       *
+* samples points, with (not necessarily unit) tangents tangents, 3 doubles   *
+* per sample each. The first frame normal is the projection of normal (may   *
+* be NULL for any) onto the first tangent normal plane. t, n and b get the   *
+* unit tangent, normal and binormal, 3 doubles per sample each.              *
+*   Samples with a zero tangent keep the frame of the sample before (after,  *
+* for leading ones). If no sample has a tangent the frames are all NaN.      *
+*****************************************************************************/
+void crv_rotation_minimizing_frames(int n_samples, const double *points,
+                                    const double *tangents,
+                                    const double *normal, double *t,
+                                    double *n, double *b)
+{
+    int i, c,
+        first = -1,
+        prev;
+    double v1[3], v2[3], r_l[3], t_l[3], c1, c2;
+
+    for (i = 0; i < n_samples && first < 0; i++)
+        if (unit(&tangents[3 * i], &t[3 * i])) first = i;
+    if (first < 0) {
+        for (i = 0; i < 3 * n_samples; i++) t[i] = n[i] = b[i] = NAN;
+        return;
+    }
+
+    some_normal(&t[3 * first], normal, &n[3 * first]);
+    cross(&t[3 * first], &n[3 * first], &b[3 * first]);
+
+    for (prev = first, i = first + 1; i < n_samples; i++) {
+        if (!unit(&tangents[3 * i], &t[3 * i])) {
+            for (c = 0; c < 3; c++) {
+                t[3 * i + c] = t[3 * prev + c];
+                n[3 * i + c] = n[3 * prev + c];
+                b[3 * i + c] = b[3 * prev + c];
+            }
+            continue;
+        }
+
+        /* Reflect the previous frame in the bisector plane of the points: */
+        for (c = 0; c < 3; c++)
+            v1[c] = points[3 * i + c] - points[3 * prev + c];
+        if ((c1 = dot(v1, v1)) > 0.0) {
+            reflect(&n[3 * prev], v1, c1, r_l);
+            reflect(&t[3 * prev], v1, c1, t_l);
+        }
+        else {                             /* Coincident points - no move */
+            for (c = 0; c < 3; c++) {
+                r_l[c] = n[3 * prev + c];
+                t_l[c] = t[3 * prev + c];
+            }
+        }
+
+        /* Reflect it again, mapping the reflected tangent onto the next: */
+        for (c = 0; c < 3; c++) v2[c] = t[3 * i + c] - t_l[c];
+        if ((c2 = dot(v2, v2)) > 0.0)
+            reflect(r_l, v2, c2, &n[3 * i]);
+        else
+            for (c = 0; c < 3; c++) n[3 * i + c] = r_l[c];
+
+        /* Remove the drift so the frame stays orthonormal: */
+        c1 = dot(&n[3 * i], &t[3 * i]);
+        for (c = 0; c < 3; c++) n[3 * i + c] -= c1 * t[3 * i + c];
+        if (!unit(&n[3 * i], &n[3 * i]))
+            some_normal(&t[3 * i], &n[3 * prev], &n[3 * i]);
+        cross(&t[3 * i], &n[3 * i], &b[3 * i]);
+        prev = i;
+    }
+
+    for (i = 0; i < first; i++)
+        for (c = 0; c < 3; c++) {
+            t[3 * i + c] = t[3 * first + c];
+            n[3 * i + c] = n[3 * first + c];
+            b[3 * i + c] = b[3 * first + c];
+        }
+}
+
+/*****************************************************************************
+*   Routine to normalize v into u. Returns FALSE (u untouched) if v is zero. *
+*****************************************************************************/
+static int unit(const double *v, double *u)
+{
+    double length = sqrt(dot(v, v));
+
+    if (!(length > 0.0) || !isfinite(length)) return FALSE;
+    u[0] = v[0] / length;
+    u[1] = v[1] / length;
+    u[2] = v[2] / length;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to reflect v in the plane through the origin normal to axis,     *
+* axis2 being the squared length of axis: r = v - 2 (v.axis / axis2) axis.   *
+*****************************************************************************/
+static void reflect(const double *v, const double *axis, double axis2,
+                    double *r)
+{
+    double s = 2.0 * dot(v, axis) / axis2;
+
+    r[0] = v[0] - s * axis[0];
+    r[1] = v[1] - s * axis[1];
+    r[2] = v[2] - s * axis[2];
+}
+
+static void cross(const double *u, const double *v, double *w)
+{
+    w[0] = u[1] * v[2] - u[2] * v[1];
+    w[1] = u[2] * v[0] - u[0] * v[2];
+    w[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static double dot(const double *u, const double *v)
+{
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+/*****************************************************************************
+*   Routine to find a unit normal n to the unit tangent t: the projection of *
+* normal (may be NULL) if it is not parallel to t, or else of the axis t is  *
+* least aligned with.                                                        *
+*****************************************************************************/
+static void some_normal(const double *t, const double *normal, double *n)
+{
+    int c, axis;
+    double v[3], s;
+
+    if (normal != NULL) {
+        s = dot(normal, t);
+        for (c = 0; c < 3; c++) v[c] = normal[c] - s * t[c];
+        if (unit(v, n) && fabs(dot(n, t)) < 1e-6) return;
+    }
+
+    axis = fabs(t[0]) <= fabs(t[1]) ? 0 : 1;
+    if (fabs(t[2]) < fabs(t[axis])) axis = 2;
+    for (c = 0; c < 3; c++) v[c] = -t[axis] * t[c];
+    v[axis] += 1.0;
+    unit(v, n);
+}
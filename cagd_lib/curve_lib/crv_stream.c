@@ -0,0 +1,191 @@
+/*****************************************************************************
+*   Module to pack line drawings into one vertex stream for rendering.       *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. crv_stream *alloc_stream() - an empty stream. free_stream(stream)       *
+*                  releases it, and clear_stream(stream) empties it, keeping *
+*                  its memory for the next frame.                            *
+* 2. stream_strip(stream, n_points, dim, points, color, colors) - append a   *
+*                  polyline (curve samples, control polygon, frame vector).  *
+* 3. stream_circle(stream, center, radius, normal, n_segments, color) -      *
+*                  append a circle, such as an osculating circle.            *
+*                                                                            *
+*   A stream is interleaved float vertices, CRV_STREAM_STRIDE per vertex -   *
+* x, y, z, r, g, b - and the segments as pairs of vertex indices, so the     *
+* whole stream is drawn by a single glDrawElements(GL_LINES) call with no    *
+* vertex sent twice. Points that are not finite (undefined offset curve      *
+* samples) are dropped, and break the polyline there.                        *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  INITIAL_CAPACITY 1024
+#define  STREAM_PI        3.14159265358979323846
+
+static int reserve(crv_stream *stream, int n_vertices, int n_indices);
+static void push_vertex(crv_stream *stream, const double *p,
+                        const float *color);
+
+/*****************************************************************************
+*   Routine to allocate an empty stream. Returns NULL if out of memory.      *
+*****************************************************************************/
+crv_stream *crv_alloc_stream(void)
+{
+    return (crv_stream *) calloc(1, sizeof(crv_stream));
+}
+
+/*****************************************************************************
+*   Routine to release memory allocated for a stream.                        *
+*****************************************************************************/
+void crv_free_stream(crv_stream *stream)
+{
+    if (stream == NULL) return;
+
+    free(stream -> vertices);
+    free(stream -> indices);
+    free(stream);
+}
+
+/*****************************************************************************
+*   Routine to empty a stream, its memory is reused by the next appends.     *
+*****************************************************************************/
+void crv_clear_stream(crv_stream *stream)
+{
+    stream -> n_vertices = stream -> n_indices = 0;
+}
+
+/*****************************************************************************
+*   Routine to append the polyline through the n_points points (dim = 2 or 3 *
+* doubles each, z = 0 if 2) to the stream, of color (3 floats) or of colors  *
+* (3 floats per point, may be NULL for color). FALSE if out of memory.       *
+*****************************************************************************/
+int crv_stream_strip(crv_stream *stream, int n_points, int dim,
+                     const double *points, const float *color,
+                     const float *colors)
+{
+    int i, c, previous = -1;
+    double p[3];
+
+    if (!reserve(stream, n_points, 2 * n_points)) return FALSE;
+
+    for (i = 0; i < n_points; i++) {
+        p[2] = 0.0;
+        for (c = 0; c < dim && c < 3; c++) p[c] = points[dim * i + c];
+        if (!isfinite(p[0]) || !isfinite(p[1]) || !isfinite(p[2])) {
+            previous = -1;
+            continue;
+        }
+
+        if (previous >= 0) {
+            stream -> indices[stream -> n_indices++] = previous;
+            stream -> indices[stream -> n_indices++] = stream -> n_vertices;
+        }
+        previous = stream -> n_vertices;
+        push_vertex(stream, p, colors != NULL ? &colors[3 * i] : color);
+    }
+
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to append the circle of radius about center, in the plane normal *
+* to normal (3 doubles each), as a closed polyline of n_segments segments.   *
+* FALSE if out of memory.                                                    *
+*****************************************************************************/
+int crv_stream_circle(crv_stream *stream, const double *center,
+                      double radius, const double *normal, int n_segments,
+                      const float *color)
+{
+    int i, c, first;
+    double n[3], u[3], v[3], p[3], length, angle;
+
+    if (n_segments < 3) n_segments = 3;
+    length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                  normal[2] * normal[2]);
+    if (!(length > 0.0) || !isfinite(length) || !isfinite(radius))
+        return TRUE;                            /* No circle to draw */
+    for (c = 0; c < 3; c++) n[c] = normal[c] / length;
+
+    /* u - the axis least aligned with n, made normal to it, v = n x u: */
+    c = fabs(n[0]) <= fabs(n[1]) ? 0 : 1;
+    if (fabs(n[2]) < fabs(n[c])) c = 2;
+    for (i = 0; i < 3; i++) u[i] = -n[c] * n[i];
+    u[c] += 1.0;
+    length = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    for (i = 0; i < 3; i++) u[i] /= length;
+    v[0] = n[1] * u[2] - n[2] * u[1];
+    v[1] = n[2] * u[0] - n[0] * u[2];
+    v[2] = n[0] * u[1] - n[1] * u[0];
+
+    if (!reserve(stream, n_segments, 2 * n_segments)) return FALSE;
+
+    first = stream -> n_vertices;
+    for (i = 0; i < n_segments; i++) {
+        angle = 2.0 * STREAM_PI * i / n_segments;
+        for (c = 0; c < 3; c++)
+            p[c] = center[c] + radius * (cos(angle) * u[c] +
+                                         sin(angle) * v[c]);
+        stream -> indices[stream -> n_indices++] = first + i;
+        stream -> indices[stream -> n_indices++] =
+            first + (i + 1) % n_segments;
+        push_vertex(stream, p, color);
+    }
+
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to make room for n_vertices more vertices and n_indices more     *
+* indices. FALSE if out of memory.                                           *
+*****************************************************************************/
+static int reserve(crv_stream *stream, int n_vertices, int n_indices)
+{
+    int capacity;
+    float *vertices;
+    unsigned int *indices;
+
+    if (stream -> n_vertices + n_vertices > stream -> vertices_capacity) {
+        capacity = stream -> vertices_capacity > 0 ?
+                       stream -> vertices_capacity : INITIAL_CAPACITY;
+        while (capacity < stream -> n_vertices + n_vertices) capacity *= 2;
+        vertices = (float *) realloc(stream -> vertices,
+                                     capacity * CRV_STREAM_STRIDE *
+                                     sizeof(float));
+        if (vertices == NULL) return FALSE;
+        stream -> vertices = vertices;
+        stream -> vertices_capacity = capacity;
+    }
+
+    if (stream -> n_indices + n_indices > stream -> indices_capacity) {
+        capacity = stream -> indices_capacity > 0 ?
+                       stream -> indices_capacity : 2 * INITIAL_CAPACITY;
+        while (capacity < stream -> n_indices + n_indices) capacity *= 2;
+        indices = (unsigned int *) realloc(stream -> indices,
+                                           capacity * sizeof(unsigned int));
+        if (indices == NULL) return FALSE;
+        stream -> indices = indices;
+        stream -> indices_capacity = capacity;
+    }
+
+    return TRUE;
+}
+
+static void push_vertex(crv_stream *stream, const double *p,
+                        const float *color)
+{
+    float *vertex = &stream -> vertices[CRV_STREAM_STRIDE *
+                                        stream -> n_vertices++];
+
+    vertex[0] = (float) p[0];
+    vertex[1] = (float) p[1];
+    vertex[2] = (float) p[2];
+    vertex[3] = color[0];
+    vertex[4] = color[1];
+    vertex[5] = color[2];
+}
@@ -0,0 +1,548 @@
+/*****************************************************************************
+*   Module of a small pool of worker threads, shared by all the curvelib     *
+* routines that work on many curves (or samples) at once.                    *
+*                                                                            *
+* Main routines (all names are prefixed with crv_):                          *
+* 1. parallel_for(n_items, grain, fn, ctx) - call fn(ctx, begin, end) over   *
+*                  [0, n_items) in chunks of grain items, on all threads.    *
+* 2. set_threads(n) - number of threads to use (caller included), 0 = all    *
+*                  the processors. int get_threads() returns it.             *
+* 3. crv_jobs *alloc_jobs() - a queue of background jobs, run in order by    *
+*                  its own worker thread. free_jobs(jobs) stops it.          *
+* 4. submit_job(jobs, key, fn, ctx) - queue fn(ctx), cancelling the jobs of  *
+*                  the same key that did not finish yet.                     *
+* 5. cancel_jobs(jobs, key), wait_jobs(jobs) - cancel the jobs of key (all   *
+*                  of them if key < 0) / wait until no job is left.          *
+* 6. int job_cancelled() - TRUE in a job that was cancelled since it began.  *
+*                                                                            *
+*   The calling thread works on the chunks too, and parallel_for returns     *
+* only when all chunks were done. A parallel_for called from within a task   *
+* (or while another thread runs one) is executed serially, so tasks can use  *
+* other curvelib routines freely.                                            *
+*   Every submitted job is called exactly once, a cancelled one too (with    *
+* job_cancelled() TRUE from the start), so it can always release its ctx.    *
+* Long routines (crv_flatten_scene) poll job_cancelled() and give up early.  *
+*****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "curvelib.h"
+
+#define  TRUE      1
+#define  FALSE     0
+
+#define  MAX_THREADS  64
+#define  INITIAL_JOBS 16
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION   crv_mutex;
+typedef CONDITION_VARIABLE crv_cond;
+typedef HANDLE             crv_thread;
+#define  mutex_init(m)     InitializeCriticalSection(m)
+#define  mutex_destroy(m)  DeleteCriticalSection(m)
+#define  mutex_lock(m)     EnterCriticalSection(m)
+#define  mutex_trylock(m)  TryEnterCriticalSection(m)
+#define  mutex_unlock(m)   LeaveCriticalSection(m)
+#define  cond_init(c)      InitializeConditionVariable(c)
+#define  cond_destroy(c)
+#define  cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define  cond_broadcast(c) WakeAllConditionVariable(c)
+#define  THREAD_LOCAL      __declspec(thread)
+#else
+typedef pthread_mutex_t    crv_mutex;
+typedef pthread_cond_t     crv_cond;
+typedef pthread_t          crv_thread;
+#define  mutex_init(m)     pthread_mutex_init(m, NULL)
+#define  mutex_destroy(m)  pthread_mutex_destroy(m)
+#define  mutex_lock(m)     pthread_mutex_lock(m)
+#define  mutex_trylock(m)  (pthread_mutex_trylock(m) == 0)
+#define  mutex_unlock(m)   pthread_mutex_unlock(m)
+#define  cond_init(c)      pthread_cond_init(c, NULL)
+#define  cond_destroy(c)   pthread_cond_destroy(c)
+#define  cond_wait(c, m)   pthread_cond_wait(c, m)
+#define  cond_broadcast(c) pthread_cond_broadcast(c)
+#define  THREAD_LOCAL      __thread
+#endif
+
+typedef struct crv_pool {
+     int started;
+     int n_workers;                        /* Threads besides the caller */
+     crv_thread workers[MAX_THREADS];
+     crv_mutex lock;                        /* Guards all the job fields */
+     crv_mutex submit_lock;                   /* One job at a time only */
+     crv_cond work_cond, done_cond;
+     unsigned int generation;          /* Incremented for every new job */
+     int shutdown;
+     crv_task_fn fn;                                  /* The current job */
+     void *ctx;
+     int n_items, grain, next;
+     int busy_workers;           /* Workers that did not finish the job */
+} crv_pool;
+
+typedef struct crv_job {
+     int key;
+     crv_job_fn fn;
+     void *ctx;
+     volatile int cancelled;
+} crv_job;
+
+struct crv_jobs {
+     crv_thread worker;
+     crv_mutex lock;                    /* Guards all the fields below */
+     crv_cond work_cond, idle_cond;
+     crv_job *queue;               /* Jobs [first, n_queued) are waiting */
+     int first, n_queued, capacity;
+     crv_job current;                         /* The job the worker runs */
+     int running;
+     int shutdown;
+     int detached;          /* Freed by the worker itself, when it exits */
+};
+
+static crv_pool glbl_pool;
+static int glbl_n_threads;                /* As set by crv_set_threads */
+static THREAD_LOCAL int glbl_in_task;
+static THREAD_LOCAL crv_jobs *glbl_worker_jobs;  /* Of the worker thread */
+#ifdef _WIN32
+static INIT_ONCE glbl_pool_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t glbl_pool_once = PTHREAD_ONCE_INIT;
+#endif
+
+static int processors_count(void);
+static void pool_init_locks(void);
+static void pool_start(void);
+static void pool_stop(void);
+static void run_chunks(void);
+static void cancel_queued(crv_jobs *jobs, int key);
+static void destroy_jobs(crv_jobs *jobs);
+#ifdef _WIN32
+static BOOL CALLBACK pool_init_once(PINIT_ONCE once, PVOID param, PVOID *ctx);
+static DWORD WINAPI worker_main(LPVOID param);
+static DWORD WINAPI jobs_main(LPVOID param);
+#else
+static void *worker_main(void *param);
+static void *jobs_main(void *param);
+#endif
+
+/*****************************************************************************
+*   Routine to set the number of threads parallel_for uses, caller included. *
+* 0 means one thread per processor. Must not be called from within a task.   *
+*****************************************************************************/
+void crv_set_threads(int n_threads)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&glbl_pool_once, pool_init_once, NULL, NULL);
+#else
+    pthread_once(&glbl_pool_once, pool_init_locks);
+#endif
+    if (glbl_in_task) return;
+
+    mutex_lock(&glbl_pool.submit_lock);
+    if (glbl_pool.started) pool_stop();
+    glbl_n_threads = n_threads < 0 ? 0 : n_threads;
+    mutex_unlock(&glbl_pool.submit_lock);
+}
+
+/*****************************************************************************
+*   Routine to return the number of threads parallel_for uses.               *
+*****************************************************************************/
+int crv_get_threads(void)
+{
+    int n = glbl_n_threads > 0 ? glbl_n_threads : processors_count();
+
+    return n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+/*****************************************************************************
+*   Routine to call fn(ctx, begin, end) for consecutive chunks of at most    *
+* grain items covering [0, n_items), in parallel. Returns when all are done. *
+*****************************************************************************/
+void crv_parallel_for(int n_items, int grain, crv_task_fn fn, void *ctx)
+{
+    if (n_items <= 0) return;
+    if (grain < 1) grain = 1;
+
+#ifdef _WIN32
+    InitOnceExecuteOnce(&glbl_pool_once, pool_init_once, NULL, NULL);
+#else
+    pthread_once(&glbl_pool_once, pool_init_locks);
+#endif
+
+    /* Nested, busy pool or not worth it - do it all in this thread: */
+    if (glbl_in_task || n_items <= grain || crv_get_threads() < 2 ||
+        !mutex_trylock(&glbl_pool.submit_lock)) {
+        glbl_in_task++;
+        fn(ctx, 0, n_items);
+        glbl_in_task--;
+        return;
+    }
+
+    if (!glbl_pool.started) pool_start();
+
+    mutex_lock(&glbl_pool.lock);
+    glbl_pool.fn = fn;
+    glbl_pool.ctx = ctx;
+    glbl_pool.n_items = n_items;
+    glbl_pool.grain = grain;
+    glbl_pool.next = 0;
+    glbl_pool.busy_workers = glbl_pool.n_workers;
+    glbl_pool.generation++;
+    cond_broadcast(&glbl_pool.work_cond);
+
+    run_chunks();                                 /* Caller works as well */
+    while (glbl_pool.busy_workers > 0)
+        cond_wait(&glbl_pool.done_cond, &glbl_pool.lock);
+    glbl_pool.fn = NULL;
+    mutex_unlock(&glbl_pool.lock);
+
+    mutex_unlock(&glbl_pool.submit_lock);
+}
+
+/*****************************************************************************
+*   Routine to grab chunks of the current job and run them until none left.  *
+* Called with the pool lock held, which is released while a chunk runs.      *
+*****************************************************************************/
+static void run_chunks(void)
+{
+    int begin, end;
+    crv_task_fn fn = glbl_pool.fn;
+    void *ctx = glbl_pool.ctx;
+
+    while (glbl_pool.next < glbl_pool.n_items) {
+        begin = glbl_pool.next;
+        end = begin + glbl_pool.grain;
+        if (end > glbl_pool.n_items) end = glbl_pool.n_items;
+        glbl_pool.next = end;
+
+        mutex_unlock(&glbl_pool.lock);
+        glbl_in_task++;
+        fn(ctx, begin, end);
+        glbl_in_task--;
+        mutex_lock(&glbl_pool.lock);
+    }
+}
+
+/*****************************************************************************
+*   The worker thread: waits for a new job generation, works on it and       *
+* reports it is done.                                                        *
+*****************************************************************************/
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID param)
+#else
+static void *worker_main(void *param)
+#endif
+{
+    /* The generation at start up, so a job posted before we got here runs: */
+    unsigned int seen_generation = (unsigned int) (uintptr_t) param;
+
+    mutex_lock(&glbl_pool.lock);
+    while (TRUE) {
+        while (!glbl_pool.shutdown && glbl_pool.generation == seen_generation)
+            cond_wait(&glbl_pool.work_cond, &glbl_pool.lock);
+        if (glbl_pool.shutdown) break;
+        seen_generation = glbl_pool.generation;
+
+        run_chunks();
+        if (--glbl_pool.busy_workers == 0)
+            cond_broadcast(&glbl_pool.done_cond);
+    }
+    mutex_unlock(&glbl_pool.lock);
+    return 0;
+}
+
+/*****************************************************************************
+*   Routines to start and stop the workers, with submit_lock held.           *
+*****************************************************************************/
+static void pool_start(void)
+{
+    int i, n = crv_get_threads() - 1;
+    void *generation = (void *) (uintptr_t) glbl_pool.generation;
+
+    glbl_pool.shutdown = FALSE;
+    glbl_pool.n_workers = 0;
+    for (i = 0; i < n; i++) {
+#ifdef _WIN32
+        glbl_pool.workers[i] = CreateThread(NULL, 0, worker_main, generation,
+                                            0, NULL);
+        if (glbl_pool.workers[i] == NULL) break;
+#else
+        if (pthread_create(&glbl_pool.workers[i], NULL, worker_main,
+                           generation) != 0)
+            break;
+#endif
+        glbl_pool.n_workers++;
+    }
+    glbl_pool.started = TRUE;
+}
+
+static void pool_stop(void)
+{
+    int i;
+
+    mutex_lock(&glbl_pool.lock);
+    glbl_pool.shutdown = TRUE;
+    cond_broadcast(&glbl_pool.work_cond);
+    mutex_unlock(&glbl_pool.lock);
+
+    for (i = 0; i < glbl_pool.n_workers; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(glbl_pool.workers[i], INFINITE);
+        CloseHandle(glbl_pool.workers[i]);
+#else
+        pthread_join(glbl_pool.workers[i], NULL);
+#endif
+    }
+    glbl_pool.n_workers = 0;
+    glbl_pool.started = FALSE;
+}
+
+/*****************************************************************************
+*   Routine to allocate a queue of background jobs, with its worker thread.  *
+* Returns NULL if out of memory or the thread can not be started.            *
+*****************************************************************************/
+crv_jobs *crv_alloc_jobs(void)
+{
+    crv_jobs *jobs = (crv_jobs *) calloc(1, sizeof(crv_jobs));
+
+    if (jobs == NULL) return NULL;
+    jobs -> queue = (crv_job *) malloc(INITIAL_JOBS * sizeof(crv_job));
+    if (jobs -> queue == NULL) {
+        free(jobs);
+        return NULL;
+    }
+    jobs -> capacity = INITIAL_JOBS;
+    mutex_init(&jobs -> lock);
+    cond_init(&jobs -> work_cond);
+    cond_init(&jobs -> idle_cond);
+
+#ifdef _WIN32
+    jobs -> worker = CreateThread(NULL, 0, jobs_main, jobs, 0, NULL);
+    if (jobs -> worker == NULL) {
+#else
+    if (pthread_create(&jobs -> worker, NULL, jobs_main, jobs) != 0) {
+#endif
+        destroy_jobs(jobs);
+        return NULL;
+    }
+    return jobs;
+}
+
+/*****************************************************************************
+*   Routine to stop a jobs queue: the jobs left are cancelled (but still     *
+* called, see above) and the worker is joined. From within a job of that     *
+* queue, the worker frees the queue itself once the job returns.             *
+*****************************************************************************/
+void crv_free_jobs(crv_jobs *jobs)
+{
+    if (jobs == NULL) return;
+
+    mutex_lock(&jobs -> lock);
+    jobs -> shutdown = TRUE;
+    cancel_queued(jobs, -1);
+    jobs -> detached = glbl_worker_jobs == jobs;
+    cond_broadcast(&jobs -> work_cond);
+    mutex_unlock(&jobs -> lock);
+    if (jobs -> detached) return;
+
+#ifdef _WIN32
+    WaitForSingleObject(jobs -> worker, INFINITE);
+    CloseHandle(jobs -> worker);
+#else
+    pthread_join(jobs -> worker, NULL);
+#endif
+    destroy_jobs(jobs);
+}
+
+/*****************************************************************************
+*   Routine to queue the job fn(ctx) under key (any int but negative ones).  *
+* The queued and running jobs of the same key are cancelled, as only the     *
+* newest one is of use. Returns FALSE (fn not queued) if out of memory.      *
+*****************************************************************************/
+int crv_submit_job(crv_jobs *jobs, int key, crv_job_fn fn, void *ctx)
+{
+    int i;
+    crv_job *queue;
+
+    mutex_lock(&jobs -> lock);
+    if (jobs -> shutdown) {
+        mutex_unlock(&jobs -> lock);
+        return FALSE;
+    }
+    cancel_queued(jobs, key);
+
+    if (jobs -> n_queued == jobs -> capacity) {
+        if (jobs -> first > 0) {        /* Reuse the room of the run ones */
+            for (i = jobs -> first; i < jobs -> n_queued; i++)
+                jobs -> queue[i - jobs -> first] = jobs -> queue[i];
+            jobs -> n_queued -= jobs -> first;
+            jobs -> first = 0;
+        }
+        else {
+            queue = (crv_job *) realloc(jobs -> queue, 2 * jobs -> capacity *
+                                                        sizeof(crv_job));
+            if (queue == NULL) {
+                mutex_unlock(&jobs -> lock);
+                return FALSE;
+            }
+            jobs -> queue = queue;
+            jobs -> capacity *= 2;
+        }
+    }
+
+    jobs -> queue[jobs -> n_queued].key = key;
+    jobs -> queue[jobs -> n_queued].fn = fn;
+    jobs -> queue[jobs -> n_queued].ctx = ctx;
+    jobs -> queue[jobs -> n_queued].cancelled = FALSE;
+    jobs -> n_queued++;
+    cond_broadcast(&jobs -> work_cond);
+    mutex_unlock(&jobs -> lock);
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to cancel the queued and running jobs of key, all if key < 0.    *
+*****************************************************************************/
+void crv_cancel_jobs(crv_jobs *jobs, int key)
+{
+    mutex_lock(&jobs -> lock);
+    cancel_queued(jobs, key);
+    mutex_unlock(&jobs -> lock);
+}
+
+/*****************************************************************************
+*   Routine to wait until all the submitted jobs returned. Must not be       *
+* called from within a job of that queue.                                    *
+*****************************************************************************/
+void crv_wait_jobs(crv_jobs *jobs)
+{
+    mutex_lock(&jobs -> lock);
+    while (jobs -> first < jobs -> n_queued || jobs -> running)
+        cond_wait(&jobs -> idle_cond, &jobs -> lock);
+    mutex_unlock(&jobs -> lock);
+}
+
+/*****************************************************************************
+*   Routine to test, from within a job, if it was cancelled. FALSE outside   *
+* of jobs (and in the parallel_for tasks a job runs on the pool threads).    *
+*****************************************************************************/
+int crv_job_cancelled(void)
+{
+    return glbl_worker_jobs != NULL && glbl_worker_jobs -> current.cancelled;
+}
+
+/*****************************************************************************
+*   Routine to cancel the jobs of key (all if key < 0), with the lock held.  *
+*****************************************************************************/
+static void cancel_queued(crv_jobs *jobs, int key)
+{
+    int i;
+
+    for (i = jobs -> first; i < jobs -> n_queued; i++)
+        if (key < 0 || jobs -> queue[i].key == key)
+            jobs -> queue[i].cancelled = TRUE;
+    if (jobs -> running && (key < 0 || jobs -> current.key == key))
+        jobs -> current.cancelled = TRUE;
+}
+
+/*****************************************************************************
+*   The jobs worker thread: runs the queued jobs in order until shut down,   *
+* and then the ones left (cancelled) so all of them get called.              *
+*****************************************************************************/
+#ifdef _WIN32
+static DWORD WINAPI jobs_main(LPVOID param)
+#else
+static void *jobs_main(void *param)
+#endif
+{
+    crv_jobs *jobs = (crv_jobs *) param;
+
+    glbl_worker_jobs = jobs;
+    mutex_lock(&jobs -> lock);
+    while (TRUE) {
+        while (!jobs -> shutdown && jobs -> first == jobs -> n_queued)
+            cond_wait(&jobs -> work_cond, &jobs -> lock);
+        if (jobs -> first == jobs -> n_queued) break;
+
+        jobs -> current = jobs -> queue[jobs -> first++];
+        if (jobs -> first == jobs -> n_queued)
+            jobs -> first = jobs -> n_queued = 0;
+        jobs -> running = TRUE;
+        mutex_unlock(&jobs -> lock);
+
+        jobs -> current.fn(jobs -> current.ctx);
+
+        mutex_lock(&jobs -> lock);
+        jobs -> running = FALSE;
+        if (jobs -> first == jobs -> n_queued)
+            cond_broadcast(&jobs -> idle_cond);
+    }
+    mutex_unlock(&jobs -> lock);
+    glbl_worker_jobs = NULL;
+
+    if (jobs -> detached) {
+#ifdef _WIN32
+        CloseHandle(jobs -> worker);
+#else
+        pthread_detach(jobs -> worker);
+#endif
+        destroy_jobs(jobs);
+    }
+    return 0;
+}
+
+/*****************************************************************************
+*   Routine to release a jobs queue, once its worker is gone.                *
+*****************************************************************************/
+static void destroy_jobs(crv_jobs *jobs)
+{
+    mutex_destroy(&jobs -> lock);
+    cond_destroy(&jobs -> work_cond);
+    cond_destroy(&jobs -> idle_cond);
+    free(jobs -> queue);
+    free(jobs);
+}
+
+/*****************************************************************************
+*   Routine to initialize the pool locks, once.                              *
+*****************************************************************************/
+static void pool_init_locks(void)
+{
+    mutex_init(&glbl_pool.lock);
+    mutex_init(&glbl_pool.submit_lock);
+    cond_init(&glbl_pool.work_cond);
+    cond_init(&glbl_pool.done_cond);
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK pool_init_once(PINIT_ONCE once, PVOID param, PVOID *ctx)
+{
+    (void) once; (void) param; (void) ctx;
+    pool_init_locks();
+    return TRUE;
+}
+#endif
+
+/*****************************************************************************
+*   Routine to return the number of online processors.                       *
+*****************************************************************************/
+static int processors_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n < 1 ? 1 : (int) n;
+#endif
+}
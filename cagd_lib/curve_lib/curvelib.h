@@ -0,0 +1,260 @@
+
+#include <stddef.h>
+
+/*****************************************************************************
+* The curve kinds - should be available to every body using curvelib         *
+*****************************************************************************/
+#define CRV_BEZIER     0
+#define CRV_BSPLINE    1
+
+/*****************************************************************************
+* A scene of curves stored as struct of arrays:                              *
+* Curve i owns knots[knots_offset[i] .. knots_offset[i+1]) and the control   *
+* points [points_offset[i] .. points_offset[i+1]) of wx, wy and w. Control   *
+* points are kept homogeneous (x*w, y*w, w), exactly as in the .dat files.   *
+*****************************************************************************/
+typedef struct crv_scene {
+     int n_curves;
+     int n_knots;
+     int n_points;
+     int *kind;
+     int *order;
+     int *knots_offset;                                 /* n_curves + 1 ints */
+     int *points_offset;                                /* n_curves + 1 ints */
+     double *knots;
+     double *wx, *wy, *w;
+     int curves_capacity, knots_capacity, points_capacity;
+     const char *mapping;   /* If not NULL arrays point into this mapping */
+     size_t mapping_len;
+} crv_scene;
+
+/*****************************************************************************
+* A polyline per curve of a scene: curve i vertices are                      *
+* [vertices_offset[i] .. vertices_offset[i+1]) of x, y, at the parameters t. *
+*****************************************************************************/
+typedef struct crv_polyline {
+     int n_curves;
+     int n_vertices;
+     int *vertices_offset;                              /* n_curves + 1 ints */
+     float *x, *y;
+     double *t;
+} crv_polyline;
+
+/*****************************************************************************
+* Intersections of curves of a scene: intersection i is at parameter t1[i]   *
+* of curve curve1[i] and t2[i] of curve curve2[i], at the location x, y.     *
+*****************************************************************************/
+typedef struct crv_intersections {
+     int n_intersections;
+     int *curve1, *curve2;
+     double *t1, *t2;
+     double *x, *y;
+} crv_intersections;
+
+/*****************************************************************************
+* An arc length table: the arc length s[i] at every break point t[i] of the  *
+* n_intervals intervals, and the speed polynomial of every interval - its    *
+* CRV_ARCLEN_NODES monomial coefficients in the interval [0, 1] parameter.   *
+*****************************************************************************/
+#define CRV_ARCLEN_NODES 5            /* Gauss-Legendre nodes per interval */
+
+typedef struct crv_arclen {
+     int n_intervals;
+     double *t, *s;                                /* n_intervals + 1 each */
+     double *coef;                     /* n_intervals * CRV_ARCLEN_NODES */
+} crv_arclen;
+
+/*****************************************************************************
+* An indexed polygonal mesh, as loaded from .itd files: face i is the        *
+* vertices indices[faces_offset[i] .. faces_offset[i+1]), and every face is  *
+* also fanned to the n_triangles triangles of triangles (3 indices each).    *
+*****************************************************************************/
+typedef struct crv_mesh {
+     int n_vertices;
+     int n_faces;
+     int n_indices;
+     int n_triangles;
+     float *vertices, *normals;               /* n_vertices * 3 floats each */
+     int *faces_offset;                                  /* n_faces + 1 ints */
+     int *indices;
+     int *triangles;                                /* n_triangles * 3 ints */
+} crv_mesh;
+
+/*****************************************************************************
+* A vertex stream of line drawings: n_vertices interleaved vertices of       *
+* CRV_STREAM_STRIDE floats (x, y, z, r, g, b), and n_indices / 2 segments as *
+* pairs of vertex indices, to draw with one glDrawElements(GL_LINES).        *
+*****************************************************************************/
+#define CRV_STREAM_STRIDE 6
+
+typedef struct crv_stream {
+     int n_vertices;
+     int n_indices;
+     float *vertices;
+     unsigned int *indices;
+     int vertices_capacity, indices_capacity;
+} crv_stream;
+
+/*****************************************************************************
+* A spatial index over curves samples and control points, for picking:       *
+*****************************************************************************/
+typedef struct crv_pick_index crv_pick_index;
+
+/*****************************************************************************
+* The binary scene (.crvs) file format, see curve_lib.md:                    *
+*****************************************************************************/
+#define CRV_SCENE_MAGIC      "CRVSCENE"
+#define CRV_SCENE_BYTE_ORDER 0x01020304
+#define CRV_SCENE_VERSION    1
+#define CRV_SCENE_ALIGN      64
+
+/*****************************************************************************
+* A task run by crv_parallel_for over the items [begin, end):                *
+*****************************************************************************/
+typedef void (*crv_task_fn)(void *ctx, int begin, int end);
+
+/*****************************************************************************
+* A queue of background jobs, run in order by a worker thread of its own,    *
+* and a job: fn(ctx) of an int key, see crv_submit_job.                      *
+*****************************************************************************/
+typedef struct crv_jobs crv_jobs;
+typedef void (*crv_job_fn)(void *ctx);
+
+/*****************************************************************************
+* Error numbers as located during the loading of curve files:                *
+*****************************************************************************/
+#define CRV_OPEN_ERROR         1
+#define CRV_ALLOC_ERROR        2
+#define CRV_ORDER_EXPECT_ERROR 3
+#define CRV_KNOTS_ERROR        4
+#define CRV_POINT_ERROR        5
+#define CRV_NUMBER_ERROR       6
+#define CRV_EOF_ERROR          7
+#define CRV_FORMAT_ERROR       8
+#define CRV_VERSION_ERROR      9
+#define CRV_WRITE_ERROR        10
+#define CRV_ITD_ERROR          11
+
+/*****************************************************************************
+* Function prototypes:							     *
+*****************************************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *crv_map_file(const char *path, size_t *len);
+void       crv_unmap_file(const char *buf, size_t len);
+
+crv_scene  *crv_alloc_scene(void);
+crv_scene  *crv_copy_scene(const crv_scene *scene);
+void       crv_free_scene(crv_scene *scene);
+crv_scene  *crv_parse_dat(const char *buf, size_t len);
+crv_scene  *crv_load_dat(const char *path);
+int        crv_save_dat(const crv_scene *scene, const char *path);
+crv_scene  *crv_load_scene(const char *path);
+int        crv_save_scene(const crv_scene *scene, const char *path);
+int        crv_ioerror(void);
+int        crv_ioerror_line(void);
+void       crv_set_ioerror(int error, int line);
+crv_mesh   *crv_parse_itd(const char *buf, size_t len);
+crv_mesh   *crv_load_itd(const char *path);
+void       crv_free_mesh(crv_mesh *mesh);
+
+void       crv_parallel_for(int n_items, int grain, crv_task_fn fn, void *ctx);
+void       crv_set_threads(int n_threads);
+int        crv_get_threads(void);
+crv_jobs   *crv_alloc_jobs(void);
+void       crv_free_jobs(crv_jobs *jobs);
+int        crv_submit_job(crv_jobs *jobs, int key, crv_job_fn fn, void *ctx);
+void       crv_cancel_jobs(crv_jobs *jobs, int key);
+void       crv_wait_jobs(crv_jobs *jobs);
+int        crv_job_cancelled(void);
+
+int        crv_curve_is_valid(const crv_scene *scene, int curve);
+void       crv_curve_domain(const crv_scene *scene, int curve,
+                            double *t_start, double *t_end);
+int        crv_scene_samples(const crv_scene *scene, int n_samples,
+                             int *samples_offset);
+void       crv_eval_scene(const crv_scene *scene, int n_samples,
+                          const int *samples_offset, float *x, float *y);
+void       crv_eval_curve(const crv_scene *scene, int curve, const double *t,
+                          int n_t, double *x, double *y);
+int        crv_curve_pieces(const crv_scene *scene, int curve);
+int        crv_curve_piece(const crv_scene *scene, int curve, int piece,
+                           double *wx, double *wy, double *w,
+                           double *t0, double *t1);
+void       crv_eval_derivs(const crv_scene *scene, int curve, const double *t,
+                           int n_t, double *c, double *d1, double *d2,
+                           double *curvature);
+void       crv_eval_piece(const double *points, int n, double s, double *tmp,
+                          double *c, double *d1, double *d2);
+
+crv_polyline *crv_flatten_scene(const crv_scene *scene, double tolerance);
+void       crv_free_polyline(crv_polyline *polyline);
+
+crv_intersections *crv_intersect_curves(const crv_scene *scene, int curve1,
+                                        int curve2, double tolerance);
+crv_intersections *crv_intersect_scene(const crv_scene *scene,
+                                       double tolerance);
+void       crv_free_intersections(crv_intersections *intersections);
+
+void       crv_arclen_nodes(int n_intervals, const double *t, double *nodes);
+crv_arclen *crv_arclen_from_speeds(int n_intervals, const double *t,
+                                   const double *speeds);
+crv_arclen *crv_curve_arclen(const crv_scene *scene, int curve,
+                             int intervals_per_piece);
+void       crv_free_arclen(crv_arclen *table);
+double     crv_arclen_length(const crv_arclen *table);
+void       crv_arclen_lengths(const crv_arclen *table, const double *t,
+                              int n_t, double *s);
+void       crv_arclen_params(const crv_arclen *table, const double *s,
+                             int n_s, double *t);
+
+void       crv_offset_samples(int n_samples, int dim, const double *points,
+                              const double *normals,
+                              const unsigned char *defined, int n_offsets,
+                              const double *offsets, double *out);
+void       crv_evolute_samples(int n_samples, int dim, const double *points,
+                               const double *normals, const double *radii,
+                               const unsigned char *defined, double *out);
+
+void       crv_rotation_minimizing_frames(int n_samples, const double *points,
+                                          const double *tangents,
+                                          const double *normal, double *t,
+                                          double *n, double *b);
+
+double     crv_closest_point(const crv_scene *scene, int curve, double x,
+                             double y, double max_dist, double *t, double *cx,
+                             double *cy);
+int        crv_closest_curve(const crv_scene *scene, double x, double y,
+                             double max_dist, double *t, double *dist);
+
+crv_stream *crv_alloc_stream(void);
+void       crv_free_stream(crv_stream *stream);
+void       crv_clear_stream(crv_stream *stream);
+int        crv_stream_strip(crv_stream *stream, int n_points, int dim,
+                            const double *points, const float *color,
+                            const float *colors);
+int        crv_stream_circle(crv_stream *stream, const double *center,
+                             double radius, const double *normal,
+                             int n_segments, const float *color);
+
+crv_pick_index *crv_alloc_pick_index(void);
+void       crv_free_pick_index(crv_pick_index *index);
+int        crv_pick_insert_curve(crv_pick_index *index, int curve);
+void       crv_pick_delete_curve(crv_pick_index *index, int curve);
+int        crv_pick_set_curve(crv_pick_index *index, int curve, int n_samples,
+                              const float *x, const float *y, int n_points,
+                              const float *px, const float *py);
+int        crv_pick_nearest_curve(crv_pick_index *index, double x, double y,
+                                  double radius, int skip_curve, int *segment,
+                                  double *dist);
+int        crv_pick_nearest_point(crv_pick_index *index, int curve, double x,
+                                  double y, double radius, double *dist);
+int        crv_pick_nearest_sample(crv_pick_index *index, int curve, double x,
+                                   double y, double radius, double *dist);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+import ctypes
+
+from OpenGL.GL import *
+
+from ._curve_lib import VertexStream
+
+
+class LineStreams:
+    """
+    The lines of a frame by thickness, queued into a VertexStream per thickness and drawn at once by draw - one
+    glDrawElements call per thickness. Apart from curve_lib itself, as it needs OpenGL.
+    """
+
+    def __init__(self):
+        self._streams: dict[float, VertexStream] = {}
+
+    def __getitem__(self, thickness: float) -> VertexStream:
+        """
+        :return: the stream of the lines of thickness, to queue lines into
+        """
+        if thickness not in self._streams:
+            self._streams[thickness] = VertexStream()
+        return self._streams[thickness]
+
+    def draw(self):
+        """
+        Draw the lines queued since the last call, and clear the streams.
+        """
+        for thickness, stream in self._streams.items():
+            vertices, indices = stream.vertices, stream.indices
+            stream.clear()
+            if indices.size == 0:
+                continue
+            glLineWidth(thickness)
+            glEnableClientState(GL_VERTEX_ARRAY)
+            glEnableClientState(GL_COLOR_ARRAY)
+            glVertexPointer(3, GL_FLOAT, vertices.strides[0], ctypes.c_void_p(vertices.ctypes.data))
+            glColorPointer(3, GL_FLOAT, vertices.strides[0], ctypes.c_void_p(vertices[:, 3:].ctypes.data))
+            glDrawElements(GL_LINES, indices.size, GL_UNSIGNED_INT, indices)
+            glDisableClientState(GL_COLOR_ARRAY)
+            glDisableClientState(GL_VERTEX_ARRAY)
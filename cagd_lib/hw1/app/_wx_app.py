@@ -1,6 +1,5 @@
 import math
 import pathlib
-import itertools
 import threading
 from typing import Callable, Optional
 
@@ -11,12 +10,22 @@ from OpenGL.GL import *
 
 import numpy as np
 
-from cagd_lib.hw1.frenet_curve import import_frenet, FrenetCurve, Domain
-from cagd_lib.hw1.infix_tree import InfixTree
+from cagd_lib.hw1.frenet_curve import import_frenet, FrenetCurve, Domain, parameter_lock
+from cagd_lib.hw1.infix_tree import InfixTree, THREAD_SAFE
+from cagd_lib.curve_lib import ArcLengthTable, offset_samples, evolute_samples, rotation_minimizing_frames, JobQueue, \
+    JobCancelled, job_cancelled
+from cagd_lib.curve_lib.gl_lines import LineStreams
 from .mouse_look import MouseLook
 from .point_select import MousePointSelect
 
 
+ARC_LENGTH_INTERVALS = 256
+"""intervals of the curve arc length table, the curve is sampled at equal arc length steps"""
+PROXY_TOLERANCE = 1e-9
+"""error of the Chebyshev proxies the displayed curve is evaluated from - absolute, and relative where the curve and its
+derivatives are above 1 (the third derivatives of fast oscillations run into the millions)"""
+
+
 class GlobalStateClass:
     vertices = []
     vertices_torsion = []
@@ -33,17 +42,23 @@ class GlobalStateClass:
     animation_frame_rate = 30
 
     def __init__(self):
+        self._vertices_jobs = JobQueue(on_result=wx.WakeUpIdle)
+        """the curve sampling, off the UI thread (see _update_vertices) - a finished one wakes the canvas up"""
+        self._domain_samples = []
         self._curve = FrenetCurve(
-            infix_trees=[InfixTree(b"cos(t)"), InfixTree(b"sin(t)"), InfixTree(b"0")],
-            re_parametrization_tree=InfixTree(b"r"),
+            infix_trees=[InfixTree.cached(b"cos(t)"), InfixTree.cached(b"sin(t)"), InfixTree.cached(b"0")],
+            re_parametrization_tree=InfixTree.cached(b"r"),
             domain=[0, 2 * np.pi]
         )
+        self._curve.use_proxies(PROXY_TOLERANCE)
         self._n_samples = 0
         self.selected_point_index: int | None = None
         self.unit_visualization_length: float = 0.3
 
         self.draw_axes: bool = True
         self.draw_frenet_frame: bool = True
+        self.rotation_minimizing_frame: bool = False
+        self._rotation_minimizing_frames = None
         self.draw_offset_curve: bool = False
         self.draw_curve: bool = True
         self.draw_evolute: bool = False
@@ -69,6 +84,7 @@ class GlobalStateClass:
     @curve.setter
     def curve(self, curve):
         self._curve = curve
+        self._curve.use_proxies(PROXY_TOLERANCE)
         self._update_vertices()
 
     @property
@@ -83,24 +99,103 @@ class GlobalStateClass:
     def offset_curve_offset_value(self, offset_curve_offset_value):
         self._offset_curve_offset_value = offset_curve_offset_value
         self.offset_curve_vertices.clear()
-        self.offset_curve_vertices += [vertex + self.curve.evaluate_normal(r) * offset_curve_offset_value
-                                       for r, vertex in zip(self._domain_samples, self.vertices)]
+        if self.vertices:
+            # the normals are cached, only the offset distance changed
+            self.offset_curve_vertices += list(offset_samples(
+                self.vertices, self._normals, [offset_curve_offset_value], self._normals_defined)[0])
+
+    @property
+    def rotation_minimizing_frames(self) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """
+        (T, N, B) rotation minimizing frames at the vertices, computed on first use after the vertices change.
+        Only the first derivative is evaluated, and the frame is continuous where the Frenet frame is undefined.
+        """
+        if self._rotation_minimizing_frames is None:
+            with parameter_lock:  # the sampling job may evaluate the trees meanwhile
+                tangents = np.array([self.curve.evaluate_derivative(r) for r in self._domain_samples]).reshape(-1, 3)
+            # start aligned with the Frenet frame, where it is defined
+            first_normal = next((normal for normal, defined in zip(self._normals, self._normals_defined) if defined),
+                                None)
+            self._rotation_minimizing_frames = rotation_minimizing_frames(
+                np.array(self.vertices).reshape(-1, 3), tangents, first_normal)
+        return self._rotation_minimizing_frames
 
     def _update_vertices(self):
-        step = (self.curve.domain.end - self.curve.domain.start) / self.n_samples
-        self._domain_samples = list(np.arange(self.curve.domain.start, self.curve.domain.end, step))
-        self._domain_samples.append(self.curve.domain.end)
-        self.vertices.clear()
-        self.vertices_torsion.clear()
-        self.vertices += [self.curve.evaluate(r) for r in self._domain_samples]
-        self.vertices_torsion += [(self.curve.evaluate_torsion(r) if self.curve.is_torsion_defined(r) else None)
-                                  for r in self._domain_samples]
-
-        self.evolute_vertices.clear()
-        self.evolute_vertices += [vertex + self.curve.evaluate_curvature_radius(r) * self.curve.evaluate_normal(r)
-                                  for r, vertex in zip(self._domain_samples, self.vertices)]
+        """
+        Sample the curve again off the UI thread, cancelling the sampling under way - the vertices lists are replaced
+        by publish_vertices once the newest sampling finishes. On the UI thread with the ctypes binding of expr2tree,
+        whose trees must stay on one thread (see THREAD_SAFE).
+        """
+        curve, n_samples = self.curve, self.n_samples
+        if not THREAD_SAFE:
+            self._publish_sampled(self._sample_vertices(curve, n_samples))
+            return
+        self._vertices_jobs.submit(None, lambda: self._sample_vertices(curve, n_samples))
+
+    @staticmethod
+    def _sample_vertices(curve: FrenetCurve, n_samples: int) -> dict:
+        def check_cancelled():
+            if job_cancelled():
+                raise JobCancelled()
+
+        # equal arc length steps, so the animation moves at a constant speed
+        try:
+            arc_length_table = ArcLengthTable.from_speed(
+                np.vectorize(curve.evaluate_speed), curve.domain, ARC_LENGTH_INTERVALS)
+        except ValueError:
+            arc_length_table = None
+        if arc_length_table is not None and arc_length_table.length > 0:
+            domain_samples = list(arc_length_table.uniform_parameters(n_samples))
+        else:
+            step = (curve.domain.end - curve.domain.start) / n_samples
+            domain_samples = list(np.arange(curve.domain.start, curve.domain.end, step))
+            domain_samples.append(curve.domain.end)
+        check_cancelled()
+        vertices = [curve.evaluate(r) for r in domain_samples]
+        vertices_torsion = [(curve.evaluate_torsion(r) if curve.is_torsion_defined(r) else None)
+                            for r in domain_samples]
+        check_cancelled()
+
+        normals_defined = np.array([curve.is_normal_defined(r) for r in domain_samples], dtype=bool)
+        normals = np.array([curve.evaluate_normal(r) if defined else np.zeros(3)
+                            for r, defined in zip(domain_samples, normals_defined)]).reshape(-1, 3)
+        check_cancelled()
+        radii_defined = normals_defined & np.array(
+            [curve.is_curvature_radius_defined(r) for r in domain_samples], dtype=bool)
+        radii = np.array([curve.evaluate_curvature_radius(r) if defined else 0.0
+                          for r, defined in zip(domain_samples, radii_defined)])
+
+        return {
+            "curve": curve,  # so the UI thread releases its trees, with the result
+            "domain_samples": domain_samples,
+            "vertices": vertices,
+            "vertices_torsion": vertices_torsion,
+            "normals_defined": normals_defined,
+            "normals": normals,
+            "evolute_vertices": list(evolute_samples(vertices, normals, radii, radii_defined)) if vertices else [],
+        }
+
+    def publish_vertices(self):
+        """
+        Replace the vertices lists (in place, they are shared with the canvas) by the newest finished sampling, all
+        at once - on the UI thread, before drawing. A failed sampling is reported after the drawing.
+        """
+        sampled_curves, failures = self._vertices_jobs.take_results()
+        for error in failures.values():
+            wx.CallAfter(wx.MessageBox, f"could not sample the curve: {error}")
+        for sampled in sampled_curves.values():
+            self._publish_sampled(sampled)
+
+    def _publish_sampled(self, sampled: dict):
+        self._domain_samples = sampled["domain_samples"]
+        self._normals_defined = sampled["normals_defined"]
+        self._normals = sampled["normals"]
+        self.vertices[:] = sampled["vertices"]
+        self.vertices_torsion[:] = sampled["vertices_torsion"]
+        self.evolute_vertices[:] = sampled["evolute_vertices"]
 
         self.offset_curve_offset_value = self._offset_curve_offset_value
+        self._rotation_minimizing_frames = None
 
         self.selected_point_index: int | None = None
 
@@ -117,6 +212,8 @@ class OpenGLCanvas(glcanvas.GLCanvas):
         self.SetCurrent(self.context)
         glClearColor(0.1, 0.15, 0.1, 1.0)
         self.Bind(wx.EVT_PAINT, self.OnPaint)
+        self.lines = LineStreams()
+        """the lines of the frame by thickness, drawn at once at its end"""
 
         # mouse look handlers
         self.mouseLook = MouseLook()
@@ -147,6 +244,7 @@ class OpenGLCanvas(glcanvas.GLCanvas):
             self.Bind(wx.EVT_IDLE, new_paint)
 
     def OnDraw(self):
+        GlobalState.publish_vertices()
         glClear(GL_COLOR_BUFFER_BIT)
 
         # XYZ axes visualization
@@ -156,25 +254,17 @@ class OpenGLCanvas(glcanvas.GLCanvas):
             self.draw_line((0, 0, 0), (0, 0, 1), (0, 0, 1))
         if GlobalState.draw_curve:
             if GlobalState.visualize_torsion:
-                for (vertex1, torsion1), (vertex2, torsion2) in itertools.pairwise(
-                        zip(GlobalState.vertices, GlobalState.vertices_torsion)):
-                    if torsion1 is None or torsion2 is None:
-                        torsion_color = GlobalState.UNDEFINED_TORSION_COLOR
-                    else:
-                        torsion_average = (torsion1 + torsion2) / 2
-                        if GlobalState.visualize_torsion_abs:
-                            torsion_average = abs(torsion_average)
-                        normalized_torsion = 2/(1 + np.exp(- GlobalState.torsion_sigmoid_parameter * torsion_average)) - 1
-                        interpolation = normalized_torsion
-                        if interpolation > 0:
-                            torsion_color = GlobalState.TORSION_MID_COLOR * (1 - interpolation)\
-                                            + GlobalState.TORSION_MAX_COLOR * interpolation
-                        else:
-                            interpolation *= -1
-                            torsion_color = GlobalState.TORSION_MID_COLOR * (1 - interpolation)\
-                                            + GlobalState.TORSION_MIN_COLOR * interpolation
-
-                    self.draw_line(vertex1, vertex2, torsion_color)
+                # colored per vertex, interpolated along the segments
+                torsion = np.array([np.nan if torsion is None else torsion for torsion in GlobalState.vertices_torsion])
+                if GlobalState.visualize_torsion_abs:
+                    torsion = np.abs(torsion)
+                normalized_torsion = 2/(1 + np.exp(- GlobalState.torsion_sigmoid_parameter * torsion)) - 1
+                interpolation = np.abs(normalized_torsion).reshape(-1, 1)
+                torsion_colors = GlobalState.TORSION_MID_COLOR * (1 - interpolation) + np.where(
+                    normalized_torsion.reshape(-1, 1) > 0, GlobalState.TORSION_MAX_COLOR,
+                    GlobalState.TORSION_MIN_COLOR) * interpolation
+                torsion_colors[np.isnan(torsion)] = GlobalState.UNDEFINED_TORSION_COLOR
+                self.lines[3].add_strip(GlobalState.vertices, colors=torsion_colors)
             else:
                 self.draw_lines(GlobalState.vertices)
 
@@ -186,7 +276,12 @@ class OpenGLCanvas(glcanvas.GLCanvas):
             bi_normal = GlobalState.curve.evaluate_bi_normal(r) if GlobalState.curve.is_bi_normal_defined(r) else None
             curvature_radius = GlobalState.curve.evaluate_curvature_radius(r) if GlobalState.curve.is_curvature_radius_defined(r) else None
 
-            if GlobalState.draw_frenet_frame:
+            if GlobalState.draw_frenet_frame and GlobalState.rotation_minimizing_frame:
+                frame = [axis[GlobalState.selected_point_index] for axis in GlobalState.rotation_minimizing_frames]
+                for axis, color in zip(frame, [(0, 0, 1), (0, 1, 0), (1, 0, 0)]):
+                    if np.all(np.isfinite(axis)):
+                        self.draw_line(p, p + axis * GlobalState.unit_visualization_length, color)
+            elif GlobalState.draw_frenet_frame:
                 if tangent is not None:
                     self.draw_line(p, p + tangent * GlobalState.unit_visualization_length, (0, 0, 1))
                 if normal is not None:
@@ -206,34 +301,21 @@ class OpenGLCanvas(glcanvas.GLCanvas):
         if GlobalState.draw_evolute:
             self.draw_lines(GlobalState.evolute_vertices, color=(1, 0.5, 0.5))
 
+        self.lines.draw()
         self.SwapBuffers()
 
-    @staticmethod
-    def draw_line(start, end, color=(1, 1, 1), thickness=3):
-        OpenGLCanvas.draw_lines([start, end], color, thickness)
+    def draw_line(self, start, end, color=(1, 1, 1), thickness=3):
+        self.draw_lines([start, end], color, thickness)
 
-    @staticmethod
-    def draw_lines(vertices, color=(1, 1, 1), thickness=3):
-        glColor3f(*color)
-        glLineWidth(thickness)
-        glBegin(GL_LINES)
-        for vertex1, vertex2 in itertools.pairwise(vertices):
-            glVertex3fv(vertex1)
-            glVertex3fv(vertex2)
-        glEnd()
+    def draw_lines(self, vertices, color=(1, 1, 1), thickness=3):
+        """
+        Queue the polyline, drawn by lines.draw. Offset curve and evolute samples are NaN where the normal is
+        undefined, such samples break the polyline.
+        """
+        self.lines[thickness].add_strip(vertices, color)
 
     def draw_circle(self, center, radius, normal, color=(1, 1, 1), n_samples=200, thickness=3):
-        v = np.array(normal) + (
-            np.array((1, 1, 0)) if (normal[1] == normal[2] == normal[2] == 0) else np.array((1, 0, 0)))
-        u = np.cross(normal, v)
-        u = u / np.linalg.norm(u)
-        v = np.cross(normal, u)
-        angle_samples = list(np.arange(0, 1, 1 / n_samples) * 2 * np.pi)
-        angle_samples.append(0)
-        c = np.cos(angle_samples) * radius
-        s = np.sin(angle_samples) * radius
-        points_2d = c.reshape((-1, 1)) * v + s.reshape((-1, 1)) * u
-        self.draw_lines(center + points_2d, color, thickness)
+        self.lines[thickness].add_circle(center, radius, normal, color, n_samples)
 
 
 class OpenFileButton(wx.Button):
@@ -263,7 +345,7 @@ class ParameterTextControl(wx.TextCtrl):
 
     def update_curve_tree(self, event):
         try:
-            new_tree = InfixTree(self.GetValue().encode())
+            new_tree = InfixTree.cached(self.GetValue().encode())
         except ValueError as e:
             wx.MessageBox(f"improper infix expression: {e.args[0].decode()}")
             GlobalState.set_text()
@@ -290,7 +372,7 @@ class ReParameterizationTextControl(wx.TextCtrl):
 
     def update_curve_tree(self, event):
         try:
-            new_tree = InfixTree(self.GetValue().encode())
+            new_tree = InfixTree.cached(self.GetValue().encode())
         except ValueError as e:
             wx.MessageBox(f"improper infix expression: {e.args[0].decode()}")
             GlobalState.set_text()
@@ -351,6 +433,17 @@ class FrenetFrameCheckBox(wx.CheckBox):
         self.Bind(wx.EVT_CHECKBOX, switch)
 
 
+class RotationMinimizingFrameCheckBox(wx.CheckBox):
+    def __init__(self, parent):
+        super().__init__(parent, label="Rotation Minimizing Frame")
+        self.Value = GlobalState.rotation_minimizing_frame
+
+        def switch(event):
+            GlobalState.rotation_minimizing_frame = not GlobalState.rotation_minimizing_frame
+
+        self.Bind(wx.EVT_CHECKBOX, switch)
+
+
 class OsculatingCircleCheckBox(wx.CheckBox):
     def __init__(self, parent):
         super().__init__(parent, label="Osculating Circle")
@@ -453,7 +546,8 @@ class AnimateCheckBox(wx.CheckBox):
                         GlobalState.selected_point_index = 0
                     else:
                         GlobalState.selected_point_index += increment_size
-                        GlobalState.selected_point_index %= GlobalState.n_samples
+                        # the vertices of the last published sampling, n_samples may be newer
+                        GlobalState.selected_point_index %= max(len(GlobalState.vertices) - 1, 1)
                     self.Refresh()
                     self.animation_thread = threading.Timer(1 / frame_rate, next_keyframe)
                     self.animation_thread.start()
@@ -586,6 +680,10 @@ class MainApp(wx.App):
         frenet_frame_checkbox = FrenetFrameCheckBox(parent=panel)
         controls_sizer.Add(frenet_frame_checkbox)
 
+        # Rotation Minimizing Frame checkbox (drawn instead of the Frenet frame)
+        rotation_minimizing_frame_checkbox = RotationMinimizingFrameCheckBox(parent=panel)
+        controls_sizer.Add(rotation_minimizing_frame_checkbox)
+
         # Osculating Circle checkbox
         osculating_circle_checkbox = OsculatingCircleCheckBox(parent=panel)
         controls_sizer.Add(osculating_circle_checkbox)
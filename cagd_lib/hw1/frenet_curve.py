@@ -2,12 +2,16 @@ from typing import Sequence, NamedTuple
 
 import numpy as np
 
-from cagd_lib.hw1.infix_tree import InfixTree, Variables as v, Variables
+from cagd_lib.hw1.infix_tree import InfixTree, Variables as v, Variables, ChebyshevProxy
 import pathlib
+import threading
 
 epsilon = 1e-6
 is_epsilon = lambda x: -epsilon <= x <= epsilon
 
+parameter_lock = threading.RLock()
+"""held while the parameters are set and trees evaluated at them, as curves are also sampled off the UI thread"""
+
 
 def import_frenet(path: pathlib.Path) -> 'FrenetCurve':
     expressions = []
@@ -31,7 +35,7 @@ def import_frenet(path: pathlib.Path) -> 'FrenetCurve':
             else:
                 break
             row += 1
-    return FrenetCurve([InfixTree(e.encode()) for e in expressions], InfixTree(b"r"), domain)
+    return FrenetCurve([InfixTree.cached(e.encode()) for e in expressions], InfixTree.cached(b"r"), domain)
 
 
 class Domain(NamedTuple):
@@ -44,9 +48,32 @@ class XYZInfixTree(NamedTuple):
     y: InfixTree
     z: InfixTree
 
-    def cross(self, other):
-        # a x b = [(a.y*b.z - a.z*b.y), (a.z*b.x - a.x*b.z), (a.x*b.y - a.y*b.x)]
-        return XYZInfixTree(*np.cross(self, other))
+
+DERIVATIVES = 3
+"""derivatives of the curve by r the Frenet frame needs: dC, ddC and dddC"""
+
+PROXY_SAMPLES = 1025
+"""samples of t(r) over the domain for the range of t the proxies of C are built over"""
+
+
+def chain_rule(c_derivatives: Sequence, t_derivatives: Sequence) -> list:
+    """
+    The derivatives of C(t(r)) by r up to the third (Faa di Bruno's formula), from the derivatives of C by t at t(r)
+    and of t by r at r - numbers or numpy arrays, broadcast together.
+
+    :param c_derivatives: [C, dC/dt, ...] at t(r), as many as wanted
+    :param t_derivatives: [t, dt/dr, ...] at r, as many
+    :return: [C, dC/dr, ...]
+    """
+    c, t = c_derivatives, t_derivatives
+    derivatives = [c[0]]
+    if len(c) > 1:
+        derivatives.append(c[1] * t[1])
+    if len(c) > 2:
+        derivatives.append(c[2] * t[1] ** 2 + c[1] * t[2])
+    if len(c) > 3:
+        derivatives.append(c[3] * t[1] ** 3 + 3 * c[2] * t[1] * t[2] + c[1] * t[3])
+    return derivatives
 
 
 class FrenetCurve:
@@ -73,91 +100,130 @@ class FrenetCurve:
 
         self.infix_trees = infix_trees
         self._re_parametrization_tree = re_parametrization_tree
-        self._reparametrized_trees = XYZInfixTree(
-            *[infix_tree.re_parametrize(re_parametrization_tree, v.T) for infix_tree in infix_trees])
-
         self.domain = Domain(*domain)
 
-        # re parametrized curve C(t(r))
-        self.dC_trees = XYZInfixTree(
-            *[infix_tree.calculate_derivative(v.R) for infix_tree in self._reparametrized_trees])
-        self.ddC_trees = XYZInfixTree(*[infix_tree.calculate_derivative(v.R) for infix_tree in self.dC_trees])
-        self.dddC_trees = XYZInfixTree(*[infix_tree.calculate_derivative(v.R) for infix_tree in self.ddC_trees])
-        self.dC_norm_tree = InfixTree.norm(self.dC_trees)
-        self.dC_x_ddC_trees = XYZInfixTree.cross(self.dC_trees, self.ddC_trees)
-        self.dC_x_ddC_norm_tree = InfixTree.norm(self.dC_x_ddC_trees)
-
-        # T = dC / ||dC||
-        self._T_trees = XYZInfixTree(*[tree / self.dC_norm_tree for tree in self.dC_trees])
-        # self._dT_trees = XYZInfixTree(*[infix_tree.calculate_derivative(v.R) for infix_tree in self._T_trees])
-
-        # B = (dC x ddC) / ||dC x ddC||
-        self._B_trees = XYZInfixTree(*[tree / self.dC_x_ddC_norm_tree for tree in self.dC_x_ddC_trees])
-        # self._dB_trees = XYZInfixTree(*[infix_tree.calculate_derivative(v.R) for infix_tree in self._B_trees])
-
-        # kappa = ||dC x ddC|| / ||dC||^3
-        self._kappa_tree = self.dC_x_ddC_norm_tree / self.dC_norm_tree ** InfixTree(b'3')
-        self._osculating_circle_radius_tree = InfixTree(b'1') / self._kappa_tree
-
-        # N = B x T
-        self._N_trees = XYZInfixTree.cross(self._B_trees, self._T_trees)
-        # self._dN_trees = XYZInfixTree(*[infix_tree.calculate_derivative(v.R) for infix_tree in self._N_trees])
-
-        # tau = -dB / N
-        self._tau_tree = InfixTree.dot(self.dC_x_ddC_trees, self.dddC_trees) / self.dC_x_ddC_norm_tree ** InfixTree(
-            b'2')
+        # C is derived by t and t(r) by r apart, and C(t(r)) by the chain rule when evaluated - so a new
+        # re-parameterization derives t(r) only, and trees parsed through the cache (InfixTree.cached) are derived once.
+        # Polynomial parts in Horner form - no pow() calls, and derived through their coefficients. The derivatives
+        # are not: the expanded (t+1)^2 of a quotient rule loses every digit about its root.
+        self._C_trees = self._derivative_trees(infix_trees, v.T)
+        """[C, dC/dt, ddC/dt^2, dddC/dt^3] trees of t"""
+        self._t_trees = [trees[0] for trees in self._derivative_trees([re_parametrization_tree], v.R)]
+        """[t, dt/dr, ddt/dr^2, dddt/dr^3] trees of r"""
+
+        self._proxies: dict[str, list[ChebyshevProxy] | list[list[ChebyshevProxy]]] | None = None
+
+    @staticmethod
+    def _derivative_trees(trees: Sequence[InfixTree], variable: Variables) -> list[XYZInfixTree | list[InfixTree]]:
+        derivatives = [[tree.horner(variable) for tree in trees]]
+        for _ in range(DERIVATIVES):
+            derivatives.append([tree.calculate_derivative(variable) for tree in derivatives[-1]])
+        return [XYZInfixTree(*derived) if len(derived) == 3 else derived for derived in derivatives]
+
+    def use_proxies(self, tolerance: float | None):
+        """
+        Evaluate the curve, its derivative and speed, the normal, curvature radius and torsion from piecewise
+        Chebyshev proxies of the derivative trees of t(r) over the domain and of C over the range of t, within
+        tolerance (relative where the values are above 1, see InfixTree.chebyshev_proxy) - for display, at a cost that
+        does not grow with the depth of the trees. The is_*_defined checks
+        still evaluate the trees. None - back to the trees.
+        """
+        if tolerance is None:
+            self._proxies = None
+            return
+
+        # both sweep a parameter, through the values the other threads set
+        with parameter_lock:
+            t_samples = self._t_trees[0].evaluate_batch(v.R, np.linspace(*self.domain, PROXY_SAMPLES))
+            t_range = np.nanmin(t_samples), np.nanmax(t_samples)
+            if not np.isfinite(t_range).all():
+                self._proxies = None
+                return
+            if not t_range[0] < t_range[1]:
+                t_range = t_range[0], t_range[0] + 1.0  # t is constant, any range about it
+
+            self._proxies = {
+                "t": [tree.chebyshev_proxy(v.R, self.domain, tolerance, relative=True) for tree in self._t_trees],
+                "C": [[tree.chebyshev_proxy(v.T, t_range, tolerance, relative=True) for tree in trees]
+                      for trees in self._C_trees],
+            }
 
     @property
     def re_parametrization_tree(self):
         return self._re_parametrization_tree
 
+    def _derivatives(self, r: float, order: int, exact: bool = False) -> list[np.ndarray]:
+        """
+        :return: [C, dC/dr, ...] at r up to order (at most DERIVATIVES), from the proxies unless exact or none.
+        """
+        if self._proxies is not None and not exact:
+            t = [proxy(r) for proxy in self._proxies["t"][:order + 1]]
+            return chain_rule(
+                [np.array([proxy(t[0]) for proxy in proxies]) for proxies in self._proxies["C"][:order + 1]], t)
+        with parameter_lock:
+            InfixTree.r = r
+            t = [tree() for tree in self._t_trees[:order + 1]]
+            InfixTree.t = t[0]
+            return chain_rule([np.array([tree() for tree in trees]) for trees in self._C_trees[:order + 1]], t)
+
+    def _frenet(self, r: float, exact: bool = False) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """
+        :return: dC, dC x ddC and dddC at r
+        """
+        _, dc, ddc, dddc = self._derivatives(r, 3, exact)
+        return dc, np.cross(dc, ddc), dddc
+
     def evaluate(self, r: float):
-        InfixTree.r = r
-        return np.array([tree() for tree in self._reparametrized_trees])
+        return self._derivatives(r, 0)[0]
+
+    def evaluate_speed(self, r: float):
+        return np.linalg.norm(self._derivatives(r, 1)[1])
+
+    def evaluate_derivative(self, r: float):
+        return self._derivatives(r, 1)[1]
 
     def is_tangent_defined(self, r: float):
-        InfixTree.r = r
-        return not is_epsilon(self.dC_norm_tree())
+        return not is_epsilon(np.linalg.norm(self._derivatives(r, 1, exact=True)[1]))
 
     def evaluate_tangent(self, r: float):
-        InfixTree.r = r
-        return np.array([tree() for tree in self._T_trees])
+        dc = self._derivatives(r, 1, exact=True)[1]
+        return dc / np.linalg.norm(dc)
 
     def is_curvature_defined(self, r: float):
-        InfixTree.r = r
-        return not is_epsilon(self.dC_norm_tree())
+        return self.is_tangent_defined(r)
 
-    def evaluate_curvature(self, r: float):
-        InfixTree.r = r
-        return self._kappa_tree()
+    def evaluate_curvature(self, r: float, exact: bool = True):
+        # kappa = ||dC x ddC|| / ||dC||^3
+        dc, dc_x_ddc, _ = self._frenet(r, exact)
+        return np.linalg.norm(dc_x_ddc) / np.linalg.norm(dc) ** 3
 
     def is_curvature_radius_defined(self, r: float):
-        InfixTree.r = r
-        return self.is_curvature_defined(r) and not is_epsilon(self._kappa_tree())
+        return self.is_curvature_defined(r) and not is_epsilon(self.evaluate_curvature(r))
 
     def evaluate_curvature_radius(self, r: float):
-        InfixTree.r = r
-        return self._osculating_circle_radius_tree()
+        return 1 / self.evaluate_curvature(r, exact=False)
 
     def is_normal_defined(self, r: float):
         return self.is_bi_normal_defined(r) and self.is_tangent_defined(r)
 
-    def evaluate_normal(self, r: float):
-        InfixTree.r = r
-        return np.array([tree() for tree in self._N_trees])
+    def evaluate_normal(self, r: float, exact: bool = False):
+        # N = B x T
+        dc, dc_x_ddc, _ = self._frenet(r, exact)
+        return np.cross(dc_x_ddc / np.linalg.norm(dc_x_ddc), dc / np.linalg.norm(dc))
 
     def is_bi_normal_defined(self, r: float):
-        InfixTree.r = r
-        return not is_epsilon(self.dC_x_ddC_norm_tree())
+        _, dc_x_ddc, _ = self._frenet(r, exact=True)
+        return not is_epsilon(np.linalg.norm(dc_x_ddc))
 
     def evaluate_bi_normal(self, r: float):
-        InfixTree.r = r
-        return np.array([tree() for tree in self._B_trees])
+        # B = (dC x ddC) / ||dC x ddC||
+        _, dc_x_ddc, _ = self._frenet(r, exact=True)
+        return dc_x_ddc / np.linalg.norm(dc_x_ddc)
 
     def is_torsion_defined(self, r: float):
-        InfixTree.r = r
-        return not is_epsilon(self.dC_x_ddC_norm_tree())
+        return self.is_bi_normal_defined(r)
 
     def evaluate_torsion(self, r: float):
-        InfixTree.r = r
-        return self._tau_tree()
+        # tau = (dC x ddC) . dddC / ||dC x ddC||^2
+        _, dc_x_ddc, dddc = self._frenet(r)
+        return np.dot(dc_x_ddc, dddc) / np.dot(dc_x_ddc, dc_x_ddc)
@@ -1 +1 @@
-from ._infix_tree import InfixTree, Variables
+from ._infix_tree import InfixTree, Variables, ChebyshevProxy, THREAD_SAFE
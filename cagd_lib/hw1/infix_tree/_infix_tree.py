@@ -1,14 +1,15 @@
 import ctypes
 
 from enum import IntEnum
-from functools import reduce
 from pathlib import Path
 from typing import Iterable
 
+import numpy as np
+
 from cagd_lib.utils import unit_value
 
 __all__ = [
-    "Variables", "InfixTree"
+    "Variables", "InfixTree", "ChebyshevProxy"
 ]
 
 
@@ -47,62 +48,186 @@ class Variables(IntEnum):
 
 VARIABLE_TYPE = Variables | int | str
 
-clib = ctypes.CDLL("./expr2tree.so")
-clib.e2t_expr2tree.argtypes = [ctypes.c_char_p]
-clib.e2t_expr2tree.restype = ctypes.POINTER(ctypes.c_void_p)
+STATS_CALLS = ["expr2tree", "copytree", "evaltree", "derivtree", "cmptree", "paramintree", "freetree", "printtree",
+               "setparamvalue", "treereparameter", "trees_operation", "specialize",
+               "evalgrad", "chebproxy", "polynomial"]
+"""names of the counted expr2tree routines, in the order of their E2T_STATS_* index"""
+
+
+class _E2tStats(ctypes.Structure):
+    _fields_ = [
+        ("calls", ctypes.c_ulong * len(STATS_CALLS)),
+        ("nodes_allocated", ctypes.c_ulong),
+        ("nodes_freed", ctypes.c_ulong),
+        ("live_nodes", ctypes.c_long),
+        ("optimize_passes", ctypes.c_ulong),
+        ("optimize_rewrites", ctypes.c_ulong),
+        ("max_depth", ctypes.c_int),
+        ("parse_time", ctypes.c_double),
+        ("deriv_time", ctypes.c_double),
+        ("eval_time", ctypes.c_double),
+        ("cache_hits", ctypes.c_ulong),
+        ("cache_misses", ctypes.c_ulong),
+        ("cache_entries", ctypes.c_int),
+    ]
+
+
+def _load_ctypes_library() -> ctypes.CDLL:
+    """
+    The ctypes binding of expr2tree.so - when the _expr2tree extension module is not built. Calls are not serialized,
+    so trees must not be used from more than one thread.
+    """
+    _double_array = np.ctypeslib.ndpointer(dtype=np.float64, flags="C_CONTIGUOUS")
+
+    clib = ctypes.CDLL("./expr2tree.so")
+    clib.e2t_expr2tree.argtypes = [ctypes.c_char_p]
+    clib.e2t_expr2tree.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_printtree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_char_p]
+
+    clib.e2t_copytree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_copytree.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_freetree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+
+    clib.e2t_cmptree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_cmptree.restype = ctypes.c_int
+
+    clib.e2t_paramintree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
+    clib.e2t_paramintree.restype = ctypes.c_int
+
+    clib.e2t_setparamvalue.argtypes = [ctypes.c_double, ctypes.c_int]
+
+    clib.e2t_evaltree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_evaltree.restype = ctypes.c_double
+
+    clib.e2t_evaltree_batch.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int, ctypes.c_int, _double_array,
+                                        _double_array]
+
+    clib.e2t_derivtree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
+    clib.e2t_derivtree.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_deriverror.restype = ctypes.c_int
+
+    clib.e2t_parserror.restype = ctypes.c_int
+
+    clib.e2t_memerror.restype = ctypes.c_int
+
+    clib.e2t_specialize.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_ulong, ctypes.POINTER(ctypes.c_double)]
+    clib.e2t_specialize.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_evalgrad.argtypes = [ctypes.POINTER(ctypes.c_void_p), _double_array]
+    clib.e2t_evalgrad.restype = ctypes.c_double
+
+    clib.e2t_evalhessvec.argtypes = [ctypes.POINTER(ctypes.c_void_p), _double_array, _double_array, _double_array]
+    clib.e2t_evalhessvec.restype = ctypes.c_double
+
+    clib.e2t_evalgrad_batch.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int, ctypes.c_int, _double_array,
+                                        _double_array, _double_array]
 
-clib.e2t_printtree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_char_p)]
+    clib.e2t_chebproxy.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int, ctypes.c_double, ctypes.c_double,
+                                   ctypes.c_double, ctypes.c_int]
+    clib.e2t_chebproxy.restype = ctypes.c_void_p
 
-clib.e2t_copytree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_copytree.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_chebeval.argtypes = [ctypes.c_void_p, ctypes.c_double]
+    clib.e2t_chebeval.restype = ctypes.c_double
 
-clib.e2t_freetree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_chebeval_n.argtypes = [ctypes.c_void_p, ctypes.c_int, _double_array, _double_array]
 
-clib.e2t_cmptree.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_cmptree.restype = ctypes.c_int
+    clib.e2t_chebderiv.argtypes = [ctypes.c_void_p]
+    clib.e2t_chebderiv.restype = ctypes.c_void_p
 
-clib.e2t_paramintree.argstype = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
-clib.e2t_paramintree.restype = ctypes.c_int
+    clib.e2t_chebinteg.argtypes = [ctypes.c_void_p]
+    clib.e2t_chebinteg.restype = ctypes.c_void_p
 
-clib.e2t_setparamvalue.argstype = [ctypes.c_double, ctypes.c_int]
+    clib.e2t_freechebproxy.argtypes = [ctypes.c_void_p]
 
-clib.e2t_evaltree.argstype = [ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_evaltree.restype = ctypes.c_double
+    clib.e2t_tree2poly.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int, _double_array]
+    clib.e2t_tree2poly.restype = ctypes.c_int
 
-clib.e2t_derivtree.argstype = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
-clib.e2t_derivtree.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_poly2bernstein.argtypes = [_double_array, ctypes.c_int, ctypes.c_double, ctypes.c_double, _double_array]
 
-clib.e2t_treereparameter.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
-clib.e2t_treereparameter.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_polyhorner.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
+    clib.e2t_polyhorner.restype = ctypes.POINTER(ctypes.c_void_p)
 
-clib.e2t_trees_op_division.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_trees_op_division.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_getstats.argtypes = [ctypes.POINTER(_E2tStats)]
 
-clib.e2t_trees_op_subtraction.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_trees_op_subtraction.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_cachetree.argtypes = [ctypes.c_char_p]
+    clib.e2t_cachetree.restype = ctypes.POINTER(ctypes.c_void_p)
 
-clib.e2t_trees_op_multiplication.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_trees_op_multiplication.restype = ctypes.POINTER(ctypes.c_void_p)
+    for _cached in (clib.e2t_cachederivtree, clib.e2t_cachepolyhorner):
+        _cached.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
+        _cached.restype = ctypes.POINTER(ctypes.c_void_p)
 
-clib.e2t_trees_op_addition.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_trees_op_addition.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_releasetree.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
 
-clib.e2t_trees_op_power.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_trees_op_power.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_setcachesize.argtypes = [ctypes.c_int]
 
-clib.e2t_tree_op_sqr.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_tree_op_sqr.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_treereparameter.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p), ctypes.c_int]
+    clib.e2t_treereparameter.restype = ctypes.POINTER(ctypes.c_void_p)
 
-clib.e2t_tree_op_sqrt.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_tree_op_sqrt.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_trees_op_division.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_trees_op_division.restype = ctypes.POINTER(ctypes.c_void_p)
 
-clib.e2t_tree_op_unarminus.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
-clib.e2t_tree_op_unarminus.restype = ctypes.POINTER(ctypes.c_void_p)
+    clib.e2t_trees_op_subtraction.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_trees_op_subtraction.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_trees_op_multiplication.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_trees_op_multiplication.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_trees_op_addition.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_trees_op_addition.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_trees_op_power.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_trees_op_power.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_tree_op_sqr.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_tree_op_sqr.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_tree_op_sqrt.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_tree_op_sqrt.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    clib.e2t_tree_op_unarminus.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+    clib.e2t_tree_op_unarminus.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    for _binary_move in (clib.e2t_trees_op_division_move, clib.e2t_trees_op_subtraction_move,
+                         clib.e2t_trees_op_multiplication_move, clib.e2t_trees_op_addition_move,
+                         clib.e2t_trees_op_power_move):
+        _binary_move.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p)]
+        _binary_move.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    for _unary_move in (clib.e2t_tree_op_sqr_move, clib.e2t_tree_op_sqrt_move, clib.e2t_tree_op_unarminus_move):
+        _unary_move.argtypes = [ctypes.POINTER(ctypes.c_void_p)]
+        _unary_move.restype = ctypes.POINTER(ctypes.c_void_p)
+
+    return clib
+
+
+try:
+    # the native extension module (see infix_tree.md): tree handles, buffers, and the GIL released during the calls
+    import _expr2tree as clib
+except ImportError:
+    clib = _load_ctypes_library()
+
+THREAD_SAFE = not isinstance(clib, ctypes.CDLL)
+"""whether trees may be used from more than one thread: the extension module serializes its calls, ctypes does not"""
+
+POLY_MAX_DEGREE = 64
+"""E2T_POLY_MAX_DEGREE, the highest degree of polynomials found in trees"""
 
 
 DummyTree = unit_value("DummyTree")
 
 
+def _check_memory():
+    """
+    Raise MemoryError if the last gradient, proxy or specialize call ran out of memory - the extension module raises
+    it itself.
+    """
+    if clib.e2t_memerror():
+        raise MemoryError("expr2tree")
+
+
 def _var_type_to_var_enum(variable: VARIABLE_TYPE):
     if isinstance(variable, str):
         return getattr(Variables, variable.upper())
@@ -120,6 +245,9 @@ class InfixTreeMeta(type):
 
 
 class InfixTree(metaclass=InfixTreeMeta):
+    _shared = False
+    """the tree is of the parse cache (see cached): immutable, released instead of freed, copied instead of moved"""
+
     def __init__(self, expression: bytes):
 
         if isinstance(expression, bytes):
@@ -136,7 +264,7 @@ class InfixTree(metaclass=InfixTreeMeta):
     def __repr__(self):
         # TODO Optimize and implement properly
         repr_str_ptr = ctypes.create_string_buffer(10000)
-        clib.e2t_printtree(self._tree_pointer, ctypes.c_char_p.from_buffer(repr_str_ptr))
+        clib.e2t_printtree(self._tree_pointer, repr_str_ptr)
         return repr_str_ptr.value.decode()
 
     def __copy__(self) -> 'InfixTree':
@@ -145,7 +273,34 @@ class InfixTree(metaclass=InfixTreeMeta):
         return new_tree
 
     def __del__(self):
-        clib.e2t_freetree(self._tree_pointer)
+        if self._shared:
+            clib.e2t_releasetree(self._tree_pointer)
+        else:
+            clib.e2t_freetree(self._tree_pointer)
+
+    @classmethod
+    def cached(cls, expression: bytes) -> 'InfixTree':
+        """
+        The tree of expression from the parse cache of expr2tree, parsed only if the expression (up to case and
+        blanks) is not there - a bounded LRU cache. The tree is shared: its calculate_derivative and horner trees are
+        cached with it, and the _move operators copy it instead of moving it.
+        """
+        if not isinstance(expression, bytes):
+            raise ValueError(expression)
+        tree_pointer = clib.e2t_cachetree(expression)
+        if not bool(tree_pointer):
+            raise ValueError(expression)
+        shared_tree = InfixTree(DummyTree)
+        shared_tree._tree_pointer = tree_pointer
+        shared_tree._shared = True
+        return shared_tree
+
+    @staticmethod
+    def set_cache_size(size: int):
+        """
+        The number of trees the parse cache keeps (held trees are kept anyway), 0 for none.
+        """
+        clib.e2t_setcachesize(size)
 
     def __eq__(self, other: 'InfixTree') -> bool:
         return clib.e2t_cmptree(self._tree_pointer, other._tree_pointer) != 0
@@ -156,13 +311,151 @@ class InfixTree(metaclass=InfixTreeMeta):
     def __call__(self) -> float:
         return clib.e2t_evaltree(self._tree_pointer)
 
+    def evaluate_batch(self, variable: VARIABLE_TYPE, values) -> np.ndarray:
+        """
+        The values at every one of the values of variable, the other variables at their current values, in one call.
+        The variable value is kept.
+        """
+        values = np.ascontiguousarray(values, dtype=np.float64)
+        variable = _var_type_to_var_enum(variable)
+        if values.ndim != 1 or not 0 <= variable < Variables.Z1:
+            raise ValueError(f"can not sweep {variable!r} over values of shape {values.shape}")
+        out = np.empty(len(values))
+        clib.e2t_evaltree_batch(self._tree_pointer, len(values), variable, values, out)
+        return out
+
     def calculate_derivative(self, variable: VARIABLE_TYPE) -> 'InfixTree':
         derived_tree = InfixTree(DummyTree)
-        derived_tree._tree_pointer = clib.e2t_derivtree(self._tree_pointer, _var_type_to_var_enum(variable))
-        if not bool(self._tree_pointer):
-            raise ValueError()
+        derive = clib.e2t_cachederivtree if self._shared else clib.e2t_derivtree
+        derived_tree._tree_pointer = derive(self._tree_pointer, _var_type_to_var_enum(variable))
+        derived_tree._shared = self._shared
+        if not bool(derived_tree._tree_pointer):
+            raise ValueError(f"can not derive {self!r}: error {clib.e2t_deriverror()}")
         return derived_tree
 
+    def specialize(self, values: dict[VARIABLE_TYPE, float]) -> 'InfixTree':
+        """
+        A new tree with the given variables replaced by their values, and every subtree that becomes constant folded
+        to a number - a smaller tree for loops that sweep the other variables. Evaluates exactly as this tree does
+        with these variable values set.
+        """
+        param_mask = 0
+        param_values = (ctypes.c_double * Variables.Z1)()
+        for variable, value in values.items():
+            variable = _var_type_to_var_enum(variable)
+            if not 0 <= variable < Variables.Z1:
+                raise ValueError(variable)
+            param_mask |= 1 << variable
+            param_values[variable] = value
+
+        pointer = clib.e2t_specialize(self._tree_pointer, param_mask, param_values)
+        _check_memory()
+        specialized_tree = InfixTree(DummyTree)
+        specialized_tree._tree_pointer = pointer
+        return specialized_tree
+
+    def gradient(self) -> tuple[float, np.ndarray]:
+        """
+        The value and the derivatives by all the variables (indexed by Variables, zero for those not in the tree) at
+        the current variable values, in one reverse mode sweep instead of a derivative tree per variable.
+        """
+        grad = np.empty(Variables.Z1)
+        value = clib.e2t_evalgrad(self._tree_pointer, grad)
+        _check_memory()
+        return value, grad
+
+    def hessian_vector_product(self, v) -> tuple[float, np.ndarray, np.ndarray]:
+        """
+        The value, gradient and Hessian times v (Variables.Z1 values) at the current variable values.
+        """
+        v = np.ascontiguousarray(v, dtype=np.float64)
+        if v.shape != (Variables.Z1,):
+            raise ValueError(f"v must have {Variables.Z1} values, got shape {v.shape}")
+        grad, hv = np.empty(Variables.Z1), np.empty(Variables.Z1)
+        value = clib.e2t_evalhessvec(self._tree_pointer, v, grad, hv)
+        _check_memory()
+        return value, grad, hv
+
+    def hessian(self) -> np.ndarray:
+        """
+        The Variables.Z1 x Variables.Z1 Hessian at the current variable values, a Hessian vector product per variable
+        in the tree.
+        """
+        hessian = np.zeros((Variables.Z1, Variables.Z1))
+        v = np.zeros(Variables.Z1)
+        for variable in Variables:
+            if 0 <= variable < Variables.Z1 and variable in self:
+                v[variable] = 1.0
+                hessian[:, variable] = self.hessian_vector_product(v)[2]
+                v[variable] = 0.0
+        return hessian
+
+    @staticmethod
+    def jacobian(trees: Iterable['InfixTree']) -> tuple[np.ndarray, np.ndarray]:
+        """
+        The values of the trees and their Jacobian (a gradient row per tree) at the current variable values.
+        """
+        values, rows = zip(*(tree.gradient() for tree in trees))
+        return np.array(values), np.array(rows)
+
+    def gradient_batch(self, variable: VARIABLE_TYPE, values) -> tuple[np.ndarray, np.ndarray]:
+        """
+        The values (N,) and gradients (N, Variables.Z1) at every one of the N values of variable, the other variables
+        at their current values - as for fitting the other variables to samples. The variable value is kept.
+        """
+        values = np.ascontiguousarray(values, dtype=np.float64)
+        variable = _var_type_to_var_enum(variable)
+        if values.ndim != 1 or not 0 <= variable < Variables.Z1:
+            raise ValueError(f"can not sweep {variable!r} over values of shape {values.shape}")
+        f, grads = np.empty(len(values)), np.empty((len(values), Variables.Z1))
+        clib.e2t_evalgrad_batch(self._tree_pointer, len(values), variable, values, f, grads)
+        _check_memory()
+        return f, grads
+
+    def chebyshev_proxy(self, variable: VARIABLE_TYPE, domain: tuple[float, float],
+                        tolerance: float, relative: bool = False) -> 'ChebyshevProxy':
+        """
+        A piecewise Chebyshev approximation of the tree as a function of variable over domain, within the absolute
+        tolerance (if relative, relative where the values are above 1), the other variables at their current values.
+        Evaluating it costs the same for any tree.
+        """
+        variable = _var_type_to_var_enum(variable)
+        pointer = clib.e2t_chebproxy(self._tree_pointer, variable, domain[0], domain[1], tolerance, int(relative))
+        _check_memory()
+        if not pointer:
+            raise ValueError(f"can not approximate in {variable!r} over {domain}")
+        return ChebyshevProxy(pointer)
+
+    def polynomial(self, variable: VARIABLE_TYPE) -> np.ndarray | None:
+        """
+        The power basis coefficients (coefficient k of variable^k) if the tree is a polynomial in variable - numbers,
+        variable, +, -, *, sqr, non negative integer powers and division by constants only - else None.
+        """
+        coefs = np.empty(POLY_MAX_DEGREE + 1)
+        degree = clib.e2t_tree2poly(self._tree_pointer, _var_type_to_var_enum(variable), coefs)
+        return coefs[:degree + 1] if degree >= 0 else None
+
+    def bernstein(self, variable: VARIABLE_TYPE, domain: tuple[float, float]) -> np.ndarray | None:
+        """
+        The Bernstein basis coefficients over domain if the tree is a polynomial in variable, else None.
+        """
+        coefs = self.polynomial(variable)
+        if coefs is None:
+            return None
+        bernstein = np.empty(len(coefs))
+        clib.e2t_poly2bernstein(coefs, len(coefs) - 1, domain[0], domain[1], bernstein)
+        return bernstein
+
+    def horner(self, variable: VARIABLE_TYPE) -> 'InfixTree':
+        """
+        A copy with every polynomial subtree in variable rewritten in Horner form, evaluated without pow() calls.
+        """
+        horner_tree = InfixTree(DummyTree)
+        horner = clib.e2t_cachepolyhorner if self._shared else clib.e2t_polyhorner
+        horner_tree._tree_pointer = horner(self._tree_pointer, _var_type_to_var_enum(variable))
+        horner_tree._shared = self._shared
+        return horner_tree
+
     def re_parametrize(self, re_parametrization_tree: 'InfixTree', parameter: VARIABLE_TYPE):
         new_tree = InfixTree(DummyTree)
         new_tree._tree_pointer = clib.e2t_treereparameter(self._tree_pointer, re_parametrization_tree._tree_pointer, parameter)
@@ -170,52 +463,159 @@ class InfixTree(metaclass=InfixTreeMeta):
 
     @classmethod
     def set_variable_value(cls, variable: VARIABLE_TYPE, value: float):
-        clib.e2t_setparamvalue(ctypes.c_double(value), _var_type_to_var_enum(variable))
+        clib.e2t_setparamvalue(float(value), _var_type_to_var_enum(variable))
 
-    def __truediv__(self, other):
+    @staticmethod
+    def stats() -> dict:
+        """
+        Runtime counters of the native trees: calls of every routine (by the user, not their recursion), nodes
+        allocated / freed / live (held or leaked), optimizer passes and rewrites, the deepest tree made, and the
+        seconds spent parsing, deriving and evaluating - all since the last reset_stats.
+        """
+        stats = _E2tStats()
+        clib.e2t_getstats(stats)
+        return {
+            "calls": dict(zip(STATS_CALLS, stats.calls)),
+            **{name: getattr(stats, name) for name, _ in _E2tStats._fields_ if name != "calls"}
+        }
+
+    @staticmethod
+    def reset_stats():
+        """
+        Zero the runtime counters, except of the live nodes.
+        """
+        clib.e2t_resetstats()
+
+    def _take_pointer(self):
+        if self._shared:
+            return clib.e2t_copytree(self._tree_pointer)
+        # the native tree is moved into a new tree, so this one must not free it
+        tree_pointer = self._tree_pointer
+        self._tree_pointer = None
+        return tree_pointer
+
+    def _binary_operation(self, other: 'InfixTree', operation) -> 'InfixTree':
         new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_trees_op_division(self._tree_pointer, other._tree_pointer)
+        new_tree._tree_pointer = operation(self._tree_pointer, other._tree_pointer)
         return new_tree
 
-    def __sub__(self, other):
+    def _unary_operation(self, operation) -> 'InfixTree':
         new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_trees_op_subtraction(self._tree_pointer, other._tree_pointer)
+        new_tree._tree_pointer = operation(self._tree_pointer)
         return new_tree
 
-    def __mul__(self, other):
+    def _binary_move(self, other: 'InfixTree', move_operation) -> 'InfixTree':
+        """
+        The operation on this tree and other, linking their native trees into the new tree instead of copying them:
+        both are left empty and must not be used again (shared trees are copied, and are left as they are).
+        """
+        right_pointer = clib.e2t_copytree(other._tree_pointer) if other is self else other._take_pointer()
         new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_trees_op_multiplication(self._tree_pointer, other._tree_pointer)
+        new_tree._tree_pointer = move_operation(self._take_pointer(), right_pointer)
         return new_tree
 
-    def __add__(self, other):
+    def _unary_move(self, move_operation) -> 'InfixTree':
         new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_trees_op_addition(self._tree_pointer, other._tree_pointer)
+        new_tree._tree_pointer = move_operation(self._take_pointer())
         return new_tree
 
+    def __truediv__(self, other):
+        return self._binary_operation(other, clib.e2t_trees_op_division)
+
+    def __sub__(self, other):
+        return self._binary_operation(other, clib.e2t_trees_op_subtraction)
+
+    def __mul__(self, other):
+        return self._binary_operation(other, clib.e2t_trees_op_multiplication)
+
+    def __add__(self, other):
+        return self._binary_operation(other, clib.e2t_trees_op_addition)
+
     def __pow__(self, power, modulo=None):
-        new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_trees_op_power(self._tree_pointer, power._tree_pointer)
-        return new_tree
+        return self._binary_operation(power, clib.e2t_trees_op_power)
 
     def sqr(self):
-        new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_tree_op_sqr(self._tree_pointer)
-        return new_tree
+        return self._unary_operation(clib.e2t_tree_op_sqr)
 
     def sqrt(self):
-        new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_tree_op_sqrt(self._tree_pointer)
-        return new_tree
+        return self._unary_operation(clib.e2t_tree_op_sqrt)
 
     def __neg__(self):
-        new_tree = InfixTree(DummyTree)
-        new_tree._tree_pointer = clib.e2t_tree_op_unarminus(self._tree_pointer)
-        return new_tree
+        return self._unary_operation(clib.e2t_tree_op_unarminus)
+
+    # The operators copy their operands. The _move variants below move them instead (see _binary_move), for trees no
+    # one else holds - such as a sum of new terms, which then copies no term.
+
+    def divide_move(self, other: 'InfixTree') -> 'InfixTree':
+        return self._binary_move(other, clib.e2t_trees_op_division_move)
+
+    def subtract_move(self, other: 'InfixTree') -> 'InfixTree':
+        return self._binary_move(other, clib.e2t_trees_op_subtraction_move)
+
+    def multiply_move(self, other: 'InfixTree') -> 'InfixTree':
+        return self._binary_move(other, clib.e2t_trees_op_multiplication_move)
+
+    def add_move(self, other: 'InfixTree') -> 'InfixTree':
+        return self._binary_move(other, clib.e2t_trees_op_addition_move)
+
+    def power_move(self, power: 'InfixTree') -> 'InfixTree':
+        return self._binary_move(power, clib.e2t_trees_op_power_move)
+
+    def sqr_move(self) -> 'InfixTree':
+        return self._unary_move(clib.e2t_tree_op_sqr_move)
+
+    def sqrt_move(self) -> 'InfixTree':
+        return self._unary_move(clib.e2t_tree_op_sqrt_move)
+
+    def neg_move(self) -> 'InfixTree':
+        return self._unary_move(clib.e2t_tree_op_unarminus_move)
+
+    @staticmethod
+    def _sum_of_new_trees(trees: Iterable['InfixTree']) -> 'InfixTree':
+        # the terms are new trees no one else holds, so every addition just links the running sum and the next term
+        trees = iter(trees)
+        total = next(trees)
+        for tree in trees:
+            total = total.add_move(tree)
+        return total
 
     @staticmethod
     def norm(trees: Iterable):
-        return reduce(InfixTree.__add__, [tree.sqr() for tree in trees]).sqrt()
+        return InfixTree._sum_of_new_trees(tree.sqr() for tree in trees).sqrt_move()
 
     @staticmethod
     def dot(operand1, operand2):
-        return reduce(InfixTree.__add__, [tree1 * tree2 for tree1, tree2 in zip(operand1, operand2)])
+        return InfixTree._sum_of_new_trees(tree1 * tree2 for tree1, tree2 in zip(operand1, operand2))
+
+
+class ChebyshevProxy:
+    """
+    Piecewise Chebyshev approximation of an InfixTree in one variable (see InfixTree.chebyshev_proxy), evaluated by
+    the Clenshaw recurrence. Its derivative and integral (from the domain start) are proxies too, computed from the
+    coefficients without the tree.
+    """
+
+    def __init__(self, pointer: int):
+        self._pointer = pointer
+
+    def __del__(self):
+        clib.e2t_freechebproxy(self._pointer)
+
+    def __call__(self, x):
+        if np.ndim(x) == 0:
+            return clib.e2t_chebeval(self._pointer, x)
+
+        x = np.ascontiguousarray(x, dtype=np.float64)
+        values = np.empty(x.shape)
+        clib.e2t_chebeval_n(self._pointer, x.size, x.reshape(-1), values.reshape(-1))
+        return values
+
+    def derivative(self) -> 'ChebyshevProxy':
+        pointer = clib.e2t_chebderiv(self._pointer)
+        _check_memory()
+        return ChebyshevProxy(pointer)
+
+    def integral(self) -> 'ChebyshevProxy':
+        pointer = clib.e2t_chebinteg(self._pointer)
+        _check_memory()
+        return ChebyshevProxy(pointer)
@@ -11,15 +11,39 @@
 * 2. printtree(root,0)       - routine to print in infix form content of tree*
 * 3. e2t_expr_node *copytree(root) - returns a new copy of root pointed tree.*
 * 4. double evaltree(root)    - evaluate expression for a given param.       *
+*    evaltree_batch(root,n,prm,values,out) - at n values of parameter prm.   *
 * 5. e2t_expr_node *derivtree(root,prm) - returns new tree, rep. its         *
 *                               derivative according to parameter prm.       *
 *    int deriverror()           - return error number (expr2tree.h), 0 o.k.  *
 * 6. int setparamvalue(Value,Number) - set that parameter value...           *
+*    int memerror()             - TRUE if an allocation failed (below).      *
 *                                                                            *
 * In addition:                                                               *
 * 7. int cmptree(root1,root2) - compere symbolically two trees.              *
 * 8. int paramintree(root,parameter) - return TRUE if parameter in tree.     *
 * 9. freetree(root) - release memory allocated for tree root.                *
+* 10. e2t_expr_node *specialize(root,mask,values) - returns new tree with    *
+*                       the parameters in mask replaced by their values, and *
+*                       the subtrees that become constant folded to numbers. *
+* 11. double evalgrad(root,grad) - evaluate the tree and its gradient by all *
+*                       the parameters in one reverse mode sweep. Also       *
+*                       evalhessvec(root,v,grad,hv) for Hessian times v, and *
+*                       evalgrad_batch(root,n,prm,values,f,grads).           *
+* 12. e2t_cheb_proxy *chebproxy(root,prm,a,b,tol,rel) - piecewise Chebyshev  *
+*                       approximation of root over [a, b] within tol, and    *
+*                       chebeval, chebderiv, chebinteg and freechebproxy.    *
+* 13. int tree2poly(root,prm,coefs) - power basis coefficients of root if a  *
+*                       polynomial in prm, and polyeval, poly2bernstein, and *
+*                       polyhorner(root,prm) - rewrite polynomial subtrees   *
+*                       in Horner form. derivtree derives those through the  *
+*                       coefficients.                                        *
+* 14. getstats(stats) / resetstats() - runtime counters: calls of the above, *
+*                       nodes allocated and freed, optimizer work and the    *
+*                       time spent parsing, deriving and evaluating.         *
+* 15. const e2t_expr_node *cachetree(s) - the shared tree of s from a        *
+*                       bounded LRU parse cache, and cachederivtree,         *
+*                       cachepolyhorner of cached trees, releasetree and     *
+*                       setcachesize.                                        *
 *                                                                            *
 * Written by:  Gershon Elber                           ver 1.0, Jan. 1988    *
 *                                                                            *
@@ -44,6 +68,11 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 #include "expr2tree.h"
 
 #define  LINELEN   255
@@ -86,7 +115,11 @@
 int    e2t_parsing_error;                   /* Globals used by the parser */
 static int glbl_token, glbl_last_token;
 static int glbl_deriv_error;                 /* Globals used by derivations */
+static int glbl_memory_error;       /* Allocation failed, see e2t_memerror */
 static double GlobalParam[E2T_PARAM_Z1];     /* The parameters are save here */
+static e2t_stats glbl_stats;                    /* Runtime counters, timers */
+
+#define REWRITE(flag) (*(flag) = TRUE, glbl_stats.optimize_rewrites++)
 
 static e2t_expr_node *e2t_malloc(unsigned size);
 static void e2t_free(e2t_expr_node *Ptr);
@@ -102,12 +135,34 @@ static e2t_expr_node *gen1u2tree(int sign1,
 				 double exponent,
 				 e2t_expr_node *expr);
 static e2t_expr_node *optimize(e2t_expr_node *root, int *flag);
+static e2t_expr_node *copytree1(const e2t_expr_node *root);
+static double evaltree1(const e2t_expr_node *root);
+static int cmptree1(const e2t_expr_node *root1, const e2t_expr_node *root2);
+static int paramintree1(const e2t_expr_node *root, int param);
+static void freetree1(e2t_expr_node *root);
+static e2t_expr_node *specialize1(const e2t_expr_node *root,
+				  unsigned long param_mask,
+				  const double values[]);
+static int poly1(const e2t_expr_node *root, int param, double coefs[]);
+static int poly_mult(const double coefs1[], int degree1,
+		     const double coefs2[], int degree2, double coefs[]);
+static int poly_node(const e2t_expr_node *root);
+static e2t_expr_node *poly_horner_tree(const double coefs[], int degree,
+				       int param);
+static e2t_expr_node *polyhorner1(const e2t_expr_node *root, int param);
+
+static int tree_depth(const e2t_expr_node *root);
+static int tree_size(const e2t_expr_node *root);
+static e2t_expr_node *new_tree(e2t_expr_node *root);
+static double seconds(void);
 
 /*****************************************************************************
 *  Routine to return one expression node from free list or allocate new one: *
 *****************************************************************************/
 static e2t_expr_node *e2t_malloc(unsigned size)
 {
+    glbl_stats.nodes_allocated++;
+    glbl_stats.live_nodes++;
     return (e2t_expr_node *) malloc(size);
 }
 
@@ -116,9 +171,65 @@ static e2t_expr_node *e2t_malloc(unsigned size)
 *****************************************************************************/
 static void e2t_free(e2t_expr_node *Ptr)
 {
+    if (Ptr) {
+        glbl_stats.nodes_freed++;
+        glbl_stats.live_nodes--;
+    }
     free((char *) Ptr);
 }
 
+/*****************************************************************************
+*  Routine to return a monotonic clock, in seconds, for the stats timers.    *
+*****************************************************************************/
+static double seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*****************************************************************************
+*  Routine to return the depth of a tree (a single node is of depth 1):      *
+*****************************************************************************/
+static int tree_depth(const e2t_expr_node *root)
+{
+    int left, right;
+
+    if (!root) return 0;
+    left = tree_depth(root -> left);
+    right = tree_depth(root -> right);
+    return 1 + (left > right ? left : right);
+}
+
+/*****************************************************************************
+*  Routine to return the number of nodes of a tree:                          *
+*****************************************************************************/
+static int tree_size(const e2t_expr_node *root)
+{
+    if (!root) return 0;
+    return 1 + tree_size(root -> left) + tree_size(root -> right);
+}
+
+/*****************************************************************************
+*  Routine to record the depth of a tree handed to the user, returns it:     *
+*****************************************************************************/
+static e2t_expr_node *new_tree(e2t_expr_node *root)
+{
+    int depth = tree_depth(root);
+
+    if (depth > glbl_stats.max_depth) glbl_stats.max_depth = depth;
+    return root;
+}
+
 /*****************************************************************************
 *  Routine to convert lower case chars into upper one in the given string:   *
 *****************************************************************************/
@@ -155,9 +266,11 @@ e2t_expr_node *e2t_expr2tree(const char s[])
 {
     e2t_expr_node *root;
     int i;
+    double start = seconds();
     char
         *s2 = (char *) malloc(strlen(s) + 1);
 
+    glbl_stats.calls[E2T_STATS_EXPR2TREE]++;
     strcpy(s2, s);
 
     make_upper(s2);
@@ -168,11 +281,12 @@ e2t_expr_node *e2t_expr2tree(const char s[])
     root = operator_precedence(s2, &i);    
 
     free(s2);
+    glbl_stats.parse_time += seconds() - start;
  
     if (e2t_parsing_error)
         return (e2t_expr_node *) NULL;				 /* Error ! */
     else
-        return root;
+        return new_tree(root);
 }
 
 /*****************************************************************************
@@ -225,14 +339,14 @@ static e2t_expr_node *operator_precedence(const char s[], int *i)
 			    case SQR:
 			    case SQRT:
 			    case TAN:
-                                free(stack[temp1]); /* Free the open paran. */
+                                e2t_free(stack[temp1]); /* Free the open paran. */
 				stack[stack_pointer] -> node_kind -= 1000;
 				stack[temp1-1] -> node_kind += 1000;
 			        stack[temp1-1] -> right = stack[stack_pointer];
 				stack_pointer -= 2;
 				break;
 			    default:
-                                free(stack[temp1]); /* Free the open paran. */
+                                e2t_free(stack[temp1]); /* Free the open paran. */
                                 stack[temp1] = stack[stack_pointer--];
 				break;
 			}
@@ -252,7 +366,7 @@ static e2t_expr_node *operator_precedence(const char s[], int *i)
 			    return (e2t_expr_node *) NULL;
 			}
 			if (stack[0] != NULL)
-			  free(stack[0]);
+			  e2t_free(stack[0]);
 			stack[1] -> node_kind -= 1000;
 			return stack[1];
 		    }
@@ -571,6 +685,7 @@ void e2t_printtree(const e2t_expr_node *root, char *str)
 
     char LocalStr[255];
 
+    glbl_stats.calls[E2T_STATS_PRINTTREE]++;
     (void) strcpy(LocalStr, ""); /* Make the string empty */
 
     if (str == NULL) {
@@ -697,7 +812,7 @@ static void localprinttree(const e2t_expr_node *root, int level, char *str)
 /*****************************************************************************
 *  Routine to create a new copy of a given tree:                  	     *
 *****************************************************************************/
-e2t_expr_node *e2t_copytree(const e2t_expr_node *root)
+static e2t_expr_node *copytree1(const e2t_expr_node *root)
 {
     e2t_expr_node *node;
 
@@ -717,7 +832,7 @@ e2t_expr_node *e2t_copytree(const e2t_expr_node *root)
     case SQR :
     case SQRT :
     case TAN : node -> node_kind = root -> node_kind;
-               node -> right = e2t_copytree(root -> right);
+               node -> right = copytree1(root -> right);
                node -> left = NULL;
                return node;
 
@@ -732,8 +847,8 @@ e2t_expr_node *e2t_copytree(const e2t_expr_node *root)
                node -> node_kind = root -> node_kind;
                if ((root -> node_kind == PARAMETER) ||
                    (root -> node_kind == NUMBER)) node -> data = root -> data;
-               node -> right = e2t_copytree(root -> right);
-               node -> left  = e2t_copytree(root -> left );
+               node -> right = copytree1(root -> right);
+               node -> left  = copytree1(root -> left );
                return node;
     }
     return (e2t_expr_node *) NULL; /* Never get here (make lint quite...) */
@@ -742,32 +857,32 @@ e2t_expr_node *e2t_copytree(const e2t_expr_node *root)
 /*****************************************************************************
 *   Routine to evaluate a value of a given tree root and parameter.          *
 *****************************************************************************/
-double e2t_evaltree(const e2t_expr_node *root)
+static double evaltree1(const e2t_expr_node *root)
 {
     double temp;
 
     switch(root->node_kind) {
-    case ABS :    temp = e2t_evaltree(root->right);
+    case ABS :    temp = evaltree1(root->right);
                   return temp > 0 ? temp : -temp;
-    case ARCSIN : return asin(e2t_evaltree(root->right));
-    case ARCCOS : return acos(e2t_evaltree(root->right));
-    case ARCTAN : return atan(e2t_evaltree(root->right));
-    case COS :    return cos(e2t_evaltree(root->right));
-    case EXP :    return exp(e2t_evaltree(root->right));
-    case LN :     return log(e2t_evaltree(root->right));
-    case LOG :    return log10(e2t_evaltree(root->right));
-    case SIN :    return sin(e2t_evaltree(root->right));
-    case SQR :    temp = e2t_evaltree(root->right); return temp*temp;
-    case SQRT :   return sqrt(e2t_evaltree(root->right));
-    case TAN :    return tan(e2t_evaltree(root->right));
-
-    case DIV :    return e2t_evaltree(root->left) / e2t_evaltree(root->right);
-    case MINUS :  return e2t_evaltree(root->left) - e2t_evaltree(root->right);
-    case MULT :   return e2t_evaltree(root->left) * e2t_evaltree(root->right);
-    case PLUS :   return e2t_evaltree(root->left) + e2t_evaltree(root->right);
-    case POWER :  return pow(e2t_evaltree(root->left),
-			     e2t_evaltree(root->right));
-    case UNARMINUS : return -e2t_evaltree(root->right);
+    case ARCSIN : return asin(evaltree1(root->right));
+    case ARCCOS : return acos(evaltree1(root->right));
+    case ARCTAN : return atan(evaltree1(root->right));
+    case COS :    return cos(evaltree1(root->right));
+    case EXP :    return exp(evaltree1(root->right));
+    case LN :     return log(evaltree1(root->right));
+    case LOG :    return log10(evaltree1(root->right));
+    case SIN :    return sin(evaltree1(root->right));
+    case SQR :    temp = evaltree1(root->right); return temp*temp;
+    case SQRT :   return sqrt(evaltree1(root->right));
+    case TAN :    return tan(evaltree1(root->right));
+
+    case DIV :    return evaltree1(root->left) / evaltree1(root->right);
+    case MINUS :  return evaltree1(root->left) - evaltree1(root->right);
+    case MULT :   return evaltree1(root->left) * evaltree1(root->right);
+    case PLUS :   return evaltree1(root->left) + evaltree1(root->right);
+    case POWER :  return pow(evaltree1(root->left),
+			     evaltree1(root->right));
+    case UNARMINUS : return -evaltree1(root->right);
 
     case NUMBER :    return root->data;
     case PARAMETER : return GlobalParam[(int) (root->data)];
@@ -781,25 +896,35 @@ double e2t_evaltree(const e2t_expr_node *root)
 e2t_expr_node *e2t_derivtree(const e2t_expr_node *root, int param)
 {
     int i, flag = TRUE;
+    double start = seconds();
     e2t_expr_node *node, *newnode;
 
+    glbl_stats.calls[E2T_STATS_DERIVTREE]++;
+    glbl_deriv_error = 0;                           /* No errors so far ... */
     node = derivtree1(root, param);
 
-    if (!glbl_deriv_error) {
-        while (flag) {
-            flag = FALSE;
-            newnode = optimize(node, &flag);
-            e2t_freetree(node); /* Release old tree area */
-            node = newnode;
-        }
-        for (i=0; i<10; i++) { /* Do more loops - might optimize by shift */
-            flag = FALSE;
-            newnode = optimize(node, &flag);
-            e2t_freetree(node); /* Release old tree area */
-            node = newnode;
-        }
+    if (glbl_deriv_error) {
+        freetree1(node);                    /* Release the partial tree */
+        glbl_stats.deriv_time += seconds() - start;
+        return (e2t_expr_node *) NULL;
+    }
+
+    while (flag) {
+        flag = FALSE;
+        newnode = optimize(node, &flag);
+        freetree1(node); /* Release old tree area */
+        node = newnode;
+        glbl_stats.optimize_passes++;
     }
-    return newnode;
+    for (i=0; i<10; i++) { /* Do more loops - might optimize by shift */
+        flag = FALSE;
+        newnode = optimize(node, &flag);
+        freetree1(node); /* Release old tree area */
+        node = newnode;
+        glbl_stats.optimize_passes++;
+    }
+    glbl_stats.deriv_time += seconds() - start;
+    return new_tree(node);
 }
 
 /*****************************************************************************
@@ -807,31 +932,41 @@ e2t_expr_node *e2t_derivtree(const e2t_expr_node *root, int param)
 *****************************************************************************/
 static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
 {
+    int k, degree;
+    double coefs[E2T_POLY_MAX_DEGREE + 1];
     e2t_expr_node *node1, *node2, *node3, *node4, *node_mul;
 
+    /* A polynomial in prm is derived through its coefficients: */
+    if (poly_node(root) && (degree = poly1(root, prm, coefs)) >= 0) {
+        for (k = 1; k <= degree; k++) coefs[k - 1] = k * coefs[k];
+        if (degree == 0) coefs[0] = 0.0;
+        return poly_horner_tree(coefs, degree > 0 ? degree - 1 : 0, prm);
+    }
+
     node_mul = e2t_malloc(sizeof(e2t_expr_node));
     node_mul -> node_kind = MULT;
 
     switch(root->node_kind) {
     case ABS :    glbl_deriv_error = E2T_NO_ABS_DERIV_ERROR;
+                  e2t_free(node_mul);
                   return NULL; /* No derivative ! */
     case ARCSIN : node_mul->left = gen1u2tree(PLUS , MINUS, -0.5,
-					      e2t_copytree(root->right));
+					      copytree1(root->right));
                   node_mul->right = derivtree1(root->right, prm);
                   return node_mul;
     case ARCCOS : node_mul->left = gen1u2tree(MINUS, MINUS, -0.5,
-					      e2t_copytree(root->right));
+					      copytree1(root->right));
                   node_mul->right = derivtree1(root->right, prm);
                   return node_mul;
     case ARCTAN : node_mul->left = gen1u2tree(PLUS , PLUS , -1.0,
-					      e2t_copytree(root->right));
+					      copytree1(root->right));
                   node_mul->right = derivtree1(root->right, prm);
                   return node_mul;
     case COS :    node1 = e2t_malloc(sizeof(e2t_expr_node));
                   node2 = e2t_malloc(sizeof(e2t_expr_node));
                   node1 -> node_kind = UNARMINUS;
                   node2 -> node_kind = SIN;
-                  node2 -> right = e2t_copytree(root->right);
+                  node2 -> right = copytree1(root->right);
                   node1 -> left = node2 -> left = NULL;
                   node1 -> right = node2;
                   node_mul -> left = node1;
@@ -840,18 +975,18 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
     case EXP :    node1 = e2t_malloc(sizeof(e2t_expr_node));
                   node1 -> node_kind = EXP;
                   node1 -> left = NULL;
-                  node1 -> right = e2t_copytree(root->right);
+                  node1 -> right = copytree1(root->right);
                   node_mul -> left = node1;
                   node_mul -> right = derivtree1(root->right, prm);
                   return node_mul;
     case LN :     node_mul -> node_kind = DIV; /* Not nice, but work ! */
-                  node_mul -> right = e2t_copytree(root->right);
+                  node_mul -> right = copytree1(root->right);
                   node_mul -> left = derivtree1(root->right, prm);
                   return node_mul;
     case LOG :    node1 = e2t_malloc(sizeof(e2t_expr_node));   
                   node2 = e2t_malloc(sizeof(e2t_expr_node));   
                   node1 -> node_kind = DIV;
-                  node1 -> right = e2t_copytree(root->right);
+                  node1 -> right = copytree1(root->right);
                   node1 -> left = derivtree1(root->right, prm);
                   node2 -> node_kind = NUMBER;;
                   node2 -> data = log10(exp(1.0));
@@ -860,7 +995,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   return node_mul;
     case SIN :    node1 = e2t_malloc(sizeof(e2t_expr_node));
                   node1 -> node_kind = COS;
-                  node1 -> right = e2t_copytree(root->right);
+                  node1 -> right = copytree1(root->right);
                   node1 -> left = NULL;
                   node_mul -> left = node1;
                   node_mul -> right = derivtree1(root->right, prm);
@@ -872,7 +1007,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   node1 -> data = 2.0;
                   node2 -> node_kind = MULT;;
                   node2 -> right = derivtree1(root->right, prm);
-                  node2 -> left  = e2t_copytree(root->right);
+                  node2 -> left  = copytree1(root->right);
                   node_mul -> left = node1;
                   node_mul -> right = node2;
                   return node_mul;
@@ -885,7 +1020,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   node1 -> data = -0.5;
                   node2 -> node_kind = POWER;
                   node2 -> right = node1;
-                  node2 -> left  = e2t_copytree(root->right);
+                  node2 -> left  = copytree1(root->right);
                   node3 -> node_kind = NUMBER;
                   node3 -> right = node3 -> left = NULL;
                   node3 -> data = 0.5;
@@ -899,7 +1034,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   node2 = e2t_malloc(sizeof(e2t_expr_node));   
                   node1 -> node_kind = COS;
                   node1 -> left = NULL;
-                  node1 -> right = e2t_copytree(root->right);
+                  node1 -> right = copytree1(root->right);
                   node2 -> node_kind = SQR;
                   node2 -> left = NULL;
                   node2 -> right = node1;
@@ -912,16 +1047,16 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   node3 = e2t_malloc(sizeof(e2t_expr_node));   
                   node4 = e2t_malloc(sizeof(e2t_expr_node));   
                   node1 -> node_kind = MULT;
-                  node1 -> left  = e2t_copytree(root->left);
+                  node1 -> left  = copytree1(root->left);
                   node1 -> right = derivtree1(root->right, prm);
                   node2 -> node_kind = MULT;
                   node2 -> left  = derivtree1(root->left, prm);
-                  node2 -> right = e2t_copytree(root->right);
+                  node2 -> right = copytree1(root->right);
                   node3 -> node_kind = MINUS;
                   node3 -> right = node1;
                   node3 -> left = node2;
                   node4 -> node_kind = SQR;
-                  node4 -> right = e2t_copytree(root->right);
+                  node4 -> right = copytree1(root->right);
                   node4 -> left  = NULL;
                   node_mul -> node_kind = DIV; /* Not nice, but work */
                   node_mul -> left = node3;
@@ -934,11 +1069,11 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
     case MULT :   node1 = e2t_malloc(sizeof(e2t_expr_node));   
                   node2 = e2t_malloc(sizeof(e2t_expr_node));   
                   node1 -> node_kind = MULT;
-                  node1 -> left  = e2t_copytree(root->left);
+                  node1 -> left  = copytree1(root->left);
                   node1 -> right = derivtree1(root->right, prm);
                   node2 -> node_kind = MULT;
                   node2 -> left  = derivtree1(root->left, prm);
-                  node2 -> right = e2t_copytree(root->right);
+                  node2 -> right = copytree1(root->right);
                   node_mul -> node_kind = PLUS; /* Not nice, but work */
                   node_mul -> left = node1;
                   node_mul -> right = node2;
@@ -949,6 +1084,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   return node_mul;
     case POWER :  if (root -> right -> node_kind != NUMBER) {
                       glbl_deriv_error = E2T_NONE_CONST_EXP_ERROR;
+                      e2t_free(node_mul);
                       return NULL;
                   }
                   node1 = e2t_malloc(sizeof(e2t_expr_node));   
@@ -959,7 +1095,7 @@ static e2t_expr_node *derivtree1(const e2t_expr_node *root, int prm)
                   node1 -> left  = node1 -> right = NULL;
                   node1 -> data = root -> right -> data - 1;
                   node2 -> node_kind = POWER;
-                  node2 -> left  = e2t_copytree(root->left);
+                  node2 -> left  = copytree1(root->left);
                   node2 -> right = node1;
                   node3 -> node_kind = NUMBER;
                   node3 -> left  = node3 -> right = NULL;
@@ -1012,7 +1148,7 @@ static e2t_expr_node *gen1u2tree(int sign1,
     node1 -> left  = node1 -> right = NULL;
     node1 -> data = 1.0;
     node2 -> node_kind = SQR;
-    node2 -> right  = e2t_copytree(expr);
+    node2 -> right  = copytree1(expr);
     node2 -> left = NULL;
     node3 -> node_kind = sign2;
     node3 -> left = node1;
@@ -1043,11 +1179,11 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
 
     if (!root) return NULL;
     if ((root -> node_kind != NUMBER) &&
-        (!e2t_paramintree(root, E2T_PARAM_ALL))) { /* Expression is constant */
-        *flag = TRUE;
+        (!paramintree1(root, E2T_PARAM_ALL))) { /* Expression is constant */
+        REWRITE(flag);
         node = e2t_malloc(sizeof(e2t_expr_node));
         node -> node_kind = NUMBER;
-        node -> data = e2t_evaltree(root);
+        node -> data = evaltree1(root);
         node -> right = node -> left = NULL;
         return node;
     }
@@ -1072,16 +1208,16 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
     switch(root->node_kind) {
     case DIV :   if ((root -> right -> node_kind == NUMBER) &&
                      (root -> right -> data == 1.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> left, flag);  /* Div by 1 */
                  }
                  if ((root -> left  -> node_kind == NUMBER) &&
                      (root -> left  -> data == 0.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> left, flag);/* Div 0 - return 0 */
                  }
-                 if (e2t_cmptree(root -> left, root -> right)) {
-                     *flag = TRUE;
+                 if (cmptree1(root -> left, root -> right)) {
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = NUMBER;
                      node -> data = 1.0;
@@ -1091,11 +1227,11 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                  break;
     case MINUS : if ((root -> right -> node_kind == NUMBER) &&
                      (root -> right -> data == 0.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> left, flag); /* Sub 0 */
                  }
-                 if (e2t_cmptree(root -> left, root -> right)) {
-                     *flag = TRUE;
+                 if (cmptree1(root -> left, root -> right)) {
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = NUMBER;
                      node -> data = 0.0;
@@ -1103,20 +1239,20 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                      return node; /* f-f == 0.0 */
                  }
                  if (root -> right -> node_kind == UNARMINUS) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = PLUS;
                      node -> left = optimize(root -> left, flag);
                      node -> right = optimize(root -> right -> right, flag);
                      node2 = optimize(node, flag);  /* a-(-b) --> a+b */
-		     e2t_freetree(node);
+		     freetree1(node);
 		     return node2;
                  }
                  break;
     case MULT :  if ((root -> right -> node_kind == NUMBER) &&
                      ((root -> right -> data == 1.0) ||
                       (root -> right -> data == 0.0))) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      if (root -> right -> data == 1.0)
                           return optimize(root -> left , flag);  /* Mul by 1 */
                      else return optimize(root -> right, flag);  /* Mul by 0 */
@@ -1124,13 +1260,13 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                  if ((root -> left  -> node_kind == NUMBER) &&
                      ((root -> left  -> data == 1.0) ||
                       (root -> left  -> data == 0.0))) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      if (root -> left -> data == 1.0)
 		          return optimize(root -> right, flag);  /* Mul by 1 */
                      else return optimize(root -> left , flag);  /* Mul by 0 */
                  }
-                 if (e2t_cmptree(root -> left, root -> right)) {
-                     *flag = TRUE;
+                 if (cmptree1(root -> left, root -> right)) {
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = SQR;
                      node -> right = optimize(root -> right, flag);
@@ -1140,16 +1276,16 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                  break;
     case PLUS :	 if ((root -> right -> node_kind == NUMBER) &&
                      (root -> right -> data == 0.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> left, flag);  /* Add 0 */
                  }
                  if ((root -> left  -> node_kind == NUMBER) &&
                      (root -> left  -> data == 0.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> right, flag);  /* Add 0 */
                  }
-                 if (e2t_cmptree(root -> left, root -> right)) {
-                     *flag = TRUE;
+                 if (cmptree1(root -> left, root -> right)) {
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = MULT;
                      node -> left = optimize(root -> right, flag);
@@ -1160,30 +1296,30 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                      return node; /* f+f = f*2 */
                  }
                  if (root -> right -> node_kind == UNARMINUS) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = MINUS;
                      node -> left = optimize(root -> left, flag);
                      node -> right = optimize(root -> right -> right, flag);
 		     node2 = optimize(node, flag);  /* a+(-b) --> a-b */
-		     e2t_freetree(node);
+		     freetree1(node);
                      return node2;
 
                  }
                  if (root -> left  -> node_kind == UNARMINUS) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = MINUS;
                      node -> left = optimize(root -> right, flag);
                      node -> right = optimize(root -> left -> right, flag);
                      node2 = optimize(node, flag);  /* (-a)+b --> b-a */
-		     e2t_freetree(node);
+		     freetree1(node);
                      return node2;
                  }
                  break;
     case POWER : if ((root -> right -> node_kind == NUMBER) &&
                      (root -> right -> data == 0.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      node = e2t_malloc(sizeof(e2t_expr_node));
                      node -> node_kind = NUMBER;
                      node -> data = 1.0;
@@ -1192,13 +1328,13 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
                  }
                  if ((root -> right -> node_kind == NUMBER) &&
                      (root -> right -> data == 1.0)) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> left, flag);  /* f^1 = f */
                  }
                  break;
     case UNARMINUS :
                  if (root -> right -> node_kind == UNARMINUS) {
-                     *flag = TRUE;
+                     REWRITE(flag);
                      return optimize(root -> right -> right, flag); /* --a=a */
                  }
                  break;
@@ -1219,7 +1355,7 @@ static e2t_expr_node *optimize(e2t_expr_node *root, int *flag)
 *   Routine to compere two trees - for equality:                             *
 * The trees are compered to be symbolically equal i.e. A*B == B*A !          *
 *****************************************************************************/
-int e2t_cmptree(const e2t_expr_node *root1, const e2t_expr_node *root2)
+static int cmptree1(const e2t_expr_node *root1, const e2t_expr_node *root2)
 {
     if (root1->node_kind != root2->node_kind) return FALSE;
 
@@ -1236,18 +1372,18 @@ int e2t_cmptree(const e2t_expr_node *root1, const e2t_expr_node *root2)
     case SQR :
     case SQRT :
     case TAN :
-    case UNARMINUS : return e2t_cmptree(root1->right, root2->right);
+    case UNARMINUS : return cmptree1(root1->right, root2->right);
 
     case MULT :      /* Note that A*B = B*A ! */
-    case PLUS :      return ((e2t_cmptree(root1->right, root2->right) &&
-                              e2t_cmptree(root1->left , root2->left )) ||
-                             (e2t_cmptree(root1->right, root2->left ) &&
-                              e2t_cmptree(root1->left , root2->right)));
+    case PLUS :      return ((cmptree1(root1->right, root2->right) &&
+                              cmptree1(root1->left , root2->left )) ||
+                             (cmptree1(root1->right, root2->left ) &&
+                              cmptree1(root1->left , root2->right)));
 
     case DIV :
     case MINUS :
-    case POWER :     return (e2t_cmptree(root1->right, root2->right) &&
-                             e2t_cmptree(root1->left , root2->left ));
+    case POWER :     return (cmptree1(root1->right, root2->right) &&
+                             cmptree1(root1->left , root2->left ));
 
     case NUMBER :
     case PARAMETER : return (root1->data == root2->data);
@@ -1259,7 +1395,7 @@ int e2t_cmptree(const e2t_expr_node *root1, const e2t_expr_node *root2)
 *   Routine to test if the parameter is in the tree :                        *
 * If parameter == E2T_PARAM_ALL then any parameter return TRUE.              *
 *****************************************************************************/
-int e2t_paramintree(const e2t_expr_node *root, int param)
+static int paramintree1(const e2t_expr_node *root, int param)
 {
     if (!root) return FALSE;
 
@@ -1276,14 +1412,14 @@ int e2t_paramintree(const e2t_expr_node *root, int param)
     case SQR :
     case SQRT :
     case TAN :
-    case UNARMINUS : return e2t_paramintree(root->right, param);
+    case UNARMINUS : return paramintree1(root->right, param);
 
     case DIV :
     case MINUS :
     case MULT :
     case PLUS :
-    case POWER :     return e2t_paramintree(root->right, param) ||
-                            e2t_paramintree(root->left, param);
+    case POWER :     return paramintree1(root->right, param) ||
+                            paramintree1(root->left, param);
 
     case NUMBER :    return FALSE;
     case PARAMETER : if (param != E2T_PARAM_ALL)
@@ -1296,7 +1432,7 @@ int e2t_paramintree(const e2t_expr_node *root, int param)
 /*****************************************************************************
 *   Routine to free a tree - release all memory allocated by it.             *
 *****************************************************************************/
-void e2t_freetree(e2t_expr_node *root)
+static void freetree1(e2t_expr_node *root)
 {
     if (!root) return;
     switch(root->node_kind) {
@@ -1312,7 +1448,7 @@ void e2t_freetree(e2t_expr_node *root)
     case SQR :
     case SQRT :
     case TAN :
-    case UNARMINUS : e2t_freetree(root->right);
+    case UNARMINUS : freetree1(root->right);
                      e2t_free(root);
                      break;
 
@@ -1320,8 +1456,8 @@ void e2t_freetree(e2t_expr_node *root)
     case MINUS :
     case MULT :
     case PLUS :
-    case POWER :     e2t_freetree(root->right);
-                     e2t_freetree(root->left);
+    case POWER :     freetree1(root->right);
+                     freetree1(root->left);
                      e2t_free(root);
                      break;
 
@@ -1355,14 +1491,1340 @@ int e2t_deriverror(void)
     return temp;
 }
 
+/*****************************************************************************
+*   Routine to return TRUE if an allocation failed since the last call, in   *
+* evalgrad (which then returns NaN), chebproxy or specialize (NULL), FALSE   *
+* elsewhere.                                                                 *
+*****************************************************************************/
+int e2t_memerror(void)
+{
+    int temp;
+
+    temp = glbl_memory_error;
+    glbl_memory_error = FALSE;
+    return temp;
+}
+
 /*****************************************************************************
 *  Routine to set the value of a parameter before evaluating it.             *
 *****************************************************************************/
 void e2t_setparamvalue(double Value, int Number)
 {
+    glbl_stats.calls[E2T_STATS_SETPARAMVALUE]++;
     if ((Number >= 0) && (Number <= E2T_PARAM_Z)) GlobalParam[Number] = Value;
 }
 
+/*****************************************************************************
+*   Routine to specialize a tree on known parameter values: returns a new    *
+* tree where every parameter i with bit (1 << i) set in param_mask is the    *
+* number values[i], and every subtree that becomes constant is folded to one *
+* number. Built in one bottom up pass - linear in the tree size - and the    *
+* folded numbers are computed by the very operations evaltree would apply,   *
+* so evaluating the result gives the same values, bit for bit. Returns NULL  *
+* if out of memory (see e2t_memerror).                                       *
+*****************************************************************************/
+e2t_expr_node *e2t_specialize(const e2t_expr_node *root,
+			      unsigned long param_mask,
+			      const double values[])
+{
+    glbl_stats.calls[E2T_STATS_SPECIALIZE]++;
+    return new_tree(specialize1(root, param_mask, values));
+}
+
+static e2t_expr_node *specialize1(const e2t_expr_node *root,
+				  unsigned long param_mask,
+				  const double values[])
+{
+    e2t_expr_node *node;
+
+    if (!root) return (e2t_expr_node *) NULL;
+
+    if ((node = e2t_malloc(sizeof(e2t_expr_node))) == NULL) {
+        glbl_memory_error = TRUE;
+        return (e2t_expr_node *) NULL;
+    }
+    node -> node_kind = root -> node_kind;
+    node -> data = root -> data;
+    node -> left = specialize1(root -> left, param_mask, values);
+    node -> right = specialize1(root -> right, param_mask, values);
+    if ((root -> left && !node -> left) ||
+        (root -> right && !node -> right)) {       /* Out of memory below */
+        freetree1(node -> left);
+        freetree1(node -> right);
+        e2t_free(node);
+        return (e2t_expr_node *) NULL;
+    }
+
+    switch(root->node_kind) {
+    case NUMBER :    return node;
+    case PARAMETER : if (param_mask & (1UL << (int) (root -> data))) {
+                         node -> node_kind = NUMBER;
+                         node -> data = values[(int) (root -> data)];
+                     }
+                     return node;
+    }
+
+    /* An operator or function - fold it if its operands are numbers now: */
+    if ((node -> left == NULL || node -> left -> node_kind == NUMBER) &&
+        (node -> right == NULL || node -> right -> node_kind == NUMBER)) {
+        node -> data = evaltree1(node);
+        freetree1(node -> left);
+        freetree1(node -> right);
+        node -> left = node -> right = NULL;
+        node -> node_kind = NUMBER;
+    }
+    return node;
+}
+
+/*****************************************************************************
+*   Reverse mode differentiation: a forward sweep records every node of the  *
+* tree on a tape (post order, so children precede their parent) with its     *
+* value and the partial derivatives of it by its operands. A backward sweep  *
+* over the tape then accumulates the adjoints, giving the derivatives by all *
+* the parameters at once, for about the price of two evaluations.            *
+*   If a direction v is given, every value also carries its derivative in    *
+* direction v (forward mode), and so do the partials and the adjoints - the  *
+* derivatives of the gradient in direction v are then the Hessian times v.   *
+*****************************************************************************/
+typedef struct grad_tape_node {
+     int left, right;                 /* Tape index of operands, or -1 */
+     int param;                          /* PARAMETER number, or -1 */
+     double value, dot;                  /* dot - derivative in v direction */
+     double d_left, d_right;              /* Partials by the operands */
+     double dd_left, dd_right;             /* and their derivative in v */
+     double adj, adj_dot;
+} grad_tape_node;
+
+static grad_tape_node *glbl_tape = NULL;    /* Grows to the largest tree */
+static int glbl_tape_size = 0;
+
+static int grad_tape1(const e2t_expr_node *root, const double v[], int *n);
+static double evalgrad(const e2t_expr_node *root, const double v[],
+		       double grad[], double hv[]);
+
+/*****************************************************************************
+*   Routine to evaluate tree root and its gradient by all the parameters:    *
+* grad gets E2T_PARAM_Z1 derivatives, zero for parameters not in the tree.   *
+* ABS is derived as the sign of its operand, although derivtree refuses it.  *
+*****************************************************************************/
+double e2t_evalgrad(const e2t_expr_node *root, double grad[])
+{
+    glbl_stats.calls[E2T_STATS_EVALGRAD]++;
+    return evalgrad(root, NULL, grad, NULL);
+}
+
+/*****************************************************************************
+*   As e2t_evalgrad, and hv gets the Hessian of tree root times the vector v *
+* (E2T_PARAM_Z1 each), by forward over reverse mode - E2T_PARAM_Z1 of those  *
+* with unit vectors v make the full Hessian.                                 *
+*****************************************************************************/
+double e2t_evalhessvec(const e2t_expr_node *root, const double v[],
+		       double grad[], double hv[])
+{
+    glbl_stats.calls[E2T_STATS_EVALGRAD]++;
+    return evalgrad(root, v, grad, hv);
+}
+
+/*****************************************************************************
+*   Routine to evaluate tree root and its gradient at n values of parameter  *
+* param: f[i] and grads[i * E2T_PARAM_Z1 ...] get the value and gradient for *
+* param = values[i]. The tape is reused, and the parameter value restored.   *
+* Counted as one call.                                                       *
+*****************************************************************************/
+void e2t_evalgrad_batch(const e2t_expr_node *root, int n, int param,
+			const double values[], double f[], double grads[])
+{
+    int i;
+    double param_value;
+
+    glbl_stats.calls[E2T_STATS_EVALGRAD]++;
+    if ((param < 0) || (param > E2T_PARAM_Z)) return;
+
+    param_value = GlobalParam[param];
+    for (i = 0; i < n; i++) {
+        GlobalParam[param] = values[i];
+        f[i] = evalgrad(root, NULL, &grads[(size_t) i * E2T_PARAM_Z1], NULL);
+    }
+    GlobalParam[param] = param_value;
+}
+
+static double evalgrad(const e2t_expr_node *root, const double v[],
+		       double grad[], double hv[])
+{
+    int i, n = 0;
+    double start = seconds();
+    grad_tape_node *node;
+
+    i = tree_size(root);
+    if (i > glbl_tape_size) {
+        free(glbl_tape);
+        glbl_tape = (grad_tape_node *) malloc(sizeof(grad_tape_node) * i);
+        if (glbl_tape == NULL) {
+            glbl_tape_size = 0;
+            glbl_memory_error = TRUE;
+            for (i = 0; i < E2T_PARAM_Z1; i++) {
+                grad[i] = NAN;
+                if (hv != NULL) hv[i] = NAN;
+            }
+            return NAN;
+        }
+        glbl_tape_size = i;
+    }
+
+    grad_tape1(root, v, &n);                               /* Forward sweep */
+
+    for (i = 0; i < E2T_PARAM_Z1; i++) {
+        grad[i] = 0.0;
+        if (hv != NULL) hv[i] = 0.0;
+    }
+    for (i = 0; i < n; i++) glbl_tape[i].adj = glbl_tape[i].adj_dot = 0.0;
+    glbl_tape[n - 1].adj = 1.0;
+
+    for (i = n - 1; i >= 0; i--) {                        /* Backward sweep */
+        node = &glbl_tape[i];
+        if (node -> param >= 0) {
+            grad[node -> param] += node -> adj;
+            if (hv != NULL) hv[node -> param] += node -> adj_dot;
+            continue;
+        }
+        if (node -> left >= 0) {
+            glbl_tape[node -> left].adj += node -> adj * node -> d_left;
+            glbl_tape[node -> left].adj_dot += node -> adj_dot *
+                node -> d_left + node -> adj * node -> dd_left;
+        }
+        if (node -> right >= 0) {
+            glbl_tape[node -> right].adj += node -> adj * node -> d_right;
+            glbl_tape[node -> right].adj_dot += node -> adj_dot *
+                node -> d_right + node -> adj * node -> dd_right;
+        }
+    }
+
+    glbl_stats.eval_time += seconds() - start;
+    return glbl_tape[n - 1].value;
+}
+
+/*****************************************************************************
+*   Routine to record tree root on the tape from index *n on, children       *
+* first. Returns the tape index of root. If v is NULL no derivatives in a    *
+* direction are computed (the dot fields are left zero).                     *
+*****************************************************************************/
+static int grad_tape1(const e2t_expr_node *root, const double v[], int *n)
+{
+    int left, right;
+    double a = 0.0, b = 0.0, a_dot = 0.0, b_dot = 0.0, value, temp, temp2;
+    grad_tape_node *node;
+
+    left = root -> left != NULL ? grad_tape1(root -> left, v, n) : -1;
+    if (left >= 0) {
+        a = glbl_tape[left].value;
+        a_dot = glbl_tape[left].dot;
+    }
+    right = root -> right != NULL ? grad_tape1(root -> right, v, n) : -1;
+    if (right >= 0) {
+        b = glbl_tape[right].value;
+        b_dot = glbl_tape[right].dot;
+    }
+
+    node = &glbl_tape[*n];
+    node -> left = left;
+    node -> right = right;
+    node -> param = -1;
+    node -> d_left = node -> d_right = 0.0;
+    node -> dd_left = node -> dd_right = 0.0;
+    node -> dot = 0.0;
+
+    /* value, and the partial by the (only, right) operand of a function and */
+    /* its derivative in direction v - the second derivative times b_dot:    */
+    switch(root->node_kind) {
+    case ABS :    value = b > 0 ? b : -b;
+                  node -> d_right = b > 0 ? 1.0 : b < 0 ? -1.0 : 0.0;
+                  break;
+    case ARCSIN : value = asin(b);
+                  temp = 1.0 / (1.0 - b * b);
+                  node -> d_right = sqrt(temp);
+                  node -> dd_right = b * temp * node -> d_right * b_dot;
+                  break;
+    case ARCCOS : value = acos(b);
+                  temp = 1.0 / (1.0 - b * b);
+                  node -> d_right = -sqrt(temp);
+                  node -> dd_right = b * temp * node -> d_right * b_dot;
+                  break;
+    case ARCTAN : value = atan(b);
+                  temp = 1.0 / (1.0 + b * b);
+                  node -> d_right = temp;
+                  node -> dd_right = -2.0 * b * temp * temp * b_dot;
+                  break;
+    case COS :    value = cos(b);
+                  node -> d_right = -sin(b);
+                  node -> dd_right = -value * b_dot;
+                  break;
+    case EXP :    value = exp(b);
+                  node -> d_right = value;
+                  node -> dd_right = value * b_dot;
+                  break;
+    case LN :     value = log(b);
+                  node -> d_right = 1.0 / b;
+                  node -> dd_right = -b_dot / (b * b);
+                  break;
+    case LOG :    value = log10(b);
+                  node -> d_right = 1.0 / (b * log(10.0));
+                  node -> dd_right = -node -> d_right * b_dot / b;
+                  break;
+    case SIN :    value = sin(b);
+                  node -> d_right = cos(b);
+                  node -> dd_right = -value * b_dot;
+                  break;
+    case SQR :    value = b * b;
+                  node -> d_right = 2.0 * b;
+                  node -> dd_right = 2.0 * b_dot;
+                  break;
+    case SQRT :   value = sqrt(b);
+                  node -> d_right = 0.5 / value;
+                  node -> dd_right = -0.5 * node -> d_right * b_dot / b;
+                  break;
+    case TAN :    value = tan(b);
+                  node -> d_right = 1.0 + value * value;
+                  node -> dd_right = 2.0 * value * node -> d_right * b_dot;
+                  break;
+
+    case DIV :    value = a / b;
+                  node -> d_left = 1.0 / b;
+                  node -> d_right = -value / b;
+                  node -> dd_left = -b_dot / (b * b);
+                  node -> dd_right = (2.0 * value * b_dot - a_dot) / (b * b);
+                  break;
+    case MINUS :  value = a - b;
+                  node -> d_left = 1.0;
+                  node -> d_right = -1.0;
+                  break;
+    case MULT :   value = a * b;
+                  node -> d_left = b;
+                  node -> d_right = a;
+                  node -> dd_left = b_dot;
+                  node -> dd_right = a_dot;
+                  break;
+    case PLUS :   value = a + b;
+                  node -> d_left = node -> d_right = 1.0;
+                  break;
+    case POWER :  value = pow(a, b);
+                  /* d/da = b a^(b-1), and d/db = a^b ln(a) - taken as zero */
+                  /* for a <= 0, where only constant exponents are defined. */
+                  temp = pow(a, b - 1.0);
+                  temp2 = a > 0.0 ? log(a) : 0.0;
+                  node -> d_left = b != 0.0 ? b * temp : 0.0;
+                  node -> d_right = value * temp2;
+                  if (v != NULL) {
+                      if (b_dot != 0.0)
+                          node -> dd_left = b_dot * temp * (1.0 + b * temp2);
+                      if (b != 0.0 && b != 1.0)
+                          node -> dd_left += b * (b - 1.0) *
+                                             pow(a, b - 2.0) * a_dot;
+                      node -> dd_right = (node -> d_left * a_dot +
+                                          node -> d_right * b_dot) * temp2;
+                      if (a > 0.0) node -> dd_right += value * a_dot / a;
+                  }
+                  break;
+    case UNARMINUS : value = -b;
+                  node -> d_right = -1.0;
+                  break;
+
+    case NUMBER : value = root -> data;
+                  break;
+    case PARAMETER : node -> param = (int) (root -> data);
+                  value = GlobalParam[node -> param];
+                  if (v != NULL) node -> dot = v[node -> param];
+                  break;
+    default :     value = 0.0;           /* Never get here (make lint quite) */
+                  break;
+    }
+
+    node -> value = value;
+    if (v != NULL && node -> param < 0)
+        node -> dot = node -> d_left * a_dot + node -> d_right * b_dot;
+    return (*n)++;
+}
+
+/*****************************************************************************
+*   Chebyshev proxies: a tree, as a function of one parameter over a domain, *
+* is sampled at Chebyshev points and replaced by a piecewise Chebyshev       *
+* expansion, evaluated by the Clenshaw recurrence at a cost independent of   *
+* the tree. A piece starts at degree CHEB_MIN_DEGREE, doubles its degree     *
+* (reusing the samples) until its trailing coefficients are below the error  *
+* bound, and is bisected when CHEB_MAX_DEGREE is not enough. Pieces whose    *
+* samples are partly undefined (singularities) are bisected as well, down to *
+* CHEB_MAX_DEPTH halvings, and are then kept as they are.                    *
+*****************************************************************************/
+#define CHEB_MIN_DEGREE 16
+#define CHEB_MAX_DEGREE 128
+#define CHEB_MAX_DEPTH  30
+#define CHEB_PI         3.14159265358979323846
+
+static int cheb_build(e2t_cheb_proxy *proxy, const e2t_expr_node *root,
+		      double lo, double hi, double tol, int relative,
+		      int depth, int *pieces_size, int *coefs_size);
+static void cheb_coefs(const double values[], int degree, double coefs[]);
+static int cheb_add_piece(e2t_cheb_proxy *proxy, double hi,
+			  const double coefs[], int n_coefs,
+			  int *pieces_size, int *coefs_size);
+static double cheb_clenshaw(const double coefs[], int n_coefs, double s);
+static e2t_cheb_proxy *cheb_new(int param, int n_pieces, int n_coefs);
+static e2t_cheb_proxy *cheb_alloc(const e2t_cheb_proxy *shape, int extra);
+static void *cheb_realloc(void *ptr, size_t size);
+
+/*****************************************************************************
+*   Routine to build the Chebyshev proxy of tree root as a function of       *
+* parameter param over [a, b], within absolute error tol (estimated from     *
+* the coefficients) - if relative, relative to the largest sample of a piece *
+* where it is above 1. The other parameters keep their current values, and   *
+* param its value too. Returns NULL if the domain is empty, param is invalid *
+* or out of memory (see e2t_memerror).                                       *
+*****************************************************************************/
+e2t_cheb_proxy *e2t_chebproxy(const e2t_expr_node *root, int param,
+			      double a, double b, double tol, int relative)
+{
+    int built,
+	pieces_size = 16,
+	coefs_size = 16 * (CHEB_MAX_DEGREE + 1);
+    double param_value, start = seconds();
+    e2t_cheb_proxy *proxy;
+
+    glbl_stats.calls[E2T_STATS_CHEBPROXY]++;
+    if ((param < 0) || (param > E2T_PARAM_Z) || !(a < b))
+        return (e2t_cheb_proxy *) NULL;
+
+    if ((proxy = cheb_new(param, pieces_size, coefs_size)) == NULL)
+        return (e2t_cheb_proxy *) NULL;
+    proxy -> n_pieces = 0;
+    proxy -> breaks[0] = a;
+    proxy -> offsets[0] = 0;
+
+    param_value = GlobalParam[param];
+    built = cheb_build(proxy, root, a, b, tol, relative, 0, &pieces_size,
+		       &coefs_size);
+    GlobalParam[param] = param_value;
+
+    glbl_stats.eval_time += seconds() - start;
+    if (!built) {
+        e2t_freechebproxy(proxy);
+        return (e2t_cheb_proxy *) NULL;
+    }
+    return proxy;
+}
+
+/*****************************************************************************
+*   Routine to build the pieces of [lo, hi], appending them to proxy.        *
+* Returns FALSE if out of memory.                                            *
+*****************************************************************************/
+static int cheb_build(e2t_cheb_proxy *proxy, const e2t_expr_node *root,
+		      double lo, double hi, double tol, int relative,
+		      int depth, int *pieces_size, int *coefs_size)
+{
+    int j, degree, n_coefs, n_defined = 0;
+    double values[CHEB_MAX_DEGREE + 1], coefs[CHEB_MAX_DEGREE + 1], tail,
+	bound,
+	mid = 0.5 * (lo + hi),
+	half = 0.5 * (hi - lo);
+
+    for (degree = CHEB_MIN_DEGREE; ; degree *= 2) {
+        /* Samples at the Chebyshev extrema cos(pi j / degree) - the even  */
+        /* ones are the samples of the previous degree.                    */
+        for (j = degree; j >= 0; j--) {
+            if (degree > CHEB_MIN_DEGREE && j % 2 == 0)
+                values[j] = values[j / 2];
+            else {
+                GlobalParam[proxy -> param] =
+                    mid + half * cos(CHEB_PI * j / degree);
+                values[j] = evaltree1(root);
+            }
+        }
+        for (j = 0, n_defined = 0, bound = 1.0; j <= degree; j++)
+            if (isfinite(values[j])) {
+                n_defined++;
+                if (relative) bound = fmax(bound, fabs(values[j]));
+            }
+        if (n_defined <= degree) break;              /* Partly undefined */
+        bound *= tol;
+
+        /* The error is estimated by the last quarter of the coefficients - */
+        /* a few of them only may be small by chance (a kink, symmetry) -   */
+        /* with a margin for the slow decay past a kink.                    */
+        cheb_coefs(values, degree, coefs);
+        for (j = degree - degree / 4, tail = 0.0; j <= degree; j++)
+            tail += fabs(coefs[j]);
+        if (tail <= 0.125 * bound) {
+            /* Converged - chop the coefficients the error bound allows: */
+            for (n_coefs = degree + 1, tail = 0.0; n_coefs > 1; n_coefs--) {
+                tail += fabs(coefs[n_coefs - 1]);
+                if (tail > 0.25 * bound) break;
+            }
+            return cheb_add_piece(proxy, hi, coefs, n_coefs, pieces_size,
+                                  coefs_size);
+        }
+        if (degree == CHEB_MAX_DEGREE) break;
+    }
+
+    if (depth < CHEB_MAX_DEPTH && n_defined > 0) {
+        return cheb_build(proxy, root, lo, mid, tol, relative, depth + 1,
+                          pieces_size, coefs_size) &&
+               cheb_build(proxy, root, mid, hi, tol, relative, depth + 1,
+                          pieces_size, coefs_size);
+    }
+
+    /* Not resolved: keep the best we have (NaN if no sample is defined). */
+    if (n_defined <= degree)
+        for (j = 0; j <= degree; j++) coefs[j] = NAN;
+    else
+        cheb_coefs(values, degree, coefs);
+    return cheb_add_piece(proxy, hi, coefs,
+                          n_defined <= degree ? 1 : degree + 1,
+                          pieces_size, coefs_size);
+}
+
+/*****************************************************************************
+*   Routine to compute the degree + 1 Chebyshev coefficients interpolating   *
+* values at the extrema cos(pi j / degree), j = 0..degree (a DCT-I).         *
+*****************************************************************************/
+static void cheb_coefs(const double values[], int degree, double coefs[])
+{
+    int j, k;
+    double sum;
+
+    for (k = 0; k <= degree; k++) {
+        sum = 0.5 * (values[0] + (k % 2 ? -values[degree] : values[degree]));
+        for (j = 1; j < degree; j++)
+            sum += values[j] *
+                   cos(CHEB_PI * ((j * k) % (2 * degree)) / degree);
+        coefs[k] = sum * 2.0 / degree;
+    }
+    coefs[0] *= 0.5;
+    coefs[degree] *= 0.5;
+}
+
+/*****************************************************************************
+*   Routine to append a piece ending at hi, with n_coefs coefficients.       *
+* Returns FALSE if out of memory (proxy is kept as it was, still valid).     *
+*****************************************************************************/
+static int cheb_add_piece(e2t_cheb_proxy *proxy, double hi,
+			  const double coefs[], int n_coefs,
+			  int *pieces_size, int *coefs_size)
+{
+    int *offsets,
+	n = proxy -> n_pieces,
+	offset = proxy -> offsets[n];
+    double *breaks, *new_coefs;
+
+    if (n == *pieces_size) {
+        if ((breaks = (double *) cheb_realloc(proxy -> breaks,
+			      sizeof(double) * (2 * *pieces_size + 1))) == NULL)
+            return FALSE;
+        proxy -> breaks = breaks;
+        if ((offsets = (int *) cheb_realloc(proxy -> offsets,
+			      sizeof(int) * (2 * *pieces_size + 1))) == NULL)
+            return FALSE;
+        proxy -> offsets = offsets;
+        *pieces_size *= 2;
+    }
+    if (offset + n_coefs > *coefs_size) {
+        if ((new_coefs = (double *) cheb_realloc(proxy -> coefs,
+			      sizeof(double) * 2 * (offset + n_coefs))) == NULL)
+            return FALSE;
+        proxy -> coefs = new_coefs;
+        *coefs_size = 2 * (offset + n_coefs);
+    }
+
+    memcpy(&proxy -> coefs[offset], coefs, sizeof(double) * n_coefs);
+    proxy -> breaks[n + 1] = hi;
+    proxy -> offsets[n + 1] = offset + n_coefs;
+    proxy -> n_pieces++;
+    return TRUE;
+}
+
+/*****************************************************************************
+*   Routine to evaluate the proxy at x. Outside of the domain the end pieces *
+* are extrapolated.                                                          *
+*****************************************************************************/
+double e2t_chebeval(const e2t_cheb_proxy *proxy, double x)
+{
+    int lo = 0,
+	hi = proxy -> n_pieces - 1,
+	mid;
+    double a, b;
+
+    while (lo < hi) {                       /* Last piece starting <= x */
+        mid = (lo + hi + 1) / 2;
+        if (proxy -> breaks[mid] <= x) lo = mid; else hi = mid - 1;
+    }
+    a = proxy -> breaks[lo];
+    b = proxy -> breaks[lo + 1];
+    return cheb_clenshaw(&proxy -> coefs[proxy -> offsets[lo]],
+			 proxy -> offsets[lo + 1] - proxy -> offsets[lo],
+			 (2.0 * x - a - b) / (b - a));
+}
+
+/*****************************************************************************
+*   Routine to evaluate the proxy at n points x into values.                 *
+*****************************************************************************/
+void e2t_chebeval_n(const e2t_cheb_proxy *proxy, int n, const double x[],
+		    double values[])
+{
+    int i;
+
+    for (i = 0; i < n; i++) values[i] = e2t_chebeval(proxy, x[i]);
+}
+
+/*****************************************************************************
+*   Routine to evaluate sum c[k] T_k(s), s in [-1, 1], by Clenshaw.          *
+*****************************************************************************/
+static double cheb_clenshaw(const double coefs[], int n_coefs, double s)
+{
+    int k;
+    double b0 = 0.0, b1 = 0.0, b2;
+
+    for (k = n_coefs - 1; k >= 1; k--) {
+        b2 = b1;
+        b1 = b0;
+        b0 = 2.0 * s * b1 - b2 + coefs[k];
+    }
+    return s * b0 - b1 + coefs[0];
+}
+
+/*****************************************************************************
+*   Routine to return the proxy of the derivative of proxy, by the           *
+* coefficients recurrence c'[k-1] = c'[k+1] + 2 k c[k] of every piece. NULL  *
+* if out of memory.                                                          *
+*****************************************************************************/
+e2t_cheb_proxy *e2t_chebderiv(const e2t_cheb_proxy *proxy)
+{
+    int i, k, n;
+    const double *c;
+    double *d, scale;
+    e2t_cheb_proxy *deriv = cheb_alloc(proxy, 0);
+
+    if (deriv == NULL) return (e2t_cheb_proxy *) NULL;
+    for (i = 0; i < proxy -> n_pieces; i++) {
+        c = &proxy -> coefs[proxy -> offsets[i]];
+        d = &deriv -> coefs[deriv -> offsets[i]];
+        n = proxy -> offsets[i + 1] - proxy -> offsets[i];
+        scale = 2.0 / (proxy -> breaks[i + 1] - proxy -> breaks[i]);
+
+        d[n - 1] = 0.0;
+        if (n > 1) d[n - 2] = 2.0 * (n - 1) * c[n - 1];
+        for (k = n - 2; k >= 1; k--)
+            d[k - 1] = d[k + 1] + 2.0 * k * c[k];
+        if (n > 1) d[0] *= 0.5;
+        for (k = 0; k < n; k++) d[k] *= scale;
+    }
+    return deriv;
+}
+
+/*****************************************************************************
+*   Routine to return the proxy of the integral of proxy from the domain     *
+* start, by C[k] = (c[k-1] - c[k+1]) / 2k of every piece, one degree higher. *
+* The pieces are chained so the integral is continuous. NULL if out of       *
+* memory.                                                                    *
+*****************************************************************************/
+e2t_cheb_proxy *e2t_chebinteg(const e2t_cheb_proxy *proxy)
+{
+    int i, k, n;
+    const double *c;
+    double *d, half, sum,
+	value = 0.0;                        /* The integral at piece start */
+    e2t_cheb_proxy *integ = cheb_alloc(proxy, 1);
+
+    if (integ == NULL) return (e2t_cheb_proxy *) NULL;
+    for (i = 0; i < proxy -> n_pieces; i++) {
+        c = &proxy -> coefs[proxy -> offsets[i]];
+        d = &integ -> coefs[integ -> offsets[i]];
+        n = proxy -> offsets[i + 1] - proxy -> offsets[i];
+        half = 0.5 * (proxy -> breaks[i + 1] - proxy -> breaks[i]);
+
+        for (k = 1; k <= n; k++)
+            d[k] = half * ((k == 1 ? 2.0 * c[0] : c[k - 1]) -
+                           (k + 1 < n ? c[k + 1] : 0.0)) / (2.0 * k);
+        for (k = 1, sum = 0.0; k <= n; k++)       /* Value at s = -1 is */
+            sum += k % 2 ? -d[k] : d[k];                 /* d[0] + sum */
+        d[0] = value - sum;
+        value = cheb_clenshaw(d, n + 1, 1.0);
+    }
+    return integ;
+}
+
+/*****************************************************************************
+*   Routine to release a proxy.                                              *
+*****************************************************************************/
+void e2t_freechebproxy(e2t_cheb_proxy *proxy)
+{
+    if (!proxy) return;
+    free(proxy -> breaks);
+    free(proxy -> offsets);
+    free(proxy -> coefs);
+    free(proxy);
+}
+
+/*****************************************************************************
+*   Routine to allocate a proxy of param with room for n_pieces pieces and   *
+* n_coefs coefficients. Returns NULL if out of memory.                       *
+*****************************************************************************/
+static e2t_cheb_proxy *cheb_new(int param, int n_pieces, int n_coefs)
+{
+    e2t_cheb_proxy *proxy =
+	(e2t_cheb_proxy *) cheb_realloc(NULL, sizeof(e2t_cheb_proxy));
+
+    if (proxy == NULL) return (e2t_cheb_proxy *) NULL;
+    proxy -> param = param;
+    proxy -> n_pieces = n_pieces;
+    proxy -> breaks = (double *) cheb_realloc(NULL,
+					      sizeof(double) * (n_pieces + 1));
+    proxy -> offsets = (int *) cheb_realloc(NULL,
+					    sizeof(int) * (n_pieces + 1));
+    proxy -> coefs = (double *) cheb_realloc(NULL, sizeof(double) * n_coefs);
+    if (proxy -> breaks == NULL || proxy -> offsets == NULL ||
+        proxy -> coefs == NULL) {
+        e2t_freechebproxy(proxy);
+        return (e2t_cheb_proxy *) NULL;
+    }
+    return proxy;
+}
+
+/*****************************************************************************
+*   Routine to allocate a proxy with the pieces of shape, with extra more    *
+* coefficients per piece (the integral is a degree higher). Returns NULL if  *
+* out of memory.                                                             *
+*****************************************************************************/
+static e2t_cheb_proxy *cheb_alloc(const e2t_cheb_proxy *shape, int extra)
+{
+    int i,
+	n = shape -> n_pieces;
+    e2t_cheb_proxy *proxy = cheb_new(shape -> param, n,
+				     shape -> offsets[n] + extra * n);
+
+    if (proxy == NULL) return (e2t_cheb_proxy *) NULL;
+    memcpy(proxy -> breaks, shape -> breaks, sizeof(double) * (n + 1));
+    for (i = 0; i <= n; i++)
+        proxy -> offsets[i] = shape -> offsets[i] + extra * i;
+    return proxy;
+}
+
+/*****************************************************************************
+*   Routine to (re)allocate size bytes as realloc does, flagging the error   *
+* for e2t_memerror on failure (ptr is then kept).                            *
+*****************************************************************************/
+static void *cheb_realloc(void *ptr, size_t size)
+{
+    void *new_ptr = realloc(ptr, size);
+
+    if (new_ptr == NULL) glbl_memory_error = TRUE;
+    return new_ptr;
+}
+
+/*****************************************************************************
+*   Polynomials: a (sub)tree built only of numbers, the parameter param,     *
+* PLUS, MINUS, MULT, UNARMINUS, SQR, POWER by a non negative integer number  *
+* and DIV by a constant, is expanded to its dense power basis coefficients.  *
+* Such subtrees are then evaluated by Horner's scheme (no pow() calls), and  *
+* derived through their coefficients rather than symbolically.               *
+*****************************************************************************/
+/*****************************************************************************
+*   Routine to expand tree root, if a polynomial in parameter param, into    *
+* coefs (room for E2T_POLY_MAX_DEGREE + 1, coefs[k] of param^k). Returns the *
+* degree, or -1 if root is not a polynomial (or of a higher degree).         *
+*****************************************************************************/
+int e2t_tree2poly(const e2t_expr_node *root, int param, double coefs[])
+{
+    glbl_stats.calls[E2T_STATS_POLYNOMIAL]++;
+    return poly1(root, param, coefs);
+}
+
+static int poly1(const e2t_expr_node *root, int param, double coefs[])
+{
+    int i, n, degree, degree2;
+    double coefs2[E2T_POLY_MAX_DEGREE + 1], power[E2T_POLY_MAX_DEGREE + 1];
+
+    switch(root->node_kind) {
+    case NUMBER :    coefs[0] = root -> data;
+                     return 0;
+    case PARAMETER : if ((int) (root -> data) != param) return -1;
+                     coefs[0] = 0.0;
+                     coefs[1] = 1.0;
+                     return 1;
+    case UNARMINUS : if ((degree = poly1(root -> right, param, coefs)) < 0)
+                         return -1;
+                     for (i = 0; i <= degree; i++) coefs[i] = -coefs[i];
+                     return degree;
+    case PLUS :
+    case MINUS :     if ((degree = poly1(root -> left, param, coefs)) < 0 ||
+                         (degree2 = poly1(root -> right, param, coefs2)) < 0)
+                         return -1;
+                     for (i = degree + 1; i <= degree2; i++) coefs[i] = 0.0;
+                     for (i = 0; i <= degree2; i++)
+                         coefs[i] += root -> node_kind == PLUS ? coefs2[i] :
+                                                                 -coefs2[i];
+                     return degree > degree2 ? degree : degree2;
+    case MULT :      if ((degree = poly1(root -> left, param, power)) < 0 ||
+                         (degree2 = poly1(root -> right, param, coefs2)) < 0)
+                         return -1;
+                     return poly_mult(power, degree, coefs2, degree2, coefs);
+    case SQR :       if ((degree = poly1(root -> right, param, coefs2)) < 0)
+                         return -1;
+                     return poly_mult(coefs2, degree, coefs2, degree, coefs);
+    case DIV :       if ((degree = poly1(root -> left, param, coefs)) < 0 ||
+                         poly1(root -> right, param, coefs2) != 0 ||
+                         coefs2[0] == 0.0)
+                         return -1;
+                     for (i = 0; i <= degree; i++) coefs[i] /= coefs2[0];
+                     return degree;
+    case POWER :     if (root -> right -> node_kind != NUMBER ||
+                         root -> right -> data < 0 ||
+                         root -> right -> data > E2T_POLY_MAX_DEGREE ||
+                         root -> right -> data !=
+                             (int) root -> right -> data ||
+                         (degree = poly1(root -> left, param, coefs2)) < 0)
+                         return -1;
+                     /* By repeated squaring, n <= E2T_POLY_MAX_DEGREE: */
+                     n = (int) root -> right -> data;
+                     coefs[0] = 1.0;
+                     degree2 = 0;
+                     while (n > 0) {
+                         if (n & 1) {
+                             for (i = 0; i <= degree2; i++)
+                                 power[i] = coefs[i];
+                             if ((degree2 = poly_mult(power, degree2, coefs2,
+						      degree, coefs)) < 0)
+                                 return -1;
+                         }
+                         if ((n >>= 1) > 0) {
+                             for (i = 0; i <= degree; i++)
+                                 power[i] = coefs2[i];
+                             if ((degree = poly_mult(power, degree, power,
+						     degree, coefs2)) < 0)
+                                 return -1;
+                         }
+                     }
+                     return degree2;
+    }
+    return -1;                             /* A function - not a polynomial */
+}
+
+/*****************************************************************************
+*   Routine to multiply two polynomials into coefs (which may not be one of  *
+* them). Returns the degree, or -1 if above E2T_POLY_MAX_DEGREE.             *
+*****************************************************************************/
+static int poly_mult(const double coefs1[], int degree1,
+		     const double coefs2[], int degree2, double coefs[])
+{
+    int i, j;
+
+    if (degree1 + degree2 > E2T_POLY_MAX_DEGREE) return -1;
+    for (i = 0; i <= degree1 + degree2; i++) coefs[i] = 0.0;
+    for (i = 0; i <= degree1; i++)
+        for (j = 0; j <= degree2; j++)
+            coefs[i + j] += coefs1[i] * coefs2[j];
+    return degree1 + degree2;
+}
+
+/*****************************************************************************
+*   Routine to evaluate the polynomial of degree coefs at x by Horner's      *
+* scheme. If deriv is not NULL it gets the derivative, from the same pass.   *
+*****************************************************************************/
+double e2t_polyeval(const double coefs[], int degree, double x,
+		    double *deriv)
+{
+    int k;
+    double value = coefs[degree],
+	slope = 0.0;
+
+    for (k = degree - 1; k >= 0; k--) {
+        slope = slope * x + value;
+        value = value * x + coefs[k];
+    }
+    if (deriv != NULL) *deriv = slope;
+    return value;
+}
+
+/*****************************************************************************
+*   Routine to convert the power basis coefs of degree to the Bernstein      *
+* basis over [a, b]: bernstein[i] of B(i, degree)((x - a) / (b - a)).        *
+*****************************************************************************/
+void e2t_poly2bernstein(const double coefs[], int degree, double a, double b,
+			double bernstein[])
+{
+    int i, k;
+    double u[E2T_POLY_MAX_DEGREE + 1], binom_ratio;
+
+    /* Substitute x = a + (b - a) u, by a Taylor shift to a and scaling: */
+    for (i = 0; i <= degree; i++) u[i] = coefs[i];
+    for (i = 0; i < degree; i++)
+        for (k = degree - 1; k >= i; k--) u[k] += a * u[k + 1];
+    for (i = 1, binom_ratio = 1.0; i <= degree; i++) {
+        binom_ratio *= b - a;
+        u[i] *= binom_ratio;
+    }
+
+    /* bernstein[i] = sum over k <= i of C(i, k) / C(degree, k) u[k]: */
+    for (i = 0; i <= degree; i++) {
+        bernstein[i] = 0.0;
+        for (k = 0, binom_ratio = 1.0; k <= i; k++) {
+            bernstein[i] += binom_ratio * u[k];
+            binom_ratio *= (double) (i - k) / (degree - k);
+        }
+    }
+}
+
+/*****************************************************************************
+*   Routine to return a copy of tree root with its polynomial subtrees in    *
+* parameter param (see e2t_tree2poly) rewritten in Horner form - NUMBER,     *
+* PLUS, MULT and PARAMETER nodes only, so evaluation calls no pow().         *
+*****************************************************************************/
+e2t_expr_node *e2t_polyhorner(const e2t_expr_node *root, int param)
+{
+    glbl_stats.calls[E2T_STATS_POLYNOMIAL]++;
+    return new_tree(polyhorner1(root, param));
+}
+
+static e2t_expr_node *polyhorner1(const e2t_expr_node *root, int param)
+{
+    int degree;
+    double coefs[E2T_POLY_MAX_DEGREE + 1];
+    e2t_expr_node *node;
+
+    if (!root) return (e2t_expr_node *) NULL;
+    if (poly_node(root) && (degree = poly1(root, param, coefs)) >= 0)
+        return poly_horner_tree(coefs, degree, param);
+
+    node = e2t_malloc(sizeof(e2t_expr_node));
+    node -> node_kind = root -> node_kind;
+    node -> data = root -> data;
+    node -> left = polyhorner1(root -> left, param);
+    node -> right = polyhorner1(root -> right, param);
+    return node;
+}
+
+/*****************************************************************************
+*   Routine to test if root is an operator a polynomial may be made of.      *
+*****************************************************************************/
+static int poly_node(const e2t_expr_node *root)
+{
+    switch(root->node_kind) {
+    case PLUS :
+    case MINUS :
+    case MULT :
+    case DIV :
+    case POWER :
+    case SQR :
+    case UNARMINUS : return TRUE;
+    }
+    return FALSE;
+}
+
+/*****************************************************************************
+*   Routine to build the Horner form tree (..(c[n] * t + c[n-1]) * t ..) +   *
+* c[0] of the polynomial coefs of degree in parameter param.                 *
+*****************************************************************************/
+static e2t_expr_node *poly_horner_tree(const double coefs[], int degree,
+				       int param)
+{
+    int k;
+    e2t_expr_node *root, *node;
+
+    root = e2t_malloc(sizeof(e2t_expr_node));
+    root -> left = root -> right = NULL;
+    if (degree > 0 && coefs[degree] == 1.0) {    /* Monic - start at param */
+        root -> node_kind = PARAMETER;
+        root -> data = param;
+    }
+    else {
+        root -> node_kind = NUMBER;
+        root -> data = coefs[degree];
+    }
+
+    for (k = degree - 1; k >= 0; k--) {
+        if (k < degree - 1 || root -> node_kind != PARAMETER) {
+            node = e2t_malloc(sizeof(e2t_expr_node));    /* root * param */
+            node -> node_kind = MULT;
+            node -> left = root;
+            node -> right = e2t_malloc(sizeof(e2t_expr_node));
+            node -> right -> node_kind = PARAMETER;
+            node -> right -> data = param;
+            node -> right -> left = node -> right -> right = NULL;
+            root = node;
+        }
+
+        if (coefs[k] != 0.0) {                                 /* + c[k] */
+            node = e2t_malloc(sizeof(e2t_expr_node));
+            node -> node_kind = PLUS;
+            node -> left = root;
+            node -> right = e2t_malloc(sizeof(e2t_expr_node));
+            node -> right -> node_kind = NUMBER;
+            node -> right -> data = coefs[k];
+            node -> right -> left = node -> right -> right = NULL;
+            root = node;
+        }
+    }
+    return root;
+}
+
+/*****************************************************************************
+*   The parse cache: a bounded LRU cache of trees by normalized expression   *
+* text - upper case, blanks dropped but between two tokens they separate.    *
+* Derived and Horner trees of cached trees are cached too, keyed by the      *
+* parent key, CACHE_KEY_OP, an op letter and the parameter letter. Trees in  *
+* the cache are shared and immutable: the user holds a reference from        *
+* e2t_cachetree, e2t_cachederivtree or e2t_cachepolyhorner, and returns it   *
+* by e2t_releasetree - never e2t_freetree. Entries held are never evicted,   *
+* so the cache may hold more than its size until they are released.          *
+*****************************************************************************/
+#define CACHE_BUCKETS      256  /* Of both hash tables, a power of 2 */
+#define CACHE_DEFAULT_SIZE 256  /* A Frenet curve holds ~30 derivatives */
+#define CACHE_KEY_OP       '\001'     /* Never in a parsed expression */
+#define CACHE_DERIV        'D'
+#define CACHE_HORNER       'H'
+
+typedef struct cache_entry {
+     char *key;
+     unsigned long hash;
+     e2t_expr_node *tree;
+     int ref_count;                       /* References held by the user */
+     struct cache_entry *key_next, *tree_next;     /* Hash table chains */
+     struct cache_entry *newer, *older;                 /* The LRU list */
+} cache_entry;
+
+static cache_entry *glbl_cache_keys[CACHE_BUCKETS],
+                   *glbl_cache_trees[CACHE_BUCKETS],
+                   *glbl_cache_newest, *glbl_cache_oldest;
+static int glbl_cache_entries, glbl_cache_size = CACHE_DEFAULT_SIZE;
+
+static char *cache_normalize(const char s[]);
+static unsigned long cache_hash(const char *key);
+static cache_entry *cache_find_tree(const e2t_expr_node *tree);
+static const e2t_expr_node *cache_lookup(char *key,
+                                         const e2t_expr_node *parent,
+                                         int op, int param);
+static const e2t_expr_node *cache_derived(const e2t_expr_node *cached,
+                                          int op, int param);
+static void cache_unlink(cache_entry *entry);
+static void cache_evict(void);
+
+/*****************************************************************************
+*   Routine to return the shared tree of expression s, parsed only if not in *
+* the cache. NULL if s does not parse (see e2t_parserror). Release it by     *
+* e2t_releasetree.                                                           *
+*****************************************************************************/
+const e2t_expr_node *e2t_cachetree(const char s[])
+{
+    char *key = cache_normalize(s);
+
+    return key != NULL ? cache_lookup(key, NULL, 0, 0) : NULL;
+}
+
+/*****************************************************************************
+*   Routine to return the shared derivative by param of cached, a tree from  *
+* the cache, derived only if not in the cache. NULL if cached is not from    *
+* the cache or can not be derived (see e2t_deriverror).                      *
+*****************************************************************************/
+const e2t_expr_node *e2t_cachederivtree(const e2t_expr_node *cached,
+                                        int param)
+{
+    return cache_derived(cached, CACHE_DERIV, param);
+}
+
+/*****************************************************************************
+*   Routine to return the shared Horner form in param (see e2t_polyhorner)   *
+* of cached, a tree from the cache. NULL if cached is not from the cache.    *
+*****************************************************************************/
+const e2t_expr_node *e2t_cachepolyhorner(const e2t_expr_node *cached,
+                                         int param)
+{
+    return cache_derived(cached, CACHE_HORNER, param);
+}
+
+/*****************************************************************************
+*   Routine to release a reference to a tree from the cache. It stays cached *
+* until evicted, as the least recently used beyond the cache size.           *
+*****************************************************************************/
+void e2t_releasetree(const e2t_expr_node *cached)
+{
+    cache_entry *entry = cache_find_tree(cached);
+
+    if (entry == NULL || entry -> ref_count == 0) return;
+    entry -> ref_count--;
+    cache_evict();
+}
+
+/*****************************************************************************
+*   Routine to set the number of trees kept in the cache, 0 to cache only    *
+* the trees held.                                                            *
+*****************************************************************************/
+void e2t_setcachesize(int size)
+{
+    glbl_cache_size = size > 0 ? size : 0;
+    cache_evict();
+}
+
+/*****************************************************************************
+*   Routine to find the shared tree of key, or make it - by parsing key, or  *
+* else by op (CACHE_DERIV, CACHE_HORNER) on parent. Takes the ownership of   *
+* key. The tree is returned referenced, and made the most recently used.     *
+*****************************************************************************/
+static const e2t_expr_node *cache_lookup(char *key,
+                                         const e2t_expr_node *parent,
+                                         int op, int param)
+{
+    unsigned long hash = cache_hash(key);
+    cache_entry *entry, **bucket;
+    e2t_expr_node *tree;
+
+    for (entry = glbl_cache_keys[hash & (CACHE_BUCKETS - 1)];
+         entry != NULL;
+         entry = entry -> key_next)
+        if (entry -> hash == hash && strcmp(entry -> key, key) == 0) break;
+
+    if (entry != NULL) {
+        glbl_stats.cache_hits++;
+        free(key);
+        cache_unlink(entry);               /* Moved to the newest, below */
+    }
+    else {
+        glbl_stats.cache_misses++;
+        if (parent == NULL)
+            tree = e2t_expr2tree(key);
+        else if (op == CACHE_DERIV)
+            tree = e2t_derivtree(parent, param);
+        else
+            tree = e2t_polyhorner(parent, param);
+        if (tree == NULL ||
+            (entry = (cache_entry *) malloc(sizeof(cache_entry))) == NULL) {
+            freetree1(tree);
+            free(key);
+            return NULL;
+        }
+
+        entry -> key = key;
+        entry -> hash = hash;
+        entry -> tree = tree;
+        entry -> ref_count = 0;
+        bucket = &glbl_cache_keys[hash & (CACHE_BUCKETS - 1)];
+        entry -> key_next = *bucket;
+        *bucket = entry;
+        bucket = &glbl_cache_trees[((size_t) tree >> 4) &
+                                   (CACHE_BUCKETS - 1)];
+        entry -> tree_next = *bucket;
+        *bucket = entry;
+        glbl_cache_entries++;
+    }
+
+    entry -> older = glbl_cache_newest;
+    entry -> newer = NULL;
+    if (glbl_cache_newest != NULL) glbl_cache_newest -> newer = entry;
+    glbl_cache_newest = entry;
+    if (glbl_cache_oldest == NULL) glbl_cache_oldest = entry;
+
+    entry -> ref_count++;
+    cache_evict();
+    return entry -> tree;
+}
+
+static const e2t_expr_node *cache_derived(const e2t_expr_node *cached,
+                                          int op, int param)
+{
+    size_t length;
+    char *key;
+    cache_entry *entry = cache_find_tree(cached);
+
+    if (entry == NULL || param < 0 || param >= E2T_PARAM_Z1) return NULL;
+
+    length = strlen(entry -> key);
+    if ((key = (char *) malloc(length + 4)) == NULL) return NULL;
+    memcpy(key, entry -> key, length);
+    key[length] = CACHE_KEY_OP;
+    key[length + 1] = (char) op;
+    key[length + 2] = (char) ('A' + param);
+    key[length + 3] = 0;
+    return cache_lookup(key, cached, op, param);
+}
+
+/*****************************************************************************
+*   Routine to return s in upper case, without blanks but one between two    *
+* names or numbers, so equal expressions are equal keys. NULL if no memory.  *
+*****************************************************************************/
+static char *cache_normalize(const char s[])
+{
+    int i, j = 0, blank = FALSE;
+    char *key = (char *) malloc(strlen(s) + 1);
+
+    if (key == NULL) return NULL;
+    for (i = 0; s[i] != 0; i++) {
+        if (s[i] == ' ' || s[i] == TAB) {
+            blank = TRUE;
+            continue;
+        }
+        if (blank && j > 0 && (isalnum(key[j - 1]) || key[j - 1] == '.') &&
+            (isalnum(s[i]) || s[i] == '.'))
+            key[j++] = ' ';
+        blank = FALSE;
+        key[j++] = islower(s[i]) ? toupper(s[i]) : s[i];
+    }
+    key[j] = 0;
+    return key;
+}
+
+/*****************************************************************************
+*   Routine to hash a key (FNV-1a), in one pass over it.                     *
+*****************************************************************************/
+static unsigned long cache_hash(const char *key)
+{
+    unsigned long hash = 2166136261UL;
+
+    while (*key) {
+        hash ^= (unsigned char) *key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static cache_entry *cache_find_tree(const e2t_expr_node *tree)
+{
+    cache_entry *entry;
+
+    if (tree == NULL) return NULL;
+    for (entry = glbl_cache_trees[((size_t) tree >> 4) &
+                                  (CACHE_BUCKETS - 1)];
+         entry != NULL && entry -> tree != tree;
+         entry = entry -> tree_next);
+    return entry;
+}
+
+/*****************************************************************************
+*   Routine to take an entry out of the LRU list.                            *
+*****************************************************************************/
+static void cache_unlink(cache_entry *entry)
+{
+    if (entry -> newer != NULL)
+        entry -> newer -> older = entry -> older;
+    else
+        glbl_cache_newest = entry -> older;
+    if (entry -> older != NULL)
+        entry -> older -> newer = entry -> newer;
+    else
+        glbl_cache_oldest = entry -> newer;
+}
+
+/*****************************************************************************
+*   Routine to free the least recently used entries not held, until the      *
+* cache is within its size.                                                  *
+*****************************************************************************/
+static void cache_evict(void)
+{
+    cache_entry *entry, *newer, **link;
+
+    for (entry = glbl_cache_oldest;
+         entry != NULL && glbl_cache_entries > glbl_cache_size;
+         entry = newer) {
+        newer = entry -> newer;
+        if (entry -> ref_count > 0) continue;
+
+        cache_unlink(entry);
+        for (link = &glbl_cache_keys[entry -> hash & (CACHE_BUCKETS - 1)];
+             *link != entry;
+             link = &(*link) -> key_next);
+        *link = entry -> key_next;
+        for (link = &glbl_cache_trees[((size_t) entry -> tree >> 4) &
+                                      (CACHE_BUCKETS - 1)];
+             *link != entry;
+             link = &(*link) -> tree_next);
+        *link = entry -> tree_next;
+
+        freetree1(entry -> tree);
+        free(entry -> key);
+        free(entry);
+        glbl_cache_entries--;
+    }
+}
+
+/*****************************************************************************
+*  The public entries of the recursive routines above - count the calls      *
+* (and time the evaluations) of the user only, not of the recursion.         *
+*****************************************************************************/
+e2t_expr_node *e2t_copytree(const e2t_expr_node *root)
+{
+    glbl_stats.calls[E2T_STATS_COPYTREE]++;
+    return copytree1(root);
+}
+
+double e2t_evaltree(const e2t_expr_node *root)
+{
+    double value,
+        start = seconds();
+
+    glbl_stats.calls[E2T_STATS_EVALTREE]++;
+    value = evaltree1(root);
+    glbl_stats.eval_time += seconds() - start;
+    return value;
+}
+
+/*****************************************************************************
+*  Routine to evaluate root at n values of parameter param into out, one     *
+* call. The parameter keeps its value.                                       *
+*****************************************************************************/
+void e2t_evaltree_batch(const e2t_expr_node *root, int n, int param,
+			const double values[], double out[])
+{
+    int i;
+    double param_value,
+        start = seconds();
+
+    glbl_stats.calls[E2T_STATS_EVALTREE]++;
+    if ((param < 0) || (param > E2T_PARAM_Z)) return;
+
+    param_value = GlobalParam[param];
+    for (i = 0; i < n; i++) {
+        GlobalParam[param] = values[i];
+        out[i] = evaltree1(root);
+    }
+    GlobalParam[param] = param_value;
+    glbl_stats.eval_time += seconds() - start;
+}
+
+int e2t_cmptree(const e2t_expr_node *root1, const e2t_expr_node *root2)
+{
+    glbl_stats.calls[E2T_STATS_CMPTREE]++;
+    return cmptree1(root1, root2);
+}
+
+int e2t_paramintree(const e2t_expr_node *root, int param)
+{
+    glbl_stats.calls[E2T_STATS_PARAMINTREE]++;
+    return paramintree1(root, param);
+}
+
+void e2t_freetree(e2t_expr_node *root)
+{
+    glbl_stats.calls[E2T_STATS_FREETREE]++;
+    freetree1(root);
+}
+
+/*****************************************************************************
+*  Routine to copy the runtime counters and timers into stats. The live      *
+* nodes are the nodes allocated and not freed yet - trees held by the user,  *
+* or leaked.                                                                 *
+*****************************************************************************/
+void e2t_getstats(e2t_stats *stats)
+{
+    *stats = glbl_stats;
+    stats -> cache_entries = glbl_cache_entries;
+}
+
+/*****************************************************************************
+*  Routine to zero the runtime counters and timers. The live nodes count     *
+* is kept, so leaks are still seen after a reset.                            *
+*****************************************************************************/
+void e2t_resetstats(void)
+{
+    long live_nodes = glbl_stats.live_nodes;
+
+    memset(&glbl_stats, 0, sizeof(glbl_stats));
+    glbl_stats.live_nodes = live_nodes;
+}
+
 /*****************************************************************************
   Routine re parametrize tree.                                               *
 *****************************************************************************/
@@ -1372,8 +2834,8 @@ static e2t_expr_node *reparametrize_tree(e2t_expr_node *tree, const e2t_expr_nod
     }
 
     if ((tree->node_kind == PARAMETER) & (tree->data == parameter)) {
-        e2t_freetree(tree);
-        return e2t_copytree(reparameter);
+        freetree1(tree);
+        return copytree1(reparameter);
     } else {
         tree->left = reparametrize_tree(tree->left, reparameter, parameter);
         tree->right = reparametrize_tree(tree->right, reparameter, parameter);
@@ -1381,29 +2843,35 @@ static e2t_expr_node *reparametrize_tree(e2t_expr_node *tree, const e2t_expr_nod
     }
 }
 e2t_expr_node *e2t_treereparameter(const e2t_expr_node *tree, const e2t_expr_node *reparameter, int parameter) {
-    e2t_expr_node * new_tree = e2t_copytree(tree);
-    new_tree = reparametrize_tree(new_tree, reparameter, parameter);
-    return new_tree;
+    e2t_expr_node * reparametrized_tree = copytree1(tree);
+    glbl_stats.calls[E2T_STATS_TREEREPARAMETER]++;
+    reparametrized_tree = reparametrize_tree(reparametrized_tree, reparameter, parameter);
+    return new_tree(reparametrized_tree);
 }
 
 
 /*****************************************************************************
   operations between trees                                                    *
+  The e2t_*_op_*_move variants take the ownership of their operand trees and *
+  link them under the new operator node, no copy made - the operands must    *
+  not be used (or freed) by the caller afterwards.                           *
 *****************************************************************************/
-// TREE op TREE
-e2t_expr_node *e2t_trees_operation(const e2t_expr_node *left_tree, const e2t_expr_node *right_tree, int op_node_kind) {
+// TREE op TREE, owning the operands
+static e2t_expr_node *e2t_trees_operation_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree, int op_node_kind) {
     e2t_expr_node *root = e2t_malloc(sizeof(e2t_expr_node));
+    glbl_stats.calls[E2T_STATS_TREES_OPERATION]++;
     root->node_kind = op_node_kind;
-    root->left = e2t_copytree(left_tree);
-    root->right = e2t_copytree(right_tree);
-    return root;
+    root->left = left_tree;
+    root->right = right_tree;
+    return new_tree(root);
+}
+// TREE op TREE
+e2t_expr_node *e2t_trees_operation(const e2t_expr_node *left_tree, const e2t_expr_node *right_tree, int op_node_kind) {
+    return e2t_trees_operation_move(copytree1(left_tree), copytree1(right_tree), op_node_kind);
 }
 // op(TREE)
 e2t_expr_node *e2t_tree_operation(const e2t_expr_node *tree, int op_node_kind) {
-    e2t_expr_node *root = e2t_malloc(sizeof(e2t_expr_node));
-    root->node_kind = op_node_kind;
-    root->right = e2t_copytree(tree);
-    return root;
+    return e2t_trees_operation_move(NULL, copytree1(tree), op_node_kind);
 }
 
 ////////// TREE op TREE
@@ -1441,3 +2909,39 @@ e2t_expr_node *e2t_tree_op_sqrt(const e2t_expr_node *tree) {
 e2t_expr_node *e2t_tree_op_unarminus(const e2t_expr_node *tree) {
     return e2t_tree_operation(tree, UNARMINUS);
 }
+
+////////// TREE op TREE, owning the operands
+
+e2t_expr_node *e2t_trees_op_division_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree) {
+    return e2t_trees_operation_move(left_tree, right_tree, DIV);
+}
+
+e2t_expr_node *e2t_trees_op_subtraction_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree) {
+    return e2t_trees_operation_move(left_tree, right_tree, MINUS);
+}
+
+e2t_expr_node *e2t_trees_op_multiplication_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree) {
+    return e2t_trees_operation_move(left_tree, right_tree, MULT);
+}
+
+e2t_expr_node *e2t_trees_op_addition_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree) {
+    return e2t_trees_operation_move(left_tree, right_tree, PLUS);
+}
+
+e2t_expr_node *e2t_trees_op_power_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree) {
+    return e2t_trees_operation_move(left_tree, right_tree, POWER);
+}
+
+////////// op(TREE), owning the operand
+
+e2t_expr_node *e2t_tree_op_sqr_move(e2t_expr_node *tree) {
+    return e2t_trees_operation_move(NULL, tree, SQR);
+}
+
+e2t_expr_node *e2t_tree_op_sqrt_move(e2t_expr_node *tree) {
+    return e2t_trees_operation_move(NULL, tree, SQRT);
+}
+
+e2t_expr_node *e2t_tree_op_unarminus_move(e2t_expr_node *tree) {
+    return e2t_trees_operation_move(NULL, tree, UNARMINUS);
+}
@@ -31,6 +31,8 @@
 #define E2T_PARAM_Z1   26  /* Number of variables */
 #define E2T_PARAM_ALL  -1  /* Match all E2T_PARAMs is searches */
 
+#define E2T_POLY_MAX_DEGREE 64  /* Of polynomials found by e2t_tree2poly */
+
 extern int e2t_parsing_error;
 
 /*****************************************************************************
@@ -61,6 +63,50 @@ typedef struct e2t_expr_node {
 #define E2T_NONE_CONST_EXP_ERROR 1
 #define E2T_NO_ABS_DERIV_ERROR   2
 
+/*****************************************************************************
+* Runtime counters, see e2t_getstats - calls[] is indexed by E2T_STATS_*:    *
+*****************************************************************************/
+#define E2T_STATS_EXPR2TREE       0
+#define E2T_STATS_COPYTREE        1
+#define E2T_STATS_EVALTREE        2
+#define E2T_STATS_DERIVTREE       3
+#define E2T_STATS_CMPTREE         4
+#define E2T_STATS_PARAMINTREE     5
+#define E2T_STATS_FREETREE        6
+#define E2T_STATS_PRINTTREE       7
+#define E2T_STATS_SETPARAMVALUE   8
+#define E2T_STATS_TREEREPARAMETER 9
+#define E2T_STATS_TREES_OPERATION 10  /* All the e2t_tree(s)_op_* together */
+#define E2T_STATS_SPECIALIZE      11
+#define E2T_STATS_EVALGRAD        12  /* evalgrad, evalhessvec and the batch */
+#define E2T_STATS_CHEBPROXY       13
+#define E2T_STATS_POLYNOMIAL      14  /* tree2poly and polyhorner */
+#define E2T_STATS_N_CALLS         15
+
+typedef struct e2t_stats {
+     unsigned long calls[E2T_STATS_N_CALLS];
+     unsigned long nodes_allocated, nodes_freed;
+     long live_nodes;                      /* Allocated and not yet freed */
+     unsigned long optimize_passes;     /* Optimizer passes over a tree */
+     unsigned long optimize_rewrites;   /* Simplifications they applied */
+     int max_depth;                 /* Deepest tree handed to the user */
+     double parse_time, deriv_time, eval_time;                /* Seconds */
+     unsigned long cache_hits, cache_misses;   /* Of the parse cache, and */
+     int cache_entries;                /* its trees now (see e2t_cachetree) */
+} e2t_stats;
+
+/*****************************************************************************
+* Piecewise Chebyshev approximation of a tree in one parameter, see          *
+* e2t_chebproxy:                                                             *
+*****************************************************************************/
+typedef struct e2t_cheb_proxy {
+     int param;                  /* The parameter it is a function of */
+     int n_pieces;
+     double *breaks;           /* n_pieces + 1 increasing piece ends */
+     int *offsets;    /* Piece i coefs are coefs[offsets[i]..offsets[i+1]) */
+     double *coefs;       /* Chebyshev coefficients over each piece */
+} e2t_cheb_proxy;
+
 /*****************************************************************************
 * Function prototypes:							     *
 *****************************************************************************/
@@ -74,13 +120,36 @@ e2t_expr_node *e2t_treereparameter(const e2t_expr_node *tree, const e2t_expr_nod
 void e2t_printtree(const e2t_expr_node *root, char *str);
 e2t_expr_node *e2t_copytree(const e2t_expr_node *root);
 double     e2t_evaltree(const e2t_expr_node *root);
+void       e2t_evaltree_batch(const e2t_expr_node *root, int n, int param, const double values[], double out[]);
 e2t_expr_node *e2t_derivtree(const e2t_expr_node *root, int param);
 int        e2t_cmptree(const e2t_expr_node *root1, const e2t_expr_node *root2);
 int        e2t_paramintree(const e2t_expr_node *root, int param);
 void       e2t_freetree(e2t_expr_node *root);
 int        e2t_parserror();
 int        e2t_deriverror();
+int        e2t_memerror();
 void       e2t_setparamvalue(double Value, int Number);
+e2t_expr_node *e2t_specialize(const e2t_expr_node *root, unsigned long param_mask, const double values[]);
+double     e2t_evalgrad(const e2t_expr_node *root, double grad[]);
+double     e2t_evalhessvec(const e2t_expr_node *root, const double v[], double grad[], double hv[]);
+void       e2t_evalgrad_batch(const e2t_expr_node *root, int n, int param, const double values[], double f[], double grads[]);
+e2t_cheb_proxy *e2t_chebproxy(const e2t_expr_node *root, int param, double a, double b, double tol, int relative);
+double     e2t_chebeval(const e2t_cheb_proxy *proxy, double x);
+void       e2t_chebeval_n(const e2t_cheb_proxy *proxy, int n, const double x[], double values[]);
+e2t_cheb_proxy *e2t_chebderiv(const e2t_cheb_proxy *proxy);
+e2t_cheb_proxy *e2t_chebinteg(const e2t_cheb_proxy *proxy);
+void       e2t_freechebproxy(e2t_cheb_proxy *proxy);
+int        e2t_tree2poly(const e2t_expr_node *root, int param, double coefs[]);
+double     e2t_polyeval(const double coefs[], int degree, double x, double *deriv);
+void       e2t_poly2bernstein(const double coefs[], int degree, double a, double b, double bernstein[]);
+e2t_expr_node *e2t_polyhorner(const e2t_expr_node *root, int param);
+void       e2t_getstats(e2t_stats *stats);
+void       e2t_resetstats(void);
+const e2t_expr_node *e2t_cachetree(const char s[]);
+const e2t_expr_node *e2t_cachederivtree(const e2t_expr_node *cached, int param);
+const e2t_expr_node *e2t_cachepolyhorner(const e2t_expr_node *cached, int param);
+void       e2t_releasetree(const e2t_expr_node *cached);
+void       e2t_setcachesize(int size);
 
 e2t_expr_node *e2t_treereparameter(const e2t_expr_node *tree, const e2t_expr_node *reparameter, int parameter);
 e2t_expr_node *e2t_trees_op_division(const e2t_expr_node *left_tree, const e2t_expr_node *right_tree);
@@ -92,6 +161,15 @@ e2t_expr_node *e2t_tree_op_sqr(const e2t_expr_node *tree);
 e2t_expr_node *e2t_tree_op_sqrt(const e2t_expr_node *tree);
 e2t_expr_node *e2t_tree_op_unarminus(const e2t_expr_node *tree);
 
+e2t_expr_node *e2t_trees_op_division_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree);
+e2t_expr_node *e2t_trees_op_subtraction_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree);
+e2t_expr_node *e2t_trees_op_multiplication_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree);
+e2t_expr_node *e2t_trees_op_addition_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree);
+e2t_expr_node *e2t_trees_op_power_move(e2t_expr_node *left_tree, e2t_expr_node *right_tree);
+e2t_expr_node *e2t_tree_op_sqr_move(e2t_expr_node *tree);
+e2t_expr_node *e2t_tree_op_sqrt_move(e2t_expr_node *tree);
+e2t_expr_node *e2t_tree_op_unarminus_move(e2t_expr_node *tree);
+
 #ifdef __cplusplus
 }
 #endif
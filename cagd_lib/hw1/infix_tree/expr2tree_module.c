@@ -0,0 +1,954 @@
+/*****************************************************************************
+*   CPython extension module _expr2tree - the native binding of expr2tree,   *
+* used by _infix_tree.py in place of the ctypes one when it is built (see    *
+* infix_tree.md).                                                            *
+*                                                                            *
+*   The functions are named as the e2t_ routines and take the same           *
+* arguments, except that:                                                    *
+* 1. Trees are held by Tree handles, freed with the handle or by             *
+*    e2t_freetree, whichever comes first - NULL trees are None. The _move    *
+*    operators take the trees of their operand handles, leaving them empty.  *
+*    Handles of shared trees (e2t_cachetree) release them instead, and can   *
+*    not be moved.                                                           *
+* 2. Chebyshev proxies are held by ChebProxy handles the same way.           *
+* 3. Arrays are C contiguous buffers of doubles (numpy float64 arrays,       *
+*    ctypes double arrays), checked to be large enough.                      *
+* 4. Gradients, proxies and specialized trees that run out of memory         *
+*    (e2t_memerror) raise MemoryError.                                       *
+*                                                                            *
+*   expr2tree keeps global state (parameter values, the parser and the       *
+* derivation errors, counters), so every call into it holds the module lock, *
+* with the GIL released - other Python threads run meanwhile, and one may    *
+* evaluate a batch while another parses.                                     *
+*****************************************************************************/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+#include <string.h>
+
+#include "expr2tree.h"
+
+typedef struct TreeObject {
+     PyObject_HEAD
+     e2t_expr_node *tree;                          /* NULL once freed */
+     int shared;     /* A tree of the parse cache, released when freed */
+} TreeObject;
+
+typedef struct ChebProxyObject {
+     PyObject_HEAD
+     e2t_cheb_proxy *proxy;                        /* NULL once freed */
+} ChebProxyObject;
+
+static PyThread_type_lock glbl_lock;
+
+/* Run statement holding the module lock, without the GIL: */
+#define E2T_CALL(statement) \
+    Py_BEGIN_ALLOW_THREADS \
+    PyThread_acquire_lock(glbl_lock, WAIT_LOCK); \
+    statement; \
+    PyThread_release_lock(glbl_lock); \
+    Py_END_ALLOW_THREADS
+
+static PyTypeObject TreeType, ChebProxyType;
+
+static PyObject *new_tree(e2t_expr_node *tree);
+static PyObject *new_shared_tree(const e2t_expr_node *tree);
+static void free_tree(TreeObject *tree);
+static PyObject *new_proxy(e2t_cheb_proxy *proxy);
+static int freed_error(int freed);
+static int memory_error(int failed);
+static double *get_doubles(PyObject *obj, Py_buffer *view, int writable,
+                           Py_ssize_t n, const char *name);
+
+/*****************************************************************************
+*   The handle types.                                                        *
+*****************************************************************************/
+static void tree_dealloc(TreeObject *self)
+{
+    if (self -> tree != NULL) E2T_CALL(free_tree(self));
+    Py_TYPE(self) -> tp_free((PyObject *) self);
+}
+
+static void proxy_dealloc(ChebProxyObject *self)
+{
+    e2t_cheb_proxy *proxy = self -> proxy;
+
+    if (proxy != NULL) {
+        self -> proxy = NULL;
+        E2T_CALL(e2t_freechebproxy(proxy));
+    }
+    Py_TYPE(self) -> tp_free((PyObject *) self);
+}
+
+static PyTypeObject TreeType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_expr2tree.Tree",
+    .tp_doc = "Handle of an expr2tree tree, freed with it or by e2t_freetree",
+    .tp_basicsize = sizeof(TreeObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) tree_dealloc,
+};
+
+static PyTypeObject ChebProxyType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_expr2tree.ChebProxy",
+    .tp_doc = "Handle of a Chebyshev proxy, freed with it or by "
+              "e2t_freechebproxy",
+    .tp_basicsize = sizeof(ChebProxyObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) proxy_dealloc,
+};
+
+/*****************************************************************************
+*   Routine to wrap a new tree in a handle - None for NULL.                  *
+*****************************************************************************/
+static PyObject *new_tree(e2t_expr_node *tree)
+{
+    TreeObject *self;
+
+    if (tree == NULL) Py_RETURN_NONE;
+    if ((self = PyObject_New(TreeObject, &TreeType)) == NULL) {
+        E2T_CALL(e2t_freetree(tree));
+        return NULL;
+    }
+    self -> tree = tree;
+    self -> shared = 0;
+    return (PyObject *) self;
+}
+
+/*****************************************************************************
+*   Routine to wrap a referenced tree of the parse cache in a handle - None  *
+* for NULL.                                                                  *
+*****************************************************************************/
+static PyObject *new_shared_tree(const e2t_expr_node *tree)
+{
+    TreeObject *self;
+
+    if (tree == NULL) Py_RETURN_NONE;
+    if ((self = PyObject_New(TreeObject, &TreeType)) == NULL) {
+        E2T_CALL(e2t_releasetree(tree));
+        return NULL;
+    }
+    self -> tree = (e2t_expr_node *) tree;
+    self -> shared = 1;
+    return (PyObject *) self;
+}
+
+/*****************************************************************************
+*   Routine to free (release, if shared) the tree of a handle, under the     *
+* module lock.                                                               *
+*****************************************************************************/
+static void free_tree(TreeObject *tree)
+{
+    if (tree -> shared)
+        e2t_releasetree(tree -> tree);
+    else
+        e2t_freetree(tree -> tree);
+    tree -> tree = NULL;
+}
+
+static PyObject *new_proxy(e2t_cheb_proxy *proxy)
+{
+    ChebProxyObject *self;
+
+    if (proxy == NULL) Py_RETURN_NONE;
+    if ((self = PyObject_New(ChebProxyObject, &ChebProxyType)) == NULL) {
+        E2T_CALL(e2t_freechebproxy(proxy));
+        return NULL;
+    }
+    self -> proxy = proxy;
+    return (PyObject *) self;
+}
+
+/*****************************************************************************
+*   Routine to raise the error of a freed handle used, if freed. The handle  *
+* pointers are read under the module lock, as e2t_freetree clears them.      *
+*****************************************************************************/
+static int freed_error(int freed)
+{
+    if (freed) PyErr_SetString(PyExc_ValueError, "the tree was freed");
+    return freed;
+}
+
+/*****************************************************************************
+*   Routine to raise MemoryError if failed (by e2t_memerror, read under the  *
+* module lock with the call that failed).                                    *
+*****************************************************************************/
+static int memory_error(int failed)
+{
+    if (failed) PyErr_NoMemory();
+    return failed;
+}
+
+/*****************************************************************************
+*   Routine to get the C contiguous doubles of buffer obj, at least n of     *
+* them. Returns NULL (an exception set) if obj is not such a buffer. The     *
+* view must be released by PyBuffer_Release.                                 *
+*****************************************************************************/
+static double *get_doubles(PyObject *obj, Py_buffer *view, int writable,
+                           Py_ssize_t n, const char *name)
+{
+    const char *format;
+
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT |
+                           (writable ? PyBUF_WRITABLE : 0)) < 0)
+        return NULL;
+
+    format = view -> format;
+    if (format != NULL && strchr("@=<", format[0]) != NULL) format++;
+    if (view -> itemsize != sizeof(double) ||
+        (format != NULL && strcmp(format, "d") != 0)) {
+        PyErr_Format(PyExc_TypeError, "%s must be a buffer of doubles", name);
+        PyBuffer_Release(view);
+        return NULL;
+    }
+    if (view -> len / (Py_ssize_t) sizeof(double) < n) {
+        PyErr_Format(PyExc_ValueError, "%s must have at least %zd doubles",
+                     name, n);
+        PyBuffer_Release(view);
+        return NULL;
+    }
+    return (double *) view -> buf;
+}
+
+/*****************************************************************************
+*   Trees.                                                                   *
+*****************************************************************************/
+static PyObject *py_expr2tree(PyObject *module, PyObject *args)
+{
+    const char *s;
+    e2t_expr_node *tree;
+
+    if (!PyArg_ParseTuple(args, "y:e2t_expr2tree", &s)) return NULL;
+    E2T_CALL(tree = e2t_expr2tree(s));
+    return new_tree(tree);
+}
+
+static PyObject *py_parserror(PyObject *module, PyObject *args)
+{
+    int error;
+
+    E2T_CALL(error = e2t_parserror());
+    return PyLong_FromLong(error);
+}
+
+static PyObject *py_printtree(PyObject *module, PyObject *args)
+{
+    int freed = 0;
+    TreeObject *tree;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "O!w*:e2t_printtree", &TreeType, &tree,
+                          &view))
+        return NULL;
+    if (view.len < 1) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "empty string buffer");
+        return NULL;
+    }
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 e2t_printtree(tree -> tree, (char *) view.buf));
+    PyBuffer_Release(&view);
+    if (freed_error(freed)) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_copytree(PyObject *module, PyObject *args)
+{
+    int freed = 0;
+    TreeObject *tree;
+    e2t_expr_node *copy = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!:e2t_copytree", &TreeType, &tree))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 copy = e2t_copytree(tree -> tree));
+    if (freed_error(freed)) return NULL;
+    return new_tree(copy);
+}
+
+static PyObject *py_freetree(PyObject *module, PyObject *args)
+{
+    PyObject *obj;
+    TreeObject *tree;
+
+    if (!PyArg_ParseTuple(args, "O:e2t_freetree", &obj)) return NULL;
+    if (obj == Py_None) Py_RETURN_NONE;
+    if (!PyObject_TypeCheck(obj, &TreeType)) {
+        PyErr_SetString(PyExc_TypeError, "a Tree or None expected");
+        return NULL;
+    }
+    tree = (TreeObject *) obj;
+    E2T_CALL(if (tree -> tree != NULL) free_tree(tree));
+    Py_RETURN_NONE;
+}
+
+/*****************************************************************************
+*   The parse cache - its trees are shared, the handles release them.        *
+*****************************************************************************/
+static PyObject *py_cachetree(PyObject *module, PyObject *args)
+{
+    const char *s;
+    const e2t_expr_node *tree;
+
+    if (!PyArg_ParseTuple(args, "y:e2t_cachetree", &s)) return NULL;
+    E2T_CALL(tree = e2t_cachetree(s));
+    return new_shared_tree(tree);
+}
+
+static PyObject *cached(PyObject *args, const char *format,
+                        const e2t_expr_node *(*operation)
+                            (const e2t_expr_node *, int))
+{
+    int param, freed = 0;
+    TreeObject *tree;
+    const e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, format, &TreeType, &tree, &param))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 result = operation(tree -> tree, param));
+    if (freed_error(freed)) return NULL;
+    return new_shared_tree(result);
+}
+
+static PyObject *py_cachederivtree(PyObject *module, PyObject *args)
+{
+    return cached(args, "O!i:e2t_cachederivtree", e2t_cachederivtree);
+}
+
+static PyObject *py_cachepolyhorner(PyObject *module, PyObject *args)
+{
+    return cached(args, "O!i:e2t_cachepolyhorner", e2t_cachepolyhorner);
+}
+
+/* Either kind of handle is freed by its own kind, as by e2t_freetree: */
+static PyObject *py_releasetree(PyObject *module, PyObject *args)
+{
+    return py_freetree(module, args);
+}
+
+static PyObject *py_setcachesize(PyObject *module, PyObject *args)
+{
+    int size;
+
+    if (!PyArg_ParseTuple(args, "i:e2t_setcachesize", &size)) return NULL;
+    E2T_CALL(e2t_setcachesize(size));
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_evaltree(PyObject *module, PyObject *args)
+{
+    int freed = 0;
+    double value = 0.0;
+    TreeObject *tree;
+
+    if (!PyArg_ParseTuple(args, "O!:e2t_evaltree", &TreeType, &tree))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 value = e2t_evaltree(tree -> tree));
+    if (freed_error(freed)) return NULL;
+    return PyFloat_FromDouble(value);
+}
+
+static PyObject *py_evaltree_batch(PyObject *module, PyObject *args)
+{
+    int n, param, freed = 0;
+    double *values, *out;
+    PyObject *values_obj, *out_obj;
+    TreeObject *tree;
+    Py_buffer values_view, out_view;
+
+    if (!PyArg_ParseTuple(args, "O!iiOO:e2t_evaltree_batch", &TreeType, &tree,
+                          &n, &param, &values_obj, &out_obj))
+        return NULL;
+    if ((values = get_doubles(values_obj, &values_view, 0, n,
+                              "values")) == NULL)
+        return NULL;
+    if ((out = get_doubles(out_obj, &out_view, 1, n, "out")) == NULL) {
+        PyBuffer_Release(&values_view);
+        return NULL;
+    }
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 e2t_evaltree_batch(tree -> tree, n, param, values, out));
+    PyBuffer_Release(&values_view);
+    PyBuffer_Release(&out_view);
+    if (freed_error(freed)) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_derivtree(PyObject *module, PyObject *args)
+{
+    int param, freed = 0;
+    TreeObject *tree;
+    e2t_expr_node *deriv = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!i:e2t_derivtree", &TreeType, &tree,
+                          &param))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 deriv = e2t_derivtree(tree -> tree, param));
+    if (freed_error(freed)) return NULL;
+    return new_tree(deriv);
+}
+
+static PyObject *py_deriverror(PyObject *module, PyObject *args)
+{
+    int error;
+
+    E2T_CALL(error = e2t_deriverror());
+    return PyLong_FromLong(error);
+}
+
+static PyObject *py_memerror(PyObject *module, PyObject *args)
+{
+    int error;
+
+    E2T_CALL(error = e2t_memerror());
+    return PyLong_FromLong(error);
+}
+
+static PyObject *py_cmptree(PyObject *module, PyObject *args)
+{
+    int equal = 0, freed = 0;
+    TreeObject *tree1, *tree2;
+
+    if (!PyArg_ParseTuple(args, "O!O!:e2t_cmptree", &TreeType, &tree1,
+                          &TreeType, &tree2))
+        return NULL;
+    E2T_CALL(if (!(freed = tree1 -> tree == NULL || tree2 -> tree == NULL))
+                 equal = e2t_cmptree(tree1 -> tree, tree2 -> tree));
+    if (freed_error(freed)) return NULL;
+    return PyLong_FromLong(equal);
+}
+
+static PyObject *py_paramintree(PyObject *module, PyObject *args)
+{
+    int param, found = 0, freed = 0;
+    TreeObject *tree;
+
+    if (!PyArg_ParseTuple(args, "O!i:e2t_paramintree", &TreeType, &tree,
+                          &param))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 found = e2t_paramintree(tree -> tree, param));
+    if (freed_error(freed)) return NULL;
+    return PyLong_FromLong(found);
+}
+
+static PyObject *py_setparamvalue(PyObject *module, PyObject *args)
+{
+    int number;
+    double value;
+
+    if (!PyArg_ParseTuple(args, "di:e2t_setparamvalue", &value, &number))
+        return NULL;
+    E2T_CALL(e2t_setparamvalue(value, number));
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_treereparameter(PyObject *module, PyObject *args)
+{
+    int param, freed = 0;
+    TreeObject *tree, *reparameter;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!O!i:e2t_treereparameter", &TreeType, &tree,
+                          &TreeType, &reparameter, &param))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL ||
+                           reparameter -> tree == NULL))
+                 result = e2t_treereparameter(tree -> tree,
+                                              reparameter -> tree, param));
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+static PyObject *py_specialize(PyObject *module, PyObject *args)
+{
+    int freed = 0, no_memory = 0;
+    unsigned long param_mask;
+    double *values;
+    PyObject *values_obj;
+    TreeObject *tree;
+    Py_buffer view;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!kO:e2t_specialize", &TreeType, &tree,
+                          &param_mask, &values_obj))
+        return NULL;
+    if ((values = get_doubles(values_obj, &view, 0, E2T_PARAM_Z1,
+                              "values")) == NULL)
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 result = e2t_specialize(tree -> tree, param_mask, values);
+                 no_memory = e2t_memerror();
+             });
+    PyBuffer_Release(&view);
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    return new_tree(result);
+}
+
+/*****************************************************************************
+*   Gradients.                                                               *
+*****************************************************************************/
+static PyObject *py_evalgrad(PyObject *module, PyObject *args)
+{
+    int freed = 0, no_memory = 0;
+    double value = 0.0, *grad;
+    PyObject *grad_obj;
+    TreeObject *tree;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "O!O:e2t_evalgrad", &TreeType, &tree,
+                          &grad_obj))
+        return NULL;
+    if ((grad = get_doubles(grad_obj, &view, 1, E2T_PARAM_Z1,
+                            "grad")) == NULL)
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 value = e2t_evalgrad(tree -> tree, grad);
+                 no_memory = e2t_memerror();
+             });
+    PyBuffer_Release(&view);
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    return PyFloat_FromDouble(value);
+}
+
+static PyObject *py_evalhessvec(PyObject *module, PyObject *args)
+{
+    int i, freed = 0, no_memory = 0;
+    double value = 0.0, *arrays[3];
+    static const char *names[3] = { "v", "grad", "hv" };
+    PyObject *objs[3];
+    TreeObject *tree;
+    Py_buffer views[3];
+
+    if (!PyArg_ParseTuple(args, "O!OOO:e2t_evalhessvec", &TreeType, &tree,
+                          &objs[0], &objs[1], &objs[2]))
+        return NULL;
+    for (i = 0; i < 3; i++)
+        if ((arrays[i] = get_doubles(objs[i], &views[i], i > 0, E2T_PARAM_Z1,
+                                     names[i])) == NULL) {
+            while (--i >= 0) PyBuffer_Release(&views[i]);
+            return NULL;
+        }
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 value = e2t_evalhessvec(tree -> tree, arrays[0], arrays[1],
+                                         arrays[2]);
+                 no_memory = e2t_memerror();
+             });
+    for (i = 0; i < 3; i++) PyBuffer_Release(&views[i]);
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    return PyFloat_FromDouble(value);
+}
+
+static PyObject *py_evalgrad_batch(PyObject *module, PyObject *args)
+{
+    int i, n, param, freed = 0, no_memory = 0;
+    double *arrays[3];
+    static const char *names[3] = { "values", "f", "grads" };
+    PyObject *objs[3];
+    TreeObject *tree;
+    Py_buffer views[3];
+
+    if (!PyArg_ParseTuple(args, "O!iiOOO:e2t_evalgrad_batch", &TreeType,
+                          &tree, &n, &param, &objs[0], &objs[1], &objs[2]))
+        return NULL;
+    for (i = 0; i < 3; i++)
+        if ((arrays[i] = get_doubles(objs[i], &views[i], i > 0,
+                                     i == 2 ? (Py_ssize_t) n * E2T_PARAM_Z1 :
+                                              n,
+                                     names[i])) == NULL) {
+            while (--i >= 0) PyBuffer_Release(&views[i]);
+            return NULL;
+        }
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 e2t_evalgrad_batch(tree -> tree, n, param, arrays[0],
+                                    arrays[1], arrays[2]);
+                 no_memory = e2t_memerror();
+             });
+    for (i = 0; i < 3; i++) PyBuffer_Release(&views[i]);
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    Py_RETURN_NONE;
+}
+
+/*****************************************************************************
+*   Chebyshev proxies.                                                       *
+*****************************************************************************/
+static PyObject *py_chebproxy(PyObject *module, PyObject *args)
+{
+    int param, relative, freed = 0, no_memory = 0;
+    double a, b, tol;
+    TreeObject *tree;
+    e2t_cheb_proxy *proxy = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!idddi:e2t_chebproxy", &TreeType, &tree,
+                          &param, &a, &b, &tol, &relative))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 proxy = e2t_chebproxy(tree -> tree, param, a, b, tol,
+                                       relative);
+                 no_memory = e2t_memerror();
+             });
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    return new_proxy(proxy);
+}
+
+static PyObject *py_chebeval(PyObject *module, PyObject *args)
+{
+    int freed = 0;
+    double x, value = 0.0;
+    ChebProxyObject *proxy;
+
+    if (!PyArg_ParseTuple(args, "O!d:e2t_chebeval", &ChebProxyType, &proxy,
+                          &x))
+        return NULL;
+    /* Proxies are not global state - only the handle needs the lock: */
+    E2T_CALL(if (!(freed = proxy -> proxy == NULL))
+                 value = e2t_chebeval(proxy -> proxy, x));
+    if (freed_error(freed)) return NULL;
+    return PyFloat_FromDouble(value);
+}
+
+static PyObject *py_chebeval_n(PyObject *module, PyObject *args)
+{
+    int n, freed = 0;
+    double *x, *values;
+    PyObject *x_obj, *values_obj;
+    ChebProxyObject *proxy;
+    Py_buffer x_view, values_view;
+
+    if (!PyArg_ParseTuple(args, "O!iOO:e2t_chebeval_n", &ChebProxyType,
+                          &proxy, &n, &x_obj, &values_obj))
+        return NULL;
+    if ((x = get_doubles(x_obj, &x_view, 0, n, "x")) == NULL) return NULL;
+    if ((values = get_doubles(values_obj, &values_view, 1, n,
+                              "values")) == NULL) {
+        PyBuffer_Release(&x_view);
+        return NULL;
+    }
+    E2T_CALL(if (!(freed = proxy -> proxy == NULL))
+                 e2t_chebeval_n(proxy -> proxy, n, x, values));
+    PyBuffer_Release(&x_view);
+    PyBuffer_Release(&values_view);
+    if (freed_error(freed)) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *proxy_operation(PyObject *args, const char *format,
+                                 e2t_cheb_proxy *(*operation)
+                                     (const e2t_cheb_proxy *))
+{
+    int freed = 0, no_memory = 0;
+    ChebProxyObject *proxy;
+    e2t_cheb_proxy *result = NULL;
+
+    if (!PyArg_ParseTuple(args, format, &ChebProxyType, &proxy)) return NULL;
+    E2T_CALL(if (!(freed = proxy -> proxy == NULL)) {
+                 result = operation(proxy -> proxy);
+                 no_memory = e2t_memerror();
+             });
+    if (freed_error(freed) || memory_error(no_memory)) return NULL;
+    return new_proxy(result);
+}
+
+static PyObject *py_chebderiv(PyObject *module, PyObject *args)
+{
+    return proxy_operation(args, "O!:e2t_chebderiv", e2t_chebderiv);
+}
+
+static PyObject *py_chebinteg(PyObject *module, PyObject *args)
+{
+    return proxy_operation(args, "O!:e2t_chebinteg", e2t_chebinteg);
+}
+
+static PyObject *py_freechebproxy(PyObject *module, PyObject *args)
+{
+    PyObject *obj;
+    ChebProxyObject *proxy;
+
+    if (!PyArg_ParseTuple(args, "O:e2t_freechebproxy", &obj)) return NULL;
+    if (obj == Py_None) Py_RETURN_NONE;
+    if (!PyObject_TypeCheck(obj, &ChebProxyType)) {
+        PyErr_SetString(PyExc_TypeError, "a ChebProxy or None expected");
+        return NULL;
+    }
+    proxy = (ChebProxyObject *) obj;
+    E2T_CALL(e2t_freechebproxy(proxy -> proxy); proxy -> proxy = NULL);
+    Py_RETURN_NONE;
+}
+
+/*****************************************************************************
+*   Polynomials.                                                             *
+*****************************************************************************/
+static PyObject *py_tree2poly(PyObject *module, PyObject *args)
+{
+    int param, degree = -1, freed = 0;
+    double *coefs;
+    PyObject *coefs_obj;
+    TreeObject *tree;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "O!iO:e2t_tree2poly", &TreeType, &tree,
+                          &param, &coefs_obj))
+        return NULL;
+    if ((coefs = get_doubles(coefs_obj, &view, 1, E2T_POLY_MAX_DEGREE + 1,
+                             "coefs")) == NULL)
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 degree = e2t_tree2poly(tree -> tree, param, coefs));
+    PyBuffer_Release(&view);
+    if (freed_error(freed)) return NULL;
+    return PyLong_FromLong(degree);
+}
+
+static PyObject *py_polyeval(PyObject *module, PyObject *args)
+{
+    int degree;
+    double x, value, *coefs;
+    PyObject *coefs_obj;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "Oid:e2t_polyeval", &coefs_obj, &degree, &x))
+        return NULL;
+    if (degree < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative degree");
+        return NULL;
+    }
+    if ((coefs = get_doubles(coefs_obj, &view, 0, degree + 1,
+                             "coefs")) == NULL)
+        return NULL;
+    value = e2t_polyeval(coefs, degree, x, NULL);        /* No global state */
+    PyBuffer_Release(&view);
+    return PyFloat_FromDouble(value);
+}
+
+static PyObject *py_poly2bernstein(PyObject *module, PyObject *args)
+{
+    int degree;
+    double a, b, *coefs, *bernstein;
+    PyObject *coefs_obj, *bernstein_obj;
+    Py_buffer coefs_view, bernstein_view;
+
+    if (!PyArg_ParseTuple(args, "OiddO:e2t_poly2bernstein", &coefs_obj,
+                          &degree, &a, &b, &bernstein_obj))
+        return NULL;
+    if (degree < 0 || degree > E2T_POLY_MAX_DEGREE) {
+        PyErr_SetString(PyExc_ValueError, "degree out of range");
+        return NULL;
+    }
+    if ((coefs = get_doubles(coefs_obj, &coefs_view, 0, degree + 1,
+                             "coefs")) == NULL)
+        return NULL;
+    if ((bernstein = get_doubles(bernstein_obj, &bernstein_view, 1,
+                                 degree + 1, "bernstein")) == NULL) {
+        PyBuffer_Release(&coefs_view);
+        return NULL;
+    }
+    e2t_poly2bernstein(coefs, degree, a, b, bernstein);  /* No global state */
+    PyBuffer_Release(&coefs_view);
+    PyBuffer_Release(&bernstein_view);
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_polyhorner(PyObject *module, PyObject *args)
+{
+    int param, freed = 0;
+    TreeObject *tree;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!i:e2t_polyhorner", &TreeType, &tree,
+                          &param))
+        return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 result = e2t_polyhorner(tree -> tree, param));
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+/*****************************************************************************
+*   Runtime counters - stats is a writable buffer of an e2t_stats (as the    *
+* ctypes structure _infix_tree._E2tStats).                                   *
+*****************************************************************************/
+static PyObject *py_getstats(PyObject *module, PyObject *args)
+{
+    e2t_stats stats;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "w*:e2t_getstats", &view)) return NULL;
+    if (view.len != sizeof(e2t_stats)) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_ValueError, "stats must be of %zd bytes",
+                     (Py_ssize_t) sizeof(e2t_stats));
+        return NULL;
+    }
+    E2T_CALL(e2t_getstats(&stats));
+    memcpy(view.buf, &stats, sizeof(e2t_stats));
+    PyBuffer_Release(&view);
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_resetstats(PyObject *module, PyObject *args)
+{
+    E2T_CALL(e2t_resetstats());
+    Py_RETURN_NONE;
+}
+
+/*****************************************************************************
+*   Operations between trees - copying their operands, or taking them (the   *
+* _move variants, which leave the operand handles empty).                    *
+*****************************************************************************/
+typedef e2t_expr_node *(*binary_operation)(const e2t_expr_node *,
+                                           const e2t_expr_node *);
+typedef e2t_expr_node *(*binary_move_operation)(e2t_expr_node *,
+                                                e2t_expr_node *);
+typedef e2t_expr_node *(*unary_operation)(const e2t_expr_node *);
+typedef e2t_expr_node *(*unary_move_operation)(e2t_expr_node *);
+
+static PyObject *binary(PyObject *args, binary_operation operation)
+{
+    int freed = 0;
+    TreeObject *left, *right;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!O!", &TreeType, &left, &TreeType, &right))
+        return NULL;
+    E2T_CALL(if (!(freed = left -> tree == NULL || right -> tree == NULL))
+                 result = operation(left -> tree, right -> tree));
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+static PyObject *binary_move(PyObject *args, binary_move_operation operation)
+{
+    int freed = 0;
+    TreeObject *left, *right;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!O!", &TreeType, &left, &TreeType, &right))
+        return NULL;
+    if (left == right) {
+        PyErr_SetString(PyExc_ValueError, "can not move a tree twice");
+        return NULL;
+    }
+    if (left -> shared || right -> shared) {
+        PyErr_SetString(PyExc_ValueError, "can not move a shared tree");
+        return NULL;
+    }
+    E2T_CALL(if (!(freed = left -> tree == NULL || right -> tree == NULL)) {
+                 result = operation(left -> tree, right -> tree);
+                 left -> tree = right -> tree = NULL;
+             });
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+static PyObject *unary(PyObject *args, unary_operation operation)
+{
+    int freed = 0;
+    TreeObject *tree;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!", &TreeType, &tree)) return NULL;
+    E2T_CALL(if (!(freed = tree -> tree == NULL))
+                 result = operation(tree -> tree));
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+static PyObject *unary_move(PyObject *args, unary_move_operation operation)
+{
+    int freed = 0;
+    TreeObject *tree;
+    e2t_expr_node *result = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!", &TreeType, &tree)) return NULL;
+    if (tree -> shared) {
+        PyErr_SetString(PyExc_ValueError, "can not move a shared tree");
+        return NULL;
+    }
+    E2T_CALL(if (!(freed = tree -> tree == NULL)) {
+                 result = operation(tree -> tree);
+                 tree -> tree = NULL;
+             });
+    if (freed_error(freed)) return NULL;
+    return new_tree(result);
+}
+
+#define BINARY(name) \
+    static PyObject *py_##name(PyObject *module, PyObject *args) \
+    { return binary(args, e2t_##name); } \
+    static PyObject *py_##name##_move(PyObject *module, PyObject *args) \
+    { return binary_move(args, e2t_##name##_move); }
+
+#define UNARY(name) \
+    static PyObject *py_##name(PyObject *module, PyObject *args) \
+    { return unary(args, e2t_##name); } \
+    static PyObject *py_##name##_move(PyObject *module, PyObject *args) \
+    { return unary_move(args, e2t_##name##_move); }
+
+BINARY(trees_op_division)
+BINARY(trees_op_subtraction)
+BINARY(trees_op_multiplication)
+BINARY(trees_op_addition)
+BINARY(trees_op_power)
+UNARY(tree_op_sqr)
+UNARY(tree_op_sqrt)
+UNARY(tree_op_unarminus)
+
+#define METHOD(name) { "e2t_" #name, py_##name, METH_VARARGS, NULL }
+#define OPERATION(name) METHOD(name), METHOD(name##_move)
+
+static PyMethodDef methods[] = {
+    METHOD(expr2tree), METHOD(parserror), METHOD(printtree),
+    METHOD(copytree), METHOD(freetree), METHOD(evaltree),
+    METHOD(evaltree_batch), METHOD(derivtree), METHOD(deriverror),
+    METHOD(memerror),
+    METHOD(cmptree), METHOD(paramintree), METHOD(setparamvalue),
+    METHOD(treereparameter), METHOD(specialize),
+    METHOD(evalgrad), METHOD(evalhessvec), METHOD(evalgrad_batch),
+    METHOD(chebproxy), METHOD(chebeval), METHOD(chebeval_n),
+    METHOD(chebderiv), METHOD(chebinteg), METHOD(freechebproxy),
+    METHOD(tree2poly), METHOD(polyeval), METHOD(poly2bernstein),
+    METHOD(polyhorner), METHOD(getstats), METHOD(resetstats),
+    METHOD(cachetree), METHOD(cachederivtree), METHOD(cachepolyhorner),
+    METHOD(releasetree), METHOD(setcachesize),
+    OPERATION(trees_op_division), OPERATION(trees_op_subtraction),
+    OPERATION(trees_op_multiplication), OPERATION(trees_op_addition),
+    OPERATION(trees_op_power), OPERATION(tree_op_sqr),
+    OPERATION(tree_op_sqrt), OPERATION(tree_op_unarminus),
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "_expr2tree",
+    .m_doc = "Native binding of expr2tree, see infix_tree.md",
+    .m_size = -1,
+    .m_methods = methods,
+};
+
+PyMODINIT_FUNC PyInit__expr2tree(void)
+{
+    PyObject *module;
+
+    if (PyType_Ready(&TreeType) < 0 || PyType_Ready(&ChebProxyType) < 0)
+        return NULL;
+    if (glbl_lock == NULL && (glbl_lock = PyThread_allocate_lock()) == NULL)
+        return PyErr_NoMemory();
+    if ((module = PyModule_Create(&module_def)) == NULL) return NULL;
+
+    Py_INCREF(&TreeType);
+    Py_INCREF(&ChebProxyType);
+    if (PyModule_AddObject(module, "Tree", (PyObject *) &TreeType) < 0 ||
+        PyModule_AddObject(module, "ChebProxy",
+                           (PyObject *) &ChebProxyType) < 0) {
+        Py_DECREF(&TreeType);
+        Py_DECREF(&ChebProxyType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
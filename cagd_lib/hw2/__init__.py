@@ -1 +1,6 @@
-from ._wx_app import MainApp
+def __getattr__(name):
+    # the app imports wx and OpenGL, edit_replay runs without them
+    if name == "MainApp":
+        from ._wx_app import MainApp
+        return MainApp
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
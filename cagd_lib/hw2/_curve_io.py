@@ -3,7 +3,9 @@ import pathlib
 from dataclasses import dataclass
 from typing import NamedTuple, Sequence, MutableSequence
 
-import wx
+import numpy as np
+
+from cagd_lib.curve_lib import CurveKinds, CurveScene, load_dat, load_scene, save_scene, SCENE_SUFFIX
 
 
 @dataclass
@@ -19,80 +21,55 @@ class BSpline:
     control_points: MutableSequence[tuple[float, float, float]]
 
 
-def _parse_control_point_line(line: str) -> tuple[float, float, float]:
-    split_line = line.split()
-    if len(split_line) == 2:
-        x, y, w = (*split_line, 1.0)
-    elif len(split_line) == 3:
-        x, y, w = split_line
-    else:
-        raise ValueError(line)
-
-    w = float(w)
-    return float(x) / w, float(y) / w, w
+def scene_from_curves(curves: Sequence[BezierCurve | BSpline]) -> CurveScene:
+    kind = [CurveKinds.BSPLINE if isinstance(curve, BSpline) else CurveKinds.BEZIER for curve in curves]
+    knots = [curve.knots if isinstance(curve, BSpline) else [] for curve in curves]
+    knots_offset = np.cumsum([0, *map(len, knots)])
+    points_offset = np.cumsum([0, *(len(curve.control_points) for curve in curves)])
+
+    control_points = np.array([point for curve in curves for point in curve.control_points],
+                              dtype=np.float64).reshape((-1, 3))
+    w = control_points[:, 2]
+    return CurveScene.from_arrays(
+        kind=kind,
+        order=[curve.order for curve in curves],
+        knots_offset=knots_offset,
+        points_offset=points_offset,
+        knots=list(itertools.chain.from_iterable(knots)),
+        wx=control_points[:, 0] * w,
+        wy=control_points[:, 1] * w,
+        w=w,
+    )
+
+
+def curves_from_scene(scene: CurveScene) -> list[BezierCurve | BSpline]:
+    xs, ys, ws = (scene.wx / scene.w).tolist(), (scene.wy / scene.w).tolist(), scene.w.tolist()
+    knots = scene.knots.tolist()
+    knots_offset, points_offset = scene.knots_offset.tolist(), scene.points_offset.tolist()
+
+    curves = []
+    for i, (kind, order) in enumerate(zip(scene.kind.tolist(), scene.order.tolist())):
+        points = slice(points_offset[i], points_offset[i + 1])
+        control_points = list(zip(xs[points], ys[points], ws[points]))
+        if kind == CurveKinds.BSPLINE:
+            curves.append(BSpline(
+                order=order, knots=knots[knots_offset[i]:knots_offset[i + 1]], control_points=control_points))
+        else:
+            curves.append(BezierCurve(order=order, control_points=control_points))
+    return curves
 
 
 def import_curves(path: pathlib.Path) -> Sequence[BezierCurve | BSpline]:
-    with open(path.resolve(), "r") as f:
-        lines = []
-        for line in f.readlines():
-            split_line = line.split()
-            if len(split_line) == 0:
-                continue
-            if split_line[0].startswith("#"):
-                continue
-            lines.append(line.replace("\n", ""))
-
-        curves = []
-        lines_iterator = iter(lines)
-
-        try:
-            line = next(lines_iterator)
-        except StopIteration:
-            return curves
-
-        while True:
-            split_line = line.split()
-            assert len(split_line) == 1
-            order = int(split_line[0])
-
-            line = next(lines_iterator)
-            split_line = line.split()
-            if split_line[0].startswith("knots"):  # BSPLINE CURVE
-                curve = BSpline(order=order, knots=[], control_points=[])
-                n_knots = int(line[line.find("[") + 1: line.find("]")])
-                curve.knots.extend([float(knot_str) for knot_str in line[line.find("=") + 1:].split()])
-                while len(curve.knots) < n_knots:
-                    line = next(lines_iterator)
-                    curve.knots.extend([float(knot_str) for knot_str in line.split()])
-                assert len(curve.knots) == n_knots
-
-                line = next(lines_iterator)
-                split_line = line.split()
-                while len(split_line) > 1:
-                    curve.control_points.append(_parse_control_point_line(line))
-                    try:
-                        line = next(lines_iterator)
-                    except StopIteration:
-                        curves.append(curve)
-                        return curves
-                    split_line = line.split()
-                curves.append(curve)
-            else:  # BEZIER CURVE
-                curve = BezierCurve(order=order, control_points=[_parse_control_point_line(line)])
-                for _ in range(1, order):
-                    line = next(lines_iterator)
-                    curve.control_points.append(_parse_control_point_line(line))
-
-                curves.append(curve)
-
-                try:
-                    line = next(lines_iterator)
-                except StopIteration:
-                    return curves
+    if path.suffix == SCENE_SUFFIX:
+        return curves_from_scene(load_scene(path))
+    return curves_from_scene(load_dat(path))
 
 
 def export_curves(path: pathlib.Path, curves: Sequence[BezierCurve | BSpline]):
+    if path.suffix == SCENE_SUFFIX:
+        save_scene(path, scene_from_curves(curves))
+        return
+
     with open(path.resolve(), "w") as f:
         for curve in curves:
             f.write(f"{curve.order}\n")
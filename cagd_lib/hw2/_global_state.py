@@ -0,0 +1,542 @@
+import bisect
+import itertools
+from dataclasses import dataclass
+from enum import Enum, auto
+
+import numpy as np
+
+from cagd_lib.curve_lib import flatten_scene, closest_point, evaluate_derivatives, PickIndex, JobQueue
+from cagd_lib.hw2._b_spline import evaluate_b_spline
+from cagd_lib.hw2._bezier_curve import evaluate_bezier
+from cagd_lib.hw2._curve_io import scene_from_curves, BezierCurve, BSpline
+
+DEFAULT_ZOOM = 0.005
+FLATTEN_TOLERANCE = 0.25
+"""maximal distance, in pixels, of a curve from its drawn polyline"""
+CACHED_DETAIL_LEVELS = 6
+"""flattenings kept per curve, of the levels of detail (zoom octaves) it was last drawn at"""
+EPSILON = 1e-6
+"""speed and absolute curvature below which the tangent and the normal and osculating circle are undefined"""
+
+
+def detail_level(pixel_size: float) -> int:
+    """
+    :return: the level of detail of a zoom, its octave: curves are flattened to FLATTEN_TOLERANCE * 2^level world
+        units, within FLATTEN_TOLERANCE pixels at any zoom of the octave.
+    """
+    return int(np.floor(np.log2(pixel_size)))
+
+
+class Tools(Enum):
+    SELECT = auto()
+    MOVE = auto()
+    ADD_DELETE = auto()
+    CONNECT_CURVES = auto()
+
+
+class CurveTypes(Enum):
+    BEZIER = auto()
+    BSPLINE = auto()
+
+
+class EndConditions(Enum):
+    FLOATING = auto()
+    OPEN = auto()
+
+
+@dataclass
+class DifferentialGeometryProperties:
+    """the Frenet frame and osculating circle at the selected point, None where undefined (see EPSILON)"""
+    tangent: np.ndarray | None
+    normal: np.ndarray | None
+    osculating_radius: np.float32 | None
+
+
+class GlobalState:
+
+    @staticmethod
+    def set_point_weight_text(text):
+        pass
+
+    @staticmethod
+    def enable_weight_text_control():
+        pass
+
+    @staticmethod
+    def disable_weight_text_control():
+        pass
+
+    @staticmethod
+    def enable_new_b_spline_controls():
+        pass
+
+    @staticmethod
+    def disable_new_b_spline_controls():
+        pass
+
+    def __init__(self):
+        self.curves: list[BezierCurve | BSpline] = []
+        self.curves_samples: list = []
+        self.curves_parameters: list = []
+        """curve parameter of every sample"""
+        self.curves_scenes: list = []
+        """single curve native scene of every curve, None until needed (see curve_scene)"""
+        self.curves_details: list[dict] = []
+        """(samples, parameters) of every curve by level of detail, the cached flattenings of it"""
+        self._pixel_size = DEFAULT_ZOOM
+        self.detail_level = detail_level(self._pixel_size)
+        """the level of detail curves_samples are flattened at, see pixel_size"""
+        self.pick_index = PickIndex()
+        """curves samples and control points, kept in sync with curves"""
+        self.resample_jobs = JobQueue()
+        """edited curves flattening, off the UI thread, by curve id (see resample_curve)"""
+        self.switch_tools = None  # def switch_tools(new_tool: Tools)
+        self.selected_curve = None
+        self._selected_point = None
+        self._selected_parameter = None
+        self.selected_sample_point = None
+        """the curve point at selected_parameter"""
+        self._new_curve_type = CurveTypes.BEZIER
+        self.new_curve_order = 3
+        self.new_curve_end_condition = EndConditions.FLOATING
+        self._differential_geometry_properties: DifferentialGeometryProperties | None = None
+        self.trace: list[dict] | None = None
+        """the editing operations, appended as they are done if not None, for edit_replay"""
+
+    @property
+    def pixel_size(self):
+        """
+        world units per pixel: curves are drawn at the level of detail of the zoom, from the cache or else flattened
+        again in the background (the coarser one is drawn meanwhile)
+        """
+        return self._pixel_size
+
+    @pixel_size.setter
+    def pixel_size(self, pixel_size):
+        self.record("pixel_size", pixel_size=pixel_size)
+        self._pixel_size = pixel_size
+        level = detail_level(pixel_size)
+        if level == self.detail_level:
+            return
+        self.detail_level = level
+        for index, curve in enumerate(self.curves):
+            if level in self.curves_details[index]:
+                self.resample_jobs.cancel(id(curve))
+                self._show_samples(index, *self.curves_details[index][level])
+            else:
+                self._submit_resample(curve)
+
+    @property
+    def selected_parameter(self):
+        return self._selected_parameter
+
+    @selected_parameter.setter
+    def selected_parameter(self, selected_parameter):
+        self._selected_parameter = selected_parameter
+        if None in[
+            selected_parameter,
+            self.selected_curve,
+        ]:
+            return
+        points, dc, ddc, curvature = evaluate_derivatives(
+            self.curve_scene(self.selected_curve), 0, [selected_parameter])
+
+        self.selected_sample_point = np.array([*points[0], 0], dtype=np.float32)
+        tangent = normal = osculating_radius = None
+        speed = np.linalg.norm(dc[0])
+        if speed >= EPSILON:
+            # T = dC / ||dC||
+            tangent = np.array([*dc[0], 0]) / speed
+            # kappa = (dC x ddC) / ||dC||^3, NaN or infinite if the speed vanishes
+            if abs(curvature[0]) >= EPSILON:
+                # N = B x T, B = +-z by the curvature sign (dC x ddC direction)
+                normal = np.sign(curvature[0]) * np.array([-tangent[1], tangent[0], 0])
+                osculating_radius = np.float32(1 / abs(curvature[0]))
+
+        self._differential_geometry_properties = DifferentialGeometryProperties(
+            tangent=None if tangent is None else tangent.astype(np.float32),
+            normal=None if normal is None else normal.astype(np.float32),
+            osculating_radius=osculating_radius,
+        )
+
+    @property
+    def differential_geometry_properties(self) -> DifferentialGeometryProperties:
+        return self._differential_geometry_properties
+
+    @property
+    def selected_point(self):
+        return self._selected_point
+
+    @selected_point.setter
+    def selected_point(self, selected_point):
+        self._selected_point = selected_point
+        if selected_point is not None:
+            self.set_point_weight_text(
+                f"{self.curves[self.selected_curve].control_points[selected_point][2]}")
+        else:
+            self.set_point_weight_text("")
+
+        if selected_point is None:
+            self.disable_weight_text_control()
+        else:
+            self.enable_weight_text_control()
+
+    @property
+    def new_curve_type(self):
+        return self._new_curve_type
+
+    @new_curve_type.setter
+    def new_curve_type(self, new_curve_type: CurveTypes):
+        if new_curve_type == CurveTypes.BSPLINE:
+            self.enable_new_b_spline_controls()
+        else:
+            self.disable_new_b_spline_controls()
+        self._new_curve_type = new_curve_type
+
+    def add_curve(self, curve):
+        self.add_curves([curve])
+
+    def add_curves(self, curves):
+        curves = list(curves)
+        for curve in curves:
+            if not isinstance(curve, (BezierCurve, BSpline)):
+                raise ValueError(curve)
+        curves_samples, curves_parameters = self.sample_curves(curves)
+        for curve, curve_samples in zip(curves, curves_samples):
+            self.pick_index.insert_curve(len(self.curves), curve_samples, curve.control_points)
+            self.curves.append(curve)
+        self.curves_samples.extend(curves_samples)
+        self.curves_parameters.extend(curves_parameters)
+        self.curves_scenes.extend(None for _ in curves)
+        self.curves_details.extend({self.detail_level: curve_samples}
+                                   for curve_samples in zip(curves_samples, curves_parameters))
+
+    def delete_curve(self, index):
+        self.resample_jobs.cancel(id(self.curves[index]))
+        if self.selected_curve is not None:
+            if self.selected_curve == index:
+                self.selected_curve = None
+            elif self.selected_curve > index:
+                self.selected_curve -= 1
+        self.curves.pop(index)
+        self.curves_samples.pop(index)
+        self.curves_parameters.pop(index)
+        self.curves_scenes.pop(index)
+        self.curves_details.pop(index)
+        self.pick_index.delete_curve(index)
+        GlobalState.selected_point = None
+
+    @staticmethod
+    def evaluate_bezier_curve(curve: BezierCurve, t: np.ndarray):
+        """
+
+        :param curve:
+        :param t: shape (-1, 1)
+        :return:
+        """
+        curves_samples_2d = evaluate_bezier(np.array(curve.control_points), t)
+        """samples in x and y"""
+
+        curves_samples_3d = np.empty(shape=(curves_samples_2d.shape[0], 3), dtype=np.float32)
+        """samples in x and y with z set to z=0"""
+
+        curves_samples_3d[:, 2] = 0
+        curves_samples_3d[:, :2] = curves_samples_2d
+        return curves_samples_3d
+
+    @staticmethod
+    def evaluate_b_spline_curve(curve: BSpline, t: np.ndarray):
+        """
+
+        :param curve:
+        :param t: shape (-1, 1)
+        :return:
+        """
+
+        curves_samples_2d = evaluate_b_spline(
+            np.array(curve.control_points), curve.knots, curve.order, t)
+        """samples in x and y"""
+
+        curves_samples_3d = np.empty(shape=(curves_samples_2d.shape[0], 3), dtype=np.float32)
+        """samples in x and y with z set to z=0"""
+
+        curves_samples_3d[:, 2] = 0
+        curves_samples_3d[:, :2] = curves_samples_2d
+        return curves_samples_3d
+
+    @staticmethod
+    def evaluate_curve(curve: BSpline | BezierCurve, t: np.ndarray):
+        if isinstance(curve, BSpline):
+            return GlobalState.evaluate_b_spline_curve(curve, t)
+        elif isinstance(curve, BezierCurve):
+            return GlobalState.evaluate_bezier_curve(curve, t)
+        else:
+            raise TypeError(curve)
+
+    @staticmethod
+    def sample_curves(curves: list[BezierCurve | BSpline]) -> tuple[list[np.ndarray], list[np.ndarray]]:
+        """
+        Flatten all the curves at the level of detail (to FLATTEN_TOLERANCE pixels) with one (parallel) native call.
+
+        :return: per curve samples, (N x 3) views on one float32 buffer with z=0, and per curve samples parameters.
+            Empty for curves that can not be evaluated yet.
+        """
+        return GlobalState.split_samples(*flatten_scene(
+            scene_from_curves(curves), FLATTEN_TOLERANCE * 2.0 ** GlobalState.detail_level))
+
+    @staticmethod
+    def split_samples(samples_offset, samples, parameters) -> tuple[list[np.ndarray], list[np.ndarray]]:
+        """
+        :return: flatten_scene buffers as per curve samples and samples parameters, see sample_curves.
+        """
+        samples = samples.transpose()
+        curves_slices = [slice(start, end) for start, end in itertools.pairwise(samples_offset)]
+        return [samples[s] for s in curves_slices], [parameters[s] for s in curves_slices]
+
+    @staticmethod
+    def resample_curve(curve):
+        """
+        Flatten the edited curve again, off the UI thread: the drawn samples are replaced by publish_resamples once
+        the newest flattening of the curve finishes, older ones are cancelled. The native scene of the curve and its
+        control points for picking are updated right away.
+        """
+        if not isinstance(curve, (BezierCurve, BSpline)):
+            raise TypeError(curve)
+        index = GlobalState.curve_index(curve)
+        GlobalState.curves_scenes[index] = None
+        GlobalState.curves_details[index] = {}
+        GlobalState.pick_index.set_curve(index, GlobalState.curves_samples[index], curve.control_points)
+        GlobalState._submit_resample(curve)
+
+    def _submit_resample(self, curve):
+        """
+        Flatten the curve at the level of detail in the background, cancelling its unfinished flattening.
+        """
+        # the scene is a copy, the curve may be edited again while it is flattened
+        scene, level = scene_from_curves([curve]), self.detail_level
+        self.resample_jobs.submit(
+            id(curve),
+            lambda: (curve, level, self.split_samples(*flatten_scene(scene, FLATTEN_TOLERANCE * 2.0 ** level))))
+
+    def publish_resamples(self):
+        """
+        Replace the samples of the curves whose resampling finished, all at once - on the UI thread, before drawing.
+        Flattenings of another level of detail than the current (the zoom changed meanwhile) are only cached. The
+        exception of a failed flattening is raised after the others are published.
+        """
+        resamples, failures = self.resample_jobs.take_results()
+        for curve, level, ((new_samples,), (new_parameters,)) in resamples.values():
+            index = self.curve_index(curve)
+            if index is None:
+                continue  # deleted meanwhile
+            details = self.curves_details[index]
+            details[level] = new_samples, new_parameters
+            while len(details) > CACHED_DETAIL_LEVELS:
+                del details[max(details, key=lambda other: abs(other - self.detail_level))]
+            if level == self.detail_level:
+                self._show_samples(index, new_samples, new_parameters)
+        for error in failures.values():
+            raise error
+
+    def _show_samples(self, index, samples, parameters):
+        self.curves_samples[index] = samples
+        self.curves_parameters[index] = parameters
+        self.pick_index.set_curve(index, samples, self.curves[index].control_points)
+
+    def wait_resamples(self):
+        """
+        Wait for all the resampling jobs and publish them, for the samples to match the curves.
+        """
+        self.resample_jobs.wait()
+        self.publish_resamples()
+
+    def curve_index(self, curve) -> int | None:
+        """
+        :return: the index of that very curve object in curves (equal curves are told apart), None if not there.
+        """
+        return next((i for i, other in enumerate(self.curves) if other is curve), None)
+
+    def curve_scene(self, index):
+        """
+        native scene of curves[index] alone, cached until the curve is resampled
+        """
+        if self.curves_scenes[index] is None:
+            self.curves_scenes[index] = scene_from_curves([self.curves[index]])
+        return self.curves_scenes[index]
+
+    def closest_point(self, index, x, y, max_distance=np.inf):
+        """
+        :return: (parameter, distance, (x, y)) of the point of curves[index] closest to (x, y), or None if farther
+            than max_distance
+        """
+        return closest_point(self.curve_scene(index), 0, x, y, max_distance)
+
+    def differentiate_curve(self, index, t: float):
+        """
+        :return: the first derivative of curves[index] at t, with z=0
+        """
+        _, dc, _, _ = evaluate_derivatives(self.curve_scene(index), 0, [t])
+        return np.array([*dc[0], 0])
+
+    def record(self, op: str, **arguments):
+        """
+        Append the editing operation op (a GlobalState method or property, see edit_replay) to the trace, if recording.
+        """
+        if self.trace is not None:
+            self.trace.append({"op": op, **arguments})
+
+    def select_curve(self, index):
+        self.record("select_curve", index=index)
+        self.selected_curve = index
+
+    def select_point(self, index):
+        self.record("select_point", index=index)
+        self.selected_point = index
+
+    def select_sample(self, x, y, radius):
+        """
+        Select the parameter of the selected curve point closest to (x, y), None if farther than radius.
+        """
+        self.record("select_sample", x=float(x), y=float(y), radius=float(radius))
+        closest = self.closest_point(self.selected_curve, x, y, radius)
+        self.selected_parameter = None if closest is None else closest[0]
+
+    def move_point(self, position):
+        """
+        Move the selected control point to position (x, y), keeping its weight.
+        """
+        if self.selected_point is None:
+            return
+        self.record("move_point", position=[float(position[0]), float(position[1])])
+        selected_curve = self.curves[self.selected_curve]
+        weight = selected_curve.control_points[self.selected_point][2]
+        selected_curve.control_points[self.selected_point] = (float(position[0]), float(position[1]), weight)
+        self.resample_curve(selected_curve)
+
+    def set_point_weight(self, weight):
+        self.record("set_point_weight", weight=float(weight))
+        selected_curve = self.curves[self.selected_curve]
+        selected_curve.control_points[self.selected_point] = \
+            *selected_curve.control_points[self.selected_point][:2], float(weight)
+        self.resample_curve(selected_curve)
+
+    def create_curve(self):
+        """
+        Add an empty curve of the new curve type, order and end condition, and select it.
+        """
+        self.record("create_curve", curve_type=self.new_curve_type.name, order=self.new_curve_order,
+                    end_condition=self.new_curve_end_condition.name)
+        if self.new_curve_type == CurveTypes.BEZIER:
+            new_curve = BezierCurve(order=0, control_points=[])
+        else:
+            new_curve = BSpline(order=self.new_curve_order, knots=[], control_points=[])
+            if self.new_curve_end_condition == EndConditions.OPEN:
+                new_curve.knots.extend(0.0 for _ in range(self.new_curve_order))
+                new_curve.knots.extend(1.0 for _ in range(self.new_curve_order))
+            else:
+                new_curve.knots.append(0.0)
+                new_curve.knots.append(1.0)
+        self.add_curve(new_curve)
+        self.selected_curve = len(self.curves) - 1
+        return new_curve
+
+    def add_point(self, position):
+        """
+        Append a control point of weight 1 at position (x, y) to the selected curve, raising a Bezier curve order.
+        """
+        self.record("add_point", position=[float(position[0]), float(position[1])])
+        selected_curve = self.curves[self.selected_curve]
+        selected_curve.control_points.append((float(position[0]), float(position[1]), float(1.0)))
+        if isinstance(selected_curve, BezierCurve):
+            selected_curve.order += 1
+        self.resample_curve(selected_curve)
+
+    def delete_point(self, index):
+        """
+        Delete a control point of the selected curve, and the curve with its last point.
+        """
+        self.record("delete_point", index=index)
+        if self.selected_point is not None:
+            if self.selected_point == index:
+                self.selected_point = None
+            elif self.selected_point > index:
+                self.selected_point -= 1
+        selected_curve = self.curves[self.selected_curve]
+        selected_curve.control_points.pop(index)
+        if len(selected_curve.control_points) == 0:
+            self.delete_curve(self.selected_curve)
+        else:
+            if isinstance(selected_curve, BezierCurve):
+                selected_curve.order -= 1
+            self.resample_curve(selected_curve)
+
+    def insert_knot(self, knot):
+        """
+        Insert knot, in order, to the knot vector of the selected B-spline.
+        """
+        self.record("insert_knot", knot=float(knot))
+        selected_curve = self.curves[self.selected_curve]
+        bisect.insort(selected_curve.knots, float(knot))
+        self.resample_curve(selected_curve)
+
+    def delete_knot(self, index):
+        self.record("delete_knot", index=index)
+        selected_curve = self.curves[self.selected_curve]
+        selected_curve.knots.pop(index)
+        self.resample_curve(selected_curve)
+
+    def connect_curves(self, curve_0_index: int, curve_1_index: int):
+        self.record("connect_curves", curve_0_index=curve_0_index, curve_1_index=curve_1_index)
+        self.wait_resamples()
+        curve_0, curve_1 = self.curves[curve_0_index], self.curves[curve_1_index]
+
+        curve_0_last_t = self.curves_parameters[curve_0_index][-1]
+        curve_1_first_t = self.curves_parameters[curve_1_index][0]
+
+        curve_0_end, curve_1_start = \
+            self.curves_samples[curve_0_index][-1][:2], self.curves_samples[curve_1_index][0][:2]
+        curve_0_tangent = self.differentiate_curve(curve_0_index, curve_0_last_t)
+        curve_1_tangent = self.differentiate_curve(curve_1_index, curve_1_first_t)
+
+        # G1 continuity
+        difference_vector = curve_1_start - curve_0_end
+        original_control_points = np.array(curve_1.control_points)
+
+        cos_theta = (
+            np.dot(curve_0_tangent, curve_1_tangent)
+            /
+            (np.linalg.norm(curve_0_tangent) * np.linalg.norm(curve_1_tangent))
+        )
+        theta = np.arccos(
+            np.clip(cos_theta, -1, 1)
+        )
+        tangents_cross = np.cross(curve_0_tangent, curve_1_tangent)
+        # theta = - np.arcsin(
+        #     np.linalg.norm(tangents_cross)
+        #     /
+        #     (np.linalg.norm(curve_0_tangent) * np.linalg.norm(curve_1_tangent))
+        # )
+        if tangents_cross[2] > 0:
+            theta = -theta
+
+        rotation_matrix = np.array([
+            [np.cos(theta), -np.sin(theta)],
+            [np.sin(theta), np.cos(theta)],
+        ], dtype=np.float32)
+        # print("original points")
+        # print(original_control_points[:, :2])
+        # print(rotation_matrix)
+        # print(curve_1_start)
+        # print(difference_vector)
+        new_control_points = \
+            (rotation_matrix @ (original_control_points[:,
+                                :2] - curve_1_start).transpose()).transpose() + curve_1_start - difference_vector
+        for i, _ in enumerate(curve_1.control_points):
+            curve_1.control_points[i] = (*tuple(new_control_points[i]), original_control_points[i][2])
+        self.resample_curve(curve_1)
+
+        if curve_0.order == curve_1.order:
+            print("curves of same order. join to single bspline")
+
+
+GlobalState = GlobalState()
@@ -0,0 +1,253 @@
+"""
+Replay of editing sessions on GlobalState without wx or OpenGL, timing every editing operation.
+
+A trace is a JSON lines file, an operation per line as GlobalState records them (see GlobalState.trace): the name of a
+GlobalState method or property and its arguments, e.g. ``{"op": "move_point", "position": [0.5, 1.0]}``. Traces are
+recorded by running the editor with ``python hw2.py --record trace.jsonl``, on the curves loaded first, or generated
+by generate_trace for any curves file.
+
+Every operation is timed twice: until it returns, which is the latency of the UI thread, and until its curves are
+flattened again and published (GlobalState.wait_resamples), which is the latency until it is drawn. Samples evaluated
+are the flattened curve samples, and allocations are the memory blocks of the Python allocator left allocated by the
+operation (numpy buffers included, curve_lib native memory excluded).
+"""
+import argparse
+import contextlib
+import io
+import json
+import pathlib
+import random
+import sys
+import threading
+import time
+import tracemalloc
+from dataclasses import dataclass, field
+from typing import Iterable, Iterator
+
+import numpy as np
+
+from cagd_lib.hw2 import _global_state
+from cagd_lib.hw2._curve_io import import_curves, BSpline
+from cagd_lib.hw2._global_state import GlobalState, CurveTypes, EndConditions
+
+PERCENTILES = (50, 95, 99)
+
+DRAG_STEPS = 20
+"""move_point operations of a generated point drag"""
+
+
+@dataclass
+class OperationStats:
+    ui_seconds: list[float] = field(default_factory=list)
+    settled_seconds: list[float] = field(default_factory=list)
+    samples: int = 0
+    allocated_blocks: int = 0
+    peak_bytes: list[int] = field(default_factory=list)
+
+
+class SampleCounter:
+    """
+    Counts the samples of the flatten_scene calls of GlobalState, on any thread, while installed.
+    """
+
+    def __init__(self):
+        self.samples = 0
+        self._lock = threading.Lock()
+        self._flatten_scene = None
+
+    def __enter__(self):
+        self._flatten_scene = _global_state.flatten_scene
+
+        def flatten_scene(*args, **kwargs):
+            samples_offset, samples, parameters = self._flatten_scene(*args, **kwargs)
+            with self._lock:
+                self.samples += int(samples_offset[-1])
+            return samples_offset, samples, parameters
+
+        _global_state.flatten_scene = flatten_scene
+        return self
+
+    def __exit__(self, *exc_info):
+        _global_state.flatten_scene = self._flatten_scene
+
+    def take(self) -> int:
+        with self._lock:
+            samples, self.samples = self.samples, 0
+        return samples
+
+
+def load_trace(path: pathlib.Path) -> list[dict]:
+    with open(path) as file:
+        trace = [json.loads(line) for line in file if line.strip()]
+    for line, operation in enumerate(trace, start=1):
+        if not isinstance(operation, dict) or "op" not in operation:
+            raise ValueError(f"{path}:{line}: not an operation: {operation}")
+    return trace
+
+
+def save_trace(path: pathlib.Path, trace: Iterable[dict]):
+    with open(path, "w") as file:
+        for operation in trace:
+            file.write(json.dumps(operation) + "\n")
+
+
+def apply_operation(operation: dict):
+    """
+    Do the recorded operation on GlobalState, through the same method the editor called.
+    """
+    operation = dict(operation)
+    op = operation.pop("op")
+    if op == "pixel_size":
+        GlobalState.pixel_size = operation["pixel_size"]
+    elif op == "create_curve":
+        GlobalState.new_curve_type = CurveTypes[operation["curve_type"]]
+        GlobalState.new_curve_order = operation["order"]
+        GlobalState.new_curve_end_condition = EndConditions[operation["end_condition"]]
+        GlobalState.create_curve()
+    elif op in ("select_curve", "select_point", "select_sample", "move_point", "set_point_weight", "add_point",
+                "delete_point", "insert_knot", "delete_knot", "connect_curves"):
+        getattr(GlobalState, op)(**operation)
+    else:
+        raise ValueError(f"unknown operation: {op}")
+
+
+def generate_trace(n_edits: int, seed: int = 0) -> Iterator[dict]:
+    """
+    Generate an editing session on the curves of GlobalState as it is replayed (the operations depend on the state):
+    every edit selects a curve and a control point, drags it, changes its weight, adds and deletes a point, inserts
+    and deletes a knot of B-splines, selects a curve point and sometimes zooms or connects the curve to another.
+    """
+    rng = random.Random(seed)
+    for edit in range(n_edits):
+        curves = [i for i, samples in enumerate(GlobalState.curves_samples)
+                  if len(samples) > 0 and GlobalState.curves[i].control_points]
+        if not curves:
+            return
+        curve_index = rng.choice(curves)
+        curve = GlobalState.curves[curve_index]
+        points = np.array(curve.control_points)[:, :2]
+        extent = max(float(np.ptp(points, axis=0).max()), GlobalState.pixel_size)
+
+        yield {"op": "select_curve", "index": curve_index}
+        point_index = rng.randrange(len(curve.control_points))
+        yield {"op": "select_point", "index": point_index}
+
+        position = np.array(curve.control_points[point_index][:2])
+        for _ in range(DRAG_STEPS):
+            position = position + [rng.gauss(0, extent / 100) for _ in range(2)]
+            yield {"op": "move_point", "position": position.tolist()}
+        yield {"op": "set_point_weight", "weight": rng.uniform(0.5, 2.0)}
+
+        new_position = points[-1] + [rng.gauss(0, extent / 10) for _ in range(2)]
+        yield {"op": "add_point", "position": new_position.tolist()}
+        yield {"op": "delete_point", "index": len(curve.control_points) - 1}
+
+        if isinstance(curve, BSpline) and len(curve.knots) >= 2:
+            knot = rng.uniform(curve.knots[0], curve.knots[-1])
+            yield {"op": "insert_knot", "knot": knot}
+            yield {"op": "delete_knot", "index": curve.knots.index(knot)}
+
+        samples = GlobalState.curves_samples[curve_index]
+        if len(samples) > 0:
+            x, y, _ = samples[rng.randrange(len(samples))]
+            yield {"op": "select_sample", "x": float(x), "y": float(y), "radius": 5 * GlobalState.pixel_size}
+
+        if edit % 4 == 3:
+            zoom = GlobalState.pixel_size * 1.3 ** rng.choice((-3, -2, 2, 3))
+            yield {"op": "pixel_size", "pixel_size": zoom}
+        others = [i for i in curves if i != curve_index]
+        if edit % 5 == 4 and others:
+            yield {"op": "connect_curves", "curve_0_index": curve_index, "curve_1_index": rng.choice(others)}
+
+        yield {"op": "select_point", "index": None}
+        yield {"op": "select_curve", "index": None}
+
+
+def replay(trace: Iterable[dict], trace_allocations: bool = False) -> tuple[dict[str, OperationStats], list[dict]]:
+    """
+    Replay the trace on GlobalState, waiting for every operation to be drawn before the next.
+
+    :param trace_allocations: also measure the peak memory of every operation with tracemalloc (slows it down).
+    :return: the statistics by operation name, and the operations replayed.
+    """
+    stats: dict[str, OperationStats] = {}
+    replayed = []
+    if trace_allocations:
+        tracemalloc.start()
+    with SampleCounter() as counter, contextlib.redirect_stdout(io.StringIO()):
+        try:
+            for operation in trace:
+                replayed.append(operation)
+                counter.take()
+                if trace_allocations:
+                    tracemalloc.reset_peak()
+                    traced_before, _ = tracemalloc.get_traced_memory()
+                blocks_before = sys.getallocatedblocks()
+
+                start = time.perf_counter()
+                apply_operation(operation)
+                returned = time.perf_counter()
+                GlobalState.wait_resamples()
+                settled = time.perf_counter()
+
+                operation_stats = stats.setdefault(operation["op"], OperationStats())
+                operation_stats.ui_seconds.append(returned - start)
+                operation_stats.settled_seconds.append(settled - start)
+                operation_stats.allocated_blocks += sys.getallocatedblocks() - blocks_before
+                operation_stats.samples += counter.take()
+                if trace_allocations:
+                    operation_stats.peak_bytes.append(tracemalloc.get_traced_memory()[1] - traced_before)
+        finally:
+            if trace_allocations:
+                tracemalloc.stop()
+    return stats, replayed
+
+
+def format_report(stats: dict[str, OperationStats]) -> str:
+    def milliseconds(seconds):
+        return "/".join(f"{p:.2f}" for p in np.percentile(np.array(seconds) * 1e3, PERCENTILES))
+
+    percentiles = "/".join(f"p{p}" for p in PERCENTILES)
+    header = f"{'operation':<18}{'count':>7}  {'ui ' + percentiles + ' ms':>24}  " \
+             f"{'settled ' + percentiles + ' ms':>29}  {'samples/op':>11}  {'net blocks/op':>14}"
+    traced = any(operation_stats.peak_bytes for operation_stats in stats.values())
+    if traced:
+        header += f"  {'peak KiB p50/p99':>17}"
+    lines = [header]
+    for op, operation_stats in sorted(stats.items()):
+        count = len(operation_stats.ui_seconds)
+        line = f"{op:<18}{count:>7}  {milliseconds(operation_stats.ui_seconds):>24}  " \
+               f"{milliseconds(operation_stats.settled_seconds):>29}  {operation_stats.samples / count:>11.1f}  " \
+               f"{operation_stats.allocated_blocks / count:>14.1f}"
+        if traced:
+            peak = np.percentile(np.array(operation_stats.peak_bytes) / 1024, (50, 99))
+            line += f"  {peak[0]:>8.1f}/{peak[1]:<8.1f}"
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("curves", type=pathlib.Path, help="curves file to edit, e.g. Bsplines/allen.dat")
+    parser.add_argument("--trace", type=pathlib.Path, help="trace to replay (default: a generated one)")
+    parser.add_argument("--edits", type=int, default=50, help="edits of the generated trace")
+    parser.add_argument("--seed", type=int, default=0, help="seed of the generated trace")
+    parser.add_argument("--save-trace", type=pathlib.Path, help="save the replayed trace")
+    parser.add_argument("--trace-allocations", action="store_true",
+                        help="also report the peak memory of operations (tracemalloc)")
+    arguments = parser.parse_args(argv)
+
+    start = time.perf_counter()
+    GlobalState.add_curves(import_curves(arguments.curves))
+    print(f"{arguments.curves}: {len(GlobalState.curves)} curves, "
+          f"{sum(map(len, GlobalState.curves_samples))} samples, loaded in {time.perf_counter() - start:.3f} s")
+
+    trace = load_trace(arguments.trace) if arguments.trace else generate_trace(arguments.edits, arguments.seed)
+    stats, replayed = replay(trace, arguments.trace_allocations)
+    print(format_report(stats))
+    if arguments.save_trace:
+        save_trace(arguments.save_trace, replayed)
+
+
+if __name__ == "__main__":
+    main()
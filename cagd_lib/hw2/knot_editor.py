@@ -1,4 +1,3 @@
-import bisect
 import math
 from typing import List
 
@@ -18,7 +17,8 @@ class KnotEditor:
         self.maxKnot = None
         self.knotVector = None
         self.selectionRadius = 5
-        self.editHandler = None
+        self.insertHandler = None  # def insertHandler(knot: float)
+        self.deleteHandler = None  # def deleteHandler(index: int)
 
     def MouseLeftEvent(self, event):
         if not self.InRange(event):
@@ -31,8 +31,7 @@ class KnotEditor:
         mousePosition = event.GetPosition()[0]
         knot = ((mousePosition - self.padding) / (self.screenWidth - 2 * self.padding)) * (self.maxKnot - self.minKnot) + self.minKnot
 
-        bisect.insort(self.knotVector, knot)
-        self.editHandler()
+        self.insertHandler(knot)
 
         event.Skip()
 
@@ -51,8 +50,7 @@ class KnotEditor:
             if i == 0 or i == len(points) - 1:
                 continue
             if point - self.selectionRadius < mousePosition < point + self.selectionRadius:
-                self.knotVector.pop(i)
-                self.editHandler()
+                self.deleteHandler(i)
                 event.Skip()
                 return
 
@@ -2,6 +2,8 @@ import numpy as np
 from OpenGL.GLU import *
 from OpenGL.GL import *
 
+from cagd_lib.hw2._global_state import DEFAULT_ZOOM
+
 
 clamp = lambda x, m, M: max(m, min(x, M))
 MOUSE_INVERT = np.array((1, -1))
@@ -12,7 +14,7 @@ class MouseLook:
         self.position = np.array((0, 0), dtype=np.float32)
         self.prevMousePosition = None
         self.dragging = False
-        self.zoom = 0.005
+        self.zoom = DEFAULT_ZOOM
         self.zoomSensitivity = 1.3
         self.zoomRange = [0.000001, 10]
         self.screenHeight = 680
@@ -1,8 +1,19 @@
+import pathlib
+import sys
+
 from cagd_lib.hw2 import MainApp
 
 
 if __name__ == '__main__':
-    MainApp().MainLoop()
+    # python hw2.py --record trace.jsonl: save the editing session, for cagd_lib.hw2.edit_replay
+    if len(sys.argv) == 3 and sys.argv[1] == '--record':
+        from cagd_lib.hw2._global_state import GlobalState
+        from cagd_lib.hw2.edit_replay import save_trace
+        GlobalState.trace = []
+        MainApp().MainLoop()
+        save_trace(pathlib.Path(sys.argv[2]), GlobalState.trace)
+    else:
+        MainApp().MainLoop()
 
 # TODO: mustafa edition
 #   1. add weights support in evaluation [DONE]